@@ -33,7 +33,8 @@ ProjectGenerator [input files] [options]
 
 read a project file and execute simulation
 
-hrpsys-simulator [project file] [options]
+hrpsys-simulator [project file] [options]<br>
+hrpsys-simulator -batch [list file] [options]
 
 -nodisplay execute simulation without display<br>
 -realtime execute simulation in real-time<br>
@@ -44,7 +45,16 @@ hrpsys-simulator [project file] [options]
 -no-default-lights turn off default lights<br>
 -max-edge-length length[m] divide large triangles which have longer edges than this value<br>
 -max-log-length length[s] set length of ring buffer<br>
--exit-on-finish exit this program when the simulation finishes
+-exit-on-finish exit this program when the simulation finishes<br>
+-collision-threads num check collision pairs with num threads<br>
+-broad-phase skip collision pairs whose bounding boxes do not overlap<br>
+-collision-scaling num print time of collision detection with 1, 2, 4 and 8 threads, measured num times each in the final state<br>
+-summary file write sim/real ratio, time of each stage and final states of bodies to file as JSON<br>
+-batch file run each line of file, a project file followed by its options, headless in worker processes and write all results to the summary file (summary.json by default)<br>
+-jobs num run num worker processes in the batch mode (by default, the number of processors)<br>
+-batch-naming register components of each run of the batch mode to NameServer
+
+In the batch mode, outputs of the i-th run are written to [summary file].i.log. Components of each run are not registered to NameServer unless -batch-naming is given, so that runs of the same project do not interfere. A worker runs lines one after another and shares ORB, the RTC manager, modules of components and models among them, so that only the first run of a worker pays this startup. Options of a line override those on the command line, except options for the RTC manager such as -o, which can only be given on the command line. When a worker dies, its run fails and a new worker takes over the remaining lines. Numbers which are not finite are written as null in the summary.
 
 Note:NameServer and openhrp-model-loader must be running
 
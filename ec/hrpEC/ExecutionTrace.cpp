@@ -0,0 +1,69 @@
+#include "ExecutionTrace.h"
+#include <fstream>
+#include <stdint.h>
+
+bool ExecutionTrace::saveChromeTrace(const char *i_fname,
+                                     const std::vector<std::string>& i_names,
+                                     double i_period) const
+{
+    std::ofstream ofs(i_fname);
+    if (!ofs.is_open()) return false;
+    unsigned int n = size(), ncomps = components();
+    if (!n) {
+        ofs << "{\"traceEvents\":[]}" << std::endl;
+        return ofs.good();
+    }
+    // time stamps are relative to the first row and written in [us]
+    long long origin = at(0)[0];
+    ofs.setf(std::ios::fixed, std::ios::floatfield);
+    ofs.precision(3);
+    ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << std::endl;
+    ofs << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"period\"}}," << std::endl;
+    ofs << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"components\"}}";
+    for (unsigned int i=0; i<n; i++){
+        const long long *r = at(i);
+        double start = (r[0] - origin)/1e3;
+        double end = (r[ncomps+1] - origin)/1e3;
+        ofs << "," << std::endl
+            << "{\"name\":\"tick\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":"
+            << start << ",\"dur\":" << end - start << "}";
+        for (unsigned int j=0; j<ncomps; j++){
+            double b = (r[j+1] - origin)/1e3, e = (r[j+2] - origin)/1e3;
+            ofs << "," << std::endl
+                << "{\"name\":\""
+                << (j < i_names.size() ? i_names[j] : std::string("unknown"))
+                << "\",\"ph\":\"X\",\"pid\":0,\"tid\":1,\"ts\":" << b
+                << ",\"dur\":" << e - b << "}";
+        }
+        if ((r[ncomps+1] - r[0])/1e9 > i_period){
+            ofs << "," << std::endl
+                << "{\"name\":\"timeover\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":"
+                << end << "}";
+        }
+    }
+    ofs << std::endl << "]}" << std::endl;
+    return ofs.good();
+}
+
+bool ExecutionTrace::saveBinary(const char *i_fname,
+                                const std::vector<std::string>& i_names) const
+{
+    std::ofstream ofs(i_fname, std::ios::out|std::ios::binary);
+    if (!ofs.is_open()) return false;
+    uint32_t ncomps = components(), n = size();
+    ofs.write("HRPECTRC", 8);
+    ofs.write((const char *)&ncomps, sizeof(ncomps));
+    ofs.write((const char *)&n, sizeof(n));
+    for (unsigned int j=0; j<ncomps; j++){
+        std::string name = j < i_names.size() ? i_names[j] : std::string("unknown");
+        ofs.write(name.c_str(), name.size()+1);
+    }
+    for (unsigned int i=0; i<n; i++){
+        const long long *r = at(i);
+        for (unsigned int j=0; j<ncomps+2; j++){
+            int64_t v = r[j];
+            ofs.write((const char *)&v, sizeof(v));
+        }
+    }
+    return ofs.good();
+}
@@ -0,0 +1,88 @@
+// -*- C++ -*-
+#ifndef ExecutionTrace_h
+#define ExecutionTrace_h
+
+#include <vector>
+#include <string>
+
+/**
+   \brief ring buffer of time stamps[ns] recorded by hrpExecutionContext.
+
+   Each row corresponds to a tick and consists of the time when the period
+   starts, the time when the first component starts and the times when
+   each component finishes. Rows are allocated by resize() so that row()
+   and commit() can be called from the RT thread without allocation.
+ */
+class ExecutionTrace
+{
+public:
+    ExecutionTrace() : m_length(0), m_width(0), m_count(0) {}
+    /**
+       \brief allocate rows and discard recorded ones
+       \param i_length the number of ticks to be kept
+       \param i_ncomps the number of components
+     */
+    void resize(unsigned int i_length, unsigned int i_ncomps){
+        m_length = i_length;
+        m_width = i_ncomps + 2;
+        m_buf.assign((size_t)m_length*m_width, 0);
+        m_count = 0;
+    }
+    /**
+       \brief get a row to be filled for the current tick
+       \param i_ncomps the number of components
+       \return row, NULL if rows are not allocated for i_ncomps components
+     */
+    long long *row(unsigned int i_ncomps){
+        if (!m_length || i_ncomps + 2 != m_width) return NULL;
+        return &m_buf[(m_count % m_length)*m_width];
+    }
+    /**
+       \brief finish filling the row obtained by row()
+     */
+    void commit() { m_count++; }
+    /**
+       \brief the number of recorded rows
+     */
+    unsigned int size() const {
+        return m_count < m_length ? m_count : m_length;
+    }
+    /**
+       \brief get a recorded row
+       \param i index of the row, 0 for the oldest one
+     */
+    const long long *at(unsigned int i) const {
+        unsigned long start = m_count > m_length ? m_count - m_length : 0;
+        return &m_buf[((start + i) % m_length)*m_width];
+    }
+    /**
+       \brief the number of components
+     */
+    unsigned int components() const { return m_width > 2 ? m_width - 2 : 0; }
+    /**
+       \brief save recorded rows in Chrome trace event format (JSON)
+       \param i_fname file name
+       \param i_names names of components
+       \param i_period expected period[s], used to mark timeovers
+       \return true if saved successfully
+     */
+    bool saveChromeTrace(const char *i_fname,
+                         const std::vector<std::string>& i_names,
+                         double i_period) const;
+    /**
+       \brief save recorded rows in a binary format. The file consists of
+       "HRPECTRC", uint32 the number of components, uint32 the number of
+       rows, null-terminated names of components and rows of int64.
+       \param i_fname file name
+       \param i_names names of components
+       \return true if saved successfully
+     */
+    bool saveBinary(const char *i_fname,
+                    const std::vector<std::string>& i_names) const;
+private:
+    std::vector<long long> m_buf;
+    unsigned int m_length, m_width;
+    unsigned long m_count;
+};
+
+#endif // ExecutionTrace_h
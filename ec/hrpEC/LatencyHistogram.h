@@ -0,0 +1,87 @@
+// -*- C++ -*-
+#ifndef LatencyHistogram_h
+#define LatencyHistogram_h
+
+#include <cmath>
+#include <cstring>
+
+#define LATENCY_HISTOGRAM_MIN 1e-6             // [s]
+#define LATENCY_HISTOGRAM_DECADES 5            // 1[us] - 100[ms]
+#define LATENCY_HISTOGRAM_BUCKETS_PER_DECADE 10
+// buckets between min and max and two buckets for values out of the range
+#define LATENCY_HISTOGRAM_SIZE (LATENCY_HISTOGRAM_DECADES*LATENCY_HISTOGRAM_BUCKETS_PER_DECADE+2)
+
+/**
+   \brief log-scale histogram of latencies with fixed buckets.
+
+   add() is called from the RT thread and doesn't allocate. Other threads
+   must not call reset() directly but requestReset() so that the histogram
+   is reset by the next add().
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() { reset(); }
+    void reset(){
+        memset(m_counts, 0, sizeof(m_counts));
+        m_count = 0;
+        m_resetRequested = false;
+    }
+    void requestReset(){
+        m_resetRequested = true;
+    }
+    /**
+       \brief add a sample
+       \param dt latency[s]
+     */
+    void add(double dt){
+        if (m_resetRequested) reset();
+        m_counts[bucket(dt)]++;
+        m_count++;
+    }
+    unsigned long count() const { return m_count; }
+    unsigned long count(int i) const { return m_counts[i]; }
+    /**
+       \brief get index of a bucket. bucket 0 is for values less than
+       LATENCY_HISTOGRAM_MIN and the last bucket is for values larger than
+       upperEdge(LATENCY_HISTOGRAM_SIZE-2)
+       \param dt latency[s]
+     */
+    static int bucket(double dt){
+        if (!(dt >= LATENCY_HISTOGRAM_MIN)) return 0;
+        int i = (int)(log10(dt/LATENCY_HISTOGRAM_MIN)*LATENCY_HISTOGRAM_BUCKETS_PER_DECADE) + 1;
+        return i < LATENCY_HISTOGRAM_SIZE-1 ? i : LATENCY_HISTOGRAM_SIZE-1;
+    }
+    /**
+       \brief get upper edge of a bucket
+       \param i index of the bucket
+       \return upper edge[s]
+     */
+    static double upperEdge(int i){
+        if (i >= LATENCY_HISTOGRAM_SIZE-1) i = LATENCY_HISTOGRAM_SIZE-2;
+        return LATENCY_HISTOGRAM_MIN*pow(10.0, (double)i/LATENCY_HISTOGRAM_BUCKETS_PER_DECADE);
+    }
+    /**
+       \brief get percentile. The upper edge of the bucket which contains
+       the percentile is returned, so the value is an upper bound.
+       \param p ratio(0-1)
+       \return percentile[s], 0 if there is no sample
+     */
+    double percentile(double p) const {
+        if (m_count == 0) return 0;
+        unsigned long target = (unsigned long)ceil(p*m_count);
+        if (target == 0) target = 1;
+        unsigned long sum = 0;
+        for (int i=0; i<LATENCY_HISTOGRAM_SIZE; i++){
+            sum += m_counts[i];
+            if (sum >= target) return upperEdge(i);
+        }
+        return upperEdge(LATENCY_HISTOGRAM_SIZE-1);
+    }
+private:
+    unsigned long m_counts[LATENCY_HISTOGRAM_SIZE];
+    unsigned long m_count;
+    volatile bool m_resetRequested;
+};
+
+#endif // LatencyHistogram_h
@@ -9,8 +9,13 @@ namespace RTC
 {
     hrpExecutionContext::hrpExecutionContext()
         : PeriodicExecutionContext(), 
-          m_priority(ART_PRIO_MAX-1)
+          m_traceEnabled(false), m_traceActive(false), m_period_sec(0),
+          m_priority(ART_PRIO_MAX-1), m_stageWorkers(-1), m_stagePlan(NULL), m_planValid(false), m_pendingPlan(NULL),
+          m_retiredPlan(NULL), m_planRequested(true), m_stageBuilderRunning(false),
+          m_timeoverSeq(0), m_timeoverTime(0), m_timeoverProcess(0), m_timeoverPlan(NULL)
     {
+        pthread_mutex_init(&m_namesMutex, NULL);
+        pthread_mutex_init(&m_stageMutex, NULL);
         resetProfile();
         rtclog.setName("hrpEC");
         coil::Properties& prop(Manager::instance().getConfig());
@@ -19,6 +24,8 @@ namespace RTC
         getProperty(prop, "exec_cxt.periodic.priority", m_priority);
         getProperty(prop, "exec_cxt.periodic.art.priority", m_priority);
         RTC_DEBUG(("Priority: %d", m_priority));
+
+        getStageProperties(prop);
     }
 
     bool hrpExecutionContext::waitForNextPeriod()
@@ -1,5 +1,8 @@
 #include "hrpEC.h"
 #include "io/iob.h"
+#include <time.h>
+#include <coil/Time.h>
+#include <coil/stringutil.h>
 #ifdef OPENRTM_VERSION_TRUNK
 #include <rtm/RTObjectStateMachine.h>
 #endif
@@ -8,10 +11,27 @@
 using std::fprintf;
 #endif
 
+// monotonic time[ns]
+static inline long long get_nsec()
+{
+#ifdef __APPLE__
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec*1000000000LL + tv.tv_usec*1000LL;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+#endif
+}
+
 namespace RTC
 {
     hrpExecutionContext::~hrpExecutionContext()
     {
+        stopStageBuilder();
+        pthread_mutex_destroy(&m_namesMutex);
+        pthread_mutex_destroy(&m_stageMutex);
     }
     int hrpExecutionContext::svc(void)
     {
@@ -33,62 +53,89 @@ namespace RTC
         long period_nsec = period_sec*1e9;
 #endif
 	    int nsubstep = number_of_substeps();
+        m_period_sec = period_sec*nsubstep;
         set_signal_period(period_nsec/nsubstep);
         std::cout << "period = " << get_signal_period()*nsubstep/1e6
                   << "[ms], priority = " << m_priority << std::endl;
 
+        // plans are built and timeovers are reported outside of the periodic loop
+        startStageBuilder();
         if (!enterRT()){
+            stopStageBuilder();
             unlock_iob();
             close_iob();
             return 0;
         }
         do{
             if (!waitForNextPeriod()){
+                m_traceActive = false;
+                stopStageBuilder();
                 unlock_iob();
                 close_iob();
                 return 0;
             }
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
+            long long tv = get_nsec();
+            m_traceActive = m_traceEnabled;
+            __sync_synchronize();
             if (m_profile.count > 0){
-#define DELTA_SEC(start, end) end.tv_sec - start.tv_sec + (end.tv_usec - start.tv_usec)/1e6;
-                double dt = DELTA_SEC(m_tv, tv);
+                double dt = (tv - m_tv)/1e9;
                 if (dt > m_profile.max_period) m_profile.max_period = dt;
                 if (dt < m_profile.min_period) m_profile.min_period = dt;
                 m_profile.avg_period = (m_profile.avg_period*m_profile.count + dt)/(m_profile.count+1);
+                m_periodHistogram.add(fabs(dt - period_sec*nsubstep));
             }
             m_profile.count++;
             m_tv = tv;
 
 #ifndef OPENRTM_VERSION_TRUNK
             invoke_worker iw;
-            struct timeval tbegin, tend;
-	        std::vector<double> processes(m_comps.size());
-            gettimeofday(&tbegin, NULL);
-            for (unsigned int i=0; i< m_comps.size(); i++){
-                iw(m_comps[i]);
-                gettimeofday(&tend, NULL);
-                double dt = DELTA_SEC(tbegin, tend);
-                processes[i] = dt;
-                tbegin = tend;
+            long long tbegin, tend;
+            // reallocated only when the number of components changes
+            if (m_processes.size() != m_comps.size()) m_processes.resize(m_comps.size());
+            std::vector<double>& processes = m_processes;
+            long long *trace = NULL;
+            if (updateStagePlan()){
+                // components in a stage run in parallel and are not traced
+                executeStages();
+            }else{
+                trace = m_traceActive ? m_trace.row(processes.size()) : NULL;
+                tbegin = get_nsec();
+                if (trace) { trace[0] = tv; trace[1] = tbegin; }
+                for (unsigned int i=0; i< m_comps.size(); i++){
+                    iw(m_comps[i]);
+                    tend = get_nsec();
+                    processes[i] = (tend - tbegin)/1e9;
+                    if (trace) trace[i+2] = tend;
+                    tbegin = tend;
+                }
             }
 #else
-            struct timeval tbegin, tend;
+            long long tbegin, tend;
             const RTCList& list = getComponentList();
-            std::vector<double> processes(list.length());
-            gettimeofday(&tbegin, NULL);
-            for (unsigned int i=0; i< list.length(); i++){
-                RTC_impl::RTObjectStateMachine* rtobj = m_worker.findComponent(list[i]);
-                rtobj->workerDo(); 
-                gettimeofday(&tend, NULL);
-                double dt = DELTA_SEC(tbegin, tend);
-                processes[i] = dt;
-                tbegin = tend;
+            if (m_processes.size() != list.length()) m_processes.resize(list.length());
+            std::vector<double>& processes = m_processes;
+            long long *trace = NULL;
+            if (updateStagePlan()){
+                // components in a stage run in parallel and are not traced
+                executeStages();
+            }else{
+                trace = m_traceActive ? m_trace.row(processes.size()) : NULL;
+                tbegin = get_nsec();
+                if (trace) { trace[0] = tv; trace[1] = tbegin; }
+                for (unsigned int i=0; i< list.length(); i++){
+                    RTC_impl::RTObjectStateMachine* rtobj = m_worker.findComponent(list[i]);
+                    rtobj->workerDo(); 
+                    tend = get_nsec();
+                    processes[i] = (tend - tbegin)/1e9;
+                    if (trace) trace[i+2] = tend;
+                    tbegin = tend;
+                }
             }
 #endif
+            if (trace) m_trace.commit();
 
-            gettimeofday(&tv, NULL);
-            double dt = DELTA_SEC(m_tv, tv);
+            tv = get_nsec();
+            double dt = (tv - m_tv)/1e9;
             if (dt > m_profile.max_process) m_profile.max_process = dt;
 	    if (m_profile.profiles.length() != processes.size()){
 	        m_profile.profiles.length(processes.size());
@@ -97,6 +144,7 @@ namespace RTC
 		    m_profile.profiles[i].avg_process = 0;
 		    m_profile.profiles[i].max_process = 0;
 		}
+                m_histograms.assign(processes.size(), LatencyHistogram());
 	    }
 	    for (unsigned int i=0; i<m_profile.profiles.length(); i++){
 #ifndef OPENRTM_VERSION_TRUNK
@@ -110,26 +158,15 @@ namespace RTC
                 double dt = processes[i];
                 if (lcs == ACTIVE_STATE){
                     prof.avg_process = (prof.avg_process*prof.count + dt)/(++prof.count);
+                    m_histograms[i].add(dt);
                 }
 	        if (prof.max_process < dt) prof.max_process = dt;
 	    }
             if (dt > period_sec*nsubstep){
   	        m_profile.timeover++; 
 #ifdef NDEBUG
-                fprintf(stderr, "[%d.%6.6d] Timeover: processing time = %4.2f[ms]\n",
-                        tv.tv_sec, tv.tv_usec, dt*1e3);
-                // Update rtc_names only when rtcs length change.
-                if (processes.size() != rtc_names.size()){
-                    rtc_names.clear();
-                    for (unsigned int i=0; i< processes.size(); i++){
-                        RTC::RTObject_var rtc = RTC::RTObject::_narrow(m_comps[i]._ref);
-                        rtc_names.push_back(std::string(rtc->get_component_profile()->instance_name));
-                    }
-                }
-                for (unsigned int i=0; i< processes.size(); i++){
-                    fprintf(stderr, "%s(%4.2f), ", rtc_names[i].c_str(),processes[i]*1e3);
-                }
-                fprintf(stderr, "\n");
+                // timeovers can be examined from the trace without disturbing this thread
+                if (!m_traceActive) recordTimeover(tv, dt);
 #endif
             }
 
@@ -138,6 +175,8 @@ namespace RTC
 #else
         } while (isRunning());
 #endif
+        m_traceActive = false;
+        stopStageBuilder();
         exitRT();
         unlock_iob();
         close_iob();
@@ -153,7 +192,7 @@ namespace RTC
         return ret;
     }
 
-    OpenHRP::ExecutionProfileService::ComponentProfile hrpExecutionContext::getComponentProfile(RTC::LightweightRTObject_ptr obj)
+    int hrpExecutionContext::findComponent(RTC::LightweightRTObject_ptr obj)
     {
 #ifndef OPENRTM_VERSION_TRUNK
         for (size_t i=0; i<m_comps.size(); i++){
@@ -164,12 +203,21 @@ namespace RTC
             RTC_impl::RTObjectStateMachine* rtobj = m_worker.findComponent(list[i]);
             if(rtobj->isEquivalent(obj)){
 #endif
-                return m_profile.profiles[i];
+                return i;
             }
         }
         throw OpenHRP::ExecutionProfileService::ExecutionProfileServiceException("no such component");
     }
 
+    OpenHRP::ExecutionProfileService::ComponentProfile hrpExecutionContext::getComponentProfile(RTC::LightweightRTObject_ptr obj)
+    {
+        int i = findComponent(obj);
+        if (i >= (int)m_profile.profiles.length()){
+            throw OpenHRP::ExecutionProfileService::ExecutionProfileServiceException("not executed yet");
+        }
+        return m_profile.profiles[i];
+    }
+
     void hrpExecutionContext::resetProfile()
     {
         m_profile.max_period = m_profile.avg_period = 0;
@@ -181,5 +229,388 @@ namespace RTC
 	    m_profile.profiles[i].max_process = 0;
         }
         m_profile.count = m_profile.timeover = 0;
+        // histograms are reset in svc()
+        for (unsigned int i=0; i<m_histograms.size(); i++){
+            m_histograms[i].requestReset();
+        }
+        m_periodHistogram.requestReset();
+        pthread_mutex_lock(&m_stageMutex);
+        if (m_stagePlan){
+            OpenHRP::ExecutionProfileService::StageProfileList &profiles = m_stagePlan->profiles;
+            for (unsigned int i=0; i<profiles.length(); i++){
+                profiles[i].count = 0;
+                profiles[i].avg_process = 0;
+                profiles[i].max_process = 0;
+            }
+        }
+        pthread_mutex_unlock(&m_stageMutex);
+    }
+
+    OpenHRP::ExecutionProfileService::LatencyHistogram *hrpExecutionContext::convertHistogram(const LatencyHistogram& hist)
+    {
+        OpenHRP::ExecutionProfileService::LatencyHistogram *ret
+            = new OpenHRP::ExecutionProfileService::LatencyHistogram;
+        ret->min_latency = LATENCY_HISTOGRAM_MIN;
+        ret->buckets_per_decade = LATENCY_HISTOGRAM_BUCKETS_PER_DECADE;
+        ret->counts.length(LATENCY_HISTOGRAM_SIZE);
+        for (int i=0; i<LATENCY_HISTOGRAM_SIZE; i++){
+            ret->counts[i] = hist.count(i);
+        }
+        ret->count = hist.count();
+        ret->p50 = hist.percentile(0.5);
+        ret->p99 = hist.percentile(0.99);
+        ret->p999 = hist.percentile(0.999);
+        return ret;
+    }
+
+    OpenHRP::ExecutionProfileService::LatencyHistogram *hrpExecutionContext::getLatencyHistogram(RTC::LightweightRTObject_ptr obj)
+    {
+        int i = findComponent(obj);
+        if (i >= (int)m_histograms.size()){
+            throw OpenHRP::ExecutionProfileService::ExecutionProfileServiceException("not executed yet");
+        }
+        return convertHistogram(m_histograms[i]);
+    }
+
+    OpenHRP::ExecutionProfileService::LatencyHistogram *hrpExecutionContext::getPeriodHistogram()
+    {
+        return convertHistogram(m_periodHistogram);
+    }
+
+    void hrpExecutionContext::resetLatencyHistogram(RTC::LightweightRTObject_ptr obj)
+    {
+        int i = findComponent(obj);
+        if (i < (int)m_histograms.size()) m_histograms[i].requestReset();
+    }
+
+    CORBA::Boolean hrpExecutionContext::startTrace(CORBA::ULong length)
+    {
+        m_traceEnabled = false;
+        waitForTraceInactive();
+        if (m_traceActive) return false;
+        pthread_mutex_lock(&m_namesMutex);
+        getComponentNames(rtc_names);
+        m_trace.resize(length, rtc_names.size());
+        pthread_mutex_unlock(&m_namesMutex);
+        __sync_synchronize();
+        m_traceEnabled = length > 0;
+        return true;
+    }
+
+    void hrpExecutionContext::stopTrace()
+    {
+        m_traceEnabled = false;
+    }
+
+    CORBA::Boolean hrpExecutionContext::saveTrace(const char *filename, CORBA::Boolean binary)
+    {
+        // recording is paused while saving
+        bool enabled = m_traceEnabled;
+        m_traceEnabled = false;
+        waitForTraceInactive();
+        if (m_traceActive){
+            m_traceEnabled = enabled;
+            return false;
+        }
+        pthread_mutex_lock(&m_namesMutex);
+        bool ret = binary ? m_trace.saveBinary(filename, rtc_names)
+            : m_trace.saveChromeTrace(filename, rtc_names, m_period_sec);
+        pthread_mutex_unlock(&m_namesMutex);
+        m_traceEnabled = enabled;
+        return ret;
+    }
+
+    void hrpExecutionContext::waitForTraceInactive()
+    {
+        __sync_synchronize();
+        for (int i=0; m_traceActive && i<1000; i++){
+            coil::usleep(1000);
+        }
+    }
+
+    void hrpExecutionContext::getComponentNames(std::vector<std::string>& o_names)
+    {
+        o_names.clear();
+#ifndef OPENRTM_VERSION_TRUNK
+        for (unsigned int i=0; i< m_comps.size(); i++){
+            RTC::RTObject_var rtc = RTC::RTObject::_narrow(m_comps[i]._ref);
+#else
+        const RTCList& list = getComponentList();
+        for (unsigned int i=0; i< list.length(); i++){
+            RTC::RTObject_var rtc = RTC::RTObject::_narrow(list[i]);
+#endif
+            o_names.push_back(std::string(rtc->get_component_profile()->instance_name));
+        }
+    }
+
+    OpenHRP::ExecutionProfileService::StageProfileList *hrpExecutionContext::getStageProfiles()
+    {
+        OpenHRP::ExecutionProfileService::StageProfileList *ret
+            = new OpenHRP::ExecutionProfileService::StageProfileList;
+        // the length of profiles of a plan never changes
+        pthread_mutex_lock(&m_stageMutex);
+        if (m_stagePlan) *ret = m_stagePlan->profiles;
+        pthread_mutex_unlock(&m_stageMutex);
+        return ret;
+    }
+
+    void hrpExecutionContext::getStageProperties(coil::Properties& prop)
+    {
+        // e.g. "sh,seq;abc;st,co". stages are separated by ';' and
+        // instance names of components in a stage are separated by ','
+        if (prop.findNode("exec_cxt.periodic.stages") != 0){
+            m_stageSpec = prop["exec_cxt.periodic.stages"];
+            coil::eraseBothEndsBlank(m_stageSpec);
+        }
+        getProperty(prop, "exec_cxt.periodic.stage_workers", m_stageWorkers);
+        if (prop.findNode("exec_cxt.periodic.stage_cpus") != 0){
+            coil::vstring cpus = coil::split(prop["exec_cxt.periodic.stage_cpus"], ",", true);
+            for (unsigned int i=0; i<cpus.size(); i++){
+                int cpu;
+                if (coil::stringTo(cpu, cpus[i].c_str())) m_stageCpus.push_back(cpu);
+            }
+        }
+        RTC_DEBUG(("Stages: %s", m_stageSpec.c_str()));
+    }
+
+    void hrpExecutionContext::startStageBuilder()
+    {
+        m_stageBuilderRunning = true;
+        if (pthread_create(&m_stageBuilder, NULL, stageBuilderMain, this) != 0){
+            std::cerr << "[hrpEC] failed to create a thread to build stages" << std::endl;
+            m_stageBuilderRunning = false;
+        }
+    }
+
+    void hrpExecutionContext::stopStageBuilder()
+    {
+        if (m_stageBuilderRunning){
+            m_stageBuilderRunning = false;
+            pthread_join(m_stageBuilder, NULL);
+        }
+        pthread_mutex_lock(&m_stageMutex);
+        delete m_stagePlan;
+        m_stagePlan = NULL;
+        pthread_mutex_unlock(&m_stageMutex);
+        delete m_pendingPlan;
+        m_pendingPlan = NULL;
+        delete m_retiredPlan;
+        m_retiredPlan = NULL;
+    }
+
+    void *hrpExecutionContext::stageBuilderMain(void *arg)
+    {
+        hrpExecutionContext *ec = (hrpExecutionContext *)arg;
+        unsigned long reported = 0;
+        while (ec->m_stageBuilderRunning){
+            ec->reportTimeover(reported);
+            __sync_synchronize();
+            if (ec->m_retiredPlan){
+                delete ec->m_retiredPlan;
+                ec->m_retiredPlan = NULL;
+            }
+            // components may be attached, detached or replaced at any time
+            if (ec->m_planRequested && !ec->m_pendingPlan){
+                ec->m_planRequested = false;
+                __sync_synchronize();
+                StagePlan *plan = ec->buildStages();
+                __sync_synchronize();
+                ec->m_pendingPlan = plan;
+            }
+            coil::usleep(10000);
+        }
+        return NULL;
+    }
+
+    hrpExecutionContext::StagePlan *hrpExecutionContext::buildStages()
+    {
+        StagePlan *plan = new StagePlan;
+        std::vector<std::string> comp_names;
+#ifndef OPENRTM_VERSION_TRUNK
+        for (unsigned int i=0; i<m_comps.size(); i++){
+            plan->comps.push_back(m_comps[i]._ref.in());
+        }
+#else
+        const RTCList& list = getComponentList();
+        plan->rtobjs.resize(list.length());
+        for (unsigned int i=0; i<list.length(); i++){
+            RTC::RTObject_ptr obj = list[i];
+            plan->comps.push_back(obj);
+            plan->rtobjs[i] = m_worker.findComponent(list[i]);
+        }
+#endif
+        getComponentNames(comp_names);
+        plan->staged = false;
+        if (comp_names.size() != plan->comps.size()){
+            // components changed while building, timeovers are reported
+            // without names until the next plan
+            return plan;
+        }
+        plan->names = comp_names;
+        plan->timeoverProcesses.resize(plan->names.size());
+        if (m_stageSpec.empty()) return plan;
+        std::vector<bool> assigned(comp_names.size(), false);
+        coil::vstring stages = coil::split(m_stageSpec, ";", true);
+        for (unsigned int i=0; i<stages.size(); i++){
+            std::vector<int> stage;
+            coil::vstring names = coil::split(stages[i], ",", true);
+            for (unsigned int j=0; j<names.size(); j++){
+                unsigned int k;
+                for (k=0; k<comp_names.size(); k++){
+                    if (comp_names[k] == names[j]) break;
+                }
+                if (k == comp_names.size()){
+                    // may be attached later
+                    RTC_DEBUG(("%s is not attached", names[j].c_str()));
+                }else if (assigned[k]){
+                    std::cerr << "[hrpEC] " << names[j]
+                              << " appears in more than one stage" << std::endl;
+                }else{
+                    stage.push_back(k);
+                    assigned[k] = true;
+                }
+            }
+            if (!stage.empty()) plan->stages.push_back(stage);
+        }
+        // components which are not listed are executed serially after
+        // the listed ones in the order they were attached
+        for (unsigned int i=0; i<comp_names.size(); i++){
+            if (!assigned[i]) plan->stages.push_back(std::vector<int>(1, i));
+        }
+
+        unsigned int widest = 0;
+        plan->profiles.length(plan->stages.size());
+        for (unsigned int i=0; i<plan->stages.size(); i++){
+            OpenHRP::ExecutionProfileService::StageProfile &prof = plan->profiles[i];
+            prof.components.length(plan->stages[i].size());
+            for (unsigned int j=0; j<plan->stages[i].size(); j++){
+                prof.components[j] = comp_names[plan->stages[i][j]].c_str();
+            }
+            prof.count = 0;
+            prof.avg_process = 0;
+            prof.max_process = 0;
+            if (plan->stages[i].size() > widest) widest = plan->stages[i].size();
+        }
+        // the calling thread also executes components
+        int nworkers = m_stageWorkers >= 0 ? m_stageWorkers : (int)widest - 1;
+        plan->staged = true;
+        if (nworkers > 0 && !plan->executor.start(nworkers, m_priority, m_stageCpus)){
+            // svc() would wait for workers which it can preempt
+            std::cerr << "[hrpEC] failed to start workers with priority "
+                      << m_priority << ", components are executed serially" << std::endl;
+            plan->staged = false;
+        }
+        return plan;
+    }
+
+    bool hrpExecutionContext::isPlanFor(const StagePlan *plan)
+    {
+#ifndef OPENRTM_VERSION_TRUNK
+        if (plan->comps.size() != m_comps.size()) return false;
+        for (unsigned int i=0; i<m_comps.size(); i++){
+            if (plan->comps[i] != m_comps[i]._ref.in()) return false;
+        }
+#else
+        const RTCList& list = getComponentList();
+        if (plan->comps.size() != list.length()) return false;
+        for (unsigned int i=0; i<list.length(); i++){
+            RTC::RTObject_ptr obj = list[i];
+            if (plan->comps[i] != obj) return false;
+        }
+#endif
+        return true;
+    }
+
+    bool hrpExecutionContext::updateStagePlan()
+    {
+        // a new plan is taken unless a service call is reading the profiles
+        if (m_pendingPlan && !m_retiredPlan
+            && pthread_mutex_trylock(&m_stageMutex) == 0){
+            m_retiredPlan = m_stagePlan;
+            m_stagePlan = m_pendingPlan;
+            __sync_synchronize();
+            m_pendingPlan = NULL;
+            pthread_mutex_unlock(&m_stageMutex);
+        }
+        // components are executed serially until stages are built for them
+        m_planValid = m_stagePlan && isPlanFor(m_stagePlan);
+        if (!m_planValid){
+            if (!m_pendingPlan) m_planRequested = true;
+            return false;
+        }
+        return m_stagePlan->staged;
+    }
+
+    void hrpExecutionContext::recordTimeover(long long tv, double dt)
+    {
+        StagePlan *plan = m_planValid ? m_stagePlan : NULL;
+        m_timeoverSeq++;
+        __sync_synchronize();
+        m_timeoverTime = tv;
+        m_timeoverProcess = dt;
+        m_timeoverPlan = plan;
+        if (plan){
+            for (unsigned int i=0; i<plan->timeoverProcesses.size(); i++){
+                plan->timeoverProcesses[i] = m_processes[i];
+            }
+        }
+        __sync_synchronize();
+        m_timeoverSeq++;
+    }
+
+    void hrpExecutionContext::reportTimeover(unsigned long& io_reported)
+    {
+        unsigned long seq = m_timeoverSeq;
+        __sync_synchronize();
+        if (seq == io_reported || (seq & 1)) return;
+        // m_stagePlan is not switched while m_stageMutex is locked
+        pthread_mutex_lock(&m_stageMutex);
+        long long tv = m_timeoverTime;
+        double dt = m_timeoverProcess;
+        StagePlan *plan = m_timeoverPlan == m_stagePlan ? m_stagePlan : NULL;
+        std::vector<double> processes;
+        if (plan) processes = plan->timeoverProcesses;
+        __sync_synchronize();
+        bool consistent = m_timeoverSeq == seq;
+        pthread_mutex_unlock(&m_stageMutex);
+        // retried at the next loop if svc() wrote it while copying
+        if (!consistent) return;
+        unsigned long skipped = (seq - io_reported)/2 - 1;
+        io_reported = seq;
+        fprintf(stderr, "[%.6f] Timeover: processing time = %4.2f[ms]\n",
+                tv/1e9, dt*1e3);
+        // plan is deleted only by this thread after svc() retires it
+        for (unsigned int i=0; i<processes.size(); i++){
+            fprintf(stderr, "%s(%4.2f), ", plan->names[i].c_str(), processes[i]*1e3);
+        }
+        if (!processes.empty()) fprintf(stderr, "\n");
+        if (skipped) fprintf(stderr, "%lu timeovers before it are not shown\n", skipped);
+    }
+
+    void hrpExecutionContext::executeStages()
+    {
+        StagePlan *plan = m_stagePlan;
+        for (unsigned int i=0; i<plan->stages.size(); i++){
+            long long tbegin = get_nsec();
+            plan->executor.execute(plan->stages[i], invokeComponent, this);
+            double dt = (get_nsec() - tbegin)/1e9;
+            OpenHRP::ExecutionProfileService::StageProfile &prof = plan->profiles[i];
+            prof.avg_process = (prof.avg_process*prof.count + dt)/(prof.count+1);
+            prof.count++;
+            if (prof.max_process < dt) prof.max_process = dt;
+        }
+    }
+
+    void hrpExecutionContext::invokeComponent(void *arg, int i)
+    {
+        hrpExecutionContext *ec = (hrpExecutionContext *)arg;
+        long long tbegin = get_nsec();
+#ifndef OPENRTM_VERSION_TRUNK
+        invoke_worker iw;
+        iw(ec->m_comps[i]);
+#else
+        ec->m_stagePlan->rtobjs[i]->workerDo();
+#endif
+        ec->m_processes[i] = (get_nsec() - tbegin)/1e9;
     }
 };
@@ -12,6 +12,16 @@
 #include <rtm/PeriodicExecutionContext.h>
 
 #include "ExecutionProfileService.hh"
+#include "LatencyHistogram.h"
+#include "ExecutionTrace.h"
+#include "util/StageExecutor.h"
+
+#ifdef OPENRTM_VERSION_TRUNK
+namespace RTC_impl
+{
+  class RTObjectStateMachine;
+};
+#endif
 
 namespace RTC
 {
@@ -35,6 +45,13 @@ namespace RTC
     OpenHRP::ExecutionProfileService::Profile *getProfile();
     OpenHRP::ExecutionProfileService::ComponentProfile getComponentProfile(RTC::LightweightRTObject_ptr obj);
     void resetProfile();
+    OpenHRP::ExecutionProfileService::LatencyHistogram *getLatencyHistogram(RTC::LightweightRTObject_ptr obj);
+    OpenHRP::ExecutionProfileService::LatencyHistogram *getPeriodHistogram();
+    void resetLatencyHistogram(RTC::LightweightRTObject_ptr obj);
+    CORBA::Boolean startTrace(CORBA::ULong length);
+    void stopTrace();
+    CORBA::Boolean saveTrace(const char *filename, CORBA::Boolean binary);
+    OpenHRP::ExecutionProfileService::StageProfileList *getStageProfiles();
     //
     bool enterRT();
     bool exitRT();
@@ -52,10 +69,74 @@ namespace RTC
           }
       }
     }
+    int findComponent(RTC::LightweightRTObject_ptr obj);
+    OpenHRP::ExecutionProfileService::LatencyHistogram *convertHistogram(const LatencyHistogram& hist);
+    void waitForTraceInactive();
+    void getComponentNames(std::vector<std::string>& o_names);
+    /**
+       names and stages of components, built from exec_cxt.periodic.stages.
+       A plan is built by the stage builder thread, used by svc() as it is
+       and deleted by the builder after svc() switches to a newer plan.
+       Plans are built without exec_cxt.periodic.stages too, so that
+       timeovers are reported with names of components.
+     */
+    struct StagePlan
+    {
+        /// components the plan is built for. Only compared with the
+        /// current ones, which keep them alive while they are attached
+        std::vector<CORBA::Object_ptr> comps;
+        bool staged; ///< false if not staged or workers can't run with the priority of svc()
+        std::vector<std::string> names; ///< instance names of comps
+        std::vector<double> timeoverProcesses; ///< processing times of the last timeover
+        std::vector<std::vector<int> > stages; ///< indices of components in each stage
+        OpenHRP::ExecutionProfileService::StageProfileList profiles;
+        StageExecutor executor;
+#ifdef OPENRTM_VERSION_TRUNK
+        std::vector<RTC_impl::RTObjectStateMachine *> rtobjs;
+#endif
+    };
+    void getStageProperties(coil::Properties& prop);
+    void startStageBuilder();
+    void stopStageBuilder();
+    static void *stageBuilderMain(void *arg);
+    StagePlan *buildStages();
+    bool isPlanFor(const StagePlan *plan);
+    bool updateStagePlan();
+    void recordTimeover(long long tv, double dt);
+    void reportTimeover(unsigned long& io_reported);
+    void executeStages();
+    static void invokeComponent(void *arg, int i);
     OpenHRP::ExecutionProfileService::Profile m_profile;
-    struct timeval m_tv;
+    std::vector<double> m_processes;
+    std::vector<LatencyHistogram> m_histograms;
+    LatencyHistogram m_periodHistogram;
+    ExecutionTrace m_trace;
+    // m_traceActive is updated by svc() at the beginning of each period
+    volatile bool m_traceEnabled, m_traceActive;
+    double m_period_sec;
+    long long m_tv; ///< time when the last period started[ns]
     int m_priority;
+    // names of components in the trace, shared by service calls
     std::vector<std::string> rtc_names;
+    pthread_mutex_t m_namesMutex;
+    // staged execution
+    std::string m_stageSpec; ///< exec_cxt.periodic.stages
+    int m_stageWorkers;      ///< exec_cxt.periodic.stage_workers
+    std::vector<int> m_stageCpus; ///< exec_cxt.periodic.stage_cpus
+    StagePlan *m_stagePlan; ///< used by svc(), guarded by m_stageMutex against service calls and reportTimeover()
+    bool m_planValid; ///< m_stagePlan is built for the current components
+    StagePlan * volatile m_pendingPlan; ///< built and not used by svc() yet
+    StagePlan * volatile m_retiredPlan; ///< no longer used by svc()
+    volatile bool m_planRequested; ///< set by svc() when the plan doesn't match the components
+    volatile bool m_stageBuilderRunning;
+    // the last timeover, written by svc() and printed by the stage builder.
+    // m_timeoverSeq is odd while it is written
+    volatile unsigned long m_timeoverSeq;
+    long long m_timeoverTime;
+    double m_timeoverProcess;
+    StagePlan *m_timeoverPlan;
+    pthread_t m_stageBuilder;
+    pthread_mutex_t m_stageMutex;
   };
 };
 
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <vector>
 #include "iob.h"
+#include "iob_snapshot.h"
 
 static std::vector<double> command;
 static std::vector<std::vector<double> > forces;
@@ -655,6 +656,16 @@ int initializeJointAngle(const char *name, const char *option)
     return TRUE;
 }
 
+#if defined(ROBOT_IOB_VERSION) && ROBOT_IOB_VERSION >= 3
+int read_iob_snapshot(struct iob_state *state)
+{
+    // the same values and updated flags as the per-id functions
+    read_iob_snapshot_by_id(state);
+    state->frame = frame;
+    return TRUE;
+}
+#endif
+
 int read_digital_input(char *dinput)
 {
     return FALSE;
@@ -736,6 +736,57 @@ extern "C"{
     int read_digital_output(char *doutput);
     //@}
 
+    /**
+     * @name snapshot
+     */
+    //@{
+#define IOB_STATE_ANGLES          0x001
+#define IOB_STATE_VELOCITIES      0x002
+#define IOB_STATE_TORQUES         0x004
+#define IOB_STATE_COMMAND_TORQUES 0x008
+#define IOB_STATE_CALIB_STATES    0x010
+#define IOB_STATE_POWER_STATES    0x020
+#define IOB_STATE_SERVO_STATES    0x040
+#define IOB_STATE_SERVO_ALARMS    0x080
+#define IOB_STATE_DRIVER_TEMPERATURES 0x100
+#define IOB_STATE_FORCES          0x200
+#define IOB_STATE_RATES           0x400
+#define IOB_STATE_ACCELS          0x800
+
+    /**
+     * @brief buffers filled by read_iob_snapshot(). Buffers are allocated
+     * by the caller and NULL ones are skipped.
+     */
+    struct iob_state
+    {
+        unsigned long long frame;     ///< frame which the state belongs to, 0 if unknown
+        double *angles;               ///< actual angles[rad], number_of_joints()
+        double *velocities;           ///< actual velocities[rad/s], number_of_joints()
+        double *torques;              ///< actual torques[Nm], number_of_joints()
+        double *command_torques;      ///< commanded torques[Nm], number_of_joints()
+        int *calib_states;            ///< see read_calib_state(), number_of_joints()
+        int *power_states;            ///< see read_power_state(), number_of_joints()
+        int *servo_states;            ///< see read_servo_state(), number_of_joints()
+        int *servo_alarms;            ///< see read_servo_alarm(), number_of_joints()
+        unsigned char *driver_temperatures; ///< see read_driver_temperature(), number_of_joints()
+        double *forces;               ///< 6*number_of_force_sensors(), see read_force_sensor()
+        double *rates;                ///< 3*number_of_gyro_sensors(), see read_gyro_sensor()
+        double *accels;               ///< 3*number_of_accelerometers(), see read_accelerometer()
+        int updated;                  ///< bitwise OR of IOB_STATE_* of filled buffers
+    };
+
+#if defined(ROBOT_IOB_VERSION) && ROBOT_IOB_VERSION >= 3
+    /**
+     * @brief read all joint and sensor states of a frame at once. This is
+     * used when compiled with ROBOT_IOB_VERSION >= 3, otherwise users build
+     * it on the per-id functions by iob_snapshot.h.
+     * @param state buffers to be filled
+     * @return TRUE if read successfully, FALSE otherwise
+     */
+    int read_iob_snapshot(struct iob_state *state);
+#endif
+    //@}
+
 #ifdef __cplusplus
 }
 #endif
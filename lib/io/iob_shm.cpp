@@ -0,0 +1,778 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <sched.h>
+#include "iob.h"
+#include "iob_shm.h"
+
+static iob_shm_segment *g_seg = NULL;
+static std::string g_name;
+static int g_openCount = 0;
+static iob_shm_state g_state;       ///< snapshot of the latest state
+static iob_shm_command g_command;   ///< commands to be published
+static int g_nJoints = 0;
+static int g_nForceSensors = 0;
+static int g_nGyroSensors = 0;
+static int g_nAccelerometers = 0;
+static int g_nAttitudeSensors = 0;
+static double g_forceOffset[IOB_SHM_MAX_FORCE_SENSORS][6];
+static double g_gyroOffset[IOB_SHM_MAX_GYRO_SENSORS][3];
+static double g_accelOffset[IOB_SHM_MAX_ACCELEROMETERS][3];
+static bool isLocked = false;
+static unsigned long long g_frame = 0;
+static long long g_next = 0;        ///< time when the next frame is expected[ns]
+static long g_period_ns = 5000000;
+static bool g_spin = false;         ///< busy-wait for the plant
+static bool g_plantAlive = false;
+
+#define POLL_INTERVAL_NS 10000
+
+#define CHECK_JOINT_ID(id) if ((id) < 0 || (id) >= number_of_joints()) return E_ID
+#define CHECK_FORCE_SENSOR_ID(id) if ((id) < 0 || (id) >= number_of_force_sensors()) return E_ID
+#define CHECK_ACCELEROMETER_ID(id) if ((id) < 0 || (id) >= number_of_accelerometers()) return E_ID
+#define CHECK_GYRO_SENSOR_ID(id) if ((id) < 0 || (id) >= number_of_gyro_sensors()) return E_ID
+#define CHECK_ATTITUDE_SENSOR_ID(id) if ((id) < 0 || (id) >= number_of_attitude_sensors()) return E_ID
+
+static int set_number(int num, int max, int& n)
+{
+    if (num < 0 || num > max){
+        std::cerr << "hrpIoShm: " << num << " exceeds the limit(" << max
+                  << ")" << std::endl;
+        return FALSE;
+    }
+    n = num;
+    return TRUE;
+}
+
+int number_of_joints()
+{
+    return g_nJoints;
+}
+
+int number_of_force_sensors()
+{
+    return g_nForceSensors;
+}
+
+int number_of_gyro_sensors()
+{
+    return g_nGyroSensors;
+}
+
+int number_of_accelerometers()
+{
+    return g_nAccelerometers;
+}
+
+int number_of_attitude_sensors()
+{
+    return g_nAttitudeSensors;
+}
+
+int set_number_of_joints(int num)
+{
+    return set_number(num, IOB_SHM_MAX_JOINTS, g_nJoints);
+}
+
+int set_number_of_force_sensors(int num)
+{
+    return set_number(num, IOB_SHM_MAX_FORCE_SENSORS, g_nForceSensors);
+}
+
+int set_number_of_gyro_sensors(int num)
+{
+    return set_number(num, IOB_SHM_MAX_GYRO_SENSORS, g_nGyroSensors);
+}
+
+int set_number_of_accelerometers(int num)
+{
+    return set_number(num, IOB_SHM_MAX_ACCELEROMETERS, g_nAccelerometers);
+}
+
+int set_number_of_attitude_sensors(int num)
+{
+    return set_number(num, IOB_SHM_MAX_ATTITUDE_SENSORS, g_nAttitudeSensors);
+}
+
+int read_power_state(int id, int *s)
+{
+    CHECK_JOINT_ID(id);
+    *s = g_command.power[id];
+    return TRUE;
+}
+
+int write_power_command(int id, int com)
+{
+    CHECK_JOINT_ID(id);
+    g_command.power[id] = com;
+    return TRUE;
+}
+
+int read_power_command(int id, int *com)
+{
+    CHECK_JOINT_ID(id);
+    *com = g_command.power[id];
+    return TRUE;
+}
+
+int read_servo_state(int id, int *s)
+{
+    CHECK_JOINT_ID(id);
+    *s = g_command.servo[id];
+    return TRUE;
+}
+
+int read_servo_alarm(int id, int *a)
+{
+    CHECK_JOINT_ID(id);
+    *a = g_state.alarm[id];
+    return TRUE;
+}
+
+int read_control_mode(int id, joint_control_mode *s)
+{
+    CHECK_JOINT_ID(id);
+    *s = (joint_control_mode)g_command.control_mode[id];
+    return TRUE;
+}
+
+int write_control_mode(int id, joint_control_mode s)
+{
+    CHECK_JOINT_ID(id);
+    g_command.control_mode[id] = s;
+    return TRUE;
+}
+
+int read_actual_angle(int id, double *angle)
+{
+    CHECK_JOINT_ID(id);
+    *angle = g_state.angle[id];
+    return TRUE;
+}
+
+int read_actual_angles(double *angles)
+{
+    memcpy(angles, g_state.angle, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int read_actual_torques(double *torques)
+{
+    memcpy(torques, g_state.torque, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int read_command_torque(int id, double *torque)
+{
+    CHECK_JOINT_ID(id);
+    *torque = g_command.torque[id];
+    return TRUE;
+}
+
+int write_command_torque(int id, double torque)
+{
+    CHECK_JOINT_ID(id);
+    g_command.torque[id] = torque;
+    return TRUE;
+}
+
+int read_command_torques(double *torques)
+{
+    memcpy(torques, g_command.torque, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int write_command_torques(const double *torques)
+{
+    memcpy(g_command.torque, torques, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int read_command_angle(int id, double *angle)
+{
+    CHECK_JOINT_ID(id);
+    *angle = g_command.angle[id];
+    return TRUE;
+}
+
+int write_command_angle(int id, double angle)
+{
+    CHECK_JOINT_ID(id);
+    g_command.angle[id] = angle;
+    return TRUE;
+}
+
+int read_command_angles(double *angles)
+{
+    memcpy(angles, g_command.angle, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int write_command_angles(const double *angles)
+{
+    memcpy(g_command.angle, angles, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int read_pgain(int id, double *gain)
+{
+    CHECK_JOINT_ID(id);
+    *gain = g_command.pgain[id];
+    return TRUE;
+}
+
+int write_pgain(int id, double gain)
+{
+    CHECK_JOINT_ID(id);
+    g_command.pgain[id] = gain;
+    return TRUE;
+}
+
+int read_dgain(int id, double *gain)
+{
+    CHECK_JOINT_ID(id);
+    *gain = g_command.dgain[id];
+    return TRUE;
+}
+
+int write_dgain(int id, double gain)
+{
+    CHECK_JOINT_ID(id);
+    g_command.dgain[id] = gain;
+    return TRUE;
+}
+
+int read_force_sensor(int id, double *forces)
+{
+    CHECK_FORCE_SENSOR_ID(id);
+    for (int i=0; i<6; i++){
+        forces[i] = g_state.force[id][i] + g_forceOffset[id][i];
+    }
+    return TRUE;
+}
+
+int read_gyro_sensor(int id, double *rates)
+{
+    CHECK_GYRO_SENSOR_ID(id);
+    for (int i=0; i<3; i++){
+        rates[i] = g_state.gyro[id][i] + g_gyroOffset[id][i];
+    }
+    return TRUE;
+}
+
+int read_accelerometer(int id, double *accels)
+{
+    CHECK_ACCELEROMETER_ID(id);
+    for (int i=0; i<3; i++){
+        accels[i] = g_state.accel[id][i] + g_accelOffset[id][i];
+    }
+    return TRUE;
+}
+
+int read_touch_sensors(unsigned short *onoff)
+{
+    return FALSE;
+}
+
+int read_attitude_sensor(int id, double *att)
+{
+    CHECK_ATTITUDE_SENSOR_ID(id);
+    for (int i=0; i<3; i++){
+        att[i] = g_state.attitude[id][i];
+    }
+    return TRUE;
+}
+
+int read_current(int id, double *mcurrent)
+{
+    return FALSE;
+}
+
+int read_current_limit(int id, double *v)
+{
+    return FALSE;
+}
+
+int read_currents(double *currents)
+{
+    return FALSE;
+}
+
+int read_gauges(double *gauges)
+{
+    return FALSE;
+}
+
+int read_actual_velocity(int id, double *vel)
+{
+    CHECK_JOINT_ID(id);
+    *vel = g_state.velocity[id];
+    return TRUE;
+}
+
+int read_command_velocity(int id, double *vel)
+{
+    CHECK_JOINT_ID(id);
+    *vel = g_command.velocity[id];
+    return TRUE;
+}
+
+int write_command_velocity(int id, double vel)
+{
+    CHECK_JOINT_ID(id);
+    g_command.velocity[id] = vel;
+    return TRUE;
+}
+
+int read_actual_velocities(double *vels)
+{
+    memcpy(vels, g_state.velocity, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int read_command_velocities(double *vels)
+{
+    memcpy(vels, g_command.velocity, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int write_command_velocities(const double *vels)
+{
+    memcpy(g_command.velocity, vels, sizeof(double)*number_of_joints());
+    return TRUE;
+}
+
+int read_temperature(int id, double *v)
+{
+    CHECK_JOINT_ID(id);
+    *v = g_state.temperature[id];
+    return TRUE;
+}
+
+int write_servo(int id, int com)
+{
+    CHECK_JOINT_ID(id);
+    g_command.servo[id] = com;
+    return TRUE;
+}
+
+int write_dio(unsigned short buf)
+{
+    return FALSE;
+}
+
+int open_iob(void)
+{
+    if (g_openCount++ > 0) return TRUE;
+
+    const char *name = getenv("HRPSYS_IOB_SHM");
+    g_name = name ? name : IOB_SHM_DEFAULT_NAME;
+    g_spin = getenv("HRPSYS_IOB_SHM_SPIN") != NULL;
+    int fd = shm_open(g_name.c_str(), O_CREAT|O_RDWR, 0666);
+    if (fd < 0){
+        perror("shm_open");
+        g_openCount = 0;
+        return FALSE;
+    }
+    if (ftruncate(fd, sizeof(iob_shm_segment)) < 0){
+        perror("ftruncate");
+        close(fd);
+        g_openCount = 0;
+        return FALSE;
+    }
+    void *p = mmap(NULL, sizeof(iob_shm_segment), PROT_READ|PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED){
+        perror("mmap");
+        g_openCount = 0;
+        return FALSE;
+    }
+    g_seg = (iob_shm_segment *)p;
+
+    // a plant which attaches from now on waits for the magic number
+    g_seg->magic = 0;
+    __sync_synchronize();
+    memset(&g_state, 0, sizeof(g_state));
+    for (int i=0; i<g_nAccelerometers; i++) g_state.accel[i][2] = 9.81;
+    memset(&g_command, 0, sizeof(g_command));
+    for (int i=0; i<g_nJoints; i++){
+        g_command.power[i] = g_command.servo[i] = OFF;
+        g_command.control_mode[i] = JCM_POSITION;
+    }
+    memset(g_forceOffset, 0, sizeof(g_forceOffset));
+    memset(g_gyroOffset, 0, sizeof(g_gyroOffset));
+    memset(g_accelOffset, 0, sizeof(g_accelOffset));
+    g_seg->version = IOB_SHM_VERSION;
+    g_seg->num_joints = g_nJoints;
+    g_seg->num_force_sensors = g_nForceSensors;
+    g_seg->num_gyro_sensors = g_nGyroSensors;
+    g_seg->num_accelerometers = g_nAccelerometers;
+    g_seg->num_attitude_sensors = g_nAttitudeSensors;
+    g_seg->period_ns = g_period_ns;
+    g_seg->state.seq = g_seg->command.seq = 0;
+    iob_shm_write(g_seg->state, g_state);
+    iob_shm_write(g_seg->command, g_command);
+    __sync_synchronize();
+    g_seg->magic = IOB_SHM_MAGIC;
+
+    g_plantAlive = false;
+    g_next = iob_shm_now();
+    std::cout << "shared-memory IOB(" << g_name << ") is opened" << std::endl;
+    return TRUE;
+}
+
+int close_iob(void)
+{
+    if (g_openCount == 0 || --g_openCount > 0) return TRUE;
+
+    g_seg->magic = 0;
+    munmap(g_seg, sizeof(iob_shm_segment));
+    g_seg = NULL;
+    shm_unlink(g_name.c_str());
+    std::cout << "shared-memory IOB(" << g_name << ") is closed" << std::endl;
+    return TRUE;
+}
+
+int reset_body(void)
+{
+    for (int i=0; i<number_of_joints(); i++){
+        g_command.power[i] = g_command.servo[i] = OFF;
+    }
+    return TRUE;
+}
+
+int joint_calibration(int id, double angle)
+{
+    return FALSE;
+}
+
+int read_gyro_sensor_offset(int id, double *offset)
+{
+    CHECK_GYRO_SENSOR_ID(id);
+    for (int i=0; i<3; i++){
+        offset[i] = g_gyroOffset[id][i];
+    }
+    return TRUE;
+}
+
+int write_gyro_sensor_offset(int id, double *offset)
+{
+    CHECK_GYRO_SENSOR_ID(id);
+    for (int i=0; i<3; i++){
+        g_gyroOffset[id][i] = offset[i];
+    }
+    return TRUE;
+}
+
+int read_accelerometer_offset(int id, double *offset)
+{
+    CHECK_ACCELEROMETER_ID(id);
+    for (int i=0; i<3; i++){
+        offset[i] = g_accelOffset[id][i];
+    }
+    return TRUE;
+}
+
+int write_accelerometer_offset(int id, double *offset)
+{
+    CHECK_ACCELEROMETER_ID(id);
+    for (int i=0; i<3; i++){
+        g_accelOffset[id][i] = offset[i];
+    }
+    return TRUE;
+}
+
+int read_force_offset(int id, double *offsets)
+{
+    CHECK_FORCE_SENSOR_ID(id);
+    for (int i=0; i<6; i++){
+        offsets[i] = g_forceOffset[id][i];
+    }
+    return TRUE;
+}
+
+int write_force_offset(int id, double *offsets)
+{
+    CHECK_FORCE_SENSOR_ID(id);
+    for (int i=0; i<6; i++){
+        g_forceOffset[id][i] = offsets[i];
+    }
+    return TRUE;
+}
+
+int write_attitude_sensor_offset(int id, double *offset)
+{
+    return FALSE;
+}
+
+int read_calib_state(int id, int *s)
+{
+    CHECK_JOINT_ID(id);
+    *s = ON;
+    return TRUE;
+}
+
+int lock_iob()
+{
+    if (isLocked) return FALSE;
+
+    isLocked = true;
+    return TRUE;
+}
+int unlock_iob()
+{
+    isLocked = false;
+    return TRUE;
+}
+
+int read_lock_owner(pid_t *pid)
+{
+  return FALSE;
+}
+
+int read_limit_angle(int id, double *angle)
+{
+  return FALSE;
+}
+
+int read_angle_offset(int id, double *angle)
+{
+  return FALSE;
+}
+
+int write_angle_offset(int id, double angle)
+{
+  return FALSE;
+}
+
+int read_ulimit_angle(int id, double *angle)
+{
+  return FALSE;
+}
+int read_llimit_angle(int id, double *angle)
+{
+  return FALSE;
+}
+int read_encoder_pulse(int id, double *ec)
+{
+  return FALSE;
+}
+int read_gear_ratio(int id, double *gr)
+{
+  return FALSE;
+}
+int read_torque_const(int id, double *tc)
+{
+  return FALSE;
+}
+int read_torque_limit(int id, double *limit)
+{
+  return FALSE;
+}
+
+unsigned long long read_iob_frame()
+{
+    return g_frame;
+}
+
+int number_of_substeps()
+{
+    return 1;
+}
+
+int read_power(double *voltage, double *current)
+{
+    return FALSE;
+}
+
+#if defined(ROBOT_IOB_VERSION) && ROBOT_IOB_VERSION >= 2
+int number_of_batteries()
+{
+    return 0;
+}
+
+int read_battery(int id, double *voltage, double *current, double *soc)
+{
+    return FALSE;
+}
+
+int number_of_thermometers()
+{
+    return 0;
+}
+
+#endif
+
+int read_driver_temperature(int id, unsigned char *v)
+{
+    CHECK_JOINT_ID(id);
+    *v = (unsigned char)g_state.temperature[id];
+    return TRUE;
+}
+
+int wait_for_iob_signal()
+{
+    if (!g_seg) return -1;
+
+    // commands computed in the last period
+    g_command.frame = g_state.frame;
+    g_command.stamp = iob_shm_now();
+    iob_shm_write(g_seg->command, g_command);
+
+    // wait for the next state. if the plant doesn't publish it within a
+    // period after it is expected, advance the frame by the local clock
+    long long timeout = g_plantAlive ? g_next + g_period_ns : g_next;
+    while(1){
+        if (g_seg->state.frame != g_state.frame
+            && iob_shm_read(g_state, g_seg->state)){
+            if (!g_plantAlive){
+                std::cout << "hrpIoShm: plant is connected" << std::endl;
+                g_plantAlive = true;
+            }
+            g_next = iob_shm_now() + g_period_ns;
+            break;
+        }
+        long long now = iob_shm_now();
+        if (now >= timeout){
+            if (g_plantAlive){
+                std::cerr << "hrpIoShm: plant doesn't respond" << std::endl;
+                g_plantAlive = false;
+            }
+            do {
+                g_next += g_period_ns;
+            } while (g_next <= now);
+            break;
+        }
+        if (g_spin){
+            sched_yield();
+        }else{
+            struct timespec ts;
+            ts.tv_sec = 0;
+            ts.tv_nsec = POLL_INTERVAL_NS;
+            if (!g_plantAlive){
+                // sleep until the next frame is expected
+                ts.tv_nsec = timeout - now;
+                if (ts.tv_nsec >= 1000000000L) ts.tv_nsec = 999999999L;
+            }
+            nanosleep(&ts, NULL);
+        }
+    }
+    g_frame++;
+    return 0;
+}
+
+size_t length_of_extra_servo_state(int id)
+{
+    return 0;
+}
+
+int read_extra_servo_state(int id, int *state)
+{
+    return TRUE;
+}
+
+int set_signal_period(long period_ns)
+{
+    g_period_ns = period_ns;
+    if (g_seg) g_seg->period_ns = period_ns;
+    return TRUE;
+}
+
+long get_signal_period()
+{
+    return g_period_ns;
+}
+
+int initializeJointAngle(const char *name, const char *option)
+{
+    return TRUE;
+}
+
+#if defined(ROBOT_IOB_VERSION) && ROBOT_IOB_VERSION >= 3
+int read_iob_snapshot(struct iob_state *state)
+{
+    int n = number_of_joints();
+    state->updated = 0;
+    state->frame = g_frame;
+    if (state->angles){
+        memcpy(state->angles, g_state.angle, sizeof(double)*n);
+        state->updated |= IOB_STATE_ANGLES;
+    }
+    if (state->velocities){
+        memcpy(state->velocities, g_state.velocity, sizeof(double)*n);
+        state->updated |= IOB_STATE_VELOCITIES;
+    }
+    if (state->torques){
+        memcpy(state->torques, g_state.torque, sizeof(double)*n);
+        state->updated |= IOB_STATE_TORQUES;
+    }
+    if (state->command_torques){
+        memcpy(state->command_torques, g_command.torque, sizeof(double)*n);
+        state->updated |= IOB_STATE_COMMAND_TORQUES;
+    }
+    for (int i=0; i<n; i++){
+        if (state->calib_states) state->calib_states[i] = ON;
+        if (state->power_states) state->power_states[i] = g_command.power[i];
+        if (state->servo_states) state->servo_states[i] = g_command.servo[i];
+        if (state->servo_alarms) state->servo_alarms[i] = g_state.alarm[i];
+        if (state->driver_temperatures) state->driver_temperatures[i] = (unsigned char)g_state.temperature[i];
+    }
+    if (state->calib_states) state->updated |= IOB_STATE_CALIB_STATES;
+    if (state->power_states) state->updated |= IOB_STATE_POWER_STATES;
+    if (state->servo_states) state->updated |= IOB_STATE_SERVO_STATES;
+    if (state->servo_alarms) state->updated |= IOB_STATE_SERVO_ALARMS;
+    if (state->driver_temperatures) state->updated |= IOB_STATE_DRIVER_TEMPERATURES;
+    if (state->forces){
+        for (int i=0; i<g_nForceSensors; i++){
+            read_force_sensor(i, state->forces + 6*i);
+        }
+        state->updated |= IOB_STATE_FORCES;
+    }
+    if (state->rates){
+        for (int i=0; i<g_nGyroSensors; i++){
+            read_gyro_sensor(i, state->rates + 3*i);
+        }
+        state->updated |= IOB_STATE_RATES;
+    }
+    if (state->accels){
+        for (int i=0; i<g_nAccelerometers; i++){
+            read_accelerometer(i, state->accels + 3*i);
+        }
+        state->updated |= IOB_STATE_ACCELS;
+    }
+    return TRUE;
+}
+#endif
+
+int read_digital_input(char *dinput)
+{
+    return FALSE;
+}
+
+int length_digital_input()
+{
+    return 0;
+}
+
+int write_digital_output(const char *doutput)
+{
+    return FALSE;
+}
+
+int write_digital_output_with_mask(const char *doutput, const char *mask)
+{
+    return FALSE;
+}
+
+int length_digital_output()
+{
+    return 0;
+}
+
+int read_digital_output(char *doutput)
+{
+    return FALSE;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file iob_shm.h
+ * @brief layout of the shared-memory segment used by hrpIoShm and helper
+ * functions for a process which plays the robot (plant).
+ *
+ * hrpIoShm is an implementation of iob.h which doesn't drive hardware but
+ * exchanges joint commands, sensor data and frame counters with another
+ * process through a shared-memory segment. The segment is created by
+ * open_iob() of hrpIoShm and its name is given by the environment variable
+ * HRPSYS_IOB_SHM(default: IOB_SHM_DEFAULT_NAME).
+ *
+ * The plant publishes a state with a new frame counter every period and
+ * hrpIoShm publishes commands when the controller waits for the next
+ * frame. Each block is protected by a sequence counter so that neither
+ * side blocks the other. If no state is published within a period,
+ * hrpIoShm advances frames by its own clock like the dummy iob.
+ */
+#ifndef __IOB_SHM_H__
+#define __IOB_SHM_H__
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+
+#define IOB_SHM_DEFAULT_NAME "/hrpsys_iob"
+#define IOB_SHM_MAGIC   0x48525049  // "HRPI"
+#define IOB_SHM_VERSION 1
+
+#define IOB_SHM_MAX_JOINTS            128
+#define IOB_SHM_MAX_FORCE_SENSORS     8
+#define IOB_SHM_MAX_GYRO_SENSORS      4
+#define IOB_SHM_MAX_ACCELEROMETERS    4
+#define IOB_SHM_MAX_ATTITUDE_SENSORS  4
+
+/**
+ * @brief state of the robot written by the plant
+ */
+struct iob_shm_state
+{
+    volatile unsigned int seq;   ///< odd while being written
+    unsigned long long frame;    ///< incremented every period
+    long long stamp;             ///< CLOCK_MONOTONIC time when published[ns]
+    double angle[IOB_SHM_MAX_JOINTS];
+    double velocity[IOB_SHM_MAX_JOINTS];
+    double torque[IOB_SHM_MAX_JOINTS];
+    double temperature[IOB_SHM_MAX_JOINTS];
+    int alarm[IOB_SHM_MAX_JOINTS];
+    double force[IOB_SHM_MAX_FORCE_SENSORS][6];
+    double gyro[IOB_SHM_MAX_GYRO_SENSORS][3];
+    double accel[IOB_SHM_MAX_ACCELEROMETERS][3];
+    double attitude[IOB_SHM_MAX_ATTITUDE_SENSORS][3];
+};
+
+/**
+ * @brief commands written by the controller
+ */
+struct iob_shm_command
+{
+    volatile unsigned int seq;   ///< odd while being written
+    unsigned long long frame;    ///< frame of the state the commands are computed from
+    long long stamp;             ///< CLOCK_MONOTONIC time when published[ns]
+    double angle[IOB_SHM_MAX_JOINTS];
+    double velocity[IOB_SHM_MAX_JOINTS];
+    double torque[IOB_SHM_MAX_JOINTS];
+    double pgain[IOB_SHM_MAX_JOINTS];
+    double dgain[IOB_SHM_MAX_JOINTS];
+    int servo[IOB_SHM_MAX_JOINTS];
+    int power[IOB_SHM_MAX_JOINTS];
+    int control_mode[IOB_SHM_MAX_JOINTS];
+};
+
+/**
+ * @brief shared-memory segment
+ */
+struct iob_shm_segment
+{
+    volatile unsigned int magic; ///< IOB_SHM_MAGIC after initialized
+    unsigned int version;
+    int num_joints;
+    int num_force_sensors;
+    int num_gyro_sensors;
+    int num_accelerometers;
+    int num_attitude_sensors;
+    volatile long period_ns;     ///< expected period set by set_signal_period()
+    iob_shm_state state;
+    iob_shm_command command;
+};
+
+inline long long iob_shm_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief copy a block written with iob_shm_write() without being torn
+ * @param dst destination
+ * @param src block in the segment
+ * @return true if copied, false if the writer seems to have stopped while
+ * writing
+ */
+template <class T>
+inline bool iob_shm_read(T& dst, const T& src)
+{
+    for (int i=0; i<10000; i++){
+        unsigned int s = src.seq;
+        if (s & 1) continue;
+        __sync_synchronize();
+        memcpy(&dst, &src, sizeof(T));
+        __sync_synchronize();
+        if (src.seq == s) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief publish a block
+ * @param dst block in the segment
+ * @param src contents, seq is ignored
+ */
+template <class T>
+inline void iob_shm_write(T& dst, const T& src)
+{
+    unsigned int s = dst.seq;
+    dst.seq = s + 1;
+    __sync_synchronize();
+    memcpy((char *)&dst + sizeof(dst.seq), (const char *)&src + sizeof(src.seq),
+           sizeof(T) - sizeof(dst.seq));
+    __sync_synchronize();
+    dst.seq = s + 2;
+}
+
+/**
+ * @brief attach to a segment created by hrpIoShm
+ * @param name name of the segment, NULL to use the default one
+ * @return pointer to the segment, NULL if the segment doesn't exist or
+ * is not initialized yet
+ */
+inline iob_shm_segment *iob_shm_attach(const char *name)
+{
+    if (!name) name = IOB_SHM_DEFAULT_NAME;
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return NULL;
+    void *p = mmap(NULL, sizeof(iob_shm_segment), PROT_READ|PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    iob_shm_segment *seg = (iob_shm_segment *)p;
+    if (seg->magic != IOB_SHM_MAGIC || seg->version != IOB_SHM_VERSION){
+        munmap(p, sizeof(iob_shm_segment));
+        return NULL;
+    }
+    return seg;
+}
+
+/**
+ * @brief detach from a segment
+ * @param seg pointer returned by iob_shm_attach()
+ */
+inline void iob_shm_detach(iob_shm_segment *seg)
+{
+    if (seg) munmap(seg, sizeof(iob_shm_segment));
+}
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file iob_snapshot.h
+ * @brief read_iob_snapshot() built on the functions which read a joint or
+ * a sensor at a time, for drivers compiled with ROBOT_IOB_VERSION < 3.
+ * Drivers can also implement read_iob_snapshot() by this function.
+ */
+#ifndef __IOB_SNAPSHOT_H__
+#define __IOB_SNAPSHOT_H__
+
+#include "iob.h"
+
+/**
+ * @brief fill buffers of state by reading joints and sensors one by one
+ * @param state buffers to be filled
+ * @return TRUE
+ */
+static inline int read_iob_snapshot_by_id(struct iob_state *state)
+{
+    int i, n = number_of_joints();
+    state->updated = 0;
+    // read_iob_frame() is not called since it advances frames of some drivers
+    state->frame = 0;
+    if (state->angles && read_actual_angles(state->angles) == TRUE)
+        state->updated |= IOB_STATE_ANGLES;
+    if (state->velocities && read_actual_velocities(state->velocities) == TRUE)
+        state->updated |= IOB_STATE_VELOCITIES;
+    if (state->torques && read_actual_torques(state->torques) == TRUE)
+        state->updated |= IOB_STATE_TORQUES;
+    if (state->command_torques
+        && read_command_torques(state->command_torques) == TRUE)
+        state->updated |= IOB_STATE_COMMAND_TORQUES;
+    for (i=0; i<n; i++){
+        // values of joints which can't be read are set to 0
+        if (state->calib_states){
+            state->calib_states[i] = 0;
+            read_calib_state(i, &state->calib_states[i]);
+        }
+        if (state->power_states){
+            state->power_states[i] = 0;
+            read_power_state(i, &state->power_states[i]);
+        }
+        if (state->servo_states){
+            state->servo_states[i] = 0;
+            read_servo_state(i, &state->servo_states[i]);
+        }
+        if (state->servo_alarms){
+            state->servo_alarms[i] = 0;
+            read_servo_alarm(i, &state->servo_alarms[i]);
+        }
+        if (state->driver_temperatures){
+            state->driver_temperatures[i] = 0;
+            read_driver_temperature(i, &state->driver_temperatures[i]);
+        }
+    }
+    if (state->calib_states) state->updated |= IOB_STATE_CALIB_STATES;
+    if (state->power_states) state->updated |= IOB_STATE_POWER_STATES;
+    if (state->servo_states) state->updated |= IOB_STATE_SERVO_STATES;
+    if (state->servo_alarms) state->updated |= IOB_STATE_SERVO_ALARMS;
+    if (state->driver_temperatures) state->updated |= IOB_STATE_DRIVER_TEMPERATURES;
+    if (state->forces){
+        for (i=0; i<number_of_force_sensors(); i++){
+            read_force_sensor(i, state->forces + 6*i);
+        }
+        state->updated |= IOB_STATE_FORCES;
+    }
+    if (state->rates){
+        for (i=0; i<number_of_gyro_sensors(); i++){
+            read_gyro_sensor(i, state->rates + 3*i);
+        }
+        state->updated |= IOB_STATE_RATES;
+    }
+    if (state->accels){
+        for (i=0; i<number_of_accelerometers(); i++){
+            read_accelerometer(i, state->accels + 3*i);
+        }
+        state->updated |= IOB_STATE_ACCELS;
+    }
+    return TRUE;
+}
+
+#endif
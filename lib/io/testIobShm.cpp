@@ -0,0 +1,133 @@
+/* round trip latency of hrpIoShm. a plant process is forked which
+   publishes states every period and measures the time until commands for
+   the state are published by the controller(this process) */
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <sys/wait.h>
+#include "iob.h"
+#include "iob_shm.h"
+
+#define NJOINTS 40
+
+static bool consistent(const double *angles, int n)
+{
+    for (int i=1; i<n; i++){
+        if (angles[i] != angles[0] + i*1e-3) return false;
+    }
+    return true;
+}
+
+static int plant(const char *name, int ticks, long period_ns)
+{
+    iob_shm_segment *seg = NULL;
+    for (int i=0; i<1000 && !seg; i++){
+        seg = iob_shm_attach(name);
+        if (!seg) usleep(1000);
+    }
+    if (!seg){
+        std::cerr << "plant: failed to attach " << name << std::endl;
+        return 1;
+    }
+    static iob_shm_state state;
+    static iob_shm_command command;
+    memset(&state, 0, sizeof(state));
+    std::vector<double> rtt;
+    rtt.reserve(ticks);
+    int missed = 0, torn = 0;
+    long long next = iob_shm_now();
+    for (int k=1; k<=ticks; k++){
+        struct timespec ts;
+        ts.tv_sec = next/1000000000LL;
+        ts.tv_nsec = next%1000000000LL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        next += period_ns;
+
+        state.frame = k;
+        state.stamp = iob_shm_now();
+        iob_shm_write(seg->state, state);
+        // wait for commands computed from this state
+        bool received = false;
+        while (iob_shm_now() < next){
+            if (seg->command.frame == (unsigned long long)k
+                && iob_shm_read(command, seg->command)
+                && command.frame == (unsigned long long)k){
+                received = true;
+                break;
+            }
+            sched_yield();
+        }
+        if (!received){
+            missed++;
+            continue;
+        }
+        rtt.push_back((iob_shm_now() - state.stamp)/1e3);
+        if (!consistent(command.angle, seg->num_joints)) torn++;
+        // echo commands back as the actual angles
+        memcpy(state.angle, command.angle, sizeof(state.angle));
+    }
+    iob_shm_detach(seg);
+
+    if (rtt.empty()){
+        std::cerr << "plant: no command is received" << std::endl;
+        return 1;
+    }
+    std::sort(rtt.begin(), rtt.end());
+    double sum = 0;
+    for (unsigned int i=0; i<rtt.size(); i++) sum += rtt[i];
+    printf("round trip[us]: avg = %.1f, p50 = %.1f, p99 = %.1f, max = %.1f\n",
+           sum/rtt.size(), rtt[rtt.size()/2], rtt[rtt.size()*99/100],
+           rtt.back());
+    printf("ticks = %d, missed = %d, torn = %d\n", ticks, missed, torn);
+    fflush(stdout);
+    return torn ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int ticks = 2000;
+    long period_ns = 1000000;
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "--ticks") == 0 && ++i < argc){
+            ticks = atoi(argv[i]);
+        }else if (strcmp(argv[i], "--period-us") == 0 && ++i < argc){
+            period_ns = atol(argv[i])*1000;
+        }else if (strcmp(argv[i], "--spin") == 0){
+            setenv("HRPSYS_IOB_SHM_SPIN", "1", 1);
+        }
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "/hrpsys_iob_test%d", (int)getpid());
+    setenv("HRPSYS_IOB_SHM", name, 1);
+
+    set_number_of_joints(NJOINTS);
+    set_number_of_force_sensors(2);
+    set_number_of_gyro_sensors(1);
+    set_number_of_accelerometers(1);
+    set_signal_period(period_ns);
+    if (open_iob() == FALSE) return 1;
+
+    pid_t pid = fork();
+    if (pid == 0) _exit(plant(name, ticks, period_ns));
+
+    double angles[NJOINTS], commands[NJOINTS];
+    int torn = 0, status = 0;
+    // runs until the plant finishes
+    for (unsigned long long k=0; ; k++){
+        if (wait_for_iob_signal()) break;
+        read_actual_angles(angles);
+        if (!consistent(angles, NJOINTS) && angles[0] != 0) torn++;
+        for (int i=0; i<NJOINTS; i++) commands[i] = k*1e-3 + i*1e-3;
+        write_command_angles(commands);
+        if (waitpid(pid, &status, WNOHANG) == pid) break;
+    }
+    close_iob();
+
+    printf("controller: torn = %d\n", torn);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || torn) return 1;
+    return 0;
+}
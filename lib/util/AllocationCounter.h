@@ -0,0 +1,78 @@
+// -*- C++ -*-
+#ifndef AllocationCounter_h
+#define AllocationCounter_h
+
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+
+/**
+   \brief counts heap allocations of a test program.
+
+   Allocations are counted while count_allocation is true. With glibc,
+   malloc, calloc, realloc and the aligned variants are replaced, so that
+   allocations which do not go through operator new, e.g. storage of Eigen
+   matrices, are also counted. Otherwise only operator new is counted.
+
+   This header defines malloc and operator new, so it must be included by
+   only one source file of a test program.
+ */
+static bool count_allocation = false;
+static int num_allocation = 0;
+
+#ifdef __GLIBC__
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t nmemb, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+
+    void *malloc(size_t size) __THROW
+    {
+        if (count_allocation) num_allocation++;
+        return __libc_malloc(size);
+    }
+    void *calloc(size_t nmemb, size_t size) __THROW
+    {
+        if (count_allocation) num_allocation++;
+        return __libc_calloc(nmemb, size);
+    }
+    void *realloc(void *ptr, size_t size) __THROW
+    {
+        if (count_allocation) num_allocation++;
+        return __libc_realloc(ptr, size);
+    }
+    void *memalign(size_t alignment, size_t size) __THROW
+    {
+        if (count_allocation) num_allocation++;
+        return __libc_memalign(alignment, size);
+    }
+    int posix_memalign(void **memptr, size_t alignment, size_t size) __THROW
+    {
+        if (count_allocation) num_allocation++;
+        void *p = __libc_memalign(alignment, size);
+        if (!p) return ENOMEM;
+        *memptr = p;
+        return 0;
+    }
+}
+#else
+void *operator new(size_t size)
+{
+    if (count_allocation) num_allocation++;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t size)
+{
+    if (count_allocation) num_allocation++;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) throw() { free(p); }
+void operator delete[](void *p) throw() { free(p); }
+#endif
+
+#endif
@@ -125,6 +125,12 @@ void setConfiguration(RTC::RTObject_var rtc,
 RTC::RTObject_var findRTC(const std::string &rtcName)
 {
     RTC::Manager& manager = RTC::Manager::instance();
+    // components in this process are found without the name server, which
+    // may be shared with other simulator processes or disabled
+    RTC::RTObject_impl *local = manager.getComponent(rtcName.c_str());
+    if (local){
+        return RTC::RTObject::_duplicate(local->getObjRef());
+    }
     std::string nameServer = manager.getConfig()["corba.nameservers"];
     int comPos = nameServer.find(",");
     if (comPos < 0){
@@ -0,0 +1,150 @@
+// -*- C++ -*-
+#ifndef ParameterCell_h
+#define ParameterCell_h
+
+#include <pthread.h>
+
+/**
+   \brief hands off a parameter set from service threads to a real-time
+   thread without blocking it.
+
+   Service threads build a new value and publish it by set() or Writer.
+   The real-time thread calls update() at the beginning of a cycle to pick
+   up the latest published value and reads it by value() until the next
+   update(). Values are kept in three slots(triple buffer) which are
+   swapped atomically, so that update() neither waits, copies nor
+   allocates. Writers are serialized by a mutex which is never taken by
+   the reader. Only one thread may call update() at a time.
+ */
+template <class T>
+class ParameterCell
+{
+public:
+    ParameterCell() { init(); }
+    explicit ParameterCell(const T& i_value)
+    {
+        init();
+        m_latest = i_value;
+        for (int i=0; i<3; i++) m_slots[i] = i_value;
+    }
+    ~ParameterCell() { pthread_mutex_destroy(&m_mutex); }
+
+    /**
+       \brief edits the latest published value and publishes it when
+       destructed
+     */
+    class Writer
+    {
+    public:
+        Writer(ParameterCell& i_cell) : m_cell(i_cell)
+        {
+            pthread_mutex_lock(&m_cell.m_mutex);
+        }
+        ~Writer()
+        {
+            m_cell.publish();
+            pthread_mutex_unlock(&m_cell.m_mutex);
+        }
+        T& operator*() { return m_cell.m_latest; }
+        T* operator->() { return &m_cell.m_latest; }
+    private:
+        Writer(const Writer&);
+        Writer& operator=(const Writer&);
+        ParameterCell& m_cell;
+    };
+
+    /**
+       \brief publish a new value
+       \param i_value new value
+       \return sequence number of the value, which is passed to applied()
+     */
+    unsigned long set(const T& i_value)
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_latest = i_value;
+        unsigned long seq = publish();
+        pthread_mutex_unlock(&m_mutex);
+        return seq;
+    }
+    /**
+       \brief get a copy of the latest published value. It may not have
+       been picked up by the reader yet.
+     */
+    T get() const
+    {
+        pthread_mutex_lock(&m_mutex);
+        T ret(m_latest);
+        pthread_mutex_unlock(&m_mutex);
+        return ret;
+    }
+    /**
+       \brief pick up the latest published value. called by the reader
+       \return true if a new value is picked up
+     */
+    bool update()
+    {
+        if (!(m_middle & FRESH)) return false;
+        m_front = __sync_lock_test_and_set(&m_middle, m_front) & INDEX;
+        m_applied = m_seqs[m_front];
+        return true;
+    }
+    /**
+       \brief the value picked up by the last update(). A reference is
+       valid until the next update().
+     */
+    const T& value() const { return m_slots[m_front]; }
+    /**
+       \brief the value picked up by the last update(). The reader may
+       modify it, e.g. swap its contents with its own members, because
+       writers do not touch the slot until it is released by the next
+       update(). Then memory left in the slot is freed by a writer.
+     */
+    T& value() { return m_slots[m_front]; }
+    /**
+       \brief check if the value of a sequence number or a newer one has
+       been picked up by the reader
+     */
+    bool applied(unsigned long i_seq) const
+    {
+        return (long)(m_applied - i_seq) >= 0;
+    }
+private:
+    enum { INDEX = 3, FRESH = 4 };
+
+    ParameterCell(const ParameterCell&);
+    ParameterCell& operator=(const ParameterCell&);
+
+    void init()
+    {
+        pthread_mutex_init(&m_mutex, NULL);
+        m_front = 0; m_back = 1; m_middle = 2;
+        m_published = m_applied = 0;
+        for (int i=0; i<3; i++) m_seqs[i] = 0;
+    }
+    // called with m_mutex locked
+    unsigned long publish()
+    {
+        m_slots[m_back] = m_latest;
+        m_seqs[m_back] = ++m_published;
+        // the slot must be written before it is handed to the reader
+        __sync_synchronize();
+        m_back = __sync_lock_test_and_set(&m_middle, m_back | FRESH) & INDEX;
+        return m_published;
+    }
+
+    T m_slots[3];
+    unsigned long m_seqs[3];
+    // owned by the reader
+    int m_front;
+    // owned by writers
+    int m_back;
+    T m_latest;
+    unsigned long m_published;
+    // index of the slot between writers and the reader, FRESH is set
+    // when it has not been picked up yet
+    volatile int m_middle;
+    volatile unsigned long m_applied;
+    mutable pthread_mutex_t m_mutex;
+};
+
+#endif // ParameterCell_h
@@ -293,3 +293,16 @@ void initRTS(Project &prj, std::vector<ClockReceiver>& receivers)
         connectPorts(portObj1, portObj2);
     }
 }
+
+void clearRTS(Project &prj)
+{
+    RTC::Manager& manager = RTC::Manager::instance();
+
+    RTSItem& rts = prj.RTS();
+    for (std::map<std::string, RTSItem::rtc>::iterator it 
+             = rts.components.begin(); it != rts.components.end(); it++){
+        RTC::RTObject_impl *rtc = manager.getComponent(it->first.c_str());
+        if (rtc) rtc->exit();
+    }
+    manager.cleanupComponents();
+}
@@ -14,4 +14,7 @@ void initWorld(Project& prj, BodyFactory &factory,
 
 void initRTS(Project &prj, std::vector<ClockReceiver>& receivers);
 
+// exits components of the project which are in this process
+void clearRTS(Project &prj);
+
 
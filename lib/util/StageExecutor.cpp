@@ -0,0 +1,132 @@
+#include "StageExecutor.h"
+#include <iostream>
+#include <cstring>
+#include <sched.h>
+
+StageExecutor::StageExecutor()
+    : m_running(false), m_generation(0), m_jobs(NULL), m_func(NULL),
+      m_arg(NULL), m_next(0), m_arrived(0)
+{
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+StageExecutor::~StageExecutor()
+{
+    stop();
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+bool StageExecutor::start(int i_nworkers, int i_priority,
+                          const std::vector<int>& i_cpus)
+{
+    stop();
+    // workers start from generation 0 even if they are scheduled after
+    // the first stage is issued
+    m_generation = 0;
+    m_running = true;
+    bool ret = true;
+    for (int i=0; i<i_nworkers; i++){
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (i_priority > 0){
+            struct sched_param param;
+            param.sched_priority = i_priority;
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            pthread_attr_setschedparam(&attr, &param);
+        }
+        pthread_t th;
+        int err = pthread_create(&th, &attr, workerMain, this);
+        pthread_attr_destroy(&attr);
+        if (err){
+            // e.g. SCHED_FIFO is not permitted on normal linux kernel.
+            // workers of lower priority would delay the calling thread
+            std::cerr << "StageExecutor: failed to create a worker("
+                      << strerror(err) << ")" << std::endl;
+            ret = false;
+            break;
+        }
+#ifdef __linux__
+        if (!i_cpus.empty()){
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(i_cpus[i % i_cpus.size()], &cpuset);
+            if (pthread_setaffinity_np(th, sizeof(cpuset), &cpuset) != 0){
+                std::cerr << "StageExecutor: failed to pin a worker to CPU "
+                          << i_cpus[i % i_cpus.size()] << std::endl;
+            }
+        }
+#endif
+        m_threads.push_back(th);
+    }
+    if (!ret) stop();
+    return ret;
+}
+
+void StageExecutor::stop()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_running = false;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    for (unsigned int i=0; i<m_threads.size(); i++){
+        pthread_join(m_threads[i], NULL);
+    }
+    m_threads.clear();
+}
+
+void StageExecutor::execute(const std::vector<int>& i_jobs, JobFunc i_func,
+                            void *i_arg)
+{
+    if (m_threads.empty() || i_jobs.size() < 2){
+        for (unsigned int i=0; i<i_jobs.size(); i++) i_func(i_arg, i_jobs[i]);
+        return;
+    }
+    m_jobs = &i_jobs;
+    m_func = i_func;
+    m_arg = i_arg;
+    m_next = 0;
+    m_arrived = 0;
+    pthread_mutex_lock(&m_mutex);
+    m_generation++;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    runJobs();
+    // every worker arrives once per stage so that no worker is left
+    // in this stage when the next one starts
+    while (__sync_fetch_and_add(&m_arrived, 0) < (int)m_threads.size()){
+        sched_yield();
+    }
+}
+
+void StageExecutor::runJobs()
+{
+    int n = m_jobs->size();
+    while (1){
+        int i = __sync_fetch_and_add(&m_next, 1);
+        if (i >= n) break;
+        m_func(m_arg, (*m_jobs)[i]);
+    }
+}
+
+void *StageExecutor::workerMain(void *arg)
+{
+    StageExecutor *self = (StageExecutor *)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&self->m_mutex);
+    while (1){
+        while (self->m_running && self->m_generation == seen){
+            pthread_cond_wait(&self->m_cond, &self->m_mutex);
+        }
+        if (!self->m_running) break;
+        seen = self->m_generation;
+        pthread_mutex_unlock(&self->m_mutex);
+        self->runJobs();
+        __sync_fetch_and_add(&self->m_arrived, 1);
+        pthread_mutex_lock(&self->m_mutex);
+    }
+    pthread_mutex_unlock(&self->m_mutex);
+    return NULL;
+}
@@ -0,0 +1,63 @@
+// -*- C++ -*-
+#ifndef StageExecutor_h
+#define StageExecutor_h
+
+#include <vector>
+#include <pthread.h>
+
+/**
+   \brief executes groups of independent jobs(stages) on a pool of worker
+   threads.
+
+   Stages are executed in order and jobs in a stage are shared between
+   the calling thread and workers, so that a stage finishes before the
+   next one starts. Workers are created by start() and no allocation is
+   done by execute().
+ */
+class StageExecutor
+{
+public:
+    typedef void (*JobFunc)(void *arg, int job);
+
+    StageExecutor();
+    ~StageExecutor();
+    /**
+       \brief create worker threads
+       \param i_nworkers the number of worker threads
+       \param i_priority SCHED_FIFO priority of workers, 0 to inherit
+       \param i_cpus CPUs which workers are pinned to. i-th worker is pinned
+       to i_cpus[i % i_cpus.size()]. empty not to pin.
+       \return true if all workers are created. If i_priority is positive
+       and SCHED_FIFO is not permitted, no worker is left and false is
+       returned, since execute() waits for workers in the calling thread.
+     */
+    bool start(int i_nworkers, int i_priority, const std::vector<int>& i_cpus);
+    /**
+       \brief terminate worker threads
+     */
+    void stop();
+    /**
+       \brief execute a stage
+       \param i_jobs jobs of the stage
+       \param i_func function called for each job
+       \param i_arg argument passed to i_func
+     */
+    void execute(const std::vector<int>& i_jobs, JobFunc i_func, void *i_arg);
+    int workers() const { return m_threads.size(); }
+private:
+    static void *workerMain(void *arg);
+    void runJobs();
+
+    std::vector<pthread_t> m_threads;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    bool m_running;
+    unsigned long m_generation;
+    // the current stage
+    const std::vector<int> *m_jobs;
+    JobFunc m_func;
+    void *m_arg;
+    volatile int m_next, m_arrived;
+};
+
+#endif // StageExecutor_h
@@ -0,0 +1,154 @@
+// -*- C++ -*-
+#ifndef TestUtil_h
+#define TestUtil_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <hrpModel/Body.h>
+#include <hrpModel/Link.h>
+
+/**
+   \brief helpers shared by test programs: a monotonic timer, printing
+   results of checks and a kinematic humanoid made without model files.
+ */
+
+/**
+   \brief monotonic time
+   \return time [s]
+ */
+static inline double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/**
+   \brief prints a result of a check
+   \param cond result
+   \param msg description of the check
+   \return cond
+ */
+inline bool checkResult(const bool cond, const std::string& msg)
+{
+    std::cerr << (cond ? "[ok] " : "[ng] ") << msg << std::endl;
+    return cond;
+}
+
+/**
+   \brief makes a body which has only a root link
+   \param name name of the root link
+   \param jointType FREE_JOINT for a floating base or FIXED_JOINT
+   \param p position of the root link
+   \return the body
+ */
+inline hrp::BodyPtr makeTestBody(const std::string& name, const hrp::Link::JointType jointType, const hrp::Vector3& p)
+{
+    hrp::BodyPtr body(new hrp::Body());
+    hrp::Link* root = new hrp::Link();
+    root->name = name;
+    root->jointId = -1;
+    root->jointType = jointType;
+    root->p = p;
+    root->R = hrp::Matrix33::Identity();
+    body->setRootLink(root);
+    body->updateLinkTree();
+    return body;
+}
+
+/**
+   \brief adds a rotational joint whose range is [-pi/2, pi/2]
+   \param body body
+   \param parent parent link
+   \param name name of the joint
+   \param b position in the parent link
+   \param axis joint axis
+   \param q initial joint angle
+   \return the added link
+ */
+inline hrp::Link* addTestJoint(hrp::BodyPtr& body, hrp::Link* parent, const std::string& name, const hrp::Vector3& b, const hrp::Vector3& axis, const double q)
+{
+    hrp::Link* l = new hrp::Link();
+    l->name = name;
+    l->jointId = body->numJoints();
+    l->jointType = hrp::Link::ROTATIONAL_JOINT;
+    l->b = b;
+    l->a = axis;
+    l->Rs = hrp::Matrix33::Identity();
+    l->p = hrp::Vector3::Zero();
+    l->R = hrp::Matrix33::Identity();
+    l->q = q;
+    l->dq = 0;
+    l->ulimit = M_PI/2;
+    l->llimit = -M_PI/2;
+    l->uvlimit = 10;
+    l->lvlimit = -10;
+    parent->addChild(l);
+    body->updateLinkTree();
+    return l;
+}
+
+/**
+   \brief adds a 6-DOF leg, HIP_Y, HIP_R, HIP_P, KNEE_P, ANKLE_P and ANKLE_R
+   with 0.3[m] thigh and shank, whose knee is bent
+   \param body body
+   \param parent parent link
+   \param prefix prefix of joint names, e.g. "RLEG_"
+   \param b position of the hip in the parent link
+   \return ANKLE_R
+ */
+inline hrp::Link* addTestLeg(hrp::BodyPtr& body, hrp::Link* parent, const std::string& prefix, const hrp::Vector3& b)
+{
+    hrp::Vector3 X(1,0,0), Y(0,1,0), Z(0,0,1);
+    hrp::Link* l = addTestJoint(body, parent, prefix+"HIP_Y", b, Z, 0);
+    l = addTestJoint(body, l, prefix+"HIP_R", hrp::Vector3::Zero(), X, 0);
+    l = addTestJoint(body, l, prefix+"HIP_P", hrp::Vector3::Zero(), Y, -0.3);
+    l = addTestJoint(body, l, prefix+"KNEE_P", hrp::Vector3(0, 0, -0.3), Y, 0.6);
+    l = addTestJoint(body, l, prefix+"ANKLE_P", hrp::Vector3(0, 0, -0.3), Y, -0.3);
+    return addTestJoint(body, l, prefix+"ANKLE_R", hrp::Vector3::Zero(), X, 0);
+}
+
+/**
+   \brief adds a 7-DOF arm, SHOULDER_P, SHOULDER_R, SHOULDER_Y, ELBOW,
+   WRIST_Y, WRIST_P and WRIST_R with 0.25[m] upper arm and forearm, whose
+   elbow is bent
+   \param body body
+   \param parent parent link
+   \param prefix prefix of joint names, e.g. "RARM_"
+   \param b position of the shoulder in the parent link
+   \param side -1 for a right arm, 1 for a left arm
+   \return WRIST_R
+ */
+inline hrp::Link* addTestArm(hrp::BodyPtr& body, hrp::Link* parent, const std::string& prefix, const hrp::Vector3& b, const double side)
+{
+    hrp::Vector3 X(1,0,0), Y(0,1,0), Z(0,0,1);
+    hrp::Link* l = addTestJoint(body, parent, prefix+"SHOULDER_P", b, Y, 0.3);
+    l = addTestJoint(body, l, prefix+"SHOULDER_R", hrp::Vector3::Zero(), X, side*0.2);
+    l = addTestJoint(body, l, prefix+"SHOULDER_Y", hrp::Vector3::Zero(), Z, 0);
+    l = addTestJoint(body, l, prefix+"ELBOW", hrp::Vector3(0, 0, -0.25), Y, -0.8);
+    l = addTestJoint(body, l, prefix+"WRIST_Y", hrp::Vector3::Zero(), Z, 0);
+    l = addTestJoint(body, l, prefix+"WRIST_P", hrp::Vector3(0, 0, -0.25), Y, 0.2);
+    return addTestJoint(body, l, prefix+"WRIST_R", hrp::Vector3::Zero(), X, 0);
+}
+
+/**
+   \brief makes a biped whose root is WAIST with RLEG_ and LLEG_ legs
+   \param root_height height of WAIST
+   \param leg_pos positions of the right and the left foot, whose y are
+   those of hips in WAIST
+   \param ends ANKLE_R of the right and the left leg are stored
+   \return the body
+ */
+inline hrp::BodyPtr makeTestBiped(const double root_height, const std::vector<hrp::Vector3>& leg_pos, hrp::Link* ends[2])
+{
+    hrp::BodyPtr body = makeTestBody("WAIST", hrp::Link::FREE_JOINT, hrp::Vector3(0, 0, root_height));
+    const char* lr[] = {"R", "L"};
+    for (int i = 0; i < 2; i++) {
+        ends[i] = addTestLeg(body, body->rootLink(), std::string(lr[i]) + "LEG_", hrp::Vector3(0, leg_pos[i](1), 0));
+    }
+    return body;
+}
+
+#endif
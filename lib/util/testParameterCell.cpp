@@ -0,0 +1,179 @@
+/* stress test of ParameterCell. Writers keep building and publishing
+   parameter sets while a reader picks them up every 2[ms] like onExecute.
+   The reader must never see a partially written set. The worst-case
+   time to pick up a set is printed together with that of a mutex which
+   is held by writers while they build a set.
+     testParameterCell [--ticks N] [--writers N] [--size N]
+*/
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <time.h>
+#include <pthread.h>
+#include "ParameterCell.h"
+#include "TestUtil.h"
+
+struct Param
+{
+    unsigned long seq;
+    std::vector<double> gains;
+};
+
+static int nsize = 1000;
+static volatile bool running = true;
+static volatile unsigned long nwrites = 0;
+
+// takes about 1[ms] like a service call which prints parameters
+static void build(Param& o_param, unsigned long seq)
+{
+    o_param.seq = seq;
+    o_param.gains.resize(nsize);
+    double start = now();
+    while (now() - start < 1e-3){
+        for (int i=0; i<nsize; i++) o_param.gains[i] = seq;
+    }
+}
+
+static bool consistent(const Param& param)
+{
+    if ((int)param.gains.size() != nsize) return false;
+    for (int i=0; i<nsize; i++){
+        if (param.gains[i] != param.seq) return false;
+    }
+    return true;
+}
+
+static ParameterCell<Param> *cell;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static Param shared;
+
+static void *cellWriter(void *)
+{
+    Param param;
+    while (running){
+        build(param, __sync_add_and_fetch(&nwrites, 1));
+        cell->set(param);
+    }
+    return NULL;
+}
+
+static void *mutexWriter(void *)
+{
+    while (running){
+        pthread_mutex_lock(&mutex);
+        build(shared, __sync_add_and_fetch(&nwrites, 1));
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+// picks up parameter sets every 2[ms] and returns the worst-case time
+static double reader(bool use_cell, int ticks, int& o_updates, int& o_errors)
+{
+    const double dt = 2e-3;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double max_time = 0;
+    unsigned long prev_seq = 0;
+    o_updates = o_errors = 0;
+    for (int i=0; i<ticks; i++){
+        ts.tv_nsec += (long)(dt*1e9);
+        if (ts.tv_nsec >= 1000000000){
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        double t1 = now();
+        unsigned long seq;
+        bool ok;
+        if (use_cell){
+            cell->update();
+            seq = cell->value().seq;
+            ok = consistent(cell->value());
+        }else{
+            pthread_mutex_lock(&mutex);
+            seq = shared.seq;
+            ok = consistent(shared);
+            pthread_mutex_unlock(&mutex);
+        }
+        double t2 = now();
+        if (t2 - t1 > max_time) max_time = t2 - t1;
+        if (seq != prev_seq) o_updates++;
+        if (!ok) o_errors++;
+        prev_seq = seq;
+    }
+    return max_time;
+}
+
+static double run(bool use_cell, int ticks, int nwriters, int& o_updates, int& o_errors)
+{
+    running = true;
+    std::vector<pthread_t> threads(nwriters);
+    for (int i=0; i<nwriters; i++){
+        pthread_create(&threads[i], NULL, use_cell ? cellWriter : mutexWriter, NULL);
+    }
+    double max_time = reader(use_cell, ticks, o_updates, o_errors);
+    running = false;
+    for (int i=0; i<nwriters; i++) pthread_join(threads[i], NULL);
+    return max_time;
+}
+
+int main(int argc, char *argv[])
+{
+    int ticks = 1000, nwriters = 2;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ticks") == 0 && ++i < argc) {
+            ticks = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--writers") == 0 && ++i < argc) {
+            nwriters = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--size") == 0 && ++i < argc) {
+            nsize = atoi(argv[i]);
+        }
+    }
+    Param init;
+    build(init, 0);
+    cell = new ParameterCell<Param>(init);
+    shared = init;
+
+    int updates, errors;
+    bool ret = true;
+    char buf[256];
+
+    double t_mutex = run(false, ticks, nwriters, updates, errors);
+    sprintf(buf, "mutex : worst-case %.3f[ms], %d updates in %d ticks",
+            t_mutex*1e3, updates, ticks);
+    checkResult(true, buf);
+
+    unsigned long written = nwrites;
+    double t_cell = run(true, ticks, nwriters, updates, errors);
+    written = nwrites - written;
+    sprintf(buf, "cell  : worst-case %.3f[ms], %d updates in %d ticks, %lu sets are published, errors = %d",
+            t_cell*1e3, updates, ticks, written, errors);
+    ret &= checkResult(errors == 0 && updates > 0, buf);
+
+    // the latest set is picked up by the next update
+    unsigned long seq = cell->set(init);
+    ret &= checkResult(!cell->applied(seq) && cell->update() && cell->applied(seq)
+                       && !cell->update() && cell->value().seq == 0,
+                       "the latest set is picked up");
+    {
+        ParameterCell<Param>::Writer w(*cell);
+        w->seq = 1;
+        for (int i=0; i<nsize; i++) w->gains[i] = 1;
+    }
+    ret &= checkResult(cell->get().seq == 1 && cell->update() && consistent(cell->value()) && cell->value().seq == 1,
+                       "Writer publishes the edited set");
+
+    // the reader swaps out the picked up set, which is overwritten by the
+    // next set
+    std::vector<double> gains;
+    gains.swap(cell->value().gains);
+    cell->set(init);
+    ret &= checkResult(gains.size() == (size_t)nsize && cell->update() && consistent(cell->value()) && cell->value().seq == 0,
+                       "the reader can swap out the picked up set");
+
+    delete cell;
+    return ret ? 0 : 1;
+}
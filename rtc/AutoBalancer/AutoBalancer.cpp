@@ -66,6 +66,7 @@ AutoBalancer::AutoBalancer(RTC::Manager* manager)
       gait_type(BIPED),
       move_base_gain(0.8),
       m_robot(hrp::BodyPtr()),
+      m_fs_result(0),
       m_debugLevel(0)
 {
     m_service0.autobalancer(this);
@@ -235,6 +236,18 @@ RTC::ReturnCode_t AutoBalancer::onInitialize()
         }
     }
 
+    // whole-body IK, limbs are added in order of ee_vec
+    wbik = wbikPtr(new hrp::WholeBodyIKSolver(m_robot, std::string(m_profile.instance_name)));
+    for (size_t i = 0; i < ee_vec.size(); i++) {
+        wbik->addLimb(ikp[ee_vec[i]].manip);
+    }
+    ik_q_backup.resize(m_robot->numJoints());
+    use_whole_body_ik = false;
+    ik_max_iteration = 1;
+    ik_iteration_count = 0;
+    wbik_failure_count = 0;
+    ik_solve_time = 0;
+
     zmp_offset_interpolator = new interpolator(ikp.size()*3, m_dt);
     zmp_offset_interpolator->setName(std::string(m_profile.instance_name)+" zmp_offset_interpolator");
     zmp_transition_time = 1.0;
@@ -381,7 +394,7 @@ RTC::ReturnCode_t AutoBalancer::onDeactivated(RTC::UniqueId ec_id)
   if (control_mode == MODE_ABC) {
     control_mode = MODE_SYNC_TO_IDLE;
     double tmp_ratio = 0.0;
-    transition_interpolator->go(&tmp_ratio, m_dt, true); // sync in one controller loop
+    transition_interpolator->setGoal(&tmp_ratio, m_dt, true); // sync in one controller loop
   }
   return RTC::RTC_OK;
 }
@@ -443,6 +456,12 @@ RTC::ReturnCode_t AutoBalancer::onExecute(RTC::UniqueId ec_id)
     }
 
     Guard guard(m_mutex);
+    if (m_abcp_cell.update()) commitAutoBalancerParam(m_abcp_cell.value());
+    if (m_fs_cell.update()) {
+      // dropped if walking has ended or the index has been passed since they were sent
+      bool is_overwritten = gg_is_walking && gg->swap_overwrite_foot_steps_list(m_fs_cell.value().fnsl, m_fs_cell.value().overwrite_fs_idx);
+      m_fs_result = is_overwritten ? 1 : -1;
+    }
     hrp::Vector3 ref_basePos;
     hrp::Matrix33 ref_baseRot;
     hrp::Vector3 rel_ref_zmp; // ref zmp in base frame
@@ -916,7 +935,12 @@ void AutoBalancer::fixLegToCoords (const hrp::Vector3& fix_pos, const hrp::Matri
 bool AutoBalancer::solveLimbIKforLimb (ABCIKparam& param)
 {
   param.manip->calcInverseKinematics2Loop(param.target_p0, param.target_r0, 1.0, param.avoid_gain, param.reference_gain, &qrefv, transition_interpolator_ratio * leg_names_interpolator_ratio);
-  // IK check
+  checkLimbIKError(param);
+  return true;
+}
+
+void AutoBalancer::checkLimbIKError (ABCIKparam& param)
+{
   hrp::Vector3 vel_p, vel_r;
   vel_p = param.target_p0 - param.target_link->p;
   rats::difference_rotation(vel_r, param.target_link->R, param.target_r0);
@@ -938,7 +962,6 @@ bool AutoBalancer::solveLimbIKforLimb (ABCIKparam& param)
   } else {
       param.rot_ik_error_count = 0;
   }
-  return true;
 }
 
 void AutoBalancer::solveLimbIK ()
@@ -974,8 +997,42 @@ void AutoBalancer::solveLimbIK ()
   }
   m_robot->calcForwardKinematics();
 
-  for ( std::map<std::string, ABCIKparam>::iterator it = ikp.begin(); it != ikp.end(); it++ ) {
-    if (it->second.is_active) solveLimbIKforLimb(it->second);
+  coil::TimeValue t1(coil::gettimeofday());
+  bool is_solved = false;
+  if (use_whole_body_ik) {
+    for ( int i = 0; i < m_robot->numJoints(); i++ ) ik_q_backup(i) = m_robot->joint(i)->q;
+    // all limbs by one whole-body Jacobian, iterated until pos_ik_thre and rot_ik_thre are satisfied
+    for (size_t i = 0; i < ee_vec.size(); i++) {
+      ABCIKparam& param = ikp[ee_vec[i]];
+      wbik->setLimbTarget(i, param.target_p0, param.target_r0, param.avoid_gain, param.reference_gain);
+    }
+    is_solved = wbik->solve(ik_max_iteration, 1.0, &qrefv, transition_interpolator_ratio * leg_names_interpolator_ratio, pos_ik_thre, rot_ik_thre);
+    ik_iteration_count = wbik->getNumIterations();
+    if (is_solved) {
+      wbik_failure_count = 0;
+      for ( std::map<std::string, ABCIKparam>::iterator it = ikp.begin(); it != ikp.end(); it++ ) {
+        if (it->second.is_active) checkLimbIKError(it->second);
+      }
+    } else {
+      if (wbik_failure_count % ik_error_debug_print_freq == 0) {
+          std::cerr << "[" << m_profile.instance_name << "] Whole-body IK failed, IK of each limb is used, count = " << wbik_failure_count << std::endl;
+      }
+      wbik_failure_count++;
+      for ( int i = 0; i < m_robot->numJoints(); i++ ) m_robot->joint(i)->q = ik_q_backup(i);
+      m_robot->calcForwardKinematics();
+    }
+  }
+  if (!is_solved) {
+    for ( std::map<std::string, ABCIKparam>::iterator it = ikp.begin(); it != ikp.end(); it++ ) {
+      if (it->second.is_active) solveLimbIKforLimb(it->second);
+    }
+    ik_iteration_count = 1;
+  }
+  coil::TimeValue t2(coil::gettimeofday());
+  coil::TimeValue dt = t2-t1;
+  ik_solve_time = dt.sec() + dt.usec()*1e-6;
+  if (DEBUGP) {
+    std::cerr << "[" << m_profile.instance_name << "] IK iterations = " << ik_iteration_count << ", time = " << ik_solve_time*1e3 << "[ms]" << std::endl;
   }
   if (gg_is_walking && !gg_solved) stopWalking ();
 }
@@ -1023,7 +1080,8 @@ void AutoBalancer::startABCparam(const OpenHRP::AutoBalancerService::StrSequence
   transition_interpolator->clear();
   transition_interpolator->set(&tmp_ratio);
   tmp_ratio = 1.0;
-  transition_interpolator->go(&tmp_ratio, transition_time, true);
+  // interpolated online by onExecute, so that no queue is built with m_mutex locked
+  transition_interpolator->setGoal(&tmp_ratio, transition_time, true);
   for ( std::map<std::string, ABCIKparam>::iterator it = ikp.begin(); it != ikp.end(); it++ ) {
     it->second.is_active = false;
   }
@@ -1033,19 +1091,23 @@ void AutoBalancer::startABCparam(const OpenHRP::AutoBalancerService::StrSequence
     tmp.is_active = true;
     std::cerr << "[" << m_profile.instance_name << "]   limb [" << std::string(limbs[i]) << "]" << std::endl;
   }
+  // whole-body IK is laid out here, not in onExecute
+  std::vector<bool> wbik_active(ee_vec.size());
+  for (size_t i = 0; i < ee_vec.size(); i++) wbik_active[i] = ikp[ee_vec[i]].is_active;
+  wbik->setActiveLimbs(wbik_active);
 
   control_mode = MODE_SYNC_TO_ABC;
 }
 
 void AutoBalancer::stopABCparam()
 {
+  // called with m_mutex locked, by stopWalking in onExecute or by stopAutoBalancer
   std::cerr << "[" << m_profile.instance_name << "] stop auto balancer mode" << std::endl;
-  //Guard guard(m_mutex);
   double tmp_ratio = 1.0;
   transition_interpolator->clear();
   transition_interpolator->set(&tmp_ratio);
   tmp_ratio = 0.0;
-  transition_interpolator->go(&tmp_ratio, transition_time, true);
+  transition_interpolator->setGoal(&tmp_ratio, transition_time, true);
   control_mode = MODE_SYNC_TO_IDLE;
 }
 
@@ -1060,6 +1122,8 @@ void AutoBalancer::startWalking ()
     startABCparam(fix_limbs);
     waitABCTransition();
   }
+  std::vector<step_node> init_support_leg_steps, init_swing_leg_dst_steps;
+  hrp::Vector3 init_cog;
   {
     Guard guard(m_mutex);
     has_ik_failed = false;
@@ -1074,12 +1138,17 @@ void AutoBalancer::startWalking ()
     std::set_difference(tmp_all_limbs.begin(), tmp_all_limbs.end(),
                         init_swing_leg_names.begin(), init_swing_leg_names.end(),
                         std::back_inserter(init_support_leg_names));
-    std::vector<step_node> init_support_leg_steps, init_swing_leg_dst_steps;
     for (std::vector<std::string>::iterator it = init_support_leg_names.begin(); it != init_support_leg_names.end(); it++)
         init_support_leg_steps.push_back(step_node(*it, ikp[*it].target_end_coords, 0, 0, 0, 0));
     for (std::vector<std::string>::iterator it = init_swing_leg_names.begin(); it != init_swing_leg_names.end(); it++)
         init_swing_leg_dst_steps.push_back(step_node(*it, ikp[*it].target_end_coords, 0, 0, 0, 0));
     gg->set_default_zmp_offsets(default_zmp_offsets);
+    init_cog = ref_cog;
+  }
+  // solve the riccati equation of the preview controller without locking m_mutex
+  gg->prepare_preview_controller(init_cog, init_support_leg_steps, init_swing_leg_dst_steps);
+  {
+    Guard guard(m_mutex);
     gg->initialize_gait_parameter(ref_cog, init_support_leg_steps, init_swing_leg_dst_steps);
   }
   is_hand_fix_initial = true;
@@ -1122,7 +1191,10 @@ bool AutoBalancer::startAutoBalancer (const OpenHRP::AutoBalancerService::StrSeq
 bool AutoBalancer::stopAutoBalancer ()
 {
   if (control_mode == MODE_ABC) {
-    stopABCparam();
+    {
+      Guard guard(m_mutex);
+      stopABCparam();
+    }
     waitABCTransition();
     return true;
   } else {
@@ -1248,24 +1320,27 @@ bool AutoBalancer::setFootStepsWithParam(const OpenHRP::AutoBalancerService::Foo
         // Initial footstep Snapping
         coordinates tmpfs, fstrans;
         step_node initial_support_step, initial_input_step;
+        bool is_walking, is_valid_index = true;
+        std::vector<std::string> cur_leg_names;
         {
+            // states of onExecute are copied with m_mutex locked, and footsteps are built without it
+            Guard guard(m_mutex);
+            is_walking = gg_is_walking;
+            cur_leg_names = leg_names;
             std::vector<step_node> initial_support_steps;
-            if (gg_is_walking) {
-                if (overwrite_fs_idx <= 0) {
-                    std::cerr << "[" << m_profile.instance_name << "]   Invalid overwrite index = " << overwrite_fs_idx << std::endl;
-                    return false;
-                }
-                if (!gg->get_footstep_nodes_by_index(initial_support_steps, overwrite_fs_idx-1)) {
-                    std::cerr << "[" << m_profile.instance_name << "]   Invalid overwrite index = " << overwrite_fs_idx << std::endl;
-                    return false;
-                }
+            if (is_walking) {
+                is_valid_index = (overwrite_fs_idx > 0 && gg->get_footstep_nodes_by_index(initial_support_steps, overwrite_fs_idx-1));
             } else {
                 // If walking, snap initial leg to current ABC foot coords.
                 for (size_t i = 0; i < fss[0].fs.length(); i++) {
                     initial_support_steps.push_back(step_node(std::string(fss[0].fs[i].leg), ikp[std::string(fss[0].fs[i].leg)].target_end_coords, 0, 0, 0, 0));
                 }
             }
-            initial_support_step = initial_support_steps.front(); /* use only one leg for representation */
+            if (is_valid_index) initial_support_step = initial_support_steps.front(); /* use only one leg for representation */
+        }
+        if (!is_valid_index) {
+            std::cerr << "[" << m_profile.instance_name << "]   Invalid overwrite index = " << overwrite_fs_idx << std::endl;
+            return false;
         }
         {
             std::map<leg_type, std::string> leg_type_map = gg->get_leg_type_map();
@@ -1287,7 +1362,7 @@ bool AutoBalancer::setFootStepsWithParam(const OpenHRP::AutoBalancerService::Foo
             std::vector<std::string> leg_name_vec;
             for (size_t j = 0; j < fss[i].fs.length(); j++) {
                 std::string leg(fss[i].fs[j].leg);
-                if (std::find(leg_names.begin(), leg_names.end(), leg) != leg_names.end()) {
+                if (std::find(cur_leg_names.begin(), cur_leg_names.end(), leg) != cur_leg_names.end()) {
                     memcpy(tmpfs.pos.data(), fss[i].fs[j].pos, sizeof(double)*3);
                     tmpfs.rot = (Eigen::Quaternion<double>(fss[i].fs[j].rot[0], fss[i].fs[j].rot[1], fss[i].fs[j].rot[2], fss[i].fs[j].rot[3])).normalized().toRotationMatrix(); // rtc: (x, y, z, w) but eigen: (w, x, y, z)
                     initial_input_step.worldcoords.transformation(fstrans, tmpfs);
@@ -1310,7 +1385,7 @@ bool AutoBalancer::setFootStepsWithParam(const OpenHRP::AutoBalancerService::Foo
         std::cerr << "[" << m_profile.instance_name << "] print footsteps " << std::endl;
         std::vector< std::vector<step_node> > fnsl;
         for (size_t i = 0; i < fs_vec_list.size(); i++) {
-            if (!(gg_is_walking && i == 0)) { // If initial footstep, e.g., not walking, pass user-defined footstep list. If walking, pass cdr footsteps in order to neglect initial double support leg.
+            if (!(is_walking && i == 0)) { // If initial footstep, e.g., not walking, pass user-defined footstep list. If walking, pass cdr footsteps in order to neglect initial double support leg.
                 std::vector<step_node> tmp_fns;
                 for (size_t j = 0; j < fs_vec_list.at(i).size(); j++) {
                     tmp_fns.push_back(step_node(leg_name_vec_list[i][j], fs_vec_list[i][j], spss[i].sps[j].step_height, spss[i].sps[j].step_time, spss[i].sps[j].toe_angle, spss[i].sps[j].heel_angle));
@@ -1318,13 +1393,31 @@ bool AutoBalancer::setFootStepsWithParam(const OpenHRP::AutoBalancerService::Foo
                 fnsl.push_back(tmp_fns);
             }
         }
-        if (gg_is_walking) {
+        gg->append_finalize_footstep(fnsl);
+        if (is_walking) {
             std::cerr << "[" << m_profile.instance_name << "]  Set overwrite footsteps" << std::endl;
-            gg->set_overwrite_foot_steps_list(fnsl);
-            gg->set_overwrite_foot_step_index(overwrite_fs_idx);
+            gg->print_footstep_nodes_list(fnsl);
+            // onExecute swaps them into gg, so that this call never blocks it,
+            // and the result is waited for here
+            Guard fs_guard(m_fs_mutex);
+            m_fs_result = 0;
+            {
+                ParameterCell<ABCFootStepsUpdate>::Writer fs(m_fs_cell);
+                fs->fnsl.swap(fnsl);
+                fs->overwrite_fs_idx = overwrite_fs_idx;
+            }
+            while (m_fs_result == 0) usleep(1000);
+            if (m_fs_result < 0) {
+                std::cerr << "[" << m_profile.instance_name << "]   Overwrite footsteps dropped, walking has ended or overwrite index = " << overwrite_fs_idx << " has been passed" << std::endl;
+                return false;
+            }
         } else {
             std::cerr << "[" << m_profile.instance_name << "]  Set normal footsteps" << std::endl;
-            gg->set_foot_steps_list(fnsl);
+            gg->print_footstep_nodes_list(fnsl);
+            {
+                Guard guard(m_mutex);
+                gg->swap_foot_steps_list(fnsl);
+            }
             startWalking();
         }
         return true;
@@ -1355,62 +1448,70 @@ void AutoBalancer::waitFootStepsEarly(const double tm)
 bool AutoBalancer::setGaitGeneratorParam(const OpenHRP::AutoBalancerService::GaitGeneratorParam& i_param)
 {
   std::cerr << "[" << m_profile.instance_name << "] setGaitGeneratorParam" << std::endl;
-  gg->set_stride_parameters(i_param.stride_parameter[0], i_param.stride_parameter[1], i_param.stride_parameter[2], i_param.stride_parameter[3]);
+  // containers are built and toe_heel_phase_ratio, which is printed when
+  // validated, is set without m_mutex, and the other setters are called
+  // with m_mutex locked
   std::vector<hrp::Vector3> off;
   for (size_t i = 0; i < i_param.leg_default_translate_pos.length(); i++) {
       off.push_back(hrp::Vector3(i_param.leg_default_translate_pos[i][0], i_param.leg_default_translate_pos[i][1], i_param.leg_default_translate_pos[i][2]));
   }
-  gg->set_leg_default_translate_pos(off);
-  gg->set_default_step_time(i_param.default_step_time);
-  gg->set_default_step_height(i_param.default_step_height);
-  gg->set_default_double_support_ratio_before(i_param.default_double_support_ratio/2.0);
-  gg->set_default_double_support_ratio_after(i_param.default_double_support_ratio/2.0);
-  gg->set_default_double_support_static_ratio_before(i_param.default_double_support_static_ratio/2.0);
-  gg->set_default_double_support_static_ratio_after(i_param.default_double_support_static_ratio/2.0);
-  gg->set_default_double_support_ratio_swing_before(i_param.default_double_support_ratio/2.0);
-  gg->set_default_double_support_ratio_swing_after(i_param.default_double_support_ratio/2.0);
-  // gg->set_default_double_support_ratio_before(i_param.default_double_support_ratio_before);
-  // gg->set_default_double_support_ratio_after(i_param.default_double_support_ratio_after);
-  // gg->set_default_double_support_static_ratio_before(i_param.default_double_support_static_ratio_before);
-  // gg->set_default_double_support_static_ratio_after(i_param.default_double_support_static_ratio_after);
-  // gg->set_default_double_support_ratio_swing_before(i_param.default_double_support_ratio_before);
-  // gg->set_default_double_support_ratio_swing_after(i_param.default_double_support_ratio_after);
-  // gg->set_default_double_support_ratio_swing_before(i_param.default_double_support_ratio_swing_before);
-  // gg->set_default_double_support_ratio_swing_after(i_param.default_double_support_ratio_swing_after);
-  if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::SHUFFLING) {
-    gg->set_default_orbit_type(SHUFFLING);
-  } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CYCLOID) {
-    gg->set_default_orbit_type(CYCLOID);
-  } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::RECTANGLE) {
-    gg->set_default_orbit_type(RECTANGLE);
-  } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::STAIR) {
-    gg->set_default_orbit_type(STAIR);
-  } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CYCLOIDDELAY) {
-    gg->set_default_orbit_type(CYCLOIDDELAY);
-  } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CYCLOIDDELAYKICK) {
-    gg->set_default_orbit_type(CYCLOIDDELAYKICK);
-  } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CROSS) {
-    gg->set_default_orbit_type(CROSS);
-  }
-  gg->set_swing_trajectory_delay_time_offset(i_param.swing_trajectory_delay_time_offset);
-  gg->set_swing_trajectory_final_distance_weight(i_param.swing_trajectory_final_distance_weight);
-  gg->set_stair_trajectory_way_point_offset(hrp::Vector3(i_param.stair_trajectory_way_point_offset[0], i_param.stair_trajectory_way_point_offset[1], i_param.stair_trajectory_way_point_offset[2]));
-  gg->set_cycloid_delay_kick_point_offset(hrp::Vector3(i_param.cycloid_delay_kick_point_offset[0], i_param.cycloid_delay_kick_point_offset[1], i_param.cycloid_delay_kick_point_offset[2]));  
-  gg->set_gravitational_acceleration(i_param.gravitational_acceleration);
-  gg->set_toe_angle(i_param.toe_angle);
-  gg->set_heel_angle(i_param.heel_angle);
-  gg->set_toe_pos_offset_x(i_param.toe_pos_offset_x);
-  gg->set_heel_pos_offset_x(i_param.heel_pos_offset_x);
-  gg->set_toe_zmp_offset_x(i_param.toe_zmp_offset_x);
-  gg->set_heel_zmp_offset_x(i_param.heel_zmp_offset_x);
+  std::map<leg_type, double> zmp_weight_map = boost::assign::map_list_of<leg_type, double>(RLEG, i_param.zmp_weight_map[0])(LLEG, i_param.zmp_weight_map[1])(RARM, i_param.zmp_weight_map[2])(LARM, i_param.zmp_weight_map[3]);
   std::vector<double> tmp_ratio(i_param.toe_heel_phase_ratio.get_buffer(), i_param.toe_heel_phase_ratio.get_buffer()+i_param.toe_heel_phase_ratio.length());
   std::cerr << "[" << m_profile.instance_name << "]   "; // for set_toe_heel_phase_ratio
   gg->set_toe_heel_phase_ratio(tmp_ratio);
-  gg->set_use_toe_joint(i_param.use_toe_joint);
-  gg->set_use_toe_heel_transition(i_param.use_toe_heel_transition);
-  gg->set_zmp_weight_map(boost::assign::map_list_of<leg_type, double>(RLEG, i_param.zmp_weight_map[0])(LLEG, i_param.zmp_weight_map[1])(RARM, i_param.zmp_weight_map[2])(LARM, i_param.zmp_weight_map[3]));
-  gg->set_optional_go_pos_finalize_footstep_num(i_param.optional_go_pos_finalize_footstep_num);
-  gg->set_overwritable_footstep_index_offset(i_param.overwritable_footstep_index_offset);
+  {
+    Guard guard(m_mutex);
+    gg->set_stride_parameters(i_param.stride_parameter[0], i_param.stride_parameter[1], i_param.stride_parameter[2], i_param.stride_parameter[3]);
+    gg->set_leg_default_translate_pos(off);
+    gg->set_default_step_time(i_param.default_step_time);
+    gg->set_default_step_height(i_param.default_step_height);
+    gg->set_default_double_support_ratio_before(i_param.default_double_support_ratio/2.0);
+    gg->set_default_double_support_ratio_after(i_param.default_double_support_ratio/2.0);
+    gg->set_default_double_support_static_ratio_before(i_param.default_double_support_static_ratio/2.0);
+    gg->set_default_double_support_static_ratio_after(i_param.default_double_support_static_ratio/2.0);
+    gg->set_default_double_support_ratio_swing_before(i_param.default_double_support_ratio/2.0);
+    gg->set_default_double_support_ratio_swing_after(i_param.default_double_support_ratio/2.0);
+    // gg->set_default_double_support_ratio_before(i_param.default_double_support_ratio_before);
+    // gg->set_default_double_support_ratio_after(i_param.default_double_support_ratio_after);
+    // gg->set_default_double_support_static_ratio_before(i_param.default_double_support_static_ratio_before);
+    // gg->set_default_double_support_static_ratio_after(i_param.default_double_support_static_ratio_after);
+    // gg->set_default_double_support_ratio_swing_before(i_param.default_double_support_ratio_before);
+    // gg->set_default_double_support_ratio_swing_after(i_param.default_double_support_ratio_after);
+    // gg->set_default_double_support_ratio_swing_before(i_param.default_double_support_ratio_swing_before);
+    // gg->set_default_double_support_ratio_swing_after(i_param.default_double_support_ratio_swing_after);
+    if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::SHUFFLING) {
+      gg->set_default_orbit_type(SHUFFLING);
+    } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CYCLOID) {
+      gg->set_default_orbit_type(CYCLOID);
+    } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::RECTANGLE) {
+      gg->set_default_orbit_type(RECTANGLE);
+    } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::STAIR) {
+      gg->set_default_orbit_type(STAIR);
+    } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CYCLOIDDELAY) {
+      gg->set_default_orbit_type(CYCLOIDDELAY);
+    } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CYCLOIDDELAYKICK) {
+      gg->set_default_orbit_type(CYCLOIDDELAYKICK);
+    } else if (i_param.default_orbit_type == OpenHRP::AutoBalancerService::CROSS) {
+      gg->set_default_orbit_type(CROSS);
+    }
+    gg->set_swing_trajectory_delay_time_offset(i_param.swing_trajectory_delay_time_offset);
+    gg->set_swing_trajectory_final_distance_weight(i_param.swing_trajectory_final_distance_weight);
+    gg->set_stair_trajectory_way_point_offset(hrp::Vector3(i_param.stair_trajectory_way_point_offset[0], i_param.stair_trajectory_way_point_offset[1], i_param.stair_trajectory_way_point_offset[2]));
+    gg->set_cycloid_delay_kick_point_offset(hrp::Vector3(i_param.cycloid_delay_kick_point_offset[0], i_param.cycloid_delay_kick_point_offset[1], i_param.cycloid_delay_kick_point_offset[2]));  
+    gg->set_gravitational_acceleration(i_param.gravitational_acceleration);
+    gg->set_toe_angle(i_param.toe_angle);
+    gg->set_heel_angle(i_param.heel_angle);
+    gg->set_toe_pos_offset_x(i_param.toe_pos_offset_x);
+    gg->set_heel_pos_offset_x(i_param.heel_pos_offset_x);
+    gg->set_toe_zmp_offset_x(i_param.toe_zmp_offset_x);
+    gg->set_heel_zmp_offset_x(i_param.heel_zmp_offset_x);
+    gg->set_use_toe_joint(i_param.use_toe_joint);
+    gg->set_use_toe_heel_transition(i_param.use_toe_heel_transition);
+    gg->set_zmp_weight_map(zmp_weight_map);
+    gg->set_optional_go_pos_finalize_footstep_num(i_param.optional_go_pos_finalize_footstep_num);
+    gg->set_overwritable_footstep_index_offset(i_param.overwritable_footstep_index_offset);
+    gg->set_overwrite_refzmp_queue_num_per_tick(i_param.overwrite_refzmp_queue_num_per_tick);
+  }
 
   // print
   gg->print_param(std::string(m_profile.instance_name));
@@ -1480,149 +1581,152 @@ bool AutoBalancer::getGaitGeneratorParam(OpenHRP::AutoBalancerService::GaitGener
   i_param.zmp_weight_map[3] = tmp_zmp_weight_map[LARM];
   i_param.optional_go_pos_finalize_footstep_num = gg->get_optional_go_pos_finalize_footstep_num();
   i_param.overwritable_footstep_index_offset = gg->get_overwritable_footstep_index_offset();
+  i_param.overwrite_refzmp_queue_num_per_tick = gg->get_overwrite_refzmp_queue_num_per_tick();
   return true;
 };
 
 bool AutoBalancer::setAutoBalancerParam(const OpenHRP::AutoBalancerService::AutoBalancerParam& i_param)
 {
-  Guard guard(m_mutex);
+  // parameters are validated, printed and converted here, and onExecute
+  // only swaps them into members, so that this call never blocks onExecute
+  ParameterCell<ABCParamUpdate>::Writer abcp(m_abcp_cell);
+  prepareAutoBalancerParam(i_param, *abcp);
+  return true;
+}
+
+void AutoBalancer::prepareAutoBalancerParam(const OpenHRP::AutoBalancerService::AutoBalancerParam& i_param, ABCParamUpdate& o_param)
+{
+  // members which are read here are set only in onInitialize, or they are
+  // only printed
   std::cerr << "[" << m_profile.instance_name << "] setAutoBalancerParam" << std::endl;
-  double *default_zmp_offsets_array = new double[ikp.size()*3];
-  move_base_gain = i_param.move_base_gain;
+  o_param.move_base_gain = i_param.move_base_gain;
+  o_param.default_zmp_offsets.resize(ikp.size()*3);
   for (size_t i = 0; i < ikp.size(); i++)
     for (size_t j = 0; j < 3; j++)
-      default_zmp_offsets_array[i*3+j] = i_param.default_zmp_offsets[i][j];
-  zmp_transition_time = i_param.zmp_transition_time;
-  adjust_footstep_transition_time = i_param.adjust_footstep_transition_time;
-  if (zmp_offset_interpolator->isEmpty()) {
-      zmp_offset_interpolator->clear();
-      zmp_offset_interpolator->go(default_zmp_offsets_array, zmp_transition_time, true);
-  } else {
+      o_param.default_zmp_offsets[i*3+j] = i_param.default_zmp_offsets[i][j];
+  o_param.zmp_transition_time = i_param.zmp_transition_time;
+  o_param.adjust_footstep_transition_time = i_param.adjust_footstep_transition_time;
+  if (!zmp_offset_interpolator->isEmpty()) {
       std::cerr << "[" << m_profile.instance_name << "]   default_zmp_offsets cannot be set because interpolating." << std::endl;
   }
-  if (control_mode == MODE_IDLE) {
-    switch (i_param.use_force_mode) {
-    case OpenHRP::AutoBalancerService::MODE_NO_FORCE:
-        use_force = MODE_NO_FORCE;
-        break;
-    case OpenHRP::AutoBalancerService::MODE_REF_FORCE:
-        use_force = MODE_REF_FORCE;
-        break;
-    default:
-        break;
-    }
-  } else {
+  o_param.use_force_mode = i_param.use_force_mode;
+  o_param.is_use_force_mode_set = (control_mode == MODE_IDLE);
+  if (!o_param.is_use_force_mode_set) {
       std::cerr << "[" << m_profile.instance_name << "]   use_force_mode cannot be changed to [" << i_param.use_force_mode << "] during MODE_ABC, MODE_SYNC_TO_IDLE or MODE_SYNC_TO_ABC." << std::endl;
   }
-  graspless_manip_mode = i_param.graspless_manip_mode;
-  graspless_manip_arm = std::string(i_param.graspless_manip_arm);
+  o_param.graspless_manip_mode = i_param.graspless_manip_mode;
+  o_param.graspless_manip_arm = std::string(i_param.graspless_manip_arm);
   for (size_t j = 0; j < 3; j++)
-      graspless_manip_p_gain[j] = i_param.graspless_manip_p_gain[j];
+      o_param.graspless_manip_p_gain[j] = i_param.graspless_manip_p_gain[j];
   for (size_t j = 0; j < 3; j++)
-      graspless_manip_reference_trans_coords.pos[j] = i_param.graspless_manip_reference_trans_pos[j];
-  graspless_manip_reference_trans_coords.rot = (Eigen::Quaternion<double>(i_param.graspless_manip_reference_trans_rot[0],
-                                                                          i_param.graspless_manip_reference_trans_rot[1],
-                                                                          i_param.graspless_manip_reference_trans_rot[2],
-                                                                          i_param.graspless_manip_reference_trans_rot[3]).normalized().toRotationMatrix()); // rtc: (x, y, z, w) but eigen: (w, x, y, z)
-  transition_time = i_param.transition_time;
-  std::vector<std::string> cur_leg_names, dst_leg_names;
-  cur_leg_names = leg_names;
+      o_param.graspless_manip_reference_trans_coords.pos[j] = i_param.graspless_manip_reference_trans_pos[j];
+  o_param.graspless_manip_reference_trans_coords.rot = (Eigen::Quaternion<double>(i_param.graspless_manip_reference_trans_rot[0],
+                                                                                  i_param.graspless_manip_reference_trans_rot[1],
+                                                                                  i_param.graspless_manip_reference_trans_rot[2],
+                                                                                  i_param.graspless_manip_reference_trans_rot[3]).normalized().toRotationMatrix()); // rtc: (x, y, z, w) but eigen: (w, x, y, z)
+  o_param.transition_time = i_param.transition_time;
+  o_param.leg_names.clear();
   for (size_t i = 0; i < i_param.leg_names.length(); i++) {
-      dst_leg_names.push_back(std::string(i_param.leg_names[i]));
-  }
-  std::sort(cur_leg_names.begin(), cur_leg_names.end());
-  std::sort(dst_leg_names.begin(), dst_leg_names.end());
-  if (cur_leg_names != dst_leg_names) {
-      if (leg_names_interpolator->isEmpty()) {
-          leg_names.clear();
-          leg_names = dst_leg_names;
-          if (control_mode == MODE_ABC) {
-              double tmp_ratio = 0.0;
-              leg_names_interpolator->set(&tmp_ratio);
-              tmp_ratio = 1.0;
-              leg_names_interpolator->go(&tmp_ratio, 5.0, true);
-              control_mode = MODE_SYNC_TO_ABC;
-          }
-      }
-  } else {
+      o_param.leg_names.push_back(std::string(i_param.leg_names[i]));
+  }
+  std::sort(o_param.leg_names.begin(), o_param.leg_names.end());
+  if (!leg_names_interpolator->isEmpty()) {
       std::cerr << "[" << m_profile.instance_name << "]   leg_names cannot be set because interpolating." << std::endl;
   }
-  pos_ik_thre = i_param.pos_ik_thre;
-  rot_ik_thre = i_param.rot_ik_thre;
+  o_param.pos_ik_thre = i_param.pos_ik_thre;
+  o_param.rot_ik_thre = i_param.rot_ik_thre;
+  o_param.use_whole_body_ik = i_param.use_whole_body_ik;
+  o_param.is_ik_max_iteration_set = (i_param.ik_max_iteration > 0);
+  if (o_param.is_ik_max_iteration_set) {
+      o_param.ik_max_iteration = i_param.ik_max_iteration;
+  } else {
+      std::cerr << "[" << m_profile.instance_name << "]   ik_max_iteration should be positive (input = " << i_param.ik_max_iteration << ")" << std::endl;
+  }
+  o_param.is_hand_fix_mode = i_param.is_hand_fix_mode;
   if (!gg_is_walking) {
-      is_hand_fix_mode = i_param.is_hand_fix_mode;
-      std::cerr << "[" << m_profile.instance_name << "]   is_hand_fix_mode = " << is_hand_fix_mode << std::endl;
+      std::cerr << "[" << m_profile.instance_name << "]   is_hand_fix_mode = " << o_param.is_hand_fix_mode << std::endl;
   } else {
       std::cerr << "[" << m_profile.instance_name << "]   is_hand_fix_mode cannot be set in (gg_is_walking = true). Current is_hand_fix_mode is " << (is_hand_fix_mode?"true":"false") << std::endl;
   }
+  o_param.end_effector_names.clear();
+  o_param.end_effector_localPos.clear();
+  o_param.end_effector_localR.clear();
   if (control_mode == MODE_IDLE) {
       for (size_t i = 0; i < i_param.end_effector_list.length(); i++) {
-          std::map<std::string, ABCIKparam>::iterator it = ikp.find(std::string(i_param.end_effector_list[i].leg));
-          memcpy(it->second.localPos.data(), i_param.end_effector_list[i].pos, sizeof(double)*3);
-          it->second.localR = (Eigen::Quaternion<double>(i_param.end_effector_list[i].rot[0], i_param.end_effector_list[i].rot[1], i_param.end_effector_list[i].rot[2], i_param.end_effector_list[i].rot[3])).normalized().toRotationMatrix();
+          std::string leg(i_param.end_effector_list[i].leg);
+          if (ikp.find(leg) == ikp.end()) {
+              std::cerr << "[" << m_profile.instance_name << "]   No such end-effector : " << leg << std::endl;
+              continue;
+          }
+          hrp::Vector3 localPos;
+          memcpy(localPos.data(), i_param.end_effector_list[i].pos, sizeof(double)*3);
+          o_param.end_effector_names.push_back(leg);
+          o_param.end_effector_localPos.push_back(localPos);
+          o_param.end_effector_localR.push_back((Eigen::Quaternion<double>(i_param.end_effector_list[i].rot[0], i_param.end_effector_list[i].rot[1], i_param.end_effector_list[i].rot[2], i_param.end_effector_list[i].rot[3])).normalized().toRotationMatrix());
       }
   } else {
       std::cerr << "[" << m_profile.instance_name << "] cannot change end-effectors except during MODE_IDLE" << std::endl;
   }
-  if (i_param.default_gait_type == OpenHRP::AutoBalancerService::BIPED) {
-      gait_type = BIPED;
-  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::TROT) {
-      gait_type = TROT;
-  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::PACE) {
-      gait_type = PACE;
-  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::CRAWL) {
-      gait_type = CRAWL;
-  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::GALLOP) {
-      gait_type = GALLOP;
-  }
+  o_param.default_gait_type = i_param.default_gait_type;
   for (std::map<std::string, ABCIKparam>::iterator it = ikp.begin(); it != ikp.end(); it++) {
+      hrp::Vector3 localPos(it->second.localPos);
+      hrp::Matrix33 localR(it->second.localR);
+      for (size_t i = 0; i < o_param.end_effector_names.size(); i++) {
+          if (o_param.end_effector_names[i] == it->first) {
+              localPos = o_param.end_effector_localPos[i];
+              localR = o_param.end_effector_localR[i];
+          }
+      }
       std::cerr << "[" << m_profile.instance_name << "] End Effector [" << it->first << "]" << std::endl;
-      std::cerr << "[" << m_profile.instance_name << "]   localpos = " << it->second.localPos.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[m]" << std::endl;
-      std::cerr << "[" << m_profile.instance_name << "]   localR = " << it->second.localR.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
+      std::cerr << "[" << m_profile.instance_name << "]   localpos = " << localPos.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[m]" << std::endl;
+      std::cerr << "[" << m_profile.instance_name << "]   localR = " << localR.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
   }
 
-  std::cerr << "[" << m_profile.instance_name << "]   move_base_gain = " << move_base_gain << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   move_base_gain = " << o_param.move_base_gain << std::endl;
   std::cerr << "[" << m_profile.instance_name << "]   default_zmp_offsets = ";
   for (size_t i = 0; i < ikp.size() * 3; i++) {
-      std::cerr << default_zmp_offsets_array[i] << " ";
+      std::cerr << o_param.default_zmp_offsets[i] << " ";
   }
   std::cerr << std::endl;
-  delete[] default_zmp_offsets_array;
-  std::cerr << "[" << m_profile.instance_name << "]   use_force_mode = " << use_force << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_mode = " << graspless_manip_mode << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_arm = " << graspless_manip_arm << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_p_gain = " << graspless_manip_p_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_reference_trans_pos = " << graspless_manip_reference_trans_coords.pos.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_reference_trans_rot = " << graspless_manip_reference_trans_coords.rot.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   transition_time = " << transition_time << "[s], zmp_transition_time = " << zmp_transition_time << "[s], adjust_footstep_transition_time = " << adjust_footstep_transition_time << "[s]" << std::endl;
-  for (std::vector<std::string>::iterator it = leg_names.begin(); it != leg_names.end(); it++) std::cerr << "[" << m_profile.instance_name << "]   leg_names [" << *it << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   pos_ik_thre = " << pos_ik_thre << "[m], rot_ik_thre = " << rot_ik_thre << "[rad]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   default_gait_type = " << gait_type << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   use_force_mode = " << (o_param.is_use_force_mode_set ? static_cast<int>(o_param.use_force_mode) : static_cast<int>(use_force)) << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_mode = " << o_param.graspless_manip_mode << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_arm = " << o_param.graspless_manip_arm << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_p_gain = " << o_param.graspless_manip_p_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_reference_trans_pos = " << o_param.graspless_manip_reference_trans_coords.pos.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   graspless_manip_reference_trans_rot = " << o_param.graspless_manip_reference_trans_coords.rot.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   transition_time = " << o_param.transition_time << "[s], zmp_transition_time = " << o_param.zmp_transition_time << "[s], adjust_footstep_transition_time = " << o_param.adjust_footstep_transition_time << "[s]" << std::endl;
+  for (std::vector<std::string>::iterator it = o_param.leg_names.begin(); it != o_param.leg_names.end(); it++) std::cerr << "[" << m_profile.instance_name << "]   leg_names [" << *it << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   pos_ik_thre = " << o_param.pos_ik_thre << "[m], rot_ik_thre = " << o_param.rot_ik_thre << "[rad]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   use_whole_body_ik = " << (o_param.use_whole_body_ik?"true":"false") << ", ik_max_iteration = " << (o_param.is_ik_max_iteration_set ? o_param.ik_max_iteration : ik_max_iteration) << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   default_gait_type = " << o_param.default_gait_type << std::endl;
   // IK limb parameters
   std::cerr << "[" << m_profile.instance_name << "]  IK limb parameters" << std::endl;
-  bool is_ik_limb_parameter_valid_length = true;
+  o_param.is_ik_limb_parameter_valid = true;
   if (i_param.ik_limb_parameters.length() != ee_vec.size()) {
-      is_ik_limb_parameter_valid_length = false;
+      o_param.is_ik_limb_parameter_valid = false;
       std::cerr << "[" << m_profile.instance_name << "]   ik_limb_parameters invalid length! Cannot be set. (input = " << i_param.ik_limb_parameters.length() << ", desired = " << ee_vec.size() << ")" << std::endl;
   } else {
       for (size_t i = 0; i < ee_vec.size(); i++) {
           if (ikp[ee_vec[i]].manip->numJoints() != i_param.ik_limb_parameters[i].ik_optional_weight_vector.length())
-              is_ik_limb_parameter_valid_length = false;
+              o_param.is_ik_limb_parameter_valid = false;
       }
-      if (is_ik_limb_parameter_valid_length) {
+      if (o_param.is_ik_limb_parameter_valid) {
+          o_param.ik_optional_weight_vectors.resize(ee_vec.size());
+          o_param.sr_gains.resize(ee_vec.size());
+          o_param.avoid_gains.resize(ee_vec.size());
+          o_param.reference_gains.resize(ee_vec.size());
+          o_param.manipulability_limits.resize(ee_vec.size());
           for (size_t i = 0; i < ee_vec.size(); i++) {
-              ABCIKparam& param = ikp[ee_vec[i]];
               const OpenHRP::AutoBalancerService::IKLimbParameters& ilp = i_param.ik_limb_parameters[i];
-              std::vector<double> ov;
-              ov.resize(param.manip->numJoints());
-              for (size_t j = 0; j < param.manip->numJoints(); j++) {
+              std::vector<double>& ov = o_param.ik_optional_weight_vectors[i];
+              ov.resize(ikp[ee_vec[i]].manip->numJoints());
+              for (size_t j = 0; j < ov.size(); j++) {
                   ov[j] = ilp.ik_optional_weight_vector[j];
               }
-              param.manip->setOptionalWeightVector(ov);
-              param.manip->setSRGain(ilp.sr_gain);
-              param.avoid_gain = ilp.avoid_gain;
-              param.reference_gain = ilp.reference_gain;
-              param.manip->setManipulabilityLimit(ilp.manipulability_limit);
+              o_param.sr_gains[i] = ilp.sr_gain;
+              o_param.avoid_gains[i] = ilp.avoid_gain;
+              o_param.reference_gains[i] = ilp.reference_gain;
+              o_param.manipulability_limits[i] = ilp.manipulability_limit;
           }
       } else {
           std::cerr << "[" << m_profile.instance_name << "]   ik_optional_weight_vector invalid length! Cannot be set. (input = [";
@@ -1636,46 +1740,131 @@ bool AutoBalancer::setAutoBalancerParam(const OpenHRP::AutoBalancerService::Auto
           std::cerr << "])" << std::endl;
       }
   }
-  if (is_ik_limb_parameter_valid_length) {
+  if (o_param.is_ik_limb_parameter_valid) {
       std::cerr << "[" << m_profile.instance_name << "]   ik_optional_weight_vectors = ";
       for (size_t i = 0; i < ee_vec.size(); i++) {
-          ABCIKparam& param = ikp[ee_vec[i]];
-          std::vector<double> ov;
-          ov.resize(param.manip->numJoints());
-          param.manip->getOptionalWeightVector(ov);
           std::cerr << "[";
-          for (size_t j = 0; j < param.manip->numJoints(); j++) {
-              std::cerr << ov[j] << " ";
+          for (size_t j = 0; j < o_param.ik_optional_weight_vectors[i].size(); j++) {
+              std::cerr << o_param.ik_optional_weight_vectors[i][j] << " ";
           }
           std::cerr << "]";
       }
       std::cerr << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   sr_gains = [";
       for (size_t i = 0; i < ee_vec.size(); i++) {
-          std::cerr << ikp[ee_vec[i]].manip->getSRGain() << ", ";
+          std::cerr << o_param.sr_gains[i] << ", ";
       }
       std::cerr << "]" << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   avoid_gains = [";
       for (size_t i = 0; i < ee_vec.size(); i++) {
-          std::cerr << ikp[ee_vec[i]].avoid_gain << ", ";
+          std::cerr << o_param.avoid_gains[i] << ", ";
       }
       std::cerr << "]" << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   reference_gains = [";
       for (size_t i = 0; i < ee_vec.size(); i++) {
-          std::cerr << ikp[ee_vec[i]].reference_gain << ", ";
+          std::cerr << o_param.reference_gains[i] << ", ";
       }
       std::cerr << "]" << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   manipulability_limits = [";
       for (size_t i = 0; i < ee_vec.size(); i++) {
-          std::cerr << ikp[ee_vec[i]].manip->getManipulabilityLimit() << ", ";
+          std::cerr << o_param.manipulability_limits[i] << ", ";
       }
       std::cerr << "]" << std::endl;
   }
-  return true;
+};
+
+void AutoBalancer::commitAutoBalancerParam(ABCParamUpdate& i_param)
+{
+  // called with m_mutex locked. Only values are copied or swapped, so
+  // that no memory is allocated
+  move_base_gain = i_param.move_base_gain;
+  zmp_transition_time = i_param.zmp_transition_time;
+  adjust_footstep_transition_time = i_param.adjust_footstep_transition_time;
+  if (zmp_offset_interpolator->isEmpty()) {
+      // interpolated by get() of onExecute, instead of computing the whole trajectory by go()
+      double tm = zmp_transition_time;
+      if (tm == 0) tm = zmp_offset_interpolator->calc_interpolation_time(&i_param.default_zmp_offsets[0]);
+      zmp_offset_interpolator->clear();
+      zmp_offset_interpolator->setGoal(&i_param.default_zmp_offsets[0], tm, true);
+  }
+  // the following parameters were checked against control_mode or
+  // gg_is_walking by setAutoBalancerParam, and they are skipped if it has
+  // changed since then
+  if (i_param.is_use_force_mode_set && control_mode == MODE_IDLE) {
+    switch (i_param.use_force_mode) {
+    case OpenHRP::AutoBalancerService::MODE_NO_FORCE:
+        use_force = MODE_NO_FORCE;
+        break;
+    case OpenHRP::AutoBalancerService::MODE_REF_FORCE:
+        use_force = MODE_REF_FORCE;
+        break;
+    default:
+        break;
+    }
+  }
+  graspless_manip_mode = i_param.graspless_manip_mode;
+  graspless_manip_arm.swap(i_param.graspless_manip_arm);
+  graspless_manip_p_gain = i_param.graspless_manip_p_gain;
+  graspless_manip_reference_trans_coords = i_param.graspless_manip_reference_trans_coords;
+  transition_time = i_param.transition_time;
+  // i_param.leg_names is sorted, and names are unique
+  bool is_leg_names_changed = (leg_names.size() != i_param.leg_names.size());
+  for (size_t i = 0; i < i_param.leg_names.size() && !is_leg_names_changed; i++) {
+      is_leg_names_changed = (std::find(leg_names.begin(), leg_names.end(), i_param.leg_names[i]) == leg_names.end());
+  }
+  if (is_leg_names_changed && leg_names_interpolator->isEmpty()) {
+      leg_names.swap(i_param.leg_names);
+      if (control_mode == MODE_ABC) {
+          double tmp_ratio = 0.0;
+          leg_names_interpolator->set(&tmp_ratio);
+          tmp_ratio = 1.0;
+          leg_names_interpolator->setGoal(&tmp_ratio, 5.0, true);
+          control_mode = MODE_SYNC_TO_ABC;
+      }
+  }
+  pos_ik_thre = i_param.pos_ik_thre;
+  rot_ik_thre = i_param.rot_ik_thre;
+  use_whole_body_ik = i_param.use_whole_body_ik;
+  if (i_param.is_ik_max_iteration_set) ik_max_iteration = i_param.ik_max_iteration;
+  if (!gg_is_walking) is_hand_fix_mode = i_param.is_hand_fix_mode;
+  if (control_mode == MODE_IDLE) {
+      for (size_t i = 0; i < i_param.end_effector_names.size(); i++) {
+          ABCIKparam& param = ikp.find(i_param.end_effector_names[i])->second;
+          param.localPos = i_param.end_effector_localPos[i];
+          param.localR = i_param.end_effector_localR[i];
+      }
+  }
+  if (i_param.default_gait_type == OpenHRP::AutoBalancerService::BIPED) {
+      gait_type = BIPED;
+  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::TROT) {
+      gait_type = TROT;
+  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::PACE) {
+      gait_type = PACE;
+  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::CRAWL) {
+      gait_type = CRAWL;
+  } else if (i_param.default_gait_type == OpenHRP::AutoBalancerService::GALLOP) {
+      gait_type = GALLOP;
+  }
+  if (i_param.is_ik_limb_parameter_valid) {
+      for (size_t i = 0; i < ee_vec.size(); i++) {
+          ABCIKparam& param = ikp.find(ee_vec[i])->second;
+          param.manip->setOptionalWeightVector(i_param.ik_optional_weight_vectors[i]);
+          param.manip->setSRGain(i_param.sr_gains[i]);
+          param.avoid_gain = i_param.avoid_gains[i];
+          param.reference_gain = i_param.reference_gains[i];
+          param.manip->setManipulabilityLimit(i_param.manipulability_limits[i]);
+      }
+  }
 };
 
 bool AutoBalancer::getAutoBalancerParam(OpenHRP::AutoBalancerService::AutoBalancerParam& i_param)
 {
+  {
+      // parameters which onExecute has not picked up yet are applied here,
+      // so that those of the last setAutoBalancerParam are returned
+      Guard guard(m_mutex);
+      if (m_abcp_cell.update()) commitAutoBalancerParam(m_abcp_cell.value());
+  }
   i_param.move_base_gain = move_base_gain;
   i_param.default_zmp_offsets.length(ikp.size());
   for (size_t i = 0; i < ikp.size(); i++) {
@@ -1714,6 +1903,10 @@ bool AutoBalancer::getAutoBalancerParam(OpenHRP::AutoBalancerService::AutoBalanc
   for (size_t i = 0; i < leg_names.size(); i++) i_param.leg_names[i] = leg_names.at(i).c_str();
   i_param.pos_ik_thre = pos_ik_thre;
   i_param.rot_ik_thre = rot_ik_thre;
+  i_param.use_whole_body_ik = use_whole_body_ik;
+  i_param.ik_max_iteration = ik_max_iteration;
+  i_param.ik_iteration_count = ik_iteration_count;
+  i_param.ik_solve_time = ik_solve_time;
   i_param.is_hand_fix_mode = is_hand_fix_mode;
   i_param.end_effector_list.length(ikp.size());
   {
@@ -21,6 +21,8 @@
 #include "../ImpedanceController/JointPathEx.h"
 #include "../ImpedanceController/RatsMatrix.h"
 #include "GaitGenerator.h"
+#include "WholeBodyIKSolver.h"
+#include "util/ParameterCell.h"
 // Service implementation headers
 // <rtc-template block="service_impl_h">
 #include "AutoBalancerService_impl.h"
@@ -195,9 +197,44 @@ class AutoBalancer
     size_t pos_ik_error_count, rot_ik_error_count;
     bool is_active, has_toe_joint;
   };
+  // parameters of setAutoBalancerParam, which are validated and converted by
+  // prepareAutoBalancerParam in the service thread and copied or swapped into
+  // members by commitAutoBalancerParam in onExecute
+  struct ABCParamUpdate {
+    double move_base_gain, transition_time, zmp_transition_time, adjust_footstep_transition_time;
+    std::vector<double> default_zmp_offsets;
+    bool is_use_force_mode_set;
+    OpenHRP::AutoBalancerService::UseForceMode use_force_mode;
+    bool graspless_manip_mode;
+    std::string graspless_manip_arm;
+    hrp::Vector3 graspless_manip_p_gain;
+    rats::coordinates graspless_manip_reference_trans_coords;
+    // sorted leg names
+    std::vector<std::string> leg_names;
+    double pos_ik_thre, rot_ik_thre;
+    bool use_whole_body_ik, is_ik_max_iteration_set, is_hand_fix_mode;
+    size_t ik_max_iteration;
+    OpenHRP::AutoBalancerService::GaitType default_gait_type;
+    // end-effectors of end_effector_list, which are set only in MODE_IDLE
+    std::vector<std::string> end_effector_names;
+    std::vector<hrp::Vector3> end_effector_localPos;
+    std::vector<hrp::Matrix33> end_effector_localR;
+    // IK limb parameters in the order of ee_vec
+    bool is_ik_limb_parameter_valid;
+    std::vector<std::vector<double> > ik_optional_weight_vectors;
+    std::vector<double> sr_gains, avoid_gains, reference_gains, manipulability_limits;
+  };
+  // footsteps of setFootSteps while walking, which are swapped into gg by onExecute
+  struct ABCFootStepsUpdate {
+    std::vector< std::vector<rats::step_node> > fnsl;
+    size_t overwrite_fs_idx;
+  };
+  void prepareAutoBalancerParam(const OpenHRP::AutoBalancerService::AutoBalancerParam& i_param, ABCParamUpdate& o_param);
+  void commitAutoBalancerParam(ABCParamUpdate& i_param);
   void getCurrentParameters();
   void getTargetParameters();
   bool solveLimbIKforLimb (ABCIKparam& param);
+  void checkLimbIKError (ABCIKparam& param);
   void solveLimbIK();
   void startABCparam(const ::OpenHRP::AutoBalancerService::StrSequence& limbs);
   void stopABCparam();
@@ -237,6 +274,15 @@ class AutoBalancer
   double m_dt, move_base_gain;
   hrp::BodyPtr m_robot;
   coil::Mutex m_mutex;
+  // parameters set by setAutoBalancerParam and footsteps overwritten by
+  // setFootSteps, which are applied by onExecute
+  ParameterCell<ABCParamUpdate> m_abcp_cell;
+  ParameterCell<ABCFootStepsUpdate> m_fs_cell;
+  // serializes setFootSteps while walking, each of which waits for
+  // m_fs_result set by onExecute, 1 if overwritten, -1 if dropped and 0
+  // until it is picked up
+  coil::Mutex m_fs_mutex;
+  volatile int m_fs_result;
 
   double transition_interpolator_ratio, transition_time, zmp_transition_time, adjust_footstep_transition_time, leg_names_interpolator_ratio;
   interpolator *zmp_offset_interpolator;
@@ -259,6 +305,13 @@ class AutoBalancer
   hrp::Vector3 graspless_manip_p_gain;
   rats::coordinates graspless_manip_reference_trans_coords;
   double pos_ik_thre, rot_ik_thre;
+  // for whole-body IK
+  typedef boost::shared_ptr<hrp::WholeBodyIKSolver> wbikPtr;
+  wbikPtr wbik;
+  hrp::dvector ik_q_backup;
+  bool use_whole_body_ik;
+  size_t ik_max_iteration, ik_iteration_count, wbik_failure_count;
+  double ik_solve_time;
 };
 
 
@@ -52,28 +52,35 @@ namespace rats
   };
 
   /* member function implementation for refzmp_generator */
-  void refzmp_generator::push_refzmp_from_footstep_nodes_for_dual (const std::vector<step_node>& fns,
-                                                                   const std::vector<step_node>& _support_leg_steps,
-                                                                   const std::vector<step_node>& _swing_leg_steps)
+  hrp::Vector3 refzmp_generator::calc_refzmp_for_dual (const std::vector<step_node>& _support_leg_steps,
+                                                      const std::vector<step_node>& _swing_leg_steps) const
   {
-    hrp::Vector3 rzmp;
     std::vector<hrp::Vector3> dzl;
-    hrp::Vector3 ret_zmp;
     hrp::Vector3 tmp_zero = hrp::Vector3::Zero();
-    std::vector<hrp::Vector3> foot_x_axises;
     double sum_of_weight = 0.0;
     for (std::vector<step_node>::const_iterator it = _support_leg_steps.begin(); it != _support_leg_steps.end(); it++) {
-        dzl.push_back((it->worldcoords.rot * default_zmp_offsets[it->l_r] + it->worldcoords.pos) * zmp_weight_map[it->l_r]);
-        sum_of_weight += zmp_weight_map[it->l_r];
+        double weight = zmp_weight_map.find(it->l_r)->second;
+        dzl.push_back((it->worldcoords.rot * default_zmp_offsets[it->l_r] + it->worldcoords.pos) * weight);
+        sum_of_weight += weight;
     }
     for (std::vector<step_node>::const_iterator it = _swing_leg_steps.begin(); it != _swing_leg_steps.end(); it++) {
-        dzl.push_back((it->worldcoords.rot * default_zmp_offsets[it->l_r] + it->worldcoords.pos) * zmp_weight_map[it->l_r]);
-        sum_of_weight += zmp_weight_map[it->l_r];
+        double weight = zmp_weight_map.find(it->l_r)->second;
+        dzl.push_back((it->worldcoords.rot * default_zmp_offsets[it->l_r] + it->worldcoords.pos) * weight);
+        sum_of_weight += weight;
+    }
+    return std::accumulate(dzl.begin(), dzl.end(), tmp_zero) / sum_of_weight;
+  };
+
+  void refzmp_generator::push_refzmp_from_footstep_nodes_for_dual (const std::vector<step_node>& fns,
+                                                                   const std::vector<step_node>& _support_leg_steps,
+                                                                   const std::vector<step_node>& _swing_leg_steps)
+  {
+    std::vector<hrp::Vector3> foot_x_axises;
+    for (std::vector<step_node>::const_iterator it = _swing_leg_steps.begin(); it != _swing_leg_steps.end(); it++) {
         foot_x_axises.push_back( hrp::Vector3(it->worldcoords.rot * hrp::Vector3::UnitX()) );
     }
     foot_x_axises_list.push_back(foot_x_axises);
-    rzmp = std::accumulate(dzl.begin(), dzl.end(), tmp_zero) / sum_of_weight;
-    refzmp_cur_list.push_back( rzmp );
+    refzmp_cur_list.push_back( calc_refzmp_for_dual(_support_leg_steps, _swing_leg_steps) );
     std::vector<leg_type> swing_leg_types;
     for (size_t i = 0; i < fns.size(); i++) {
         swing_leg_types.push_back(fns.at(i).l_r);
@@ -520,12 +527,19 @@ namespace rats
     // rg+lcg initialization
     rg.reset(one_step_len);
     rg.push_refzmp_from_footstep_nodes_for_dual(footstep_nodes_list.front(), initial_support_leg_steps, initial_swing_leg_dst_steps);
-    if ( preview_controller_ptr != NULL ) {
-      delete preview_controller_ptr;
-      preview_controller_ptr = NULL;
+    if ( prepared_preview_controller_ptr != NULL ) {
+      /* created by prepare_preview_controller, which also deleted the retired one */
+      retired_preview_controller_ptr = preview_controller_ptr;
+      preview_controller_ptr = prepared_preview_controller_ptr;
+      prepared_preview_controller_ptr = NULL;
+    } else {
+      if ( preview_controller_ptr != NULL ) {
+        delete preview_controller_ptr;
+        preview_controller_ptr = NULL;
+      }
+      //preview_controller_ptr = new preview_dynamics_filter<preview_control>(dt, cog(2) - refzmp_cur_list[0](2), refzmp_cur_list[0]);
+      preview_controller_ptr = new preview_dynamics_filter<extended_preview_control>(dt, calc_preview_cog_z(cog, initial_support_leg_steps, initial_swing_leg_dst_steps), rg.get_refzmp_cur(), gravitational_acceleration);
     }
-    //preview_controller_ptr = new preview_dynamics_filter<preview_control>(dt, cog(2) - refzmp_cur_list[0](2), refzmp_cur_list[0]);
-    preview_controller_ptr = new preview_dynamics_filter<extended_preview_control>(dt, cog(2) - rg.get_refzmp_cur()(2), rg.get_refzmp_cur(), gravitational_acceleration);
     lcg.reset(one_step_len, footstep_nodes_list.at(1).front().step_time/dt, initial_swing_leg_dst_steps, initial_swing_leg_dst_steps, initial_support_leg_steps, default_double_support_ratio_swing_before, default_double_support_ratio_swing_after);
     /* make another */
     lcg.set_swing_support_steps_list(footstep_nodes_list);
@@ -536,18 +550,20 @@ namespace rats
                                                 lcg.get_support_leg_steps_idx(footstep_nodes_list.size()-1),
                                                 lcg.get_swing_leg_dst_steps_idx(footstep_nodes_list.size()-1));
     emergency_flg = IDLING;
+    is_overwriting_refzmp_queue = false;
   };
 
   bool gait_generator::proc_one_tick ()
   {
     solved = false;
+    bool is_rg_updated = false;
     /* update refzmp */
     if (emergency_flg == EMERGENCY_STOP && lcg.get_footstep_index() > 0) {
         leg_type cur_leg = footstep_nodes_list[lcg.get_footstep_index()].front().l_r;
         overwrite_footstep_nodes_list.push_back(boost::assign::list_of(step_node(cur_leg==RLEG?LLEG:RLEG, footstep_nodes_list[lcg.get_footstep_index()-1].front().worldcoords, 0, default_step_time, 0, 0)));
         overwrite_footstep_nodes_list.push_back(boost::assign::list_of(step_node(cur_leg, footstep_nodes_list[lcg.get_footstep_index()].front().worldcoords, 0, default_step_time, 0, 0)));
         overwrite_footstep_nodes_list.push_back(boost::assign::list_of(step_node(cur_leg==RLEG?LLEG:RLEG, footstep_nodes_list[lcg.get_footstep_index()-1].front().worldcoords, 0, default_step_time, 0, 0)));
-        overwrite_refzmp_queue(overwrite_footstep_nodes_list);
+        is_rg_updated = overwrite_refzmp_queue(overwrite_footstep_nodes_list);
         overwrite_footstep_nodes_list.clear();
         emergency_flg = STOPPING;
     } else if ( lcg.get_lcg_count() == get_overwrite_check_timing() ) {
@@ -569,17 +585,24 @@ namespace rats
             }
             overwrite_footstep_nodes_list.push_back(tmp_fsn);
         }
-        overwrite_refzmp_queue(overwrite_footstep_nodes_list);
+        is_rg_updated = overwrite_refzmp_queue(overwrite_footstep_nodes_list);
         overwrite_footstep_nodes_list.clear();
       } else if ( !overwrite_footstep_nodes_list.empty() && // If overwrite_footstep_node_list exists
                   (lcg.get_footstep_index() < footstep_nodes_list.size()-1) &&  // If overwrite_footstep_node_list is specified and current footstep is not last footstep.
                   get_overwritable_index() == overwrite_footstep_index ) {
-        overwrite_refzmp_queue(overwrite_footstep_nodes_list);
+        is_rg_updated = overwrite_refzmp_queue(overwrite_footstep_nodes_list);
         overwrite_footstep_nodes_list.clear();
       }
     }
 
-    if ( !solved ) {
+    if ( !solved && is_overwriting_refzmp_queue ) {
+      /* continue overwriting the queue instead of pushing new refzmp */
+      preview_controller_ptr->shift_preview_queue();
+      overwrite_refzmp_queue_index--;
+      overwrite_refzmp_queue_entries(overwrite_refzmp_queue_num_per_tick);
+      solved = preview_controller_ptr->update_with_current_queue(refzmp, cog, swing_foot_zmp_offsets);
+      is_rg_updated = true;
+    } else if ( !solved ) {
       hrp::Vector3 rzmp;
       std::vector<hrp::Vector3> sfzos;
       bool refzmp_exist_p = rg.get_current_refzmp(rzmp, sfzos, default_double_support_ratio_before, default_double_support_ratio_after, default_double_support_static_ratio_before, default_double_support_static_ratio_after);
@@ -594,7 +617,7 @@ namespace rats
       solved = preview_controller_ptr->update(refzmp, cog, swing_foot_zmp_offsets, rzmp, sfzos, (refzmp_exist_p || finalize_count < preview_controller_ptr->get_delay()-default_step_time/dt));
     }
 
-    rg.update_refzmp(footstep_nodes_list);
+    if ( !is_rg_updated ) rg.update_refzmp(footstep_nodes_list);
     // { // debug
     //   double cart_zmp[3];
     //   preview_controller_ptr->get_cart_zmp(cart_zmp);
@@ -837,8 +860,11 @@ namespace rats
     }
   };
 
-  void gait_generator::overwrite_refzmp_queue(const std::vector< std::vector<step_node> >& fnsl)
+  /* overwrite_refzmp_queue returns true if refzmp_generator has already been updated in this tick */
+  bool gait_generator::overwrite_refzmp_queue(const std::vector< std::vector<step_node> >& fnsl)
   {
+    /* finish the previous overwrite before starting a new one */
+    if (is_overwriting_refzmp_queue) overwrite_refzmp_queue_entries(preview_controller_ptr->get_preview_queue_size());
     size_t idx = get_overwritable_index();
     footstep_nodes_list.erase(footstep_nodes_list.begin()+idx, footstep_nodes_list.end());
 
@@ -851,12 +877,11 @@ namespace rats
     /* Update refzmp_generator */
     /*   Remove refzmp after idx for allocation of new refzmp by push_refzmp_from_footstep_nodes */
     rg.remove_refzmp_cur_list_over_length(idx);
-    /*   Remove refzmp in preview contoroller queue */
-    if (overwritable_footstep_index_offset == 0) {
-        preview_controller_ptr->remove_preview_queue(); // Remove all queue
-    } else {
-        preview_controller_ptr->remove_preview_queue(lcg.get_lcg_count()); // Remove queue except current footstep. ZMP queue for current footstep remains
-    }
+    /*   Number of refzmp in preview contoroller queue to be kept */
+    size_t remain_length = (overwritable_footstep_index_offset == 0 ? 0 /* Remove all queue */ : lcg.get_lcg_count() /* ZMP queue for current footstep remains */);
+    bool is_spread = (overwrite_refzmp_queue_num_per_tick > 0 && velocity_mode_flg == VEL_DOING && emergency_flg == IDLING &&
+                      remain_length < preview_controller_ptr->get_preview_queue_size());
+    if (!is_spread) preview_controller_ptr->remove_preview_queue(remain_length);
     /*   reset index and counter */
     rg.set_indices(idx);
     if (overwritable_footstep_index_offset == 0) {
@@ -880,6 +905,15 @@ namespace rats
             }
         }
     }
+    if (is_spread) {
+      /* overwrite refzmp after remain_length in place. The rest is overwritten in the following ticks. */
+      is_overwriting_refzmp_queue = true;
+      overwrite_refzmp_queue_index = remain_length;
+      overwrite_refzmp_queue_count = preview_controller_ptr->get_preview_queue_size() - remain_length;
+      overwrite_refzmp_queue_entries(overwrite_refzmp_queue_num_per_tick);
+      solved = preview_controller_ptr->update_with_current_queue(refzmp, cog, swing_foot_zmp_offsets);
+      return true;
+    }
     /* fill preview controller queue by new refzmp */
     hrp::Vector3 rzmp;
     while ( !solved ) {
@@ -888,6 +922,40 @@ namespace rats
       solved = preview_controller_ptr->update(refzmp, cog, swing_foot_zmp_offsets, rzmp, sfzos, refzmp_exist_p);
       rg.update_refzmp(footstep_nodes_list);
     }
+    return false;
+  };
+
+  /* overwrite at most num refzmp in preview controller queue from overwrite_refzmp_queue_index,
+   * which results in the same queue as overwrite_refzmp_queue without spreading.
+   */
+  void gait_generator::overwrite_refzmp_queue_entries(const size_t num)
+  {
+    hrp::Vector3 rzmp;
+    for (size_t i = 0; i < num && overwrite_refzmp_queue_index < preview_controller_ptr->get_preview_queue_size(); i++) {
+      overwrite_sfzos.clear();
+      bool refzmp_exist_p = rg.get_current_refzmp(rzmp, overwrite_sfzos, default_double_support_ratio_before, default_double_support_ratio_after, default_double_support_static_ratio_before, default_double_support_static_ratio_after);
+      bool is_last_overwritten = false;
+      /* swapped instead of copied, overwrite_sfzos is cleared in the next entry anyway */
+      const std::vector<hrp::Vector3>* sfzos = &overwrite_sfzos;
+      if (overwrite_refzmp_queue_count > 0) {
+        /* refzmp which is pushed in the tick of overwriting without spreading */
+        is_last_overwritten = (--overwrite_refzmp_queue_count == 0);
+      } else if (!refzmp_exist_p) {
+        /* refzmp which is pushed in the following ticks as proc_one_tick does */
+        finalize_count++;
+        rzmp = prev_que_rzmp;
+        sfzos = &prev_que_sfzos;
+      } else {
+        prev_que_rzmp = rzmp;
+        prev_que_sfzos.swap(overwrite_sfzos);
+        sfzos = &prev_que_sfzos;
+      }
+      preview_controller_ptr->set_preview_queue(overwrite_refzmp_queue_index++, rzmp, *sfzos);
+      rg.update_refzmp(footstep_nodes_list);
+      /* proc_one_tick updates refzmp_generator once more in the tick of overwriting */
+      if (is_last_overwritten) rg.update_refzmp(footstep_nodes_list);
+    }
+    if (overwrite_refzmp_queue_index >= preview_controller_ptr->get_preview_queue_size()) is_overwriting_refzmp_queue = false;
   };
 
   const std::vector<leg_type> gait_generator::calc_counter_leg_types_from_footstep_nodes(const std::vector<step_node>& fns, std::vector<std::string> _all_limbs) const {
@@ -107,7 +107,7 @@ namespace rats
     {
         double toe_heel_phase_ratio[NUM_TH_PHASES];
         size_t toe_heel_phase_count[NUM_TH_PHASES], one_step_count;
-        bool calc_toe_heel_phase_count_from_raio ()
+        void calc_toe_heel_phase_count_from_raio ()
         {
             double ratio_sum = 0.0;
             for (size_t i = 0; i < NUM_TH_PHASES; i++) {
@@ -261,6 +261,9 @@ namespace rats
         swing_leg_types_list.clear();
         step_count_list.clear();
       };
+      /* weighted mean of zmps of the feet in double support phase */
+      hrp::Vector3 calc_refzmp_for_dual (const std::vector<step_node>& _support_leg_steps,
+                                         const std::vector<step_node>& _swing_leg_steps) const;
       void push_refzmp_from_footstep_nodes_for_dual (const std::vector<step_node>& fns,
                                                      const std::vector<step_node>& _support_leg_steps,
                                                      const std::vector<step_node>& _swing_leg_steps);
@@ -273,13 +276,13 @@ namespace rats
       void set_toe_zmp_offset_x (const double _off) { toe_zmp_offset_x = _off; };
       void set_heel_zmp_offset_x (const double _off) { heel_zmp_offset_x = _off; };
       void set_use_toe_heel_transition (const double _u) { use_toe_heel_transition = _u; };
-      void set_zmp_weight_map (const std::map<leg_type, double> _map) {
+      void set_zmp_weight_map (const std::map<leg_type, double>& _map) {
           double zmp_weight_array[4] = {_map.find(RLEG)->second, _map.find(LLEG)->second, _map.find(RARM)->second, _map.find(LARM)->second};
           if (zmp_weight_interpolator->isEmpty()) {
               zmp_weight_interpolator->clear();
               double zmp_weight_initial_value[4] = {zmp_weight_map[RLEG], zmp_weight_map[LLEG], zmp_weight_map[RARM], zmp_weight_map[LARM]};
               zmp_weight_interpolator->set(zmp_weight_initial_value);
-              zmp_weight_interpolator->go(zmp_weight_array, 2.0, true);
+              zmp_weight_interpolator->setGoal(zmp_weight_array, 2.0, true); // interpolated by proc_zmp_weight_map_interpolation
           } else {
               std::cerr << "zmp_weight_map cannot be set because interpolating." << std::endl;
           }
@@ -416,7 +419,7 @@ namespace rats
         }
         // if illegal tmp-ratio
         if (current_length < 0) return org_point_vec.front();
-        else org_point_vec.back();
+        else return org_point_vec.back();
       };
     };
 
@@ -874,6 +877,16 @@ namespace rats
     // overwritable_footstep_index_offset is used for emergency stop and velocity mode.
     //   overwritable footstep index is "footstep_index + overwritable_footstep_index_offset", which is obtained by get_overwritable_index().
     size_t overwritable_footstep_index_offset;
+    // overwrite_refzmp_queue_num_per_tick is the number of refzmp entries of the preview queue overwritten per tick in velocity mode.
+    //   If 0, all entries are overwritten in the tick in which footsteps are overwritten.
+    //   Otherwise the queue is overwritten in place from the nearest entry over several ticks and entries not yet overwritten are old ones.
+    size_t overwrite_refzmp_queue_num_per_tick;
+    // State of overwriting the queue over ticks.
+    //   overwrite_refzmp_queue_index is the index of the next entry to be overwritten.
+    //   overwrite_refzmp_queue_count is the number of entries to be overwritten before rg skips one refzmp, as it does after overwriting in one tick.
+    bool is_overwriting_refzmp_queue;
+    size_t overwrite_refzmp_queue_index, overwrite_refzmp_queue_count;
+    std::vector<hrp::Vector3> overwrite_sfzos;
     velocity_mode_flag velocity_mode_flg;
     emergency_flag emergency_flg;
     bool use_inside_step_limitation;
@@ -884,6 +897,10 @@ namespace rats
     /* preview controller parameters */
     //preview_dynamics_filter<preview_control>* preview_controller_ptr;
     preview_dynamics_filter<extended_preview_control>* preview_controller_ptr;
+    /* created by prepare_preview_controller and taken by initialize_gait_parameter,
+       which leaves the previous controller to be deleted by the next preparation */
+    preview_dynamics_filter<extended_preview_control>* prepared_preview_controller_ptr;
+    preview_dynamics_filter<extended_preview_control>* retired_preview_controller_ptr;
 
     void append_go_pos_step_nodes (const coordinates& _ref_coords,
                                    const std::vector<leg_type>& lts)
@@ -904,7 +921,8 @@ namespace rats
       }
       _footstep_nodes_list.push_back(sns);
     };
-    void overwrite_refzmp_queue(const std::vector< std::vector<step_node> >& fnsl);
+    bool overwrite_refzmp_queue(const std::vector< std::vector<step_node> >& fnsl);
+    void overwrite_refzmp_queue_entries(const size_t num);
     void calc_ref_coords_trans_vector_velocity_mode (coordinates& ref_coords, hrp::Vector3& trans, double& dth, const std::vector<step_node>& sup_fns, const velocity_mode_parameter& cur_vel_param) const;
     void calc_next_coords_velocity_mode (std::vector< std::vector<step_node> >& ret_list, const size_t idx, const size_t future_step_num = 3);
     void append_footstep_list_velocity_mode ();
@@ -925,9 +943,10 @@ namespace rats
         vel_param(), offset_vel_param(), cog(hrp::Vector3::Zero()), refzmp(hrp::Vector3::Zero()), prev_que_rzmp(hrp::Vector3::Zero()),
         dt(_dt), default_step_time(1.0), default_double_support_ratio_before(0.1), default_double_support_ratio_after(0.1), default_double_support_static_ratio_before(0.0), default_double_support_static_ratio_after(0.0), default_double_support_ratio_swing_before(0.1), default_double_support_ratio_swing_after(0.1), gravitational_acceleration(DEFAULT_GRAVITATIONAL_ACCELERATION),
         finalize_count(0), optional_go_pos_finalize_footstep_num(0), overwrite_footstep_index(0), overwritable_footstep_index_offset(1),
+        overwrite_refzmp_queue_num_per_tick(0), is_overwriting_refzmp_queue(false), overwrite_refzmp_queue_index(0), overwrite_refzmp_queue_count(0),
         velocity_mode_flg(VEL_IDLING), emergency_flg(IDLING),
         use_inside_step_limitation(true),
-        preview_controller_ptr(NULL) {
+        preview_controller_ptr(NULL), prepared_preview_controller_ptr(NULL), retired_preview_controller_ptr(NULL) {
         swing_foot_zmp_offsets = boost::assign::list_of<hrp::Vector3>(hrp::Vector3::Zero());
         prev_que_sfzos = boost::assign::list_of<hrp::Vector3>(hrp::Vector3::Zero());
         leg_type_map = boost::assign::map_list_of<leg_type, std::string>(RLEG, "rleg")(LLEG, "lleg")(RARM, "rarm")(LARM, "larm");
@@ -937,11 +956,34 @@ namespace rats
         delete preview_controller_ptr;
         preview_controller_ptr = NULL;
       }
+      delete prepared_preview_controller_ptr;
+      delete retired_preview_controller_ptr;
     };
     void initialize_gait_parameter (const hrp::Vector3& cog,
                                     const std::vector<step_node>& initial_support_leg_steps,
                                     const std::vector<step_node>& initial_swing_leg_dst_steps,
                                     const double delay = 1.6);
+    /* cog height of the preview controller for a walk starting from cog and the initial steps */
+    double calc_preview_cog_z (const hrp::Vector3& cog,
+                               const std::vector<step_node>& initial_support_leg_steps,
+                               const std::vector<step_node>& initial_swing_leg_dst_steps) const
+    {
+      return cog(2) - rg.calc_refzmp_for_dual(initial_support_leg_steps, initial_swing_leg_dst_steps)(2);
+    };
+    /* create the preview controller for the same arguments as
+       initialize_gait_parameter beforehand, out of the realtime loop.
+       initialize_gait_parameter takes it instead of creating one */
+    void prepare_preview_controller (const hrp::Vector3& cog,
+                                     const std::vector<step_node>& initial_support_leg_steps,
+                                     const std::vector<step_node>& initial_swing_leg_dst_steps)
+    {
+      delete retired_preview_controller_ptr;
+      retired_preview_controller_ptr = NULL;
+      delete prepared_preview_controller_ptr;
+      prepared_preview_controller_ptr = new preview_dynamics_filter<extended_preview_control>(dt, calc_preview_cog_z(cog, initial_support_leg_steps, initial_swing_leg_dst_steps),
+                                                                                            rg.calc_refzmp_for_dual(initial_support_leg_steps, initial_swing_leg_dst_steps),
+                                                                                            gravitational_acceleration);
+    };
     bool proc_one_tick ();
     void append_footstep_nodes (const std::vector<std::string>& _legs, const std::vector<coordinates>& _fss)
     {
@@ -1023,7 +1065,7 @@ namespace rats
     void set_toe_zmp_offset_x (const double _off) { rg.set_toe_zmp_offset_x(_off); };
     void set_heel_zmp_offset_x (const double _off) { rg.set_heel_zmp_offset_x(_off); };
     void set_use_toe_heel_transition (const double _u) { rg.set_use_toe_heel_transition(_u); };
-    void set_zmp_weight_map (const std::map<leg_type, double> _map) { rg.set_zmp_weight_map(_map); };
+    void set_zmp_weight_map (const std::map<leg_type, double>& _map) { rg.set_zmp_weight_map(_map); };
     void set_default_step_height(const double _tmp) { lcg.set_default_step_height(_tmp); };
     void set_default_top_ratio(const double _tmp) { lcg.set_default_top_ratio(_tmp); };
     void set_velocity_param (const double vel_x, const double vel_y, const double vel_theta) /* [mm/s] [mm/s] [deg/s] */
@@ -1058,6 +1100,16 @@ namespace rats
     void set_optional_go_pos_finalize_footstep_num (const size_t num) { optional_go_pos_finalize_footstep_num = num; };
     void set_all_limbs (const std::vector<std::string>& _all_limbs) { all_limbs = _all_limbs; };
     void set_overwritable_footstep_index_offset (const size_t _of) { overwritable_footstep_index_offset = _of;};
+    // The queue gets one entry longer every tick, so overwriting 1 entry per tick never finishes and is rejected
+    bool set_overwrite_refzmp_queue_num_per_tick (const size_t num)
+    {
+        if (num == 1) {
+            std::cerr << "overwrite_refzmp_queue_num_per_tick cannot be set to 1 because the queue gets one entry longer every tick." << std::endl;
+            return false;
+        }
+        overwrite_refzmp_queue_num_per_tick = num;
+        return true;
+    };
     void set_foot_steps_list (const std::vector< std::vector<step_node> >& fnsl)
     {
         clear_footstep_nodes_list();
@@ -1072,6 +1124,23 @@ namespace rats
         append_finalize_footstep(overwrite_footstep_nodes_list);
         print_footstep_nodes_list(overwrite_footstep_nodes_list);
     };
+    /* Swap footsteps, to which the finalize footstep is already appended, with the current ones without copying them. fnsl gets the old footsteps. */
+    void swap_foot_steps_list (std::vector< std::vector<step_node> >& fnsl)
+    {
+        clear_footstep_nodes_list();
+        footstep_nodes_list.swap(fnsl);
+    };
+    /* Swap footsteps to overwrite, to which the finalize footstep is already appended, if idx can still be overwritten. fnsl gets the old footsteps. */
+    bool swap_overwrite_foot_steps_list (std::vector< std::vector<step_node> >& fnsl, const size_t idx)
+    {
+        if (idx >= get_overwritable_index()) {
+            overwrite_footstep_nodes_list.swap(fnsl);
+            overwrite_footstep_index = idx;
+            return true;
+        } else {
+            return false;
+        }
+    };
     /* Get overwritable footstep index. For example, if overwritable_footstep_index_offset = 1, overwrite next footstep. If overwritable_footstep_index_offset = 0, overwrite current swinging footstep. */
     size_t get_overwritable_index () const
     {
@@ -1218,6 +1287,7 @@ namespace rats
     bool get_use_toe_joint () const { return lcg.get_use_toe_joint(); };
     void get_leg_default_translate_pos (std::vector<hrp::Vector3>& off) const { off = footstep_param.leg_default_translate_pos; };
     size_t get_overwritable_footstep_index_offset () const { return overwritable_footstep_index_offset; };
+    size_t get_overwrite_refzmp_queue_num_per_tick () const { return overwrite_refzmp_queue_num_per_tick; };
     const std::vector<leg_type> calc_counter_leg_types_from_footstep_nodes (const std::vector<step_node>& fns, std::vector<std::string> _all_limbs) const;
     const std::map<leg_type, std::string> get_leg_type_map () const { return leg_type_map; };
     size_t get_optional_go_pos_finalize_footstep_num () const { return optional_go_pos_finalize_footstep_num; };
@@ -1270,6 +1340,7 @@ namespace rats
         for (int i = 0; i < get_NUM_TH_PHASES(); i++) std::cerr << tmp_ratio[i] << " ";
         std::cerr << "]" << std::endl;
         std::cerr << "[" << print_str << "]   optional_go_pos_finalize_footstep_num = " << optional_go_pos_finalize_footstep_num << ", overwritable_footstep_index_offset = " << overwritable_footstep_index_offset << std::endl;
+        std::cerr << "[" << print_str << "]   overwrite_refzmp_queue_num_per_tick = " << overwrite_refzmp_queue_num_per_tick << std::endl;
     };
   };
 }
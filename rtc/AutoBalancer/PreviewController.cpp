@@ -1,24 +1,88 @@
 /* -*- coding:utf-8-unix; mode:c++; -*- */
+#include <map>
+#include <pthread.h>
 #include "PreviewController.h"
 
 using namespace hrp;
 using namespace rats;
 
+namespace rats
+{
+  struct riccati_cache_key
+  {
+    double dt, zc, g, q, r;
+    size_t delay;
+    bool operator< (const riccati_cache_key& k) const
+    {
+      if (dt != k.dt) return dt < k.dt;
+      if (zc != k.zc) return zc < k.zc;
+      if (g != k.g) return g < k.g;
+      if (q != k.q) return q < k.q;
+      if (r != k.r) return r < k.r;
+      return delay < k.delay;
+    };
+  };
+
+  template <std::size_t dim>
+  struct riccati_cache_value
+  {
+    riccati_equation<dim> riccati;
+    hrp::dvector f;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  /* process-wide cache of solutions, one for each dim */
+  template <std::size_t dim>
+  struct riccati_cache
+  {
+    typedef std::map<riccati_cache_key, riccati_cache_value<dim>, std::less<riccati_cache_key>,
+                     Eigen::aligned_allocator<std::pair<const riccati_cache_key, riccati_cache_value<dim> > > > map_type;
+    static map_type& get ()
+    {
+      static map_type m;
+      return m;
+    };
+  };
+  static pthread_mutex_t riccati_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+  /* the cache is cleared when it grows over this size */
+  static const size_t RICCATI_CACHE_MAX_SIZE = 64;
+}
+
+template <std::size_t dim>
+void preview_control_base<dim>::init_riccati(const Eigen::Matrix<double, dim, dim>& A,
+                                             const Eigen::Matrix<double, dim, 1>& b,
+                                             const Eigen::Matrix<double, 1, dim>& c,
+                                             const double q, const double r)
+{
+  riccati_cache_key key = {dt, round(model_zc / PREVIEW_COG_Z_RESOLUTION) * PREVIEW_COG_Z_RESOLUTION, gravitational_acceleration, q, r, delay};
+  typename riccati_cache<dim>::map_type& cache = riccati_cache<dim>::get();
+  pthread_mutex_lock(&riccati_cache_mutex);
+  typename riccati_cache<dim>::map_type::const_iterator it = cache.find(key);
+  if (it != cache.end()) {
+    riccati = it->second.riccati;
+    f = it->second.f;
+    pthread_mutex_unlock(&riccati_cache_mutex);
+    return;
+  }
+  pthread_mutex_unlock(&riccati_cache_mutex);
+  /* solve out of the lock, the same solution may be inserted twice */
+  riccati = riccati_equation<dim>(A, b, c, q, r);
+  riccati.solve();
+  calc_f();
+  pthread_mutex_lock(&riccati_cache_mutex);
+  if (cache.size() >= RICCATI_CACHE_MAX_SIZE) cache.clear();
+  riccati_cache_value<dim>& v = cache[key];
+  v.riccati = riccati;
+  v.f = f;
+  pthread_mutex_unlock(&riccati_cache_mutex);
+}
+
 template <std::size_t dim>
 void preview_control_base<dim>::update_x_k(const hrp::Vector3& pr, const std::vector<hrp::Vector3>& _qdata)
 {
   zmp_z = pr(2);
-  Eigen::Matrix<double, 2, 1> tmpv;
-  tmpv(0,0) = pr(0);
-  tmpv(1,0) = pr(1);
-  p.push_back(tmpv);
-  pz.push_back(pr(2));
-  qdata.push_back(_qdata);
-  if ( p.size() > 1 + delay ) {
-    p.pop_front();
-    pz.pop_front();
-    qdata.pop_front();
-  }
+  /* the oldest entry is dropped if the queue has 1 + delay entries */
+  queue.push_back(pr, _qdata);
   if ( is_doing() ) calc_x_k();
 }
 
@@ -44,9 +108,7 @@ void preview_control::calc_f()
 
 void preview_control::calc_u()
 {
-  Eigen::Matrix<double, 1, 2> gfp(Eigen::Matrix<double, 1, 2>::Zero());
-  for (size_t i = 0; i < 1 + delay; i++)
-    gfp += f(i) * p[i];
+  Eigen::Matrix<double, 1, 2> gfp(queue.preview_sum(f));
   u_k = -riccati.K * x_k + gfp;
 };
 
@@ -73,9 +135,7 @@ void extended_preview_control::calc_f()
 
 void extended_preview_control::calc_u()
 {
-  Eigen::Matrix<double, 1, 2> gfp(Eigen::Matrix<double, 1, 2>::Zero());
-  for (size_t i = 0; i < 1 + delay; i++)
-    gfp += f(i) * p[i];
+  Eigen::Matrix<double, 1, 2> gfp(queue.preview_sum(f));
   u_k = -riccati.K * x_k_e + gfp;
 };
 
@@ -88,3 +148,5 @@ void extended_preview_control::calc_x_k()
       x_k(i,j) += x_k_e(i+1,j);
 }
 
+template class rats::preview_control_base<3>;
+template class rats::preview_control_base<4>;
@@ -4,12 +4,17 @@
 #include <iostream>
 #include <queue>
 #include <deque>
+#include <vector>
 #include <hrpUtil/Eigen3d.h>
 #include "util/Hrpsys.h"
 
 namespace rats
 {
   static const double DEFAULT_GRAVITATIONAL_ACCELERATION = 9.80665; // [m/s^2]
+  /* zc in the key of the cache of riccati solutions is rounded to this
+     resolution so that walks starting from almost the same cog height share
+     the gains. The cart-table model itself uses zc as it is */
+  static const double PREVIEW_COG_Z_RESOLUTION = 1.0e-4; // [m]
 
   template <std::size_t dim>
   struct riccati_equation
@@ -47,6 +52,107 @@ namespace rats
     }
   };
 
+  /* fixed-capacity ring buffer of reference zmp and qdata for preview control.
+     No allocation is done after the size of qdata is settled.
+     zmp x and y are interleaved and stored twice, at slot and slot + capacity,
+     so that the preview window from the front is always contiguous. */
+  class preview_queue
+  {
+    size_t cap, head, len, qdim;
+    std::vector<double> pxy;
+    std::vector<double> pz;
+    std::vector<hrp::Vector3> qdata;
+    std::vector<size_t> qsize;
+    size_t slot (const size_t i) const
+    {
+      size_t s = head + i;
+      return s >= cap ? s - cap : s;
+    };
+    void resize_qdata (const size_t n)
+    {
+      std::vector<hrp::Vector3> tmp(cap * n);
+      for (size_t s = 0; s < cap; s++)
+        for (size_t j = 0; j < qsize[s]; j++)
+          tmp[s * n + j] = qdata[s * qdim + j];
+      qdata.swap(tmp);
+      qdim = n;
+    };
+  public:
+    preview_queue (const size_t capacity)
+      : cap(capacity), head(0), len(0), qdim(0), pxy(4 * capacity, 0.0), pz(capacity, 0.0), qdata(), qsize(capacity, 0) {};
+    size_t size () const { return len; };
+    bool empty () const { return len == 0; };
+    void clear () { head = len = 0; };
+    void pop_front ()
+    {
+      if (len == 0) return;
+      head = slot(1);
+      len--;
+    };
+    void pop_back () { if (len > 0) len--; };
+    /* the oldest entry is dropped when full */
+    void push_back (const hrp::Vector3& pr, const hrp::Vector3* q, const size_t n)
+    {
+      if (len == cap) pop_front();
+      size_t s = slot(len);
+      if (n > qdim) resize_qdata(n);
+      pxy[2 * s] = pxy[2 * (s + cap)] = pr(0);
+      pxy[2 * s + 1] = pxy[2 * (s + cap) + 1] = pr(1);
+      pz[s] = pr(2);
+      for (size_t j = 0; j < n; j++) qdata[s * qdim + j] = q[j];
+      qsize[s] = n;
+      len++;
+    };
+    void push_back (const hrp::Vector3& pr, const std::vector<hrp::Vector3>& q)
+    {
+      push_back(pr, q.empty() ? NULL : &q[0], q.size());
+    };
+    /* overwrite the i-th entry from the front */
+    void set (const size_t i, const hrp::Vector3& pr, const std::vector<hrp::Vector3>& q)
+    {
+      if (q.size() > qdim) resize_qdata(q.size());
+      size_t s = slot(i);
+      pxy[2 * s] = pxy[2 * (s + cap)] = pr(0);
+      pxy[2 * s + 1] = pxy[2 * (s + cap) + 1] = pr(1);
+      pz[s] = pr(2);
+      for (size_t j = 0; j < q.size(); j++) qdata[s * qdim + j] = q[j];
+      qsize[s] = q.size();
+    };
+    /* push the last entry again */
+    void push_back ()
+    {
+      size_t s = slot(len - 1);
+      /* if capacity is 1, d == s and the entry is copied to itself */
+      if (len == cap) pop_front();
+      size_t d = slot(len);
+      pxy[2 * d] = pxy[2 * (d + cap)] = pxy[2 * s];
+      pxy[2 * d + 1] = pxy[2 * (d + cap) + 1] = pxy[2 * s + 1];
+      pz[d] = pz[s];
+      for (size_t j = 0; j < qsize[s]; j++) qdata[d * qdim + j] = qdata[s * qdim + j];
+      qsize[d] = qsize[s];
+      len++;
+    };
+    double x (const size_t i) const { return pxy[2 * slot(i)]; };
+    double y (const size_t i) const { return pxy[2 * slot(i) + 1]; };
+    double z (const size_t i) const { return pz[slot(i)]; };
+    void get_qdata (const size_t i, std::vector<hrp::Vector3>& ret) const
+    {
+      size_t s = slot(i);
+      ret.resize(qsize[s]);
+      for (size_t j = 0; j < qsize[s]; j++) ret[j] = qdata[s * qdim + j];
+    };
+    /* sum of f(i) * p[i]. x and y are computed in a SIMD register, each
+       of them is accumulated in the same order as the deque version. */
+    Eigen::Matrix<double, 1, 2> preview_sum (const hrp::dvector& f) const
+    {
+      Eigen::Matrix<double, 2, 1> gfp(Eigen::Matrix<double, 2, 1>::Zero());
+      const double* pp = &pxy[2 * head];
+      for (size_t i = 0; i < len; i++)
+        gfp += f(i) * Eigen::Map<const Eigen::Matrix<double, 2, 1> >(pp + 2 * i);
+      return gfp.transpose();
+    };
+  };
+
   template <std::size_t dim>
   class preview_control_base
   {
@@ -58,23 +164,18 @@ namespace rats
     Eigen::Matrix<double, 3, 2> x_k;
     Eigen::Matrix<double, 1, 2> u_k;
     hrp::dvector f;
-    std::deque<Eigen::Matrix<double, 2, 1> > p;
-    std::deque<double> pz;
-    std::deque< std::vector<hrp::Vector3> > qdata;
-    double zmp_z, cog_z;
+    double zmp_z, cog_z, model_zc, dt, gravitational_acceleration;
     size_t delay, ending_count;
+    preview_queue queue;
     virtual void calc_f() = 0;
     virtual void calc_u() = 0;
     virtual void calc_x_k() = 0;
+    /* the solution of the riccati equation and f are shared among
+       controllers with the same dt, zc, g, q, r and delay in the process */
     void init_riccati(const Eigen::Matrix<double, dim, dim>& A,
                       const Eigen::Matrix<double, dim, 1>& b,
                       const Eigen::Matrix<double, 1, dim>& c,
-                      const double q = 1.0, const double r = 1.0e-6)
-    {
-      riccati = riccati_equation<dim>(A, b, c, q, r);
-      riccati.solve();
-      calc_f();
-    };
+                      const double q = 1.0, const double r = 1.0e-6);
     /* inhibit copy constructor and copy insertion not by implementing */
     preview_control_base (const preview_control_base& _p);
     preview_control_base &operator=(const preview_control_base &_p);
@@ -82,8 +183,10 @@ namespace rats
     /* dt = [s], zc = [mm], d = [s] */
     preview_control_base(const double dt, const double zc,
                          const hrp::Vector3& init_xk, const double _gravitational_acceleration, const double d = 1.6)
-      : riccati(), x_k(Eigen::Matrix<double, 3, 2>::Zero()), u_k(Eigen::Matrix<double, 1, 2>::Zero()), p(), pz(), qdata(),
-        zmp_z(0), cog_z(zc), delay(static_cast<size_t>(round(d / dt))), ending_count(1+delay)
+      : riccati(), x_k(Eigen::Matrix<double, 3, 2>::Zero()), u_k(Eigen::Matrix<double, 1, 2>::Zero()),
+        zmp_z(0), cog_z(zc), model_zc(zc),
+        dt(dt), gravitational_acceleration(_gravitational_acceleration),
+        delay(static_cast<size_t>(round(d / dt))), ending_count(1+delay), queue(1+delay)
     {
       tcA << 1, dt, 0.5 * dt * dt,
         0, 1,  dt,
@@ -95,20 +198,13 @@ namespace rats
       x_k(0,0) = init_xk(0);
       x_k(0,1) = init_xk(1);
     };
-    virtual ~preview_control_base()
-    {
-      p.clear();
-      pz.clear();
-      qdata.clear();
-    };
+    virtual ~preview_control_base() {};
     virtual void update_x_k(const hrp::Vector3& pr, const std::vector<hrp::Vector3>& qdata);
     virtual void update_x_k()
     {
-      hrp::Vector3 pr;
-      pr(0) = p.back()(0);
-      pr(1) = p.back()(1);
-      pr(2) = pz.back();
-      update_x_k(pr, qdata.back());
+      zmp_z = queue.z(queue.size() - 1);
+      queue.push_back();
+      if ( is_doing() ) calc_x_k();
       ending_count--;
     };
     // void update_zc(double zc);
@@ -136,40 +232,41 @@ namespace rats
       Eigen::Matrix<double, 1, 2> _p(tcc * x_k);
       ret[0] = _p(0, 0);
       ret[1] = _p(0, 1);
-      ret[2] = pz.front();
+      ret[2] = queue.z(0);
     };
     void get_current_refzmp (double* ret)
     {
-      ret[0] = p.front()(0);
-      ret[1] = p.front()(1);
-      ret[2] = pz.front();
+      ret[0] = queue.x(0);
+      ret[1] = queue.y(0);
+      ret[2] = queue.z(0);
     };
     void get_current_qdata (std::vector<hrp::Vector3>& _qdata)
     {
-        _qdata = qdata.front();
+        queue.get_qdata(0, _qdata);
     };
-    bool is_doing () { return p.size() >= 1 + delay; };
+    bool is_doing () { return queue.size() >= 1 + delay; };
     bool is_end () { return ending_count <= 0 ; };
     void remove_preview_queue(const size_t remain_length)
     {
-      size_t num = p.size() - remain_length;
-      for (size_t i = 0; i < num; i++) {
-        p.pop_back();
-        pz.pop_back();
-        qdata.pop_back();
-      }
+      while (queue.size() > remain_length) queue.pop_back();
     };
     void remove_preview_queue() // Remove all queue
     {
-        p.clear();
-        pz.clear();
-        qdata.clear();
+        queue.clear();
     };
+    /* for overwriting the queue in place over several ticks */
+    size_t get_preview_queue_size () { return queue.size(); };
+    void set_preview_queue (const size_t i, const hrp::Vector3& pr, const std::vector<hrp::Vector3>& _qdata)
+    {
+      queue.set(i, pr, _qdata);
+    };
+    void shift_preview_queue () { queue.push_back(); }; // Push the last entry again and drop the first one
+    void update_x_k_with_current_queue () { if ( is_doing() ) calc_x_k(); };
     void print_all_queue ()
     {
       std::cerr << "(list ";
-      for (size_t i = 0; i < p.size(); i++) {
-        std::cerr << "#f(" << p[i](0) << " " << p[i](1) << ") ";
+      for (size_t i = 0; i < queue.size(); i++) {
+        std::cerr << "#f(" << queue.x(i) << " " << queue.y(i) << ") ";
       }
       std::cerr << ")" << std::endl;
     }
@@ -263,6 +360,24 @@ namespace rats
     {
       preview_controller.remove_preview_queue();
     };
+    size_t get_preview_queue_size () { return preview_controller.get_preview_queue_size(); };
+    void set_preview_queue (const size_t i, const hrp::Vector3& pr, const std::vector<hrp::Vector3>& qdata)
+    {
+      preview_controller.set_preview_queue(i, pr, qdata);
+    };
+    void shift_preview_queue () { preview_controller.shift_preview_queue(); };
+    /* update without pushing new refzmp, used while the queue is overwritten by set_preview_queue */
+    bool update_with_current_queue (hrp::Vector3& p_ret, hrp::Vector3& x_ret, std::vector<hrp::Vector3>& qdata_ret)
+    {
+      preview_controller.update_x_k_with_current_queue();
+      bool flg = preview_controller.is_doing();
+      if (flg) {
+        preview_controller.get_current_refzmp(p_ret.data());
+        preview_controller.get_refcog(x_ret.data());
+        preview_controller.get_current_qdata(qdata_ret);
+      }
+      return flg;
+    };
     void print_all_queue ()
     {
       preview_controller.print_all_queue();
@@ -0,0 +1,405 @@
+// -*- C++ -*-
+/*!
+ * @file  WholeBodyIKSolver.h
+ * @brief inverse kinematics of all limbs with a whole-body Jacobian
+ * @date  $Date$
+ *
+ * $Id$
+ */
+#ifndef WHOLEBODYIKSOLVER_H
+#define WHOLEBODYIKSOLVER_H
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <Eigen/LU>
+#include "../ImpedanceController/JointPathEx.h"
+
+namespace hrp {
+    /*
+      IK of limbs whose base links are fixed, e.g. legs and arms of
+      AutoBalancer. Tasks of active limbs are stacked into one Jacobian whose
+      columns are the joints of the limbs, and dq is solved by one weighted
+      SR-inverse per iteration:
+
+        dq = J# v + (I - J# J) u,  J# = W Jt (J W Jt + K)^-1
+
+      W, K(SR gain of each limb), u(joint limit avoidance and reference
+      joint angles), joint speed limits and interlocking joints are the same
+      as JointPathEx::calcInverseKinematics2Loop. Limbs which share joints,
+      e.g. arms on a chest joint, are coupled into a group, and J W Jt + K is
+      block diagonal with one block per group. Each block is factorized
+      separately, so limbs which do not share joints get the same solution
+      as the IK of each limb.
+
+      Buffers are allocated by addLimb() and setActiveLimbs(), which should
+      be called out of the realtime loop. solve() does not allocate memory.
+    */
+    class WholeBodyIKSolver
+    {
+    public:
+        WholeBodyIKSolver (const BodyPtr& robot, const std::string& print_str = "")
+            : m_robot(robot), num_rows(0), num_cols(0), num_iterations(0),
+              debug_print_prefix(print_str+",WholeBodyIKSolver"), debug_print_freq_count(1),
+              col_of_joint(robot->numJoints(), -1), owner_of_joint(robot->numJoints(), -1), avoid_weight_gains(robot->numJoints(), 0.0),
+              joint_limit_debug_print_counts(robot->numJoints(), 0)
+        {
+        };
+        /*
+          Add a limb. Parameters of IK such as SR gain and joint weights are
+          read from manip in every iteration.
+          Returns the index of the limb.
+        */
+        size_t addLimb (const JointPathExPtr& manip)
+        {
+            IKLimb l;
+            l.manip = manip;
+            l.J = dmatrix::Zero(6, manip->numJoints());
+            l.optional_weight_vector.resize(manip->numJoints());
+            manip->getInterlockingJointPairIndices(l.interlocking_joint_pair_indices);
+            l.target_p = Vector3::Zero();
+            l.target_R = Matrix33::Identity();
+            l.avoid_gain = l.reference_gain = 0.0;
+            l.is_active = false;
+            l.row = l.group = 0;
+            size_t rows = 6 + l.interlocking_joint_pair_indices.size();
+            l.JJt = dmatrix::Zero(rows, rows);
+            l.JJt_lu = Eigen::PartialPivLU<dmatrix>(rows);
+            limbs.push_back(l);
+            debug_print_freq_count = std::max(static_cast<size_t>(0.25/manip->getControlCycle()), static_cast<size_t>(1)); // once per 0.25[s]
+            updateLayout();
+            return limbs.size() - 1;
+        };
+        size_t numLimbs () const { return limbs.size(); };
+        /*
+          Set limbs to be solved, is_active is in order of addLimb().
+          The Jacobian and buffers are laid out again.
+        */
+        void setActiveLimbs (const std::vector<bool>& is_active)
+        {
+            for (size_t i = 0; i < limbs.size(); i++) limbs[i].is_active = (i < is_active.size() && is_active[i]);
+            updateLayout();
+        };
+        bool isLimbActive (const size_t idx) const { return limbs[idx].is_active; };
+        void setLimbTarget (const size_t idx, const Vector3& target_p, const Matrix33& target_R,
+                            const double avoid_gain, const double reference_gain)
+        {
+            IKLimb& l = limbs[idx];
+            l.target_p = target_p;
+            l.target_R = target_R;
+            l.avoid_gain = avoid_gain;
+            l.reference_gain = reference_gain;
+        };
+        /*
+          Solve IK of active limbs.
+          One iteration is same as calcInverseKinematics2Loop of all limbs.
+          Iterations are stopped when errors of all limbs are less than
+          pos_thre[m] and rot_thre[rad], or max_iteration is reached.
+          Returns false if nan/inf is found.
+        */
+        bool solve (const size_t max_iteration, const double LAMBDA, const dvector* reference_q, const double vel_gain,
+                    const double pos_thre, const double rot_thre)
+        {
+            num_iterations = 0;
+            while (num_iterations < max_iteration) {
+                if (!solveOneLoop(LAMBDA, reference_q, vel_gain)) return false;
+                num_iterations++;
+                if (isConverged(pos_thre, rot_thre)) break;
+            }
+            return true;
+        };
+        // Number of iterations of the last solve()
+        size_t getNumIterations () const { return num_iterations; };
+    private:
+        struct IKLimb {
+            JointPathExPtr manip;
+            dmatrix J;
+            std::vector<double> optional_weight_vector;
+            std::vector<std::pair<size_t, size_t> > interlocking_joint_pair_indices;
+            Vector3 target_p;
+            Matrix33 target_R;
+            double avoid_gain, reference_gain;
+            bool is_active;
+            size_t row; // first row in the whole-body Jacobian
+            size_t group;
+            // J Jt of the limb for manipulability if interlocking joints are defined
+            dmatrix JJt;
+            Eigen::PartialPivLU<dmatrix> JJt_lu;
+        };
+        // limbs coupled by shared joints, rows and cols of the group are contiguous
+        struct IKGroup {
+            size_t row, rows, col, cols;
+            Eigen::PartialPivLU<dmatrix> lu;
+        };
+        void resize (const size_t rows, const size_t cols)
+        {
+            J.resize(rows, cols);
+            WJt.resize(cols, rows);
+            A.resize(rows, rows);
+            X.resize(rows, cols);
+            v.resize(rows);
+            k.resize(rows);
+            Ju.resize(rows);
+            w.resize(cols);
+            u.resize(cols);
+            dq.resize(cols);
+            speed_ratio.resize(cols);
+        };
+        size_t findGroup (size_t i)
+        {
+            while (group_of_limb[i] != i) i = group_of_limb[i] = group_of_limb[group_of_limb[i]];
+            return i;
+        };
+        // rows and columns of the Jacobian are limbs and joints of each group in order of limbs
+        void updateLayout ()
+        {
+            for (size_t i = 0; i < active_joints.size(); i++) col_of_joint[active_joints[i]->jointId] = owner_of_joint[active_joints[i]->jointId] = -1;
+            active_joints.clear();
+            owner_of_col.clear();
+            // couple limbs which share joints
+            group_of_limb.resize(limbs.size());
+            groups.clear();
+            for (size_t i = 0; i < limbs.size(); i++) {
+                group_of_limb[i] = i;
+                if (!limbs[i].is_active) continue;
+                for (int j = 0; j < limbs[i].manip->numJoints(); j++) {
+                    int& owner = owner_of_joint[limbs[i].manip->joint(j)->jointId];
+                    if (owner < 0) {
+                        owner = i;
+                    } else {
+                        group_of_limb[findGroup(i)] = findGroup(owner);
+                    }
+                }
+            }
+            num_rows = 0;
+            for (size_t g = 0; g < limbs.size(); g++) {
+                if (!limbs[g].is_active || findGroup(g) != g) continue;
+                IKGroup group;
+                group.row = num_rows;
+                group.col = active_joints.size();
+                for (size_t i = 0; i < limbs.size(); i++) {
+                    IKLimb& l = limbs[i];
+                    if (!l.is_active || findGroup(i) != g) continue;
+                    l.row = num_rows;
+                    l.group = groups.size();
+                    num_rows += 6 + l.interlocking_joint_pair_indices.size();
+                    for (int j = 0; j < l.manip->numJoints(); j++) {
+                        Link* joint = l.manip->joint(j);
+                        if (col_of_joint[joint->jointId] < 0) {
+                            col_of_joint[joint->jointId] = active_joints.size();
+                            active_joints.push_back(joint);
+                            owner_of_col.push_back(std::pair<size_t, int>(i, j));
+                        }
+                    }
+                }
+                group.rows = num_rows - group.row;
+                group.cols = active_joints.size() - group.col;
+                group.lu = Eigen::PartialPivLU<dmatrix>(group.rows);
+                groups.push_back(group);
+            }
+            for (size_t i = 0; i < active_joints.size(); i++) owner_of_joint[active_joints[i]->jointId] = -1;
+            num_cols = active_joints.size();
+            resize(num_rows, num_cols);
+        };
+        bool solveOneLoop (const double LAMBDA, const dvector* reference_q, const double vel_gain)
+        {
+            if (num_cols == 0) return true;
+            // Total jacobian, workspace velocity and joint weights
+            J.setZero();
+            v.setZero();
+            for (size_t i = 0; i < limbs.size(); i++) {
+                IKLimb& l = limbs[i];
+                if (!l.is_active) continue;
+                Link* end = l.manip->endLink();
+                v.segment<3>(l.row) = (l.target_p - end->p) * vel_gain;
+                v.segment<3>(l.row+3) = (end->R * matrix_logEx(end->R.transpose() * l.target_R)) * vel_gain;
+                l.manip->calcJacobian(l.J);
+                for (int j = 0; j < l.manip->numJoints(); j++) {
+                    J.block(l.row, col_of_joint[l.manip->joint(j)->jointId], 6, 1) = l.J.col(j);
+                }
+                for (size_t j = 0; j < l.interlocking_joint_pair_indices.size(); j++) {
+                    const std::pair<size_t, size_t>& pair = l.interlocking_joint_pair_indices[j];
+                    J(l.row+6+j, col_of_joint[l.manip->joint(pair.first)->jointId]) = 1;
+                    J(l.row+6+j, col_of_joint[l.manip->joint(pair.second)->jointId]) = -1;
+                }
+                l.manip->getOptionalWeightVector(l.optional_weight_vector);
+            }
+            for (size_t c = 0; c < num_cols; c++) {
+                const IKLimb& l = limbs[owner_of_col[c].first];
+                w(c) = calcJointLimitAvoidanceWeight(active_joints[c], avoid_weight_gains[active_joints[c]->jointId],
+                                                     l.optional_weight_vector[owner_of_col[c].second],
+                                                     l.manip->getUseInsideJointWeightRetrieval());
+            }
+            // J# = W Jt(J W Jt + kI)-1 (Weighted SR-Inverse), k is calculated from manipulability of each limb
+            for (size_t g = 0; g < groups.size(); g++) {
+                const IKGroup& gr = groups[g];
+                WJt.block(gr.col, gr.row, gr.cols, gr.rows).noalias() = w.segment(gr.col, gr.cols).asDiagonal() * J.block(gr.row, gr.col, gr.rows, gr.cols).transpose();
+                A.block(gr.row, gr.row, gr.rows, gr.rows).noalias() = J.block(gr.row, gr.col, gr.rows, gr.cols) * WJt.block(gr.col, gr.row, gr.cols, gr.rows);
+            }
+            for (size_t i = 0; i < limbs.size(); i++) {
+                IKLimb& l = limbs[i];
+                if (!l.is_active) continue;
+                const IKGroup& gr = groups[l.group];
+                size_t rows = 6 + l.interlocking_joint_pair_indices.size();
+                // J J^t of the limb is the diagonal block of J J^t
+                double manipulability;
+                if (rows == 6) {
+                    Eigen::Matrix<double, 6, 6> JJt;
+                    JJt.noalias() = J.block(l.row, gr.col, 6, gr.cols) * J.block(l.row, gr.col, 6, gr.cols).transpose();
+                    manipulability = sqrt(JJt.determinant());
+                } else {
+                    l.JJt.noalias() = J.block(l.row, gr.col, rows, gr.cols) * J.block(l.row, gr.col, rows, gr.cols).transpose();
+                    l.JJt_lu.compute(l.JJt);
+                    manipulability = sqrt(l.JJt_lu.determinant());
+                }
+                double limit = l.manip->getManipulabilityLimit(), gain = 0;
+                if ( manipulability < limit ) {
+                    gain = l.manip->getManipulabilityGain() * pow((1 - ( manipulability / limit )), 2);
+                }
+                k.segment(l.row, rows).setConstant(l.manip->getSRGain() * gain);
+            }
+            A.diagonal() += k;
+            for (size_t g = 0; g < groups.size(); g++) {
+                IKGroup& gr = groups[g];
+                gr.lu.compute(A.block(gr.row, gr.row, gr.rows, gr.rows));
+                X.block(gr.row, gr.col, gr.rows, gr.cols) = gr.lu.solve(WJt.block(gr.col, gr.row, gr.cols, gr.rows).transpose()); // X = J#^t
+                dq.segment(gr.col, gr.cols).noalias() = X.block(gr.row, gr.col, gr.rows, gr.cols).transpose() * v.segment(gr.row, gr.rows);
+            }
+            // joint limit avoidance and following to reference_q by null space vector
+            bool use_nullspace = false;
+            for (size_t c = 0; c < num_cols; c++) {
+                const IKLimb& l = limbs[owner_of_col[c].first];
+                double ow = l.optional_weight_vector[owner_of_col[c].second];
+                Link* joint = active_joints[c];
+                u(c) = 0;
+                if ( l.avoid_gain > 0.0 ) {
+                    double r = ((( (joint->ulimit + joint->llimit) / 2.0) - joint->q) / ((joint->ulimit - joint->llimit) / 2.0));
+                    if ( r > 0 ) { r = r*r; } else { r = - r*r; }
+                    u(c) += ow * l.avoid_gain * r;
+                    use_nullspace = true;
+                }
+                if ( l.reference_gain > 0.0 && reference_q != NULL ) {
+                    u(c) += ow * l.reference_gain * ( (*reference_q)[joint->jointId] - joint->q );
+                    use_nullspace = true;
+                }
+            }
+            if (use_nullspace) {
+                // (I - J# J) u
+                dq += u;
+                for (size_t g = 0; g < groups.size(); g++) {
+                    const IKGroup& gr = groups[g];
+                    Ju.segment(gr.row, gr.rows).noalias() = J.block(gr.row, gr.col, gr.rows, gr.cols) * u.segment(gr.col, gr.cols);
+                    dq.segment(gr.col, gr.cols).noalias() -= X.block(gr.row, gr.col, gr.rows, gr.cols).transpose() * Ju.segment(gr.row, gr.rows);
+                }
+            }
+            // dq limitation using lvlimit/uvlimit of each limb
+            speed_ratio.setOnes();
+            for (size_t i = 0; i < limbs.size(); i++) {
+                IKLimb& l = limbs[i];
+                if (!l.is_active) continue;
+                double min_speed_ratio = 1.0;
+                for (int j = 0; j < l.manip->numJoints(); j++) {
+                    Link* joint = l.manip->joint(j);
+                    double dqj = dq(col_of_joint[joint->jointId]), ratio = 1.0, dt = l.manip->getControlCycle();
+                    if (dqj < joint->lvlimit * dt) {
+                        ratio = fabs(joint->lvlimit * dt / dqj);
+                    } else if (dqj > joint->uvlimit * dt) {
+                        ratio = fabs(joint->uvlimit * dt / dqj);
+                    }
+                    min_speed_ratio = std::max(std::min(min_speed_ratio, ratio), 0.0);
+                }
+                for (int j = 0; j < l.manip->numJoints(); j++) {
+                    double& r = speed_ratio(col_of_joint[l.manip->joint(j)->jointId]);
+                    r = std::min(r, min_speed_ratio);
+                }
+            }
+            for (size_t c = 0; c < num_cols; c++) {
+                if ( speed_ratio(c) < 1.0 ) dq(c) *= speed_ratio(c);
+            }
+            // check nan / inf
+            for (size_t c = 0; c < num_cols; c++) {
+                if ( isnan(dq(c)) || isinf(dq(c)) ) {
+                    std::cerr << "[" << debug_print_prefix << "] ERROR nan/inf is found" << std::endl;
+                    return false;
+                }
+            }
+            // joint angles update
+            for (size_t c = 0; c < num_cols; c++) {
+                active_joints[c]->q += LAMBDA * dq(c);
+            }
+            // If interlocking joints are defined, set interlocking joints by mid point
+            for (size_t i = 0; i < limbs.size(); i++) {
+                IKLimb& l = limbs[i];
+                if (!l.is_active) continue;
+                for (size_t j = 0; j < l.interlocking_joint_pair_indices.size(); j++) {
+                    Link* joint1 = l.manip->joint(l.interlocking_joint_pair_indices[j].first);
+                    Link* joint2 = l.manip->joint(l.interlocking_joint_pair_indices[j].second);
+                    double midp = (joint1->q + joint2->q)/2.0;
+                    joint1->q = midp;
+                    joint2->q = midp;
+                }
+            }
+            // upper/lower limit check
+            for (size_t c = 0; c < num_cols; c++) {
+                Link* joint = active_joints[c];
+                size_t& count = joint_limit_debug_print_counts[joint->jointId];
+                bool is_limit_over = false;
+                if ( joint->q > joint->ulimit ) {
+                    is_limit_over = true;
+                    if (count % debug_print_freq_count == 0) {
+                        std::cerr << "[" << debug_print_prefix << "] Upper joint limit over " << joint->name
+                                  << " (ja=" << joint->q << "[rad], limit=" << joint->ulimit << "[rad], count=" << count << ", debug_print_freq_count=" << debug_print_freq_count << ")" << std::endl;
+                    }
+                    joint->q = joint->ulimit;
+                }
+                if ( joint->q < joint->llimit ) {
+                    is_limit_over = true;
+                    if (count % debug_print_freq_count == 0) {
+                        std::cerr << "[" << debug_print_prefix << "] Lower joint limit over " << joint->name
+                                  << " (ja=" << joint->q << "[rad], limit=" << joint->llimit << "[rad], count=" << count << ", debug_print_freq_count=" << debug_print_freq_count << ")" << std::endl;
+                    }
+                    joint->q = joint->llimit;
+                }
+                if (is_limit_over) {
+                    count++;
+                } else {
+                    count = 0; // resetting
+                }
+            }
+            for (size_t i = 0; i < limbs.size(); i++) {
+                if (limbs[i].is_active) limbs[i].manip->calcForwardKinematics();
+            }
+            return true;
+        };
+        bool isConverged (const double pos_thre, const double rot_thre)
+        {
+            for (size_t i = 0; i < limbs.size(); i++) {
+                const IKLimb& l = limbs[i];
+                if (!l.is_active) continue;
+                Link* end = l.manip->endLink();
+                if ((l.target_p - end->p).norm() > pos_thre ||
+                    matrix_logEx(end->R.transpose() * l.target_R).norm() > rot_thre) return false;
+            }
+            return true;
+        };
+
+        BodyPtr m_robot;
+        std::vector<IKLimb> limbs;
+        size_t num_rows, num_cols, num_iterations;
+        std::string debug_print_prefix;
+        size_t debug_print_freq_count;
+        // joints of active limbs, (index of limb, index in limb) of each joint and column of each jointId
+        std::vector<Link*> active_joints;
+        std::vector<std::pair<size_t, int> > owner_of_col;
+        std::vector<int> col_of_joint, owner_of_joint;
+        std::vector<size_t> group_of_limb;
+        std::vector<IKGroup> groups;
+        std::vector<double> avoid_weight_gains;
+        std::vector<size_t> joint_limit_debug_print_counts;
+        dmatrix J, WJt, A, X;
+        dvector v, k, Ju, w, u, dq, speed_ratio;
+    };
+};
+
+#endif // WHOLEBODYIKSOLVER_H
@@ -4,6 +4,7 @@
 /* samples */
 using namespace rats;
 #include <cstdio>
+#include <time.h>
 #include <coil/stringutil.h>
 
 #define eps_eq(a,b,epsilon) (std::fabs((a)-(b)) < (epsilon))
@@ -16,7 +17,13 @@ protected:
     std::vector<std::string> all_limbs;
     hrp::Vector3 cog;
     gait_generator* gg;
-    bool use_gnuplot, is_small_zmp_error, is_small_zmp_diff, is_contact_states_swing_support_time_validity;
+    bool use_gnuplot, is_small_zmp_error, is_small_zmp_diff, is_contact_states_swing_support_time_validity, is_small_tick_time;
+    bool use_zmp_diff_check, use_tick_time_check, is_same_trajectory;
+    double velocity_mode_finalize_time; /* [s], finalize velocity mode if positive */
+    double max_tick_time; /* [s], max computation time of proc_one_tick */
+    std::vector<hrp::Vector3> refzmp_trajectory, cog_trajectory; /* refzmp and cog of every tick of the last walk */
+    /* make gg again for another walk */
+    virtual void reset_gait_generator () = 0;
 private:
     // error check
     bool check_zmp_error (const hrp::Vector3& czmp, const hrp::Vector3& refzmp)
@@ -27,6 +34,33 @@ private:
     {
         return (prev_zmp - zmp).norm() < 10.0*1e-3; // [mm]
     }
+    bool check_tick_time (const double tick_time)
+    {
+        return tick_time < 0.5*dt; // Half of control cycle is left for other components
+    }
+    bool check_trajectory_diff (const std::vector<hrp::Vector3>& traj0, const std::vector<hrp::Vector3>& traj1, const double thre, const std::string& name)
+    {
+        if (traj0.size() != traj1.size()) {
+            std::cerr << "  " << name << " : length differs (" << traj0.size() << " " << traj1.size() << ")" << std::endl;
+            return false;
+        }
+        double max_diff = 0;
+        for (size_t i = 0; i < traj0.size(); i++) {
+            max_diff = std::max(max_diff, (traj0[i] - traj1[i]).norm());
+        }
+        std::cerr << "  " << name << " : max diff " << max_diff*1e3 << "[mm]" << std::endl;
+        return max_diff <= thre;
+    }
+    // proc_one_tick with measurement of its cpu time, which is not affected by preemption
+    bool proc_one_tick_with_time ()
+    {
+        struct timespec s, e;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &s);
+        bool ret = gg->proc_one_tick();
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &e);
+        max_tick_time = std::max(max_tick_time, (e.tv_sec - s.tv_sec) + (e.tv_nsec - s.tv_nsec)*1e-9);
+        return ret;
+    }
     // plot and pattern generation
     void plot_and_save (FILE* gp, const std::string graph_fname, const std::string plot_str)
     {
@@ -50,7 +84,9 @@ private:
         std::vector<std::string> tmp_string_vector;
         std::vector<bool> prev_contact_states(2, true); // RLEG, LLEG
         std::vector<double> prev_swing_support_time(2, 1e2); // RLEG, LLEG
-        while ( gg->proc_one_tick() ) {
+        refzmp_trajectory.clear();
+        cog_trajectory.clear();
+        while ( proc_one_tick_with_time() ) {
             //std::cerr << gg->lcg.gp_count << std::endl;
             // if ( gg->lcg.gp_index == 4 && gg->lcg.gp_count == 100) {
             //   //std::cerr << gg->lcg.gp_index << std::endl;
@@ -164,6 +200,8 @@ private:
             bool lleg_contact_states = std::find_if(tmp_current_support_states.begin(), tmp_current_support_states.end(), boost::lambda::_1 == LLEG) != tmp_current_support_states.end();
             fprintf(fp_sstime, "%d %d ", (rleg_contact_states ? 1 : 0), (lleg_contact_states ? 1 : 0));
             fprintf(fp_sstime, "\n");
+            refzmp_trajectory.push_back(gg->get_refzmp());
+            cog_trajectory.push_back(gg->get_cog());
             // Error checking
             is_small_zmp_error = check_zmp_error(gg->get_cart_zmp(), gg->get_refzmp()) && is_small_zmp_error;
             if (i>0) {
@@ -178,8 +216,10 @@ private:
             prev_contact_states[1] = lleg_contact_states;
             prev_swing_support_time[0] = gg->get_current_swing_time(RLEG);
             prev_swing_support_time[1] = gg->get_current_swing_time(LLEG);
+            if (velocity_mode_finalize_time > 0 && i == static_cast<size_t>(velocity_mode_finalize_time/dt)) gg->finalize_velocity_mode();
             i++;
         }
+        is_small_tick_time = check_tick_time(max_tick_time);
         fclose(fp);
         fclose(fp_sstime);
 
@@ -342,6 +382,7 @@ private:
         std::cerr << "  ZMP error : " << is_small_zmp_error << std::endl;
         std::cerr << "  ZMP diff : " << is_small_zmp_diff << std::endl;
         std::cerr << "  Contact states & swing support time validity : " << is_contact_states_swing_support_time_validity << std::endl;
+        std::cerr << "  Tick time : " << is_small_tick_time << " (max " << max_tick_time*1e3 << "[ms])" << (use_tick_time_check ? "" : ", not checked") << std::endl;
     };
 
     void gen_and_plot_walk_pattern(const step_node& initial_support_leg_step, const step_node& initial_swing_leg_dst_step)
@@ -370,7 +411,8 @@ private:
 
 public:
     std::vector<std::string> arg_strs;
-    testGaitGenerator() : use_gnuplot(true), is_small_zmp_error(true), is_small_zmp_diff(true), is_contact_states_swing_support_time_validity(true) {};
+    testGaitGenerator() : gg(NULL), use_gnuplot(true), is_small_zmp_error(true), is_small_zmp_diff(true), is_contact_states_swing_support_time_validity(true), is_small_tick_time(true),
+                          use_zmp_diff_check(true), use_tick_time_check(false), is_same_trajectory(true), velocity_mode_finalize_time(-1), max_tick_time(0) {};
     virtual ~testGaitGenerator()
     {
         if (gg != NULL) {
@@ -643,6 +685,33 @@ public:
         gen_and_plot_walk_pattern();
     };
 
+    void test15 ()
+    {
+        std::cerr << "test15 : Velocity mode" << std::endl;
+        /* initialize sample footstep_list */
+        parse_params();
+        coordinates start_ref_coords;
+        mid_coords(start_ref_coords, 0.5, coordinates(leg_pos[1]), coordinates(leg_pos[0]));
+        gg->initialize_velocity_mode(start_ref_coords, 100*1e-3, 20*1e-3, 5, boost::assign::list_of(LLEG));
+        velocity_mode_finalize_time = 10.0;
+        use_zmp_diff_check = false; // refzmp skips a few ticks at the first overwrite of footsteps in velocity mode
+        gen_and_plot_walk_pattern();
+    };
+
+    void test16 ()
+    {
+        std::cerr << "test16 : Velocity mode with overwriting refzmp queue over several ticks" << std::endl;
+        /* walk of test15 as a reference */
+        test15();
+        std::vector<hrp::Vector3> ref_refzmp_trajectory(refzmp_trajectory), ref_cog_trajectory(cog_trajectory);
+        reset_gait_generator();
+        gg->set_overwrite_refzmp_queue_num_per_tick(50);
+        test15();
+        std::cerr << "Comparing with test15" << std::endl;
+        is_same_trajectory = check_trajectory_diff(ref_refzmp_trajectory, refzmp_trajectory, 1e-9, "refzmp") &&
+            check_trajectory_diff(ref_cog_trajectory, cog_trajectory, 0.1*1e-3, "cog"); // [m]
+    };
+
 
     void parse_params ()
     {
@@ -709,15 +778,20 @@ public:
               }
           } else if ( arg_strs[i]== "--optional-go-pos-finalize-footstep-num" ) {
               if (++i < arg_strs.size()) gg->set_optional_go_pos_finalize_footstep_num(atoi(arg_strs[i].c_str()));
+          } else if ( arg_strs[i]== "--overwrite-refzmp-queue-num-per-tick" ) {
+              if (++i < arg_strs.size()) gg->set_overwrite_refzmp_queue_num_per_tick(atoi(arg_strs[i].c_str()));
           } else if ( arg_strs[i]== "--use-gnuplot" ) {
               if (++i < arg_strs.size()) use_gnuplot = (arg_strs[i]=="true");
+          } else if ( arg_strs[i]== "--check-tick-time" ) {
+              if (++i < arg_strs.size()) use_tick_time_check = (arg_strs[i]=="true");
           }
       }   
     };
 
     bool check_all_results ()
     {
-        return is_small_zmp_error && is_small_zmp_diff && is_contact_states_swing_support_time_validity;
+        return is_small_zmp_error && (is_small_zmp_diff || !use_zmp_diff_check) && is_contact_states_swing_support_time_validity &&
+            (is_small_tick_time || !use_tick_time_check) && is_same_trajectory;
     };
 };
 
@@ -732,6 +806,11 @@ class testGaitGeneratorHRP2JSK : public testGaitGenerator
             leg_pos.push_back(hrp::Vector3(0,1e-3* 105,0)); /* lleg */
             all_limbs.push_back("rleg");
             all_limbs.push_back("lleg");
+            reset_gait_generator();
+        };
+    void reset_gait_generator ()
+        {
+            if (gg != NULL) delete gg;
             gg = new gait_generator(dt, leg_pos, all_limbs, 1e-3*150, 1e-3*50, 10, 1e-3*50);
         };
 };
@@ -756,6 +835,10 @@ void print_usage ()
     std::cerr << "  --test12 : Change step param in set foot steps" << std::endl;
     std::cerr << "  --test13 : Arbitrary leg switching" << std::endl;
     std::cerr << "  --test14 : kick walk" << std::endl;
+    std::cerr << "  --test15 : Velocity mode" << std::endl;
+    std::cerr << "  --test16 : Velocity mode with overwriting refzmp queue over several ticks" << std::endl;
+    std::cerr << " [option] for all tests:" << std::endl;
+    std::cerr << "  --check-tick-time true : Fail if proc_one_tick takes half of dt or more" << std::endl;
 };
 
 int main(int argc, char* argv[])
@@ -796,6 +879,10 @@ int main(int argc, char* argv[])
           tgg.test13();
       } else if (std::string(argv[1]) == "--test14") {
           tgg.test14();
+      } else if (std::string(argv[1]) == "--test15") {
+          tgg.test15();
+      } else if (std::string(argv[1]) == "--test16") {
+          tgg.test16();
       } else {
           print_usage();
           ret = 1;
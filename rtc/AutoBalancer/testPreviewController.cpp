@@ -13,16 +13,110 @@ struct gait_parameter /* for test */
 };
 
 #include<cstdio>
+#include<cstring>
+#include<sys/time.h>
+
+/* preview_control whose preview sum is computed by std::deque as before */
+class deque_preview_control : public preview_control
+{
+  std::deque<Eigen::Matrix<double, 2, 1> > p;
+  void calc_u()
+  {
+    Eigen::Matrix<double, 1, 2> gfp(Eigen::Matrix<double, 1, 2>::Zero());
+    for (size_t i = 0; i < 1 + delay; i++)
+      gfp += f(i) * p[i];
+    u_k = -riccati.K * x_k + gfp;
+  };
+public:
+  deque_preview_control(const double dt, const double zc, const hrp::Vector3& init_xk)
+    : preview_control(dt, zc, init_xk) {};
+  void update_x_k(const hrp::Vector3& pr, const std::vector<hrp::Vector3>& qdata)
+  {
+    p.push_back(Eigen::Matrix<double, 2, 1>(pr(0), pr(1)));
+    if ( p.size() > 1 + delay ) p.pop_front();
+    preview_control::update_x_k(pr, qdata);
+  };
+};
+
+/* compare outputs of the ring buffer and the deque bit by bit */
+bool check_identical (const double dt)
+{
+  preview_control pc(dt, 0.8, hrp::Vector3::Zero());
+  deque_preview_control dpc(dt, 0.8, hrp::Vector3::Zero());
+  size_t n = static_cast<size_t>(round(8.0 / dt));
+  std::vector<hrp::Vector3> qdata(2), qdata_ret;
+  double cog0[3], cog1[3];
+  for (size_t i = 0; i < n; i++) {
+    hrp::Vector3 v(0.02 * sin(i * dt * 3), -0.02 * cos(i * dt * 2), 0);
+    qdata[0] = v;
+    qdata[1] = -v;
+    pc.update_x_k(v, qdata);
+    dpc.update_x_k(v, qdata);
+    pc.get_refcog(cog0);
+    dpc.get_refcog(cog1);
+    if (memcmp(cog0, cog1, sizeof(cog0)) != 0) {
+      std::cerr << "[ng] dt = " << dt << ", cog differs at " << i << std::endl;
+      return false;
+    }
+    pc.get_current_qdata(qdata_ret);
+    size_t j = i > pc.get_delay() ? i - pc.get_delay() : 0;
+    if (qdata_ret.size() != 2 || qdata_ret[0](0) != 0.02 * sin(j * dt * 3)) {
+      std::cerr << "[ng] dt = " << dt << ", qdata differs at " << i << std::endl;
+      return false;
+    }
+  }
+  std::cerr << "[ok] dt = " << dt << ", ring buffer output is identical to deque" << std::endl;
+  return true;
+}
+
+/* time per update_x_k of extended_preview_control */
+void benchmark (const double dt)
+{
+  extended_preview_control pc(dt, 0.8, hrp::Vector3::Zero());
+  std::vector<hrp::Vector3> qdata(2);
+  size_t n = static_cast<size_t>(round(20.0 / dt));
+  struct timeval s, e;
+  gettimeofday(&s, NULL);
+  for (size_t i = 0; i < n; i++) {
+    hrp::Vector3 v(0.02 * sin(i * dt), 0.02 * cos(i * dt), 0);
+    pc.update_x_k(v, qdata);
+  }
+  gettimeofday(&e, NULL);
+  double t = (e.tv_sec - s.tv_sec) * 1e6 + (e.tv_usec - s.tv_usec);
+  fprintf(stderr, "%4.0f [Hz], delay = %zu : %.3f [us/tick]\n", 1 / dt, pc.get_delay(), t / n);
+}
+
+/* time to create a controller at walk start, with and without the riccati cache */
+void benchmark_walk_start (const double dt, const double zc)
+{
+  struct timeval s, e;
+  double t[2];
+  for (size_t i = 0; i < 2; i++) {
+    gettimeofday(&s, NULL);
+    extended_preview_control pc(dt, zc, hrp::Vector3::Zero());
+    gettimeofday(&e, NULL);
+    t[i] = (e.tv_sec - s.tv_sec) * 1e3 + (e.tv_usec - s.tv_usec) * 1e-3;
+  }
+  fprintf(stderr, "%4.0f [Hz], walk start : solve = %.3f [ms], cached = %.3f [ms]\n", 1 / dt, t[0], t[1]);
+}
 
 int main(int argc, char* argv[])
 {
   /* this is c++ version example of test-preview-filter1-modified in euslib/jsk/preview.l*/
   bool use_gnuplot = true;
-  if (argc >= 2) {
-      if ( std::string(argv[1])== "--use-gnuplot" ) {
-          use_gnuplot = (std::string(argv[2])=="true");
+  for (int i = 1; i < argc; i++) {
+      if ( std::string(argv[i])== "--use-gnuplot" && ++i < argc ) {
+          use_gnuplot = (std::string(argv[i])=="true");
+      } else if ( std::string(argv[i])== "--benchmark" ) {
+          /* 1 kHz and 500 Hz */
+          benchmark(0.001);
+          benchmark(0.002);
+          benchmark_walk_start(0.001, 0.75);
+          benchmark_walk_start(0.002, 0.75);
+          return 0;
       }
   }
+  if (!check_identical(0.01) || !check_identical(0.002)) return 1;
 
   double dt = 0.01, max_tm = 8.0;
   std::queue<hrp::Vector3> ref_zmp_list;
@@ -0,0 +1,221 @@
+/* -*- coding:utf-8-unix; mode:c++; -*- */
+/* compares WholeBodyIKSolver with IK of each limb by
+   JointPathEx::calcInverseKinematics2Loop like AutoBalancer::solveLimbIK.
+   Legs of a 30-DOF humanoid follow a walk of gait_generator and arms sway.
+     testWholeBodyIKSolver [--test0|--test1]
+*/
+#include "WholeBodyIKSolver.h"
+#include "GaitGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+#include <boost/assign.hpp>
+#include "util/AllocationCounter.h"
+#include "util/TestUtil.h"
+
+using namespace rats;
+
+
+class testWholeBodyIKSolver
+{
+    struct Limb {
+        std::string name;
+        hrp::JointPathExPtr manip;
+        hrp::Vector3 target_p;
+        hrp::Matrix33 target_R;
+    };
+    // robot with limbs, root is WAIST
+    struct Robot {
+        hrp::BodyPtr body;
+        std::vector<Limb> limbs;
+        hrp::dvector qref;
+    };
+    double dt;
+    std::vector<hrp::Vector3> leg_pos;
+    hrp::Vector3 cog, sole_offset;
+    double root_height;
+
+    // 6-DOF legs, 1-DOF chest and 7-DOF arms. Arms start from CHEST, or WAIST if share_chest.
+    void makeRobot (Robot& r, const bool share_chest)
+    {
+        hrp::Link* ends[4];
+        r.body = makeTestBiped(root_height, leg_pos, ends);
+        hrp::Link* root = r.body->rootLink();
+        hrp::Link* chest = addTestJoint(r.body, root, "CHEST_Y", hrp::Vector3(0, 0, 0.2), hrp::Vector3(0, 0, 1), 0);
+        const char* lr[] = {"R", "L"};
+        for (int i = 0; i < 2; i++) {
+            double s = (i == 0 ? -1 : 1);
+            ends[2+i] = addTestArm(r.body, chest, std::string(lr[i]) + "ARM_", hrp::Vector3(0, s*0.2, 0.2), s);
+        }
+        r.body->calcForwardKinematics();
+        const char* names[] = {"rleg", "lleg", "rarm", "larm"};
+        for (int i = 0; i < 4; i++) {
+            Limb limb;
+            limb.name = names[i];
+            limb.manip = hrp::JointPathExPtr(new hrp::JointPathEx(r.body, (i < 2 || share_chest) ? root : chest, ends[i], dt, false, "testWholeBodyIKSolver"));
+            limb.target_p = ends[i]->p;
+            limb.target_R = ends[i]->R;
+            r.limbs.push_back(limb);
+        }
+        r.qref.resize(r.body->numJoints());
+        for (int i = 0; i < r.body->numJoints(); i++) r.qref(i) = r.body->joint(i)->q;
+    };
+    // targets of limbs at a tick of walking, root follows cog
+    void setTargets (Robot& r, const double t, const hrp::Vector3& cog_pos, const coordinates& rleg, const coordinates& lleg)
+    {
+        hrp::Link* root = r.body->rootLink();
+        root->p = hrp::Vector3(cog_pos(0), cog_pos(1), root_height);
+        coordinates mid;
+        mid_coords(mid, 0.5, rleg, lleg);
+        root->R = mid.rot;
+        r.body->calcForwardKinematics();
+        const coordinates* legs[] = {&rleg, &lleg};
+        for (size_t i = 0; i < 2; i++) {
+            r.limbs[i].target_R = legs[i]->rot;
+            r.limbs[i].target_p = legs[i]->pos - r.limbs[i].target_R * sole_offset;
+        }
+        for (size_t i = 2; i < 4; i++) {
+            double s = (i == 2 ? -1 : 1);
+            r.limbs[i].target_p = root->p + root->R * hrp::Vector3(0.1 + 0.1*sin(2*M_PI*t/1.6), s*(0.25 + 0.05*sin(2*M_PI*t/1.2)), 0.05);
+            r.limbs[i].target_R = root->R * hrp::rotFromRpy(0, -M_PI/2 + 0.3*sin(2*M_PI*t/2.0), 0);
+        }
+    };
+    double maxIKError (const Robot& r)
+    {
+        double e = 0;
+        for (size_t i = 0; i < r.limbs.size(); i++) {
+            const hrp::Link* end = r.limbs[i].manip->endLink();
+            e = std::max(e, (r.limbs[i].target_p - end->p).norm());
+        }
+        return e;
+    };
+    /*
+      Walk with both IK and compare joint angles.
+      Returns false if the whole-body IK allocates memory, the difference of
+      joint angles is larger than max_q_diff or IK error of the whole-body IK
+      is larger than the per-limb IK.
+      If share_chest, only joints of legs are compared because the per-limb IK
+      moves the chest joint for each arm in turn and the arms do not converge
+      to the same angles as the whole-body IK.
+    */
+    bool walk (const bool share_chest, const size_t max_iteration, const double max_q_diff)
+    {
+        Robot r_limb, r_wb;
+        makeRobot(r_limb, share_chest);
+        makeRobot(r_wb, share_chest);
+        hrp::WholeBodyIKSolver wbik(r_wb.body, "testWholeBodyIKSolver");
+        for (size_t i = 0; i < r_wb.limbs.size(); i++) wbik.addLimb(r_wb.limbs[i].manip);
+        wbik.setActiveLimbs(std::vector<bool>(r_wb.limbs.size(), true));
+
+        std::vector<std::string> all_limbs = boost::assign::list_of("rleg")("lleg");
+        gait_generator gg(dt, leg_pos, all_limbs, 1e-3*150, 1e-3*50, 10, 1e-3*50);
+        coordinates start_ref_coords;
+        mid_coords(start_ref_coords, 0.5, coordinates(leg_pos[0]), coordinates(leg_pos[1]));
+        gg.go_pos_param_2_footstep_nodes_list(300*1e-3, 100*1e-3, 20, boost::assign::list_of(coordinates(leg_pos[0])), start_ref_coords, boost::assign::list_of(RLEG));
+        gg.initialize_gait_parameter(cog, boost::assign::list_of(step_node(LLEG, coordinates(leg_pos[1]), 0, 0, 0, 0)),
+                                     boost::assign::list_of(step_node(RLEG, coordinates(leg_pos[0]), 0, 0, 0, 0)));
+
+        while ( !gg.proc_one_tick() );
+        size_t ticks = 0, sum_iterations = 0;
+        double q_diff = 0, ik_error_limb = 0, ik_error_wb = 0, tm_limb = 0, tm_wb = 0, max_tm_wb = 0;
+        num_allocation = 0;
+        while (gg.proc_one_tick()) {
+            coordinates feet[2];
+            const std::vector<step_node>* steps[] = {&gg.get_support_leg_steps(), &gg.get_swing_leg_steps()};
+            for (size_t i = 0; i < 2; i++) {
+                for (size_t j = 0; j < steps[i]->size(); j++) {
+                    feet[steps[i]->at(j).l_r == RLEG ? 0 : 1] = steps[i]->at(j).worldcoords;
+                }
+            }
+            double t = ticks * dt;
+            setTargets(r_limb, t, gg.get_cog(), feet[0], feet[1]);
+            setTargets(r_wb, t, gg.get_cog(), feet[0], feet[1]);
+            // IK of each limb
+            double t1 = now();
+            for (size_t it = 0; it < max_iteration; it++) {
+                for (size_t i = 0; i < r_limb.limbs.size(); i++) {
+                    Limb& l = r_limb.limbs[i];
+                    l.manip->calcInverseKinematics2Loop(l.target_p, l.target_R, 1.0, 0.001, 0.01, &r_limb.qref);
+                }
+            }
+            tm_limb += now() - t1;
+            // whole-body IK
+            count_allocation = ticks > 0;
+            t1 = now();
+            for (size_t i = 0; i < r_wb.limbs.size(); i++) {
+                wbik.setLimbTarget(i, r_wb.limbs[i].target_p, r_wb.limbs[i].target_R, 0.001, 0.01);
+            }
+            wbik.solve(max_iteration, 1.0, &r_wb.qref, 1.0, 1e-6, 1e-6);
+            double tm = now() - t1;
+            count_allocation = false;
+            tm_wb += tm;
+            max_tm_wb = std::max(max_tm_wb, tm);
+            sum_iterations += wbik.getNumIterations();
+            for (size_t i = 0; i < (share_chest ? 2 : r_wb.limbs.size()); i++) {
+                const hrp::JointPathExPtr& m_wb = r_wb.limbs[i].manip;
+                const hrp::JointPathExPtr& m_limb = r_limb.limbs[i].manip;
+                for (int j = 0; j < m_wb->numJoints(); j++) {
+                    q_diff = std::max(q_diff, std::fabs(m_wb->joint(j)->q - m_limb->joint(j)->q));
+                }
+            }
+            if (ticks > 0.5/dt) {
+                ik_error_limb = std::max(ik_error_limb, maxIKError(r_limb));
+                ik_error_wb = std::max(ik_error_wb, maxIKError(r_wb));
+            }
+            ticks++;
+        }
+        char buf[256];
+        sprintf(buf, "%d ticks, per-limb IK = %.2f[us], whole-body IK = %.2f[us](max %.2f[us]), iterations = %.2f, allocations = %d",
+                (int)ticks, tm_limb/ticks*1e6, tm_wb/ticks*1e6, max_tm_wb*1e6, (double)sum_iterations/ticks, num_allocation);
+        bool ret = checkResult(num_allocation == 0, buf);
+        sprintf(buf, "  max joint angle difference = %g[rad], max IK error = %g[m](per-limb), %g[m](whole-body)", q_diff, ik_error_limb, ik_error_wb);
+        ret &= checkResult(q_diff < max_q_diff && ik_error_wb < ik_error_limb + 1e-9, buf);
+        return ret;
+    };
+public:
+    testWholeBodyIKSolver () : dt(0.004), root_height(0.64)
+    {
+        cog = 1e-3*hrp::Vector3(6.785, 1.54359, 806.831);
+        leg_pos.push_back(hrp::Vector3(0,1e-3*-105,0)); /* rleg */
+        leg_pos.push_back(hrp::Vector3(0,1e-3* 105,0)); /* lleg */
+        sole_offset = hrp::Vector3(0, 0, -0.07);
+    };
+    bool test0 ()
+    {
+        std::cerr << "test0 : Walk with one iteration per tick, limbs do not share joints" << std::endl;
+        return walk(false, 1, 1e-9);
+    };
+    bool test1 ()
+    {
+        std::cerr << "test1 : Walk with three iterations per tick, arms share a chest joint" << std::endl;
+        return walk(true, 3, 1e-9);
+    };
+};
+
+void print_usage ()
+{
+    std::cerr << "Usage : testWholeBodyIKSolver [option]" << std::endl;
+    std::cerr << " [option] should be:" << std::endl;
+    std::cerr << "  --test0 : Walk with one iteration per tick, limbs do not share joints" << std::endl;
+    std::cerr << "  --test1 : Walk with three iterations per tick, arms share a chest joint" << std::endl;
+};
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+    if (argc >= 2) {
+        testWholeBodyIKSolver twbik;
+        if (std::string(argv[1]) == "--test0") {
+            ret = twbik.test0() ? 0 : 2;
+        } else if (std::string(argv[1]) == "--test1") {
+            ret = twbik.test1() ? 0 : 2;
+        } else {
+            print_usage();
+            ret = 1;
+        }
+    } else {
+        print_usage();
+        ret = 1;
+    }
+    return ret;
+}
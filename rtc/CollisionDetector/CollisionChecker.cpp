@@ -0,0 +1,214 @@
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <hrpModel/Link.h>
+#include <hrpModel/JointPath.h>
+#include <hrpCollision/ColdetModel.h>
+#include "CollisionChecker.h"
+
+CollisionChecker::CollisionChecker()
+    : m_use_broad_phase(true), m_have_last_pose(false)
+{
+}
+
+void CollisionChecker::setup(hrp::BodyPtr i_body, const std::vector<Vclip::Polyhedron *>& i_models)
+{
+    m_robot = i_body;
+    m_models = i_models;
+    int n = m_robot->numLinks();
+    m_center.resize(n);
+    m_world_center.resize(n);
+    m_radius.resize(n);
+    m_motion.resize(n);
+    m_attitude.resize(n);
+    for (int i=0; i<n; i++){
+        // center of AABB of vertices
+        m_motion[i] = 0;
+        m_radius[i] = 0;
+        m_center[i] = hrp::Vector3(0,0,0);
+        if (!m_models[i]) continue;
+        hrp::Vector3 vmin(0,0,0), vmax(0,0,0);
+        const std::list<Vclip::Vertex>& verts = m_models[i]->verts();
+        std::list<Vclip::Vertex>::const_iterator it;
+        for (it = verts.begin(); it != verts.end(); it++){
+            const Vclip::Vect3& v = it->coords();
+            for (int j=0; j<3; j++){
+                if (it == verts.begin() || v[j] < vmin[j]) vmin[j] = v[j];
+                if (it == verts.begin() || v[j] > vmax[j]) vmax[j] = v[j];
+            }
+        }
+        m_center[i] = (vmin + vmax)/2;
+        for (it = verts.begin(); it != verts.end(); it++){
+            const Vclip::Vect3& v = it->coords();
+            hrp::Vector3 d(v[0] - m_center[i][0], v[1] - m_center[i][1], v[2] - m_center[i][2]);
+            m_radius[i] = std::max(m_radius[i], d.norm());
+        }
+    }
+    m_have_last_pose = false;
+}
+
+Vclip::Polyhedron *CollisionChecker::createVClipModel(hrp::Link *i_link)
+{
+    Vclip::Polyhedron* i_vclip_model = new Vclip::Polyhedron();
+    int n = i_link->coldetModel->getNumVertices();
+    float v[3];
+    Vclip::VertFaceName vertName;
+    for (int i = 0; i < n; i ++ ) {
+        i_link->coldetModel->getVertex(i, v[0], v[1], v[2]);
+        sprintf(vertName, "v%d", i);
+        i_vclip_model->addVertex(vertName, Vclip::Vect3(v[0], v[1], v[2]));
+    }
+    i_vclip_model->buildHull();
+    i_vclip_model->check();
+    return i_vclip_model;
+}
+
+int CollisionChecker::addPair(hrp::Link *i_link0, hrp::Link *i_link1, const std::string& i_name)
+{
+    if (m_pair_index.find(i_name) != m_pair_index.end()) return -1;
+    VclipLinkPairPtr p = new VclipLinkPair(i_link0, m_models[i_link0->index],
+                                           i_link1, m_models[i_link1->index], 0);
+    CollisionLinkPair pair(p, i_name);
+    hrp::JointPathPtr path = m_robot->getJointPath(i_link0, i_link1);
+    for (int i=0; i<path->numJoints(); i++){
+        if (path->joint(i)->jointId < 0) continue;
+        pair.joint_ids.push_back(path->joint(i)->jointId);
+    }
+    pair.stop_joint_ids = pair.joint_ids;
+    // the pair is inserted before the first one with a larger name
+    std::map<std::string, int>::iterator next = m_pair_index.upper_bound(i_name);
+    int index = next == m_pair_index.end() ? m_pairs.size() : next->second;
+    m_pairs.insert(m_pairs.begin() + index, pair);
+    for (; next != m_pair_index.end(); ++next) next->second++;
+    m_pair_index[i_name] = index;
+    m_jobs.reserve(m_pairs.size());
+    return index;
+}
+
+int CollisionChecker::findPair(const std::string& i_name) const
+{
+    std::map<std::string, int>::const_iterator it = m_pair_index.find(i_name);
+    return it == m_pair_index.end() ? -1 : it->second;
+}
+
+bool CollisionChecker::startWorkers(int i_nworkers, int i_priority,
+                                    const std::vector<int>& i_cpus)
+{
+    if (i_nworkers <= 0){
+        m_executor.stop();
+        return true;
+    }
+    return m_executor.start(i_nworkers, i_priority, i_cpus);
+}
+
+void CollisionChecker::reset()
+{
+    for (unsigned int i=0; i<m_pairs.size(); i++) m_pairs[i].lower_bound = -1;
+}
+
+void CollisionChecker::updateLinkMotion()
+{
+    if (!m_use_broad_phase) return;
+    for (int i=0; i<m_robot->numLinks(); i++){
+        hrp::Link *l = m_robot->link(i);
+        hrp::Matrix33 R(l->attitude());
+        hrp::Vector3 c(l->p + R*m_center[i]);
+        if (m_have_last_pose){
+            // any point within the sphere moves at most the displacement of
+            // the center plus radius * ||R - R_last||, where the norm is
+            // 2*sin(theta/2) = sqrt(3 - trace(R_last^T R))
+            double t = 0;
+            for (int j=0; j<3; j++){
+                for (int k=0; k<3; k++) t += R(j,k)*m_attitude[i](j,k);
+            }
+            m_motion[i] = (c - m_world_center[i]).norm()
+                + m_radius[i]*std::sqrt(std::max(0.0, 3 - t));
+        }
+        m_world_center[i] = c;
+        m_attitude[i] = R;
+    }
+    if (!m_have_last_pose){
+        // motion before this call is unknown
+        reset();
+        m_have_last_pose = true;
+        return;
+    }
+    for (unsigned int i=0; i<m_pairs.size(); i++){
+        CollisionLinkPair& c = m_pairs[i];
+        int i0 = c.pair->link(0)->index, i1 = c.pair->link(1)->index;
+        c.lower_bound -= m_motion[i0] + m_motion[i1];
+        double d = (m_world_center[i0] - m_world_center[i1]).norm()
+            - m_radius[i0] - m_radius[i1];
+        if (d > c.lower_bound) c.lower_bound = d;
+    }
+}
+
+int CollisionChecker::check(int i_begin, int i_end)
+{
+    m_jobs.clear();
+    for (int i=i_begin; i<i_end; i++){
+        CollisionLinkPair& c = m_pairs[i];
+        // negative distances are penetration depths which are not bounded
+        // by the motion of links
+        if (m_use_broad_phase && m_have_last_pose
+            && c.lower_bound > std::max(c.pair->getTolerance(), 0.0)){
+            if (c.distance < c.lower_bound) c.distance = c.lower_bound;
+            continue;
+        }
+        m_jobs.push_back(i);
+    }
+    m_executor.execute(m_jobs, checkPair, this);
+    return m_jobs.size();
+}
+
+void CollisionChecker::setInitCollisionMask(const std::vector<int>& i_init_mask)
+{
+    m_init_mask = i_init_mask;
+    for (unsigned int i=0; i<m_pairs.size(); i++){
+        CollisionLinkPair& c = m_pairs[i];
+        // if all joints are 0(move even if collide), for example leg to
+        // leg, we stop them. otherwise stop only joints with 1, for example
+        // leg to arm
+        bool stop_all = true;
+        for (unsigned int j=0; j<c.joint_ids.size(); j++){
+            if (m_init_mask[c.joint_ids[j]] == 1) stop_all = false;
+        }
+        c.stop_joint_ids.clear();
+        for (unsigned int j=0; j<c.joint_ids.size(); j++){
+            if (stop_all || m_init_mask[c.joint_ids[j]] == 1){
+                c.stop_joint_ids.push_back(c.joint_ids[j]);
+            }
+        }
+    }
+}
+
+int CollisionChecker::updateCollisionMask(std::vector<int>& o_curr_mask,
+                                          bool *o_link_collision,
+                                          bool i_use_limb_collision)
+{
+    int n = 0;
+    for (unsigned int i=0; i<m_pairs.size(); i++){
+        if (!isColliding(i)) continue;
+        CollisionLinkPair& c = m_pairs[i];
+        n++;
+        o_link_collision[c.pair->link(0)->index] = true;
+        o_link_collision[c.pair->link(1)->index] = true;
+        if (i_use_limb_collision){
+            for (unsigned int j=0; j<c.stop_joint_ids.size(); j++){
+                o_curr_mask[c.stop_joint_ids[j]] = 1;
+            }
+        }
+    }
+    if (n && !i_use_limb_collision && m_init_mask.size() == o_curr_mask.size()){
+        std::copy(m_init_mask.begin(), m_init_mask.end(), o_curr_mask.begin());
+    }
+    return n;
+}
+
+void CollisionChecker::checkPair(void *arg, int i)
+{
+    CollisionChecker *self = (CollisionChecker *)arg;
+    CollisionLinkPair& c = self->m_pairs[i];
+    c.distance = c.pair->computeDistance(c.point0.data(), c.point1.data());
+    c.lower_bound = c.distance > 0 ? c.distance : 0;
+}
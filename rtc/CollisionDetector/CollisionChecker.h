@@ -0,0 +1,131 @@
+// -*- C++ -*-
+#ifndef COLLISION_CHECKER_H
+#define COLLISION_CHECKER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <hrpModel/Body.h>
+#include "util/StageExecutor.h"
+#include "VclipLinkPair.h"
+
+class CollisionLinkPair {
+public:
+    CollisionLinkPair(VclipLinkPairPtr i_pair, const std::string& i_name)
+        : pair(i_pair), name(i_name), point0(hrp::Vector3(0,0,0)), point1(hrp::Vector3(0,0,0)),
+          distance(0), lower_bound(-1) {
+    }
+    VclipLinkPairPtr pair;
+    std::string name;
+    hrp::Vector3 point0, point1;
+    double distance;
+    /// lower bound of the current distance, used by the broad phase
+    double lower_bound;
+    /// jointId of joints between two links
+    std::vector<int> joint_ids;
+    /// jointId of joints to be stopped when the pair collides
+    std::vector<int> stop_joint_ids;
+};
+
+/**
+   \brief evaluates distances of link pairs
+
+   Pairs are stored in a contiguous array and evaluated on a pool of worker
+   threads. Before computing the exact distance, a pair is skipped if its
+   distance is proven to be larger than the tolerance by either of
+   - the distance between bounding spheres of links
+   - the distance of the previous check minus the motion of links since then
+   Closest points of skipped pairs are kept as they were in the last exact
+   check and their distances are raised to the lower bound if necessary, so
+   that a skipped pair never looks colliding.
+ */
+class CollisionChecker
+{
+public:
+    CollisionChecker();
+    /**
+       \brief create a convex hull of the collision model of a link
+     */
+    static Vclip::Polyhedron *createVClipModel(hrp::Link *i_link);
+    /**
+       \brief compute bounding spheres of links
+       \param i_body robot model
+       \param i_models convex hulls of links indexed by link index
+     */
+    void setup(hrp::BodyPtr i_body, const std::vector<Vclip::Polyhedron *>& i_models);
+    /**
+       \brief add a link pair. Pairs are sorted by their names as they
+       were in std::map, which is the order of lines of CollisionState, so
+       indices of pairs added before may change
+       \param i_name name of the pair, like "RARM_JOINT6:WAIST"
+       \return index of the pair, -1 if the name is already used
+     */
+    int addPair(hrp::Link *i_link0, hrp::Link *i_link1, const std::string& i_name);
+    /**
+       \brief create worker threads
+       \param i_nworkers the number of workers, 0 to check pairs in the calling thread
+     */
+    bool startWorkers(int i_nworkers, int i_priority=0,
+                      const std::vector<int>& i_cpus=std::vector<int>());
+    void stopWorkers() { m_executor.stop(); }
+    void useBroadPhase(bool i_flag) { m_use_broad_phase = i_flag; m_have_last_pose = false; }
+    bool useBroadPhase() const { return m_use_broad_phase; }
+    /**
+       \brief update motion of links. This must be called every time after
+       forward kinematics is computed
+     */
+    void updateLinkMotion();
+    /**
+       \brief compute distances of pairs [i_begin, i_end)
+       \return the number of pairs whose exact distances are computed
+     */
+    int check(int i_begin, int i_end);
+    int check() { return check(0, m_pairs.size()); }
+    /**
+       \brief discard bounds so that all pairs are computed in the next check
+     */
+    void reset();
+    /**
+       \brief select joints to be stopped by each pair
+       \param i_init_mask 1 for joints which do not move when collide, 0
+       for joints which move even if collide. If all joints between links of
+       a pair are 0, all of them are stopped by the pair.
+     */
+    void setInitCollisionMask(const std::vector<int>& i_init_mask);
+    /**
+       \brief update collision mask from distances of pairs. No allocation is
+       done.
+       \param o_curr_mask joints to be stopped are set to 1
+       \param o_link_collision links of colliding pairs are set to true
+       \param i_use_limb_collision stop only joints of colliding pairs if
+       true, otherwise the initial mask is copied if some pair collides
+       \return the number of colliding pairs
+     */
+    int updateCollisionMask(std::vector<int>& o_curr_mask, bool *o_link_collision,
+                            bool i_use_limb_collision);
+    bool isColliding(int i) { return m_pairs[i].distance <= m_pairs[i].pair->getTolerance(); }
+
+    unsigned int numPairs() const { return m_pairs.size(); }
+    CollisionLinkPair& pair(int i) { return m_pairs[i]; }
+    /**
+       \return index of the pair, -1 if not found
+     */
+    int findPair(const std::string& i_name) const;
+private:
+    static void checkPair(void *arg, int i);
+
+    hrp::BodyPtr m_robot;
+    std::vector<Vclip::Polyhedron *> m_models;
+    std::vector<CollisionLinkPair> m_pairs;
+    std::map<std::string, int> m_pair_index;
+    std::vector<int> m_init_mask;
+    // bounding spheres in link frames(attitude()) and link motion
+    std::vector<hrp::Vector3> m_center, m_world_center;
+    std::vector<double> m_radius, m_motion;
+    std::vector<hrp::Matrix33> m_attitude;
+    bool m_use_broad_phase, m_have_last_pose;
+    std::vector<int> m_jobs;
+    StageExecutor m_executor;
+};
+
+#endif // COLLISION_CHECKER_H
@@ -169,6 +169,7 @@ RTC::ReturnCode_t CollisionDetector::onInitialize()
         convertToConvexHull(m_robot);
     }
     setupVClipModel(m_robot);
+    m_checker.setup(m_robot, m_VclipLinks);
 
     if ( prop["collision_pair"] != "" ) {
 	std::cerr << "[" << m_profile.instance_name << "] prop[collision_pair] ->" << prop["collision_pair"] << std::endl;
@@ -196,8 +197,7 @@ RTC::ReturnCode_t CollisionDetector::onInitialize()
                 continue;
             }
 	    std::cerr << "[" << m_profile.instance_name << "] check collisions between " << m_robot->link(name1)->name << " and " <<  m_robot->link(name2)->name << std::endl;
-	    m_pair[tmp] = new CollisionLinkPair(new VclipLinkPair(m_robot->link(name1), m_VclipLinks[m_robot->link(name1)->index],
-                                                                  m_robot->link(name2), m_VclipLinks[m_robot->link(name2)->index], 0));
+	    m_checker.addPair(m_robot->link(name1), m_robot->link(name2), tmp);
 	}
     }
 
@@ -205,6 +205,23 @@ RTC::ReturnCode_t CollisionDetector::onInitialize()
         coil::stringTo(m_collision_loop, prop["collision_loop"].c_str());
         std::cerr << "[" << m_profile.instance_name << "] set collision_loop: " << m_collision_loop << std::endl;
     }
+    if ( prop["collision_broad_phase"] == "false" ) {
+        m_checker.useBroadPhase(false);
+        std::cerr << "[" << m_profile.instance_name << "] disable broad phase" << std::endl;
+    }
+    if ( prop["collision_threads"] != "" ) {
+        int nthreads = 0;
+        coil::stringTo(nthreads, prop["collision_threads"].c_str());
+        std::vector<int> cpus;
+        coil::vstring cpus_str = coil::split(prop["collision_cpus"], ",");
+        for (size_t i = 0; i < cpus_str.size(); i++) {
+            int cpu;
+            if (coil::stringTo(cpu, cpus_str[i].c_str())) cpus.push_back(cpu);
+        }
+        if (m_checker.startWorkers(nthreads, 0, cpus)) {
+            std::cerr << "[" << m_profile.instance_name << "] set collision_threads: " << nthreads << std::endl;
+        }
+    }
 #ifdef USE_HRPSYSUTIL
     if ( m_use_viewer ) {
       m_scene.addBody(m_robot);
@@ -232,6 +249,7 @@ RTC::ReturnCode_t CollisionDetector::onInitialize()
             std::cerr << "[" << m_profile.instance_name << "] ERROR size of collision_mask is differ from robot joint number .. " << mask_str.size()  << ", " << m_robot->numJoints() << std::endl;
         }
     }
+    m_checker.setInitCollisionMask(m_init_collision_mask);
 
     if ( prop["use_limb_collision"] != "" ) {
         std::cerr << "[" << m_profile.instance_name << "] prop[use_limb_collision] -> " << prop["use_limb_collision"] << std::endl;
@@ -244,6 +262,15 @@ RTC::ReturnCode_t CollisionDetector::onInitialize()
     // setup collision state
     m_state.angle.length(m_robot->numJoints());
     m_state.collide.length(m_robot->numLinks());
+    m_state.lines.length(m_checker.numPairs());
+    for (unsigned int i = 0; i < m_checker.numPairs(); i++) {
+        m_state.lines[i].length(2);
+        m_state.lines[i].get_buffer()[0].length(3);
+        m_state.lines[i].get_buffer()[1].length(3);
+    }
+    // preallocate not to allocate memory while colliding
+    m_tp.posture.resize(m_robot->numJoints());
+    m_tp.lines.resize(m_checker.numPairs());
 
     // allocate memory for outPorts
     m_q.data.length(m_robot->numJoints());
@@ -286,6 +313,7 @@ RTC::ReturnCode_t CollisionDetector::onFinalize()
     delete[] m_lastsafe_jointdata;
     delete m_interpolator;
     delete[] m_link_collision;
+    m_checker.stopWorkers();
     return RTC::RTC_OK;
 }
 
@@ -340,8 +368,6 @@ RTC::ReturnCode_t CollisionDetector::onExecute(RTC::UniqueId ec_id)
     if (m_enable && m_qRefIn.isNew()) {
 	m_qRefIn.read();
 
-        TimedPosture tp;
-
 	assert(m_qRef.data.length() == m_robot->numJoints());
 #ifdef USE_HRPSYSUTIL
         if ( m_use_viewer ) {
@@ -379,53 +405,29 @@ RTC::ReturnCode_t CollisionDetector::onExecute(RTC::UniqueId ec_id)
         //        }
         //collision check process in case of angle set above
 	m_robot->calcForwardKinematics();
+	m_checker.updateLinkMotion();
 	coil::TimeValue tm1 = coil::gettimeofday();
-        std::map<std::string, CollisionLinkPair *>::iterator it = m_pair.begin();
-	for (unsigned int i = 0; it != m_pair.end(); it++, i++){
-            int sub_size = (m_pair.size() + m_collision_loop -1) / m_collision_loop;  // 10 / 3 = 3  / floor
-            // 0 : 0 .. sub_size-1                            // 0 .. 2
-            // 1 : sub_size ... sub_size*2-1                  // 3 .. 5
-            // k : sub_size*k ... sub_size*(k+1)-1            // 6 .. 8
-            // n : sub_size*n ... m_pair.size()               // 9 .. 10
-            if ( sub_size*m_loop_for_check <= i && i < sub_size*(m_loop_for_check+1) ) {
-                CollisionLinkPair* c = it->second;
-                c->distance = c->pair->computeDistance(c->point0.data(), c->point1.data());
-                //std::cerr << i << ":" << (c->distance<=c->pair->getTolerance() ) << " ";
-            }
-        }
+        int num_pairs = m_checker.numPairs();
+        int sub_size = (num_pairs + m_collision_loop -1) / m_collision_loop;  // 10 / 3 = 3  / floor
+        // 0 : 0 .. sub_size-1                            // 0 .. 2
+        // 1 : sub_size ... sub_size*2-1                  // 3 .. 5
+        // k : sub_size*k ... sub_size*(k+1)-1            // 6 .. 8
+        // n : sub_size*n ... num_pairs                   // 9 .. 10
+        int num_checked = m_checker.check(std::min(sub_size*m_loop_for_check, num_pairs),
+                                          std::min(sub_size*(m_loop_for_check+1), num_pairs));
         if ( m_loop_for_check == m_collision_loop-1 ) {
             bool last_safe_posture = m_safe_posture;
-            m_safe_posture = true;
-            it = m_pair.begin();
-            for (unsigned int i = 0; it != m_pair.end(); i++, it++){
-                CollisionLinkPair* c = it->second;
-                VclipLinkPairPtr p = c->pair;
-                tp.lines.push_back(std::make_pair(c->point0, c->point1));
-                if ( c->distance <= c->pair->getTolerance() ) {
-                    m_safe_posture = false;
+            // collision_mask used to select output                0: passthough reference data, 1 output safe data
+            // joints to be stopped by each pair are selected in setInitCollisionMask()
+            m_safe_posture = m_checker.updateCollisionMask(m_curr_collision_mask, m_link_collision, m_use_limb_collision) == 0;
+            for (int i = 0; i < num_pairs; i++){
+                CollisionLinkPair* c = &m_checker.pair(i);
+                VclipLinkPair* p = c->pair.get();
+                m_tp.lines[i].first = c->point0;
+                m_tp.lines[i].second = c->point1;
+                if ( m_checker.isColliding(i) ) {
                     if ( loop%200==0 || last_safe_posture ) {
-                        hrp::JointPathPtr jointPath = m_robot->getJointPath(p->link(0),p->link(1));
-                        std::cerr << "[" << m_profile.instance_name << "] " << i << "/" << m_pair.size() << " pair: " << p->link(0)->name << "/" << p->link(1)->name << "(" << jointPath->numJoints() << "), distance = " << c->distance << std::endl;
-                    }
-                    m_link_collision[p->link(0)->index] = true;
-                    m_link_collision[p->link(1)->index] = true;
-                    if ( m_use_limb_collision ) {
-                        hrp::JointPathPtr jointPath = m_robot->getJointPath(p->link(0),p->link(1));
-                        bool stop_all = true;
-                        // if all joint is within false(0:move even if collide) in initial mask ( for example leg to leg ) we stop them
-                        // if some joint is not within true(1:do not move within collide) on initial mask, stop only true joint (for exmple leg to arm)
-                        for ( int i = 0; i < jointPath->numJoints(); i++ ){ if ( m_init_collision_mask[jointPath->joint(i)->jointId] == 1) stop_all = false; }
-                        for ( int i = 0; i < jointPath->numJoints(); i++ ){
-                            int id = jointPath->joint(i)->jointId;
-                            // collision_mask used to select output                0: passthough reference data, 1 output safe data
-                            if ( stop_all ) {
-                                m_curr_collision_mask[id] = 1;            // true (1: output safe data) do not move when collide,
-                            } else if (m_init_collision_mask[id] == 1) {  // skip false (0: move even if collide)
-                                m_curr_collision_mask[id] = 1;
-                            }
-                        }
-                    } else {
-                        std::copy(m_init_collision_mask.begin(), m_init_collision_mask.end(), m_curr_collision_mask.begin()); // copy init_collision_mask to curr_collision_mask
+                        std::cerr << "[" << m_profile.instance_name << "] " << i << "/" << num_pairs << " pair: " << p->link(0)->name << "/" << p->link(1)->name << "(" << c->joint_ids.size() << "), distance = " << c->distance << std::endl;
                     }
 #ifdef USE_HRPSYSUTIL
                     if ( m_use_viewer ) {
@@ -502,10 +504,10 @@ RTC::ReturnCode_t CollisionDetector::onExecute(RTC::UniqueId ec_id)
 #endif
         }
         if ( DEBUGP ) {
-          std::cerr << "[" << m_profile.instance_name << "] check collisions for " << m_pair.size() << " pairs in " << (tm2.sec()-tm1.sec())*1000+(tm2.usec()-tm1.usec())/1000.0 
+          std::cerr << "[" << m_profile.instance_name << "] check collisions for " << num_checked << "/" << num_pairs << " pairs in " << (tm2.sec()-tm1.sec())*1000+(tm2.usec()-tm1.usec())/1000.0 
                     << " [msec], safe = " << m_safe_posture << ", time = " << m_recover_time*m_dt << "[s], loop = " << m_loop_for_check << "/" << m_collision_loop << std::endl;
         }
-        if ( m_pair.size() == 0 && ( DEBUGP || (loop % ((int)(5/m_dt))) == 1) ) {
+        if ( num_pairs == 0 && ( DEBUGP || (loop % ((int)(5/m_dt))) == 1) ) {
             std::cerr << "[" << m_profile.instance_name << "] CAUTION!! The robot is moving without checking self collision detection!!! please define collision_pair in configuration file" << std::endl;
         }
         if ( ! m_have_safe_posture && ! m_safe_posture ) {
@@ -541,10 +543,9 @@ RTC::ReturnCode_t CollisionDetector::onExecute(RTC::UniqueId ec_id)
         }
 
         if ( ++m_loop_for_check >= m_collision_loop ) m_loop_for_check = 0;
-        tp.posture.resize(m_qRef.data.length());
-        for (size_t i=0; i<tp.posture.size(); i++) tp.posture[i] = m_q.data[i];
+        for (size_t i=0; i<m_tp.posture.size(); i++) m_tp.posture[i] = m_q.data[i];
 #ifdef USE_HRPSYSUTIL
-        m_log.add(tp);
+        m_log.add(m_tp);
 #endif // USE_HRPSYSUTIL
 
         // set collisoin state
@@ -558,17 +559,14 @@ RTC::ReturnCode_t CollisionDetector::onExecute(RTC::UniqueId ec_id)
                 m_state.collide[i] = m_link_collision[i];
             }
 
-            m_state.lines.length(tp.lines.size());
-            for(int i = 0; i < tp.lines.size(); i++ ){
-                const std::pair<hrp::Vector3, hrp::Vector3>& line = tp.lines[i];
+            // lengths are set in onInitialize()
+            for(int i = 0; i < m_tp.lines.size(); i++ ){
+                const std::pair<hrp::Vector3, hrp::Vector3>& line = m_tp.lines[i];
                 double *v;
-                m_state.lines[i].length(2);
-                m_state.lines[i].get_buffer()[0].length(3);
                 v = m_state.lines[i].get_buffer()[0].get_buffer();
                 v[0] = line.first.data()[0];
                 v[1] = line.first.data()[1];
                 v[2] = line.first.data()[2];
-                m_state.lines[i].get_buffer()[1].length(3);
                 v = m_state.lines[i].get_buffer()[1].get_buffer();
                 v[0] = line.second.data()[0];
                 v[1] = line.second.data()[1];
@@ -623,11 +621,11 @@ RTC::ReturnCode_t CollisionDetector::onExecute(RTC::UniqueId ec_id)
 
 bool CollisionDetector::setTolerance(const char *i_link_pair_name, double i_tolerance) {
     if (strcmp(i_link_pair_name, "all") == 0 || strcmp(i_link_pair_name, "ALL") == 0){
-        for ( std::map<std::string, CollisionLinkPair *>::iterator it = m_pair.begin();  it != m_pair.end(); it++){
-            it->second->pair->setTolerance(i_tolerance);
+        for ( unsigned int i = 0; i < m_checker.numPairs(); i++ ){
+            m_checker.pair(i).pair->setTolerance(i_tolerance);
         }
-    }else if ( m_pair.find(std::string(i_link_pair_name)) != m_pair.end() ) {
-        m_pair[std::string(i_link_pair_name)]->pair->setTolerance(i_tolerance);
+    }else if ( m_checker.findPair(std::string(i_link_pair_name)) >= 0 ) {
+        m_checker.pair(m_checker.findPair(std::string(i_link_pair_name))).pair->setTolerance(i_tolerance);
     }else{
         return false;
     }
@@ -677,15 +675,14 @@ bool CollisionDetector::enable(void)
         m_robot->joint(i)->q = m_qRef.data[i];
     }
     m_robot->calcForwardKinematics();
-    std::map<std::string, CollisionLinkPair *>::iterator it = m_pair.begin();
-    for (unsigned int i = 0; it != m_pair.end(); it++, i++){
-        CollisionLinkPair* c = it->second;
+    m_checker.updateLinkMotion();
+    m_checker.check();
+    for (unsigned int i = 0; i < m_checker.numPairs(); i++){
+        CollisionLinkPair* c = &m_checker.pair(i);
         VclipLinkPairPtr p = c->pair;
-        c->distance = c->pair->computeDistance(c->point0.data(), c->point1.data());
-        if ( c->distance <= c->pair->getTolerance() ) {
-            hrp::JointPathPtr jointPath = m_robot->getJointPath(p->link(0),p->link(1));
+        if ( m_checker.isColliding(i) ) {
             std::cerr << "[" << m_profile.instance_name << "] CollisionDetector cannot be enabled because of collision" << std::endl;
-            std::cerr << "[" << m_profile.instance_name << "] " << i << "/" << m_pair.size() << " pair: " << p->link(0)->name << "/" << p->link(1)->name << "(" << jointPath->numJoints() << "), distance = " << c->distance << std::endl;
+            std::cerr << "[" << m_profile.instance_name << "] " << i << "/" << m_checker.numPairs() << " pair: " << p->link(0)->name << "/" << p->link(1)->name << "(" << c->joint_ids.size() << "), distance = " << c->distance << std::endl;
             return false;
         }
     }
@@ -711,18 +708,7 @@ bool CollisionDetector::disable(void)
 
 void CollisionDetector::setupVClipModel(hrp::Link *i_link)
 {
-    Vclip::Polyhedron* i_vclip_model = new Vclip::Polyhedron();
-    int n = i_link->coldetModel->getNumVertices();
-    float v[3];
-    Vclip::VertFaceName vertName;
-    for (int i = 0; i < n; i ++ ) {
-        i_link->coldetModel->getVertex(i, v[0], v[1], v[2]);
-        sprintf(vertName, "v%d", i);
-        i_vclip_model->addVertex(vertName, Vclip::Vect3(v[0], v[1], v[2]));
-    }
-    i_vclip_model->buildHull();
-    i_vclip_model->check();
-    m_VclipLinks[i_link->index] = i_vclip_model;
+    m_VclipLinks[i_link->index] = CollisionChecker::createVClipModel(i_link);
 }
 
 #ifndef USE_HRPSYSUTIL
@@ -29,6 +29,7 @@
 #include "HRPDataTypes.hh"
 
 #include "VclipLinkPair.h"
+#include "CollisionChecker.h"
 #include "CollisionDetectorService_impl.h"
 
 // Service implementation headers
@@ -160,15 +161,6 @@ class CollisionDetector
   void setupVClipModel(hrp::Link *i_link);
 
  private:
-  class CollisionLinkPair {
-  public:
-      CollisionLinkPair(VclipLinkPairPtr i_pair) : point0(hrp::Vector3(0,0,0)), point1(hrp::Vector3(0,0,0)), distance(0) {
-          pair = i_pair;
-      }
-      VclipLinkPairPtr pair;
-      hrp::Vector3 point0, point1;
-      double distance;
-  };
 #ifdef USE_HRPSYSUTIL
   CollisionDetectorComponent::GLscene m_scene;
   LogManager<TimedPosture> m_log; 
@@ -180,7 +172,7 @@ class CollisionDetector
   bool m_use_limb_collision;
   bool m_use_viewer;
   hrp::BodyPtr m_robot;
-  std::map<std::string, CollisionLinkPair *> m_pair;
+  CollisionChecker m_checker;
   int m_loop_for_check, m_collision_loop;
   bool m_safe_posture;
   int m_recover_time;
@@ -196,6 +188,7 @@ class CollisionDetector
   bool m_enable;
   int collision_beep_freq, collision_beep_count;
   bool m_have_safe_posture;
+  TimedPosture m_tp;
   OpenHRP::CollisionDetectorService::CollisionState m_state;
 };
 
@@ -0,0 +1,117 @@
+/* checks that CollisionChecker doesn't allocate memory while the robot
+   is colliding. A simple robot which consists of a box body and two arms
+   is built without ModelLoader and its right arm is moved into the body.
+*/
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <hrpModel/Body.h>
+#include <hrpModel/Link.h>
+#include <hrpCollision/ColdetModel.h>
+#include "CollisionChecker.h"
+#include "util/AllocationCounter.h"
+#include "util/TestUtil.h"
+
+static void setBox(hrp::Link *l, const hrp::Vector3& c, const hrp::Vector3& s)
+{
+    hrp::ColdetModelPtr coldetModel(new hrp::ColdetModel());
+    coldetModel->setName(l->name);
+    coldetModel->setNumVertices(8);
+    for (int i=0; i<8; i++){
+        coldetModel->setVertex(i, c[0] + (i&1 ? s[0] : -s[0]),
+                               c[1] + (i&2 ? s[1] : -s[1]),
+                               c[2] + (i&4 ? s[2] : -s[2]));
+    }
+    l->coldetModel = coldetModel;
+}
+
+static hrp::Link *addLink(hrp::Link *parent, const char *name, int id,
+                          const hrp::Vector3& b, const hrp::Vector3& a)
+{
+    hrp::Link *l = new hrp::Link();
+    l->name = name;
+    l->jointId = id;
+    l->jointType = hrp::Link::ROTATIONAL_JOINT;
+    l->b = b;
+    l->a = a;
+    l->Rs = hrp::Matrix33::Identity();
+    setBox(l, hrp::Vector3(0,0,-0.15), hrp::Vector3(0.03,0.03,0.15));
+    parent->addChild(l);
+    return l;
+}
+
+int main(int argc, char *argv[])
+{
+    hrp::BodyPtr robot(new hrp::Body());
+    hrp::Link *root = new hrp::Link();
+    root->name = "WAIST";
+    root->jointType = hrp::Link::FREE_JOINT;
+    root->p = hrp::Vector3(0,0,0);
+    root->R = root->Rs = hrp::Matrix33::Identity();
+    setBox(root, hrp::Vector3(0,0,0), hrp::Vector3(0.1,0.15,0.3));
+    robot->setRootLink(root);
+    hrp::Link *rarm0 = addLink(root, "RARM_SHOULDER", 0, hrp::Vector3(0,-0.3,0.2), hrp::Vector3(1,0,0));
+    addLink(rarm0, "RARM_ELBOW", 1, hrp::Vector3(0,0,-0.3), hrp::Vector3(0,1,0));
+    hrp::Link *larm0 = addLink(root, "LARM_SHOULDER", 2, hrp::Vector3(0,0.3,0.2), hrp::Vector3(1,0,0));
+    addLink(larm0, "LARM_ELBOW", 3, hrp::Vector3(0,0,-0.3), hrp::Vector3(0,1,0));
+    robot->updateLinkTree();
+
+    std::vector<Vclip::Polyhedron *> models(robot->numLinks());
+    for (int i=0; i<robot->numLinks(); i++){
+        models[i] = CollisionChecker::createVClipModel(robot->link(i));
+    }
+    CollisionChecker checker;
+    checker.setup(robot, models);
+    checker.addPair(robot->link("RARM_ELBOW"), root, "RARM_ELBOW:WAIST");
+    checker.addPair(robot->link("LARM_ELBOW"), root, "LARM_ELBOW:WAIST");
+    checker.addPair(robot->link("RARM_ELBOW"), robot->link("LARM_ELBOW"), "RARM_ELBOW:LARM_ELBOW");
+    for (unsigned int i=0; i<checker.numPairs(); i++){
+        checker.pair(i).pair->setTolerance(0.01);
+    }
+    // right arm stops when collide, left arm doesn't
+    std::vector<int> init_mask(robot->numJoints(), 1), curr_mask(robot->numJoints(), 0);
+    init_mask[2] = init_mask[3] = 0;
+    checker.setInitCollisionMask(init_mask);
+    bool link_collision[robot->numLinks()];
+
+    bool ret = true;
+    ret &= checkResult(checker.pair(0).name == "LARM_ELBOW:WAIST"
+                       && checker.pair(1).name == "RARM_ELBOW:LARM_ELBOW"
+                       && checker.pair(2).name == "RARM_ELBOW:WAIST"
+                       && checker.findPair("RARM_ELBOW:WAIST") == 2, "pairs are sorted by names");
+    for (int nthreads=0; nthreads<=2; nthreads+=2){
+        checker.startWorkers(nthreads);
+        for (int use_limb=0; use_limb<2; use_limb++){
+            int colliding = 0;
+            std::fill(curr_mask.begin(), curr_mask.end(), 0);
+            for (int loop=0; loop<200; loop++){
+                // moves the right arm into the body from loop=100
+                robot->joint(0)->q = loop < 100 ? 0.0 : 0.6 + 0.01*sin(loop*0.1);
+                robot->joint(2)->q = -0.1*sin(loop*0.1);
+                count_allocation = loop >= 100;
+                for (int i=0; i<robot->numLinks(); i++) link_collision[i] = false;
+                robot->calcForwardKinematics();
+                checker.updateLinkMotion();
+                checker.check();
+                colliding = checker.updateCollisionMask(curr_mask, link_collision, use_limb);
+                count_allocation = false;
+                if (loop == 99 && colliding){
+                    std::cerr << "collision is detected in the initial posture" << std::endl;
+                    ret = false;
+                }
+            }
+            char buf[256];
+            sprintf(buf, "threads = %d, use_limb_collision = %d, colliding pairs = %d, allocations = %d",
+                    nthreads, use_limb, colliding, num_allocation);
+            ret &= checkResult(colliding == 1 && link_collision[robot->link("RARM_ELBOW")->index]
+                         && link_collision[root->index], buf);
+            ret &= checkResult(curr_mask[0] == 1 && curr_mask[1] == 1 && curr_mask[2] == 0 && curr_mask[3] == 0,
+                         "  joints of the right arm are stopped");
+            ret &= checkResult(num_allocation == 0, "  no allocation while colliding");
+            num_allocation = 0;
+        }
+    }
+    checker.stopWorkers();
+    return ret ? 0 : 1;
+}
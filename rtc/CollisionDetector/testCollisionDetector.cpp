@@ -0,0 +1,180 @@
+/* benchmark of CollisionChecker with pair sets of SampleRobot and HRP4C.
+   All joints are moved sinusoidally and pairs are checked every cycle by
+     - exact  : all pairs are computed serially(same as before)
+     - broad  : pairs are skipped by the broad phase
+     - thread : broad phase and a pool of worker threads
+   Results of broad and thread are compared with exact. Since the broad
+   phase is conservative, no mismatch is allowed.
+   ModelLoader must be running to load models, e.g.
+     testCollisionDetector --sample-robot --threads 3 -ORBInitRef NameService=corbaloc:iiop:localhost:15005/NameService
+*/
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <time.h>
+#include <hrpModel/Body.h>
+#include <hrpModel/Link.h>
+#include <hrpModel/JointPath.h>
+#include <hrpModel/ModelLoaderUtil.h>
+#include <hrpCollision/ColdetModel.h>
+#include "util/BVutil.h"
+#include "CollisionChecker.h"
+#include "util/TestUtil.h"
+
+#ifndef SAMPLE_ROBOT_MODEL
+#define SAMPLE_ROBOT_MODEL "file:///usr/share/OpenHRP-3.1/sample/model/sample1.wrl"
+#endif
+#ifndef HRP4C_MODEL
+#define HRP4C_MODEL "file:///usr/share/hrpsys/samples/HRP4C/HRP4Cmain.wrl"
+#endif
+
+// same as collision_pair in sample/SampleRobot/SampleRobot.conf.in
+static const char *sample_robot_pairs = "RARM_WRIST_P:WAIST LARM_WRIST_P:WAIST RARM_WRIST_P:RLEG_HIP_R LARM_WRIST_P:LLEG_HIP_R RARM_WRIST_R:RLEG_HIP_R LARM_WRIST_R:LLEG_HIP_R LLEG_ANKLE_R:RLEG_ANKLE_R";
+
+static bool hasShape(hrp::Link *l)
+{
+    return l->coldetModel && l->coldetModel->getNumVertices() > 0;
+}
+
+class Bench
+{
+public:
+    Bench(const char *i_name) : name(i_name), total(0), max(0), checked(0), mismatch(0) {}
+    void add(double t, int n){
+        total += t;
+        if (t > max) max = t;
+        checked += n;
+    }
+    void print(int cycles, int pairs){
+        printf("%-8s: avg = %7.1f[us], max = %7.1f[us], exact checks = %6.1f/%d, mismatch = %d\n",
+               name, total/cycles*1e6, max*1e6, (double)checked/cycles, pairs, mismatch);
+    }
+    const char *name;
+    double total, max;
+    long checked;
+    int mismatch;
+};
+
+static void print_usage()
+{
+    std::cerr << "Usage : testCollisionDetector [robot-name] [options]" << std::endl;
+    std::cerr << " [robot-name] should be: --sample-robot, --hrp4c" << std::endl;
+    std::cerr << " [options] : --model URL, --threads N, --cycles N, --tolerance d, ORB options" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+    std::string url, pairs;
+    if (std::string(argv[1]) == "--sample-robot") {
+        url = SAMPLE_ROBOT_MODEL;
+        pairs = sample_robot_pairs;
+    } else if (std::string(argv[1]) == "--hrp4c") {
+        // HRP4C has no collision_pair, all pairs which are not adjacent are used
+        url = HRP4C_MODEL;
+    } else {
+        print_usage();
+        return 1;
+    }
+    int nthreads = 3, cycles = 2000;
+    double tolerance = 0.005, dt = 0.005;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && ++i < argc) {
+            url = argv[i];
+        } else if (strcmp(argv[i], "--threads") == 0 && ++i < argc) {
+            nthreads = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--cycles") == 0 && ++i < argc) {
+            cycles = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--tolerance") == 0 && ++i < argc) {
+            tolerance = atof(argv[i]);
+        }
+    }
+
+    hrp::BodyPtr robot(new hrp::Body());
+    if (!loadBodyFromModelLoader(robot, url.c_str(), argc, argv, true)) {
+        std::cerr << "failed to load model[" << url << "]" << std::endl;
+        return 1;
+    }
+    convertToConvexHull(robot);
+    std::vector<Vclip::Polyhedron *> models(robot->numLinks());
+    for (int i = 0; i < robot->numLinks(); i++) {
+        models[i] = hasShape(robot->link(i)) ? CollisionChecker::createVClipModel(robot->link(i)) : NULL;
+    }
+
+    CollisionChecker exact, broad, thread;
+    exact.useBroadPhase(false);
+    CollisionChecker *checkers[] = {&exact, &broad, &thread};
+    for (int k = 0; k < 3; k++) checkers[k]->setup(robot, models);
+    if (pairs != "") {
+        std::istringstream iss(pairs);
+        std::string tmp;
+        while (getline(iss, tmp, ' ')) {
+            size_t pos = tmp.find_first_of(':');
+            hrp::Link *l1 = robot->link(tmp.substr(0, pos)), *l2 = robot->link(tmp.substr(pos+1));
+            if (!l1 || !l2 || !hasShape(l1) || !hasShape(l2)) {
+                std::cerr << "invalid pair " << tmp << std::endl;
+                return 1;
+            }
+            for (int k = 0; k < 3; k++) checkers[k]->addPair(l1, l2, tmp);
+        }
+    } else {
+        for (int i = 0; i < robot->numLinks(); i++) {
+            for (int j = i+1; j < robot->numLinks(); j++) {
+                hrp::Link *l1 = robot->link(i), *l2 = robot->link(j);
+                if (!hasShape(l1) || !hasShape(l2)) continue;
+                if (robot->getJointPath(l1, l2)->numJoints() < 3) continue;
+                for (int k = 0; k < 3; k++) checkers[k]->addPair(l1, l2, l1->name + ":" + l2->name);
+            }
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        for (unsigned int i = 0; i < checkers[k]->numPairs(); i++) {
+            checkers[k]->pair(i).pair->setTolerance(tolerance);
+        }
+    }
+    thread.startWorkers(nthreads);
+    std::cerr << robot->name() << " : " << exact.numPairs() << " pairs, "
+              << nthreads << " threads, " << cycles << " cycles" << std::endl;
+
+    Bench bench[] = {Bench("exact"), Bench("broad"), Bench("thread")};
+    int collisions = 0;
+    for (int t = 0; t < cycles; t++) {
+        for (int i = 0; i < robot->numJoints(); i++) {
+            hrp::Link *j = robot->joint(i);
+            double lo = std::max(j->llimit, -1.5), hi = std::min(j->ulimit, 1.5);
+            if (lo > hi) std::swap(lo, hi);
+            j->q = (lo + hi)/2 + (hi - lo)/2*sin(2*M_PI*t*dt/(2 + 0.37*i) + i);
+        }
+        robot->calcForwardKinematics();
+        for (int k = 0; k < 3; k++) {
+            double t1 = now();
+            checkers[k]->updateLinkMotion();
+            int n = checkers[k]->check();
+            bench[k].add(now() - t1, n);
+        }
+        for (unsigned int i = 0; i < exact.numPairs(); i++) {
+            bool collide = exact.pair(i).distance <= tolerance;
+            if (collide) collisions++;
+            // distances can slightly differ at the tolerance since features
+            // vclip starts from depend on which cycles the pair is computed
+            if (fabs(exact.pair(i).distance - tolerance) < 1e-9) continue;
+            for (int k = 1; k < 3; k++) {
+                if ((checkers[k]->pair(i).distance <= tolerance) != collide) {
+                    bench[k].mismatch++;
+                }
+            }
+        }
+    }
+    thread.stopWorkers();
+
+    std::cerr << "colliding pairs = " << (double)collisions/cycles << "/cycle" << std::endl;
+    for (int k = 0; k < 3; k++) bench[k].print(cycles, exact.numPairs());
+    return (bench[1].mismatch || bench[2].mismatch) ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+// -*- C++ -*-
+/*!
+ * @file  BinaryLog.h
+ * @brief binary log format written by DataLoggerService::saveBinary()
+ * @date  $Date$
+ *
+ * $Id$
+ */
+
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+  A binary log file (basename.portname.blog) consists of a BinaryLogHeader
+  and doubles. Time of sample i is at
+
+    timeOffset + i*sampleStride*sizeof(double)
+
+  and element j of sample i is at
+
+    dataOffset + (i*sampleStride + j*elementStride)*sizeof(double)
+
+  DataLoggerService::saveBinary() stores time stamps and each element in
+  columns (sampleStride = 1, elementStride = numSamples) so that they can
+  be used directly from a memory mapped file. Files written while
+  streaming consist of records of time and elements instead
+  (sampleStride = numElements+1, elementStride = 1) and numSamples is
+  updated whenever records are appended.
+
+  All values are little-endian and 8 byte aligned. Integer and boolean
+  elements are stored as doubles and elementType tells how they were
+  printed in the text log.
+*/
+
+#define BINARY_LOG_MAGIC "HRPSYSLG"
+#define BINARY_LOG_VERSION 2
+
+enum BinaryLogElementType {
+    BINARY_LOG_DOUBLE = 0,
+    BINARY_LOG_LONG = 1,
+    BINARY_LOG_BOOLEAN = 2
+};
+
+struct BinaryLogHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t elementType;
+    char dataType[32];
+    uint64_t numElements;
+    uint64_t numSamples;
+    uint64_t timeOffset;
+    uint64_t dataOffset;
+    uint64_t sampleStride;
+    uint64_t elementStride;
+};
+
+/**
+   \brief check byte order of the host
+   \return true if the host is little-endian
+ */
+inline bool isLittleEndianHost()
+{
+    const uint16_t v = 1;
+    return *(const unsigned char *)&v == 1;
+}
+
+/**
+   \brief fill a header of a binary log
+   \param o_header header to be filled
+   \param i_type data type name of the port
+   \param i_elementType element type(BinaryLogElementType)
+   \param i_numElements number of elements per sample
+   \param i_numSamples number of samples
+   \param i_records true to store samples as records, false to store columns
+ */
+inline void initBinaryLogHeader(BinaryLogHeader& o_header, const char *i_type,
+                                int i_elementType, size_t i_numElements,
+                                size_t i_numSamples, bool i_records=false)
+{
+    memset(&o_header, 0, sizeof(o_header));
+    memcpy(o_header.magic, BINARY_LOG_MAGIC, sizeof(o_header.magic));
+    o_header.version = BINARY_LOG_VERSION;
+    o_header.elementType = i_elementType;
+    strncpy(o_header.dataType, i_type, sizeof(o_header.dataType)-1);
+    o_header.numElements = i_numElements;
+    o_header.numSamples = i_numSamples;
+    o_header.timeOffset = sizeof(BinaryLogHeader);
+    if (i_records){
+        o_header.dataOffset = o_header.timeOffset + sizeof(double);
+        o_header.sampleStride = i_numElements + 1;
+        o_header.elementStride = 1;
+    }else{
+        o_header.dataOffset = o_header.timeOffset + i_numSamples*sizeof(double);
+        o_header.sampleStride = 1;
+        o_header.elementStride = i_numSamples;
+    }
+}
+
+/**
+   \brief read-only memory mapped binary log
+ */
+class BinaryLogReader
+{
+public:
+    BinaryLogReader() : m_addr(NULL), m_size(0) {}
+    ~BinaryLogReader() { close(); }
+    /**
+       \brief map a binary log file
+       \param i_fname file name
+       \return true if mapped and the header is valid, false otherwise
+     */
+    bool open(const char *i_fname){
+        close();
+        if (!isLittleEndianHost()) return false;
+        int fd = ::open(i_fname, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(BinaryLogHeader)){
+            ::close(fd);
+            return false;
+        }
+        void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) return false;
+        m_addr = (const char *)addr;
+        m_size = st.st_size;
+        const BinaryLogHeader& h = header();
+        if (memcmp(h.magic, BINARY_LOG_MAGIC, sizeof(h.magic)) != 0
+            || h.version != BINARY_LOG_VERSION
+            || (h.numSamples && h.numElements
+                && h.dataOffset + ((h.numSamples-1)*h.sampleStride
+                                   + (h.numElements-1)*h.elementStride + 1)*sizeof(double) > m_size)
+            || (h.numSamples
+                && h.timeOffset + ((h.numSamples-1)*h.sampleStride + 1)*sizeof(double) > m_size)){
+            close();
+            return false;
+        }
+        return true;
+    }
+    void close(){
+        if (m_addr) munmap((void *)m_addr, m_size);
+        m_addr = NULL;
+        m_size = 0;
+    }
+    const BinaryLogHeader& header() const {
+        return *(const BinaryLogHeader *)m_addr;
+    }
+    /**
+       \brief time stamp[s] of a sample
+       \param i_sample index of the sample
+     */
+    double time(size_t i_sample) const {
+        const BinaryLogHeader& h = header();
+        return ((const double *)(m_addr + h.timeOffset))[i_sample*h.sampleStride];
+    }
+    /**
+       \brief value of an element
+       \param i_sample index of the sample
+       \param i_element index of the element
+     */
+    double value(size_t i_sample, size_t i_element) const {
+        const BinaryLogHeader& h = header();
+        return ((const double *)(m_addr + h.dataOffset))[i_sample*h.sampleStride + i_element*h.elementStride];
+    }
+    /**
+       \brief time stamps[s] of all samples. NULL if they are not stored in
+       a column
+     */
+    const double *times() const {
+        if (header().sampleStride != 1) return NULL;
+        return (const double *)(m_addr + header().timeOffset);
+    }
+    /**
+       \brief values of an element of all samples. NULL if they are not
+       stored in a column
+       \param i_element index of the element
+     */
+    const double *column(size_t i_element) const {
+        if (header().sampleStride != 1) return NULL;
+        return (const double *)(m_addr + header().dataOffset)
+            + i_element*header().elementStride;
+    }
+private:
+    const char *m_addr;
+    size_t m_size;
+};
+
+#endif // BINARY_LOG_H
@@ -0,0 +1,67 @@
+/*
+  convert a binary log saved by DataLoggerService::saveBinary() into the
+  text format saved by DataLoggerService::save()
+
+  usage: BinaryLog2Text basename.portname.blog [output]
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include "BinaryLog.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2){
+        std::cerr << "usage: " << argv[0] << " basename.portname.blog [output]"
+                  << std::endl;
+        return 1;
+    }
+    std::string input(argv[1]), output;
+    if (argc >= 3){
+        output = argv[2];
+    }else{
+        std::string ext(".blog");
+        if (input.size() <= ext.size()
+            || input.compare(input.size()-ext.size(), ext.size(), ext) != 0){
+            std::cerr << "output file name is required" << std::endl;
+            return 1;
+        }
+        output = input.substr(0, input.size()-ext.size());
+    }
+
+    BinaryLogReader reader;
+    if (!reader.open(input.c_str())){
+        std::cerr << "failed to open(" << input << ")" << std::endl;
+        return 1;
+    }
+    std::ofstream ofs(output.c_str());
+    if (!ofs.is_open()){
+        std::cerr << "failed to open(" << output << ")" << std::endl;
+        return 1;
+    }
+
+    // same layout as LoggerPort::dumpLog()
+    const BinaryLogHeader& h = reader.header();
+    ofs.setf(std::ios::fixed, std::ios::floatfield);
+    for (size_t i=0; i<h.numSamples; i++){
+        ofs << std::setprecision(6) << reader.time(i) << " ";
+        for (size_t j=0; j<h.numElements; j++){
+            switch(h.elementType){
+            case BINARY_LOG_LONG:
+                ofs << (int)reader.value(i, j) << " ";
+                break;
+            case BINARY_LOG_BOOLEAN:
+                ofs << (unsigned char)reader.value(i, j) << " ";
+                break;
+            default:
+                ofs << reader.value(i, j) << " ";
+                break;
+            }
+        }
+        ofs << '\n';
+    }
+    std::cerr << h.dataType << " : " << h.numSamples << " samples, "
+              << h.numElements << " elements" << std::endl;
+    return 0;
+}
@@ -10,6 +10,10 @@
 #include "DataLogger.h"
 #include "util/Hrpsys.h"
 #include "pointcloud.hh"
+#include "LogRingBuffer.h"
+#include "BinaryLog.h"
+#include <cstddef>
+#include <coil/Time.h>
 
 
 typedef coil::Guard<coil::Mutex> Guard;
@@ -87,6 +91,19 @@ void printData(std::ostream& os, const PointCloudTypes::PointCloud& data)
   }
 } 
 
+// variable length samples are kept in std::deque
+template <> struct LogSlotTraits<OpenHRP::TimedLongSeqSeq>
+{
+    static const bool supported = false;
+    static bool fits(const OpenHRP::TimedLongSeqSeq& slot, const OpenHRP::TimedLongSeqSeq& data) { return false; }
+};
+
+template <> struct LogSlotTraits<PointCloudTypes::PointCloud>
+{
+    static const bool supported = false;
+    static bool fits(const PointCloudTypes::PointCloud& slot, const PointCloudTypes::PointCloud& data) { return false; }
+};
+
 template<class T>
 std::ostream& operator<<(std::ostream& os, const _CORBA_Unbounded_Sequence<T > & data)
 {
@@ -104,23 +121,106 @@ void printData(std::ostream& os, const T& data)
     }
 }
 
+// conversion to columns of a binary log
+template <class T>
+int elementType(const T& data) { return BINARY_LOG_DOUBLE; }
+int elementType(const RTC::LongSeq& data) { return BINARY_LOG_LONG; }
+int elementType(const RTC::BooleanSeq& data) { return BINARY_LOG_BOOLEAN; }
+
+template <class T>
+size_t dataLength(const T& data) { return data.length(); }
+size_t dataLength(const RTC::Acceleration3D& data) { return 3; }
+size_t dataLength(const RTC::Velocity2D& data) { return 3; }
+size_t dataLength(const RTC::Pose3D& data) { return 6; }
+size_t dataLength(const RTC::AngularVelocity3D& data) { return 3; }
+size_t dataLength(const RTC::Point3D& data) { return 3; }
+size_t dataLength(const RTC::Orientation3D& data) { return 3; }
+
+template <class T>
+void storeData(double *o, size_t stride, const T& data)
+{
+    for (unsigned int j=0; j<data.length(); j++){
+        o[j*stride] = data[j];
+    }
+}
+
+void storeData(double *o, size_t stride, const RTC::Acceleration3D& data)
+{
+    o[0] = data.ax; o[stride] = data.ay; o[2*stride] = data.az;
+}
+
+void storeData(double *o, size_t stride, const RTC::Velocity2D& data)
+{
+    o[0] = data.vx; o[stride] = data.vy; o[2*stride] = data.va;
+}
+
+void storeData(double *o, size_t stride, const RTC::Pose3D& data)
+{
+    o[0] = data.position.x; o[stride] = data.position.y;
+    o[2*stride] = data.position.z; o[3*stride] = data.orientation.r;
+    o[4*stride] = data.orientation.p; o[5*stride] = data.orientation.y;
+}
+
+void storeData(double *o, size_t stride, const RTC::AngularVelocity3D& data)
+{
+    o[0] = data.avx; o[stride] = data.avy; o[2*stride] = data.avz;
+}
+
+void storeData(double *o, size_t stride, const RTC::Point3D& data)
+{
+    o[0] = data.x; o[stride] = data.y; o[2*stride] = data.z;
+}
+
+void storeData(double *o, size_t stride, const RTC::Orientation3D& data)
+{
+    o[0] = data.r; o[stride] = data.p; o[2*stride] = data.y;
+}
+
+template <class T>
+void storeSample(double *o, size_t stride, const T& sample)
+{
+    storeData(o, stride, sample.data);
+}
+
+void storeSample(double *o, size_t stride, const OpenHRP::TimedLongSeqSeq& sample)
+{
+}
+
 template <class T>
 class LoggerPort : public LoggerPortBase
 {
 public:
-    LoggerPort(const char *name) : m_port(name, m_data) {}
+    LoggerPort(const char *name) : m_port(name, m_data), m_streamBinary(false),
+                                   m_streamDropped(0) {}
     const char *name(){
         return m_port.name();
     }
     virtual void dumpLog(std::ostream& os){
-        os.setf(std::ios::fixed, std::ios::floatfield);
-        for (unsigned int i=0; i<m_log.size(); i++){
-            // time
-            os << std::setprecision(6) << (m_log[i].tm.sec + m_log[i].tm.nsec/1e9) << " ";
-            // data
-            printData(os, m_log[i].data);
-            os << std::endl;
+        std::deque<T> buf;
+        printLog(os, samples(buf));
+    }
+    virtual bool dumpBinaryLog(std::ostream& os){
+        if (!isLittleEndianHost()) return false;
+        std::deque<T> buf;
+        const std::deque<T>& log = samples(buf);
+        size_t n = log.size(), len = n ? dataLength(log[0].data) : 0;
+        for (unsigned int i=1; i<n; i++){
+            // samples of different lengths can't be stored in columns
+            if (dataLength(log[i].data) != len) return false;
+        }
+        BinaryLogHeader header;
+        initBinaryLogHeader(header, m_type.c_str(),
+                            n ? elementType(log[0].data) : BINARY_LOG_DOUBLE,
+                            len, n);
+        std::vector<double> tm(n), data(n*len);
+        for (unsigned int i=0; i<n; i++){
+            tm[i] = log[i].tm.sec + log[i].tm.nsec/1e9;
+            if (len) storeSample(&data[i], n, log[i]);
         }
+        os.write((const char *)&header, sizeof(header));
+        if (n) os.write((const char *)&tm[0], n*sizeof(double));
+        if (n*len) os.write((const char *)&data[0], n*len*sizeof(double));
+        return os.good();
     }
     InPort<T>& port(){
             return m_port;
@@ -128,6 +228,10 @@ public:
     void log(){
         if (m_port.isNew()){
             m_port.read();
+            if (m_useRingBuffer){
+                m_ring.push(m_data);
+                return;
+            }
             m_log.push_back(m_data);
             while (m_log.size() > m_maxLength){
                 m_log.pop_front();
@@ -135,14 +239,127 @@ public:
         }
     }
     void clear(){
+        if (m_useRingBuffer){
+            m_ring.clear();
+        }else{
+            m_log.clear();
+        }
+    }
+    void maxLength(unsigned int len){
+        LoggerPortBase::maxLength(len);
+        if (m_useRingBuffer) m_ring.resize(len);
+    }
+    bool useRingBuffer(bool flag){
+        if (flag && !LogSlotTraits<T>::supported) return false;
+        m_useRingBuffer = flag;
         m_log.clear();
+        m_ring.resize(flag ? m_maxLength : 0);
+        return true;
+    }
+    bool openStream(const std::string& i_fname, bool i_binary){
+        if (!m_useRingBuffer) return false;
+        m_stream.open(i_fname.c_str(), i_binary ? std::ios::out|std::ios::binary : std::ios::out);
+        if (!m_stream.is_open()) return false;
+        m_streamBinary = i_binary;
+        m_streamHeader.numSamples = 0;
+        m_streamDropped = 0;
+        return true;
+    }
+    unsigned long flushStream(){
+        if (!m_stream.is_open()) return 0;
+        std::deque<T> log;
+        m_ring.drain(log);
+        if (log.empty()) return 0;
+        unsigned long n = log.size();
+        if (m_streamBinary){
+            n = writeRecords(log);
+        }else{
+            printLog(m_stream, log);
+        }
+        m_stream.flush();
+        return n;
+    }
+    void closeStream(){
+        if (m_stream.is_open()) m_stream.close();
+    }
+    unsigned long backlog(){
+        return m_useRingBuffer ? m_ring.backlog() : 0;
+    }
+    unsigned long dropped(){
+        return m_ring.dropped() + m_ring.overwritten() + m_streamDropped;
     }
 protected:
+    unsigned long writeRecords(const std::deque<T>& log){
+        if (!isLittleEndianHost()){
+            m_streamDropped += log.size();
+            return 0;
+        }
+        if (m_stream.tellp() == 0){
+            initBinaryLogHeader(m_streamHeader, m_type.c_str(),
+                                elementType(log[0].data),
+                                dataLength(log[0].data), 0, true);
+            m_stream.write((const char *)&m_streamHeader, sizeof(m_streamHeader));
+        }
+        unsigned long n = 0;
+        size_t len = m_streamHeader.numElements;
+        std::vector<double> record(len+1);
+        for (unsigned int i=0; i<log.size(); i++){
+            // records must have the same length as the first one
+            if (dataLength(log[i].data) != len){
+                m_streamDropped++;
+                continue;
+            }
+            record[0] = log[i].tm.sec + log[i].tm.nsec/1e9;
+            storeSample(&record[1], 1, log[i]);
+            m_stream.write((const char *)&record[0], record.size()*sizeof(double));
+            n++;
+        }
+        // keep the file readable while streaming
+        m_streamHeader.numSamples += n;
+        m_stream.seekp(offsetof(BinaryLogHeader, numSamples));
+        m_stream.write((const char *)&m_streamHeader.numSamples, sizeof(m_streamHeader.numSamples));
+        m_stream.seekp(0, std::ios::end);
+        return n;
+    }
+    const std::deque<T>& samples(std::deque<T>& buf){
+        if (!m_useRingBuffer) return m_log;
+        m_ring.snapshot(buf);
+        return buf;
+    }
+    void printLog(std::ostream& os, const std::deque<T>& log){
+        os.setf(std::ios::fixed, std::ios::floatfield);
+        for (unsigned int i=0; i<log.size(); i++){
+            // time
+            os << std::setprecision(6) << (log[i].tm.sec + log[i].tm.nsec/1e9) << " ";
+            // data
+            printData(os, log[i].data);
+            // streams are flushed once after all lines
+            os << '\n';
+        }
+    }
     InPort<T> m_port;
     T m_data;
     std::deque<T> m_log;
+    LogRingBuffer<T> m_ring;
+    std::ofstream m_stream;
+    bool m_streamBinary;
+    BinaryLogHeader m_streamHeader;
+    unsigned long m_streamDropped;
 };
 
+// elements of these types don't have a fixed length
+template <>
+bool LoggerPort<OpenHRP::TimedLongSeqSeq>::dumpBinaryLog(std::ostream& os)
+{
+    return false;
+}
+
+template <>
+bool LoggerPort<PointCloudTypes::PointCloud>::dumpBinaryLog(std::ostream& os)
+{
+    return false;
+}
+
 class LoggerPortForPointCloud : public LoggerPort<PointCloudTypes::PointCloud>
 {
 public:
@@ -167,6 +384,11 @@ DataLogger::DataLogger(RTC::Manager* manager)
     m_DataLoggerServicePort("DataLoggerService"),
     // </rtc-template>
     m_suspendFlag(false),
+    m_useRingBuffer(false),
+    m_writer(this),
+    m_streaming(false),
+    m_streamBinary(false),
+    m_written(0),
 	dummy(0)
 {
   m_service0.setLogger(this);
@@ -174,6 +396,8 @@ DataLogger::DataLogger(RTC::Manager* manager)
 
 DataLogger::~DataLogger()
 {
+  // stopStreaming() checks m_streaming under m_streamMutex
+  stopStreaming();
 }
 
 
@@ -306,6 +530,7 @@ RTC::ReturnCode_t DataLogger::onRateChanged(RTC::UniqueId ec_id)
 
 bool DataLogger::add(const char *i_type, const char *i_name)
 {
+  Guard streamGuard(m_streamMutex);
   suspendLogging();
   for (unsigned int i=0; i<m_ports.size(); i++){
       if (strcmp(m_ports[i]->name(),i_name) == 0){
@@ -400,19 +625,36 @@ bool DataLogger::add(const char *i_type, const char *i_name)
       resumeLogging();
       return false;
   }
+  new_port->type(i_type);
+  if (m_useRingBuffer && !new_port->useRingBuffer(true)){
+      std::cerr << "[" << m_profile.instance_name << "] " << i_name
+                << " is logged without ring buffer" << std::endl;
+  }
   m_ports.push_back(new_port);
+  if (m_streaming) openStream(new_port);
   resumeLogging();
   return true;
 }
 
-bool DataLogger::save(const char *i_basename)
+bool DataLogger::save(const char *i_basename, bool i_binary)
 {
-  suspendLogging();
+  Guard streamGuard(m_streamMutex);
+  // ring buffers can be saved while logging
+  bool suspend = !ringBufferOnly();
+  if (suspend) suspendLogging();
   bool ret = true;
   for (unsigned int i=0; i<m_ports.size(); i++){
     std::string fname = i_basename;
     fname.append(".");
     fname.append(m_ports[i]->name());
+    if (i_binary){
+      std::string bname = fname + ".blog";
+      std::ofstream ofs(bname.c_str(), std::ios::binary);
+      if (ofs.is_open() && m_ports[i]->dumpBinaryLog(ofs)) continue;
+      // fall back to the text format
+      ofs.close();
+      unlink(bname.c_str());
+    }
     std::ofstream ofs(fname.c_str());
     if (ofs.is_open()){
       m_ports[i]->dumpLog(ofs);
@@ -422,18 +664,20 @@ bool DataLogger::save(const char *i_basename)
     }
   }
   if (ret) std::cerr << "[" << m_profile.instance_name << "] Save log to " << i_basename << ".*" << std::endl;
-  resumeLogging();
+  if (suspend) resumeLogging();
   return ret;
 }
 
 bool DataLogger::clear()
 {
-  suspendLogging();
+  Guard streamGuard(m_streamMutex);
+  bool suspend = !ringBufferOnly();
+  if (suspend) suspendLogging();
   for (unsigned int i=0; i<m_ports.size(); i++){
     m_ports[i]->clear();
   }
   std::cerr << "[" << m_profile.instance_name << "] Log cleared" << std::endl;
-  resumeLogging();
+  if (suspend) resumeLogging();
   return true;
 }
 
@@ -451,6 +695,7 @@ void DataLogger::resumeLogging()
 
 void DataLogger::maxLength(unsigned int len)
 {
+  Guard streamGuard(m_streamMutex);
   suspendLogging();
   for (unsigned int i=0; i<m_ports.size(); i++){
     m_ports[i]->maxLength(len);
@@ -459,6 +704,124 @@ void DataLogger::maxLength(unsigned int len)
   resumeLogging();
 }
 
+void DataLogger::useRingBuffer(bool flag)
+{
+  Guard streamGuard(m_streamMutex);
+  if (!flag && m_streaming){
+    std::cerr << "[" << m_profile.instance_name << "] Ring buffer is required while streaming" << std::endl;
+    return;
+  }
+  setRingBuffer(flag);
+}
+
+// m_streamMutex must be locked
+void DataLogger::setRingBuffer(bool flag)
+{
+  suspendLogging();
+  m_useRingBuffer = flag;
+  for (unsigned int i=0; i<m_ports.size(); i++){
+    if (!m_ports[i]->useRingBuffer(flag)){
+      std::cerr << "[" << m_profile.instance_name << "] " << m_ports[i]->name()
+                << " is logged without ring buffer" << std::endl;
+    }
+  }
+  std::cerr << "[" << m_profile.instance_name << "] Ring buffer is "
+            << (flag ? "enabled" : "disabled") << std::endl;
+  resumeLogging();
+}
+
+bool DataLogger::ringBufferOnly()
+{
+  if (!m_useRingBuffer) return false;
+  for (unsigned int i=0; i<m_ports.size(); i++){
+    if (!m_ports[i]->ringBuffer()) return false;
+  }
+  return true;
+}
+
+// m_streamMutex must be locked
+void DataLogger::openStream(LoggerPortBase *i_port)
+{
+  std::string fname = m_streamBasename;
+  fname.append(".");
+  fname.append(i_port->name());
+  if (m_streamBinary) fname.append(".blog");
+  if (!i_port->openStream(fname, m_streamBinary)){
+    std::cerr << "[" << m_profile.instance_name << "] " << i_port->name()
+              << " is not streamed" << std::endl;
+  }
+}
+
+bool DataLogger::startStreaming(const char *i_basename, bool i_binary)
+{
+  Guard streamGuard(m_streamMutex);
+  if (m_streaming){
+    std::cerr << "[" << m_profile.instance_name << "] Already streaming" << std::endl;
+    return false;
+  }
+  if (!m_useRingBuffer) setRingBuffer(true);
+  m_streamBasename = i_basename;
+  m_streamBinary = i_binary;
+  for (unsigned int i=0; i<m_ports.size(); i++){
+    openStream(m_ports[i]);
+  }
+  m_written = 0;
+  m_streaming = true;
+  m_writer.activate();
+  std::cerr << "[" << m_profile.instance_name << "] Start streaming to " << i_basename << ".*" << std::endl;
+  return true;
+}
+
+bool DataLogger::stopStreaming()
+{
+  {
+    Guard streamGuard(m_streamMutex);
+    if (!m_streaming) return false;
+    m_streaming = false;
+  }
+  m_writer.wait();
+  m_writer.reset();
+  Guard streamGuard(m_streamMutex);
+  for (unsigned int i=0; i<m_ports.size(); i++){
+    m_written += m_ports[i]->flushStream();
+    m_ports[i]->closeStream();
+  }
+  std::cerr << "[" << m_profile.instance_name << "] Stop streaming, "
+            << m_written << " samples are written" << std::endl;
+  return true;
+}
+
+bool DataLogger::getStreamingStatus(OpenHRP::DataLoggerService::StreamingStatus& o_status)
+{
+  Guard streamGuard(m_streamMutex);
+  o_status.streaming = m_streaming;
+  o_status.backlog = o_status.dropped = 0;
+  for (unsigned int i=0; i<m_ports.size(); i++){
+    o_status.backlog += m_ports[i]->backlog();
+    o_status.dropped += m_ports[i]->dropped();
+  }
+  o_status.written = m_written;
+  return true;
+}
+
+bool DataLogger::flushStreams()
+{
+  Guard streamGuard(m_streamMutex);
+  if (!m_streaming) return false;
+  for (unsigned int i=0; i<m_ports.size(); i++){
+    m_written += m_ports[i]->flushStream();
+  }
+  return true;
+}
+
+int LogWriterTask::svc()
+{
+  while (m_logger->flushStreams()){
+    coil::usleep(LOG_STREAM_INTERVAL_USEC);
+  }
+  return 0;
+}
+
 extern "C"
 {
 
@@ -13,6 +13,7 @@
 #include <deque>
 #include <iomanip>
 
+#include <coil/Task.h>
 #include <rtm/Manager.h>
 #include <rtm/DataFlowComponentBase.h>
 #include <rtm/CorbaPort.h>
@@ -36,18 +37,44 @@
 using namespace RTC;
 
 #define DEFAULT_MAX_LOG_LENGTH (200*20)
+#define LOG_STREAM_INTERVAL_USEC 100000
 
 class LoggerPortBase
 {
 public:
-    LoggerPortBase() : m_maxLength(DEFAULT_MAX_LOG_LENGTH) {}
+    LoggerPortBase() : m_maxLength(DEFAULT_MAX_LOG_LENGTH), m_useRingBuffer(false) {}
     virtual const char *name() = 0;
     virtual void clear() = 0;
     virtual void dumpLog(std::ostream& os) = 0;
+    virtual bool dumpBinaryLog(std::ostream& os) = 0;
     virtual void log() = 0;
-    void maxLength(unsigned int len) { m_maxLength = len; }
+    virtual void maxLength(unsigned int len) { m_maxLength = len; }
+    virtual bool useRingBuffer(bool flag) = 0;
+    virtual bool openStream(const std::string& i_fname, bool i_binary) = 0;
+    virtual unsigned long flushStream() = 0;
+    virtual void closeStream() = 0;
+    virtual unsigned long backlog() = 0;
+    virtual unsigned long dropped() = 0;
+    bool ringBuffer() const { return m_useRingBuffer; }
+    void type(const char *i_type) { m_type = i_type; }
 protected:
+    std::string m_type;
     unsigned int m_maxLength;
+    bool m_useRingBuffer;
+};
+
+class DataLogger;
+
+/**
+   \brief thread which writes logged data to files while streaming
+ */
+class LogWriterTask : public coil::Task
+{
+public:
+    LogWriterTask(DataLogger *i_logger) : m_logger(i_logger) {}
+    int svc();
+private:
+    DataLogger *m_logger;
 };
 
 /**
@@ -115,11 +142,17 @@ class DataLogger
   // no corresponding operation exists in OpenRTm-aist-0.2.0
   // virtual RTC::ReturnCode_t onRateChanged(RTC::UniqueId ec_id);
   bool add(const char *i_type, const char *i_name);
-  bool save(const char *i_basename);
+  bool save(const char *i_basename, bool i_binary=false);
   bool clear();
   void suspendLogging();
   void resumeLogging();
   void maxLength(unsigned int len);
+  void useRingBuffer(bool flag);
+  bool ringBufferOnly();
+  bool startStreaming(const char *i_basename, bool i_binary);
+  bool stopStreaming();
+  bool getStreamingStatus(OpenHRP::DataLoggerService::StreamingStatus& o_status);
+  bool flushStreams();
 
   std::vector<LoggerPortBase *> m_ports;
 
@@ -160,8 +193,16 @@ class DataLogger
   // </rtc-template>
 
  private:
-  bool m_suspendFlag;
+  bool m_suspendFlag, m_useRingBuffer;
   coil::Mutex m_suspendFlagMutex;
+  void setRingBuffer(bool flag);
+  void openStream(LoggerPortBase *i_port);
+  // serializes access to ports from service calls and m_writer
+  coil::Mutex m_streamMutex;
+  LogWriterTask m_writer;
+  bool m_streaming, m_streamBinary;
+  std::string m_streamBasename;
+  unsigned long m_written;
   int dummy;
 };
 
@@ -19,6 +19,11 @@ CORBA::Boolean DataLoggerService_impl::save(const char *basename)
   return m_logger->save(basename);
 }
 
+CORBA::Boolean DataLoggerService_impl::saveBinary(const char *basename)
+{
+  return m_logger->save(basename, true);
+}
+
 CORBA::Boolean DataLoggerService_impl::clear()
 {
   return m_logger->clear();
@@ -29,4 +34,22 @@ void DataLoggerService_impl::maxLength(CORBA::ULong len)
   m_logger->maxLength(len);
 }
 
+void DataLoggerService_impl::useRingBuffer(CORBA::Boolean flag)
+{
+  m_logger->useRingBuffer(flag);
+}
 
+CORBA::Boolean DataLoggerService_impl::startStreaming(const char *basename, CORBA::Boolean binary)
+{
+  return m_logger->startStreaming(basename, binary);
+}
+
+CORBA::Boolean DataLoggerService_impl::stopStreaming()
+{
+  return m_logger->stopStreaming();
+}
+
+CORBA::Boolean DataLoggerService_impl::getStreamingStatus(OpenHRP::DataLoggerService::StreamingStatus_out status)
+{
+  return m_logger->getStreamingStatus(status);
+}
@@ -19,8 +19,13 @@ public:
 
   CORBA::Boolean add(const char *type, const char *name);
   CORBA::Boolean save(const char *basename);
+  CORBA::Boolean saveBinary(const char *basename);
   CORBA::Boolean clear();
   void maxLength(CORBA::ULong len);
+  void useRingBuffer(CORBA::Boolean flag);
+  CORBA::Boolean startStreaming(const char *basename, CORBA::Boolean binary);
+  CORBA::Boolean stopStreaming();
+  CORBA::Boolean getStreamingStatus(OpenHRP::DataLoggerService::StreamingStatus_out status);
 private:
   DataLogger *m_logger;
 };
@@ -0,0 +1,184 @@
+// -*- C++ -*-
+/*!
+ * @file  LogRingBuffer.h
+ * @brief fixed-size ring buffer used by DataLogger
+ * @date  $Date$
+ *
+ * $Id$
+ */
+
+#ifndef LOG_RING_BUFFER_H
+#define LOG_RING_BUFFER_H
+
+#include <vector>
+#include <deque>
+#include <rtm/idl/BasicDataTypeSkel.h>
+
+/**
+   \brief properties of a log sample type used by LogRingBuffer
+ */
+template <class T>
+struct LogSlotTraits
+{
+    //! true if samples of this type can be stored in a LogRingBuffer
+    static const bool supported = true;
+    /**
+       \brief check whether data can be copied into slot without allocation
+       \param slot preallocated slot
+       \param data sample to be stored
+     */
+    static bool fits(const T& slot, const T& data) { return true; }
+};
+
+#define LOG_SLOT_TRAITS_SEQ(T)                                          \
+    template <> struct LogSlotTraits<T> {                               \
+        static const bool supported = true;                             \
+        static bool fits(const T& slot, const T& data) {                \
+            return data.data.length() <= slot.data.maximum();           \
+        }                                                               \
+    };
+
+LOG_SLOT_TRAITS_SEQ(RTC::TimedDoubleSeq)
+LOG_SLOT_TRAITS_SEQ(RTC::TimedLongSeq)
+LOG_SLOT_TRAITS_SEQ(RTC::TimedBooleanSeq)
+
+#undef LOG_SLOT_TRAITS_SEQ
+
+/**
+   \brief single-producer ring buffer of log samples
+
+   push() is called from the RT thread and never allocates once the slots
+   are set up at the first sample. snapshot(), drain() and clear() may be
+   called from another thread at the same time without locking, but not
+   concurrently with each other. They don't touch the slots until push()
+   publishes them. resize() must not run concurrently with the others.
+ */
+template <class T>
+class LogRingBuffer
+{
+public:
+    LogRingBuffer() : m_capacity(0), m_size(0), m_begin(0), m_head(0), m_tail(0), m_dropped(0), m_overwritten(0) {}
+    /**
+       \brief set number of slots. stored samples are discarded and
+       slots are allocated again at the next push()
+       \param len number of slots
+     */
+    void resize(unsigned int len){
+        m_slots.clear();
+        m_capacity = len;
+        m_size = 0;
+        m_begin = m_head = m_tail = 0;
+        m_dropped = m_overwritten = 0;
+    }
+    /**
+       \brief store a sample. the oldest sample is overwritten when full
+       \param data sample
+       \return true if stored, false if it doesn't fit in a slot
+     */
+    bool push(const T& data){
+        if (m_slots.empty()){
+            if (!m_capacity) return false;
+            // allocate all slots up front with the size of the first sample
+            m_slots.assign(m_capacity, data);
+            // readers use m_size, so the slots are published only after they are set up
+            __sync_synchronize();
+            m_size = m_capacity;
+        }
+        if (!LogSlotTraits<T>::fits(m_slots[0], data)){
+            m_dropped++;
+            return false;
+        }
+        m_begin = m_head + 1;
+        __sync_synchronize();
+        m_slots[m_head % m_size] = data;
+        __sync_synchronize();
+        m_head = m_begin;
+        return true;
+    }
+    /**
+       \brief copy stored samples, oldest first
+       \param o_log samples are appended to this deque
+     */
+    void snapshot(std::deque<T>& o_log){
+        unsigned long first;
+        copy(o_log, m_tail, first);
+    }
+    /**
+       \brief move samples which are not read yet, oldest first. Samples
+       overwritten before being read are counted by overwritten().
+       \param o_log samples are appended to this deque
+       \return number of samples appended
+     */
+    size_t drain(std::deque<T>& o_log){
+        size_t n = o_log.size();
+        unsigned long first, tail = m_tail;
+        unsigned long head = copy(o_log, tail, first);
+        m_overwritten += first - tail;
+        m_tail = head;
+        return o_log.size() - n;
+    }
+    /**
+       \brief discard stored samples
+     */
+    void clear(){
+        m_tail = m_head;
+    }
+    /**
+       \brief number of samples which were dropped since they didn't fit
+     */
+    unsigned long dropped() const { return m_dropped; }
+    /**
+       \brief number of samples which were overwritten before drain()
+     */
+    unsigned long overwritten() const { return m_overwritten; }
+    /**
+       \brief number of samples which are not read by drain() yet
+     */
+    unsigned long backlog() const {
+        unsigned long n = m_head - m_tail;
+        __sync_synchronize();
+        unsigned long size = m_size;
+        return n < size ? n : size;
+    }
+    /**
+       \brief number of samples which can be stored
+     */
+    unsigned int capacity() const { return m_capacity; }
+private:
+    /*
+      copy samples from index i_from to the latest one. o_first is set to
+      the index of the first sample which is actually copied and the index
+      next to the latest one is returned.
+    */
+    unsigned long copy(std::deque<T>& o_log, unsigned long i_from, unsigned long& o_first){
+        unsigned long head = m_head;
+        __sync_synchronize();
+        o_first = head;
+        if (head <= i_from) return head;
+        unsigned long size = m_size;
+        unsigned long start = head > size ? head - size : 0;
+        if (start < i_from) start = i_from;
+        size_t offset = o_log.size();
+        for (unsigned long i=start; i<head; i++){
+            o_log.push_back(m_slots[i%size]);
+        }
+        __sync_synchronize();
+        // samples which may have been overwritten while copying are discarded
+        unsigned long valid = m_begin;
+        valid = valid > size ? valid - size : 0;
+        if (valid < start) valid = start;
+        if (valid > head) valid = head;
+        o_log.erase(o_log.begin() + offset, o_log.begin() + offset + (valid - start));
+        o_first = valid;
+        return head;
+    }
+    std::vector<T> m_slots;
+    unsigned int m_capacity;
+    //! number of slots which are set up, 0 until the first push()
+    volatile unsigned long m_size;
+    //! m_begin is incremented before writing a slot and m_head after that
+    volatile unsigned long m_begin, m_head, m_tail;
+    unsigned long m_dropped, m_overwritten;
+};
+
+#endif // LOG_RING_BUFFER_H
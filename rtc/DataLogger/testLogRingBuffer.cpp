@@ -0,0 +1,125 @@
+/* -*- coding:utf-8-unix; mode:c++; -*- */
+/*
+  compare worst-case logging time of std::deque used by DataLogger by
+  default and LogRingBuffer, for 50 ports of 40-element TimedDoubleSeq
+*/
+#include "LogRingBuffer.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "util/TestUtil.h"
+
+static void init_sample(RTC::TimedDoubleSeq& data, size_t len)
+{
+    data.data.length(len);
+    for (size_t i = 0; i < len; i++) data.data[i] = i;
+}
+
+static void set_sample(RTC::TimedDoubleSeq& data, size_t tick)
+{
+    data.tm.sec = tick / 1000;
+    data.tm.nsec = (tick % 1000) * 1000000;
+    data.data[0] = tick;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nports = 50, len = 40, max_length = 4000, nticks = 20000;
+    for (int i = 1; i < argc; ++ i) {
+        std::string arg(argv[i]);
+        if ( arg == "--ports" ) {
+            if (++i < argc) nports = atoi(argv[i]);
+        } else if ( arg == "--length" ) {
+            if (++i < argc) len = atoi(argv[i]);
+        } else if ( arg == "--max-length" ) {
+            if (++i < argc) max_length = atoi(argv[i]);
+        } else if ( arg == "--ticks" ) {
+            if (++i < argc) nticks = atoi(argv[i]);
+        }
+    }
+    RTC::TimedDoubleSeq data;
+    init_sample(data, len);
+
+    // std::deque (same as LoggerPort::log())
+    std::vector<std::deque<RTC::TimedDoubleSeq> > logs(nports);
+    double deque_max = 0, deque_sum = 0;
+    for (size_t t = 0; t < nticks; t++) {
+        set_sample(data, t);
+        double t0 = now();
+        for (size_t p = 0; p < nports; p++) {
+            logs[p].push_back(data);
+            while (logs[p].size() > max_length) logs[p].pop_front();
+        }
+        double dt = (now() - t0)*1e6;
+        deque_sum += dt;
+        if (dt > deque_max) deque_max = dt;
+    }
+
+    // LogRingBuffer. the first tick allocates slots and is reported separately
+    std::vector<LogRingBuffer<RTC::TimedDoubleSeq> > rings(nports);
+    for (size_t p = 0; p < nports; p++) rings[p].resize(max_length);
+    double ring_first = 0, ring_max = 0, ring_sum = 0;
+    for (size_t t = 0; t < nticks; t++) {
+        set_sample(data, t);
+        double t0 = now();
+        for (size_t p = 0; p < nports; p++) {
+            rings[p].push(data);
+        }
+        double dt = (now() - t0)*1e6;
+        if (t == 0) {
+            ring_first = dt;
+            continue;
+        }
+        ring_sum += dt;
+        if (dt > ring_max) ring_max = dt;
+    }
+
+    std::cerr << nports << " ports, " << len << " elements, " << nticks << " ticks" << std::endl;
+    std::cerr << "  deque : avg " << deque_sum/nticks << " [us], max " << deque_max << " [us]" << std::endl;
+    std::cerr << "  ring  : avg " << ring_sum/(nticks-1) << " [us], max " << ring_max << " [us], first " << ring_first << " [us]" << std::endl;
+
+    // check contents
+    bool ret = true;
+    std::deque<RTC::TimedDoubleSeq> log;
+    rings[0].snapshot(log);
+    size_t expected = nticks < max_length ? nticks : max_length;
+    if (log.size() != expected) {
+        std::cerr << "  snapshot has " << log.size() << " samples, expected " << expected << std::endl;
+        ret = false;
+    }
+    for (size_t i = 0; i < log.size(); i++) {
+        if (log[i].data[0] != nticks - log.size() + i || log[i].data.length() != len) {
+            std::cerr << "  sample " << i << " is broken" << std::endl;
+            ret = false;
+            break;
+        }
+    }
+    rings[0].clear();
+    log.clear();
+    rings[0].snapshot(log);
+    if (!log.empty()) {
+        std::cerr << "  snapshot after clear() is not empty" << std::endl;
+        ret = false;
+    }
+    // drain() for streaming, 5 samples are overwritten before the second drain()
+    log.clear();
+    rings[1].resize(max_length);
+    for (size_t t = 0; t < max_length + 10; t++) {
+        set_sample(data, t);
+        rings[1].push(data);
+        if (t == 4) rings[1].drain(log);
+    }
+    if (rings[1].backlog() != max_length || rings[1].drain(log) != max_length
+        || rings[1].overwritten() != 5 || rings[1].backlog() != 0 || log[5].data[0] != 10) {
+        std::cerr << "  drain() is broken" << std::endl;
+        ret = false;
+    }
+    RTC::TimedDoubleSeq longer;
+    init_sample(longer, len+1);
+    if (rings[0].push(longer) || rings[0].dropped() != 1) {
+        std::cerr << "  sample longer than slots is not dropped" << std::endl;
+        ret = false;
+    }
+    std::cerr << (ret ? "  OK" : "  NG") << std::endl;
+    return ret ? 0 : 1;
+}
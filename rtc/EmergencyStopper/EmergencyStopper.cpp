@@ -169,6 +169,11 @@ RTC::ReturnCode_t EmergencyStopper::onInitialize()
     default_recover_time = 2.5/m_dt;
     default_retrieve_time = 1;
     //default_retrieve_time = 1.0/m_dt;
+    {
+        ParameterCell<StopperParam>::Writer param(m_stopper_param);
+        param->default_recover_time = default_recover_time;
+        param->default_retrieve_time = default_retrieve_time;
+    }
     m_stop_posture = new double[m_robot->numJoints()];
     m_stop_wrenches = new double[nforce*6];
     m_tmp_wrenches = new double[nforce*6];
@@ -255,6 +260,10 @@ RTC::ReturnCode_t EmergencyStopper::onExecute(RTC::UniqueId ec_id)
 {
     int numJoints = m_robot->numJoints();
     loop++;
+    if (m_stopper_param.update()) {
+        default_recover_time = m_stopper_param.value().default_recover_time;
+        default_retrieve_time = m_stopper_param.value().default_retrieve_time;
+    }
     if (m_servoStateIn.isNew()) {
         m_servoStateIn.read();
     }
@@ -485,8 +494,9 @@ bool EmergencyStopper::releaseMotion()
 bool EmergencyStopper::getEmergencyStopperParam(OpenHRP::EmergencyStopperService::EmergencyStopperParam& i_param)
 {
     std::cerr << "[" << m_profile.instance_name << "] getEmergencyStopperParam" << std::endl;
-    i_param.default_recover_time = default_recover_time*m_dt;
-    i_param.default_retrieve_time = default_retrieve_time*m_dt;
+    StopperParam param = m_stopper_param.get();
+    i_param.default_recover_time = param.default_recover_time*m_dt;
+    i_param.default_retrieve_time = param.default_retrieve_time*m_dt;
     i_param.is_stop_mode = is_stop_mode;
     return true;
 };
@@ -494,9 +504,11 @@ bool EmergencyStopper::getEmergencyStopperParam(OpenHRP::EmergencyStopperService
 bool EmergencyStopper::setEmergencyStopperParam(const OpenHRP::EmergencyStopperService::EmergencyStopperParam& i_param)
 {
     std::cerr << "[" << m_profile.instance_name << "] setEmergencyStopperParam" << std::endl;
-    default_recover_time = i_param.default_recover_time/m_dt;
-    default_retrieve_time = i_param.default_retrieve_time/m_dt;
-    std::cerr << "[" << m_profile.instance_name << "]   default_recover_time = " << default_recover_time*m_dt << "[s], default_retrieve_time = " << default_retrieve_time*m_dt << "[s]" << std::endl;
+    StopperParam param;
+    param.default_recover_time = i_param.default_recover_time/m_dt;
+    param.default_retrieve_time = i_param.default_retrieve_time/m_dt;
+    m_stopper_param.set(param);
+    std::cerr << "[" << m_profile.instance_name << "]   default_recover_time = " << param.default_recover_time*m_dt << "[s], default_retrieve_time = " << param.default_retrieve_time*m_dt << "[s]" << std::endl;
     return true;
 };
 
@@ -20,6 +20,7 @@
 #include <hrpModel/Body.h>
 #include "interpolator.h"
 #include "HRPDataTypes.hh"
+#include "util/ParameterCell.h"
 #include <queue>
 
 // Service implementation headers
@@ -178,6 +179,11 @@ private:
     int recover_time, retrieve_time;
     double recover_time_dt;
     int default_recover_time, default_retrieve_time;
+    // parameters set by setEmergencyStopperParam, which are applied at the beginning of onExecute
+    struct StopperParam {
+        int default_recover_time, default_retrieve_time;
+    };
+    ParameterCell<StopperParam> m_stopper_param;
     double *m_stop_posture;
     double *m_stop_wrenches;
     double *m_tmp_wrenches;
@@ -248,6 +248,16 @@ RTC::ReturnCode_t ImpedanceController::onInitialize()
         }
     }
 
+    {
+        ParameterCell<ImpedanceGainSet>::Writer gains(m_gains);
+        for ( std::map<std::string, ImpedanceParam>::iterator it = m_impedance_param.begin(); it != m_impedance_param.end(); it++ ) {
+            OpenHRP::ImpedanceControllerService::impedanceParam ip;
+            copyImpedanceParam(ip, it->second);
+            copyImpedanceGains(gains->gains[it->first], ip, it->second.manip->numJoints());
+        }
+        gains->use_sh_base_pos_rpy = use_sh_base_pos_rpy;
+    }
+
     otd = boost::shared_ptr<ObjectTurnaroundDetector>(new ObjectTurnaroundDetector(m_dt));
     otd->setPrintStr(std::string(m_profile.instance_name));
 
@@ -342,6 +352,7 @@ RTC::ReturnCode_t ImpedanceController::onExecute(RTC::UniqueId ec_id)
         }
 
         Guard guard(m_mutex);
+        if (m_gains.update()) applyImpedanceGains();
 
         bool is_active = false;
         for ( std::map<std::string, ImpedanceParam>::iterator it = m_impedance_param.begin(); it != m_impedance_param.end(); it++ ) {
@@ -737,57 +748,105 @@ bool ImpedanceController::stopImpedanceController(const std::string& i_name_)
 
 bool ImpedanceController::setImpedanceControllerParam(const std::string& i_name_, OpenHRP::ImpedanceControllerService::impedanceParam i_param_)
 {
-    // Lock Mutex
-    {
-        Guard guard(m_mutex);
-        std::string name = std::string(i_name_);
-        if ( m_impedance_param.find(name) == m_impedance_param.end() ) {
-            std::cerr << "[" << m_profile.instance_name << "] Could not found impedance controller param [" << name << "]" << std::endl;
-            return false;
-        }
+    std::string name = std::string(i_name_);
+    if ( m_impedance_param.find(name) == m_impedance_param.end() ) {
+        std::cerr << "[" << m_profile.instance_name << "] Could not found impedance controller param [" << name << "]" << std::endl;
+        return false;
+    }
 
-        std::cerr << "[" << m_profile.instance_name << "] Update impedance parameters" << std::endl;
-
-        m_impedance_param[name].sr_gain    = i_param_.sr_gain;
-        m_impedance_param[name].avoid_gain = i_param_.avoid_gain;
-        m_impedance_param[name].reference_gain = i_param_.reference_gain;
-        m_impedance_param[name].manipulability_limit = i_param_.manipulability_limit;
-        m_impedance_param[name].manip->setSRGain(m_impedance_param[name].sr_gain);
-        m_impedance_param[name].manip->setManipulabilityLimit(m_impedance_param[name].manipulability_limit);
-
-        m_impedance_param[name].M_p = i_param_.M_p;
-        m_impedance_param[name].D_p = i_param_.D_p;
-        m_impedance_param[name].K_p = i_param_.K_p;
-        m_impedance_param[name].M_r = i_param_.M_r;
-        m_impedance_param[name].D_r = i_param_.D_r;
-        m_impedance_param[name].K_r = i_param_.K_r;
-
-        m_impedance_param[name].force_gain = hrp::Vector3(i_param_.force_gain[0], i_param_.force_gain[1], i_param_.force_gain[2]).asDiagonal();
-        m_impedance_param[name].moment_gain = hrp::Vector3(i_param_.moment_gain[0], i_param_.moment_gain[1], i_param_.moment_gain[2]).asDiagonal();
-
-        std::vector<double> ov;
-        ov.resize(m_impedance_param[name].manip->numJoints());
-        for (size_t i = 0; i < m_impedance_param[name].manip->numJoints(); i++) {
-            ov[i] = i_param_.ik_optional_weight_vector[i];
-        }
-        m_impedance_param[name].manip->setOptionalWeightVector(ov);
-        use_sh_base_pos_rpy = i_param_.use_sh_base_pos_rpy;
-
-        std::cerr << "[" << m_profile.instance_name << "] set parameters" << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]             name : " << name << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]    M, D, K (pos) : " << m_impedance_param[name].M_p << " " << m_impedance_param[name].D_p << " " << m_impedance_param[name].K_p << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]    M, D, K (rot) : " << m_impedance_param[name].M_r << " " << m_impedance_param[name].D_r << " " << m_impedance_param[name].K_r << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]       force_gain : " << m_impedance_param[name].force_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]      moment_gain : " << m_impedance_param[name].moment_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]      manip_limit : " << m_impedance_param[name].manipulability_limit << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]          sr_gain : " << m_impedance_param[name].sr_gain << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]       avoid_gain : " << m_impedance_param[name].avoid_gain << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]   reference_gain : " << m_impedance_param[name].reference_gain << std::endl;
-        std::cerr << "[" << m_profile.instance_name << "]   use_sh_base_pos_rpy : " << (use_sh_base_pos_rpy?"true":"false") << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "] Update impedance parameters" << std::endl;
+
+    // gains are applied by onExecute without locking m_mutex
+    ImpedanceGains g;
+    copyImpedanceGains(g, i_param_, m_impedance_param[name].manip->numJoints());
+    {
+        ParameterCell<ImpedanceGainSet>::Writer gains(m_gains);
+        gains->gains[name] = g;
+        gains->use_sh_base_pos_rpy = i_param_.use_sh_base_pos_rpy;
     }
+
+    std::cerr << "[" << m_profile.instance_name << "] set parameters" << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]             name : " << name << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]    M, D, K (pos) : " << g.M_p << " " << g.D_p << " " << g.K_p << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]    M, D, K (rot) : " << g.M_r << " " << g.D_r << " " << g.K_r << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]       force_gain : " << g.force_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]      moment_gain : " << g.moment_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]      manip_limit : " << g.manipulability_limit << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]          sr_gain : " << g.sr_gain << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]       avoid_gain : " << g.avoid_gain << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]   reference_gain : " << g.reference_gain << std::endl;
+    std::cerr << "[" << m_profile.instance_name << "]   use_sh_base_pos_rpy : " << (i_param_.use_sh_base_pos_rpy?"true":"false") << std::endl;
     return true;
 }
 
+void ImpedanceController::copyImpedanceGains (ImpedanceGains& gains, const OpenHRP::ImpedanceControllerService::impedanceParam& i_param_, size_t num_joints)
+{
+    gains.sr_gain    = i_param_.sr_gain;
+    gains.avoid_gain = i_param_.avoid_gain;
+    gains.reference_gain = i_param_.reference_gain;
+    gains.manipulability_limit = i_param_.manipulability_limit;
+    gains.M_p = i_param_.M_p;
+    gains.D_p = i_param_.D_p;
+    gains.K_p = i_param_.K_p;
+    gains.M_r = i_param_.M_r;
+    gains.D_r = i_param_.D_r;
+    gains.K_r = i_param_.K_r;
+    gains.force_gain = hrp::Vector3(i_param_.force_gain[0], i_param_.force_gain[1], i_param_.force_gain[2]).asDiagonal();
+    gains.moment_gain = hrp::Vector3(i_param_.moment_gain[0], i_param_.moment_gain[1], i_param_.moment_gain[2]).asDiagonal();
+    gains.ik_optional_weight_vector.resize(num_joints);
+    for (size_t i = 0; i < num_joints; i++) {
+        gains.ik_optional_weight_vector[i] = i_param_.ik_optional_weight_vector[i];
+    }
+}
+
+void ImpedanceController::copyImpedanceGains (OpenHRP::ImpedanceControllerService::impedanceParam& i_param_, const ImpedanceGains& gains)
+{
+    i_param_.M_p = gains.M_p;
+    i_param_.D_p = gains.D_p;
+    i_param_.K_p = gains.K_p;
+    i_param_.M_r = gains.M_r;
+    i_param_.D_r = gains.D_r;
+    i_param_.K_r = gains.K_r;
+    for (size_t i = 0; i < 3; i++) i_param_.force_gain[i] = gains.force_gain(i,i);
+    for (size_t i = 0; i < 3; i++) i_param_.moment_gain[i] = gains.moment_gain(i,i);
+    i_param_.sr_gain = gains.sr_gain;
+    i_param_.avoid_gain = gains.avoid_gain;
+    i_param_.reference_gain = gains.reference_gain;
+    i_param_.manipulability_limit = gains.manipulability_limit;
+    i_param_.ik_optional_weight_vector.length(gains.ik_optional_weight_vector.size());
+    for (size_t i = 0; i < gains.ik_optional_weight_vector.size(); i++) {
+        i_param_.ik_optional_weight_vector[i] = gains.ik_optional_weight_vector[i];
+    }
+}
+
+// called by onExecute with m_mutex locked, does not allocate memory
+void ImpedanceController::applyImpedanceGains ()
+{
+    const ImpedanceGainSet& gains = m_gains.value();
+    for ( std::map<std::string, ImpedanceGains>::const_iterator it = gains.gains.begin(); it != gains.gains.end(); it++ ) {
+        std::map<std::string, ImpedanceParam>::iterator pit = m_impedance_param.find(it->first);
+        if (pit == m_impedance_param.end()) continue;
+        ImpedanceParam& param = pit->second;
+        const ImpedanceGains& g = it->second;
+        param.sr_gain = g.sr_gain;
+        param.avoid_gain = g.avoid_gain;
+        param.reference_gain = g.reference_gain;
+        param.manipulability_limit = g.manipulability_limit;
+        param.manip->setSRGain(param.sr_gain);
+        param.manip->setManipulabilityLimit(param.manipulability_limit);
+        param.M_p = g.M_p;
+        param.D_p = g.D_p;
+        param.K_p = g.K_p;
+        param.M_r = g.M_r;
+        param.D_r = g.D_r;
+        param.K_r = g.K_r;
+        param.force_gain = g.force_gain;
+        param.moment_gain = g.moment_gain;
+        param.manip->setOptionalWeightVector(g.ik_optional_weight_vector);
+    }
+    use_sh_base_pos_rpy = gains.use_sh_base_pos_rpy;
+}
+
 void ImpedanceController::copyImpedanceParam (ImpedanceControllerService::impedanceParam& i_param_, const ImpedanceParam& param)
 {
   i_param_.M_p = param.M_p;
@@ -832,11 +891,14 @@ bool ImpedanceController::getImpedanceControllerParam(const std::string& i_name_
         std::cerr << "[" << m_profile.instance_name << "] Could not found impedance controller param [" << i_name_ << "]" << std::endl;
         // if impedance param of i_name_ is not found, return default impedance parameter ;; default parameter is specified ImpedanceParam struct's default constructer
         copyImpedanceParam(i_param_, ImpedanceParam());
-        i_param_.use_sh_base_pos_rpy = use_sh_base_pos_rpy;
+        i_param_.use_sh_base_pos_rpy = m_gains.get().use_sh_base_pos_rpy;
         return false;
     }
     copyImpedanceParam(i_param_, m_impedance_param[i_name_]);
-    i_param_.use_sh_base_pos_rpy = use_sh_base_pos_rpy;
+    // gains which may not have been applied by onExecute yet
+    ImpedanceGainSet gains = m_gains.get();
+    copyImpedanceGains(i_param_, gains.gains[i_name_]);
+    i_param_.use_sh_base_pos_rpy = gains.use_sh_base_pos_rpy;
     return true;
 }
 
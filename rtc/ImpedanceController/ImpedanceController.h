@@ -22,6 +22,7 @@
 #include "RatsMatrix.h"
 #include "ImpedanceOutputGenerator.h"
 #include "ObjectTurnaroundDetector.h"
+#include "util/ParameterCell.h"
 // Service implementation headers
 // <rtc-template block="service_impl_h">
 #include "ImpedanceControllerService_impl.h"
@@ -175,13 +176,29 @@ class ImpedanceController
     hrp::Matrix33 localR;
   };
 
+  // gains set by setImpedanceControllerParam, which are applied at the beginning of onExecute
+  struct ImpedanceGains {
+    double M_p, D_p, K_p, M_r, D_r, K_r;
+    hrp::Matrix33 force_gain, moment_gain;
+    double sr_gain, avoid_gain, reference_gain, manipulability_limit;
+    std::vector<double> ik_optional_weight_vector;
+  };
+  struct ImpedanceGainSet {
+    std::map<std::string, ImpedanceGains> gains;
+    bool use_sh_base_pos_rpy;
+  };
+
   void copyImpedanceParam (OpenHRP::ImpedanceControllerService::impedanceParam& i_param_, const ImpedanceParam& param);
+  void copyImpedanceGains (ImpedanceGains& gains, const OpenHRP::ImpedanceControllerService::impedanceParam& i_param_, size_t num_joints);
+  void copyImpedanceGains (OpenHRP::ImpedanceControllerService::impedanceParam& i_param_, const ImpedanceGains& gains);
+  void applyImpedanceGains ();
   void updateRootLinkPosRot (TimedOrientation3D tmprpy);
   void calcFootMidCoords (hrp::Vector3& new_foot_mid_pos, hrp::Matrix33& new_foot_mid_rot);
   void calcForceMoment();
   void calcObjectTurnaroundDetectorState();
 
   std::map<std::string, ImpedanceParam> m_impedance_param;
+  ParameterCell<ImpedanceGainSet> m_gains;
   std::map<std::string, ee_trans> ee_map;
   std::map<std::string, hrp::VirtualForceSensorParam> m_vfs;
   std::map<std::string, hrp::Vector3> abs_forces, abs_moments, abs_ref_forces, abs_ref_moments;
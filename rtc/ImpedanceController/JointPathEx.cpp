@@ -20,6 +20,7 @@ std::ostream& operator<<(std::ostream& out, hrp::dmatrix &a) {
         }
         out << std::endl;
     }
+    return out;
 }
 
 std::ostream& operator<<(std::ostream& out, hrp::dvector &a) {
@@ -29,6 +30,7 @@ std::ostream& operator<<(std::ostream& out, hrp::dvector &a) {
         out << std::setw(7) << std::setiosflags(std::ios::fixed) << std::setprecision(4) << a(i) << " ";
     }
     out << std::endl;
+    return out;
 }
 
 //#define DEBUG true
@@ -59,6 +61,7 @@ int hrp::calcSRInverse(const dmatrix& _a, dmatrix &_a_sr, double _sr_ratio, dmat
 
     _a_sr  = _w * at * a1;
     //if (DEBUG) { dmatrix ii = _a * _a_sr; std::cerr << "    i :" << std::endl << ii; }
+    return 0;
 }
 
 // overwrite hrplib/hrpUtil/Eigen3d.cpp
@@ -99,6 +102,26 @@ JointPathEx::JointPathEx(BodyPtr& robot, Link* base, Link* end, double control_c
   for (int i = 0 ; i < numJoints(); i++ ) {
       optional_weight_vector[i] = 1.0;
   }
+  resizeIKWorkspace(6);
+}
+
+void JointPathEx::resizeIKWorkspace(size_t workspace_dim) {
+    const int n = numJoints();
+    if (ik_J.rows() == workspace_dim && ik_J.cols() == n) return;
+    ik_J = dmatrix::Zero(workspace_dim, n);
+    ik_ee_J = dmatrix::Zero(6, n);
+    ik_Jinv.resize(n, workspace_dim);
+    ik_Jnull.resize(n, n);
+    ik_JW.resize(workspace_dim, n);
+    ik_WJt.resize(n, workspace_dim);
+    ik_JJt.resize(workspace_dim, workspace_dim);
+    ik_a1.resize(workspace_dim, workspace_dim);
+    ik_v.resize(workspace_dim);
+    ik_dq.resize(n);
+    ik_u.resize(n);
+    ik_Jnullu.resize(n);
+    ik_w.resize(n);
+    ik_lu = Eigen::PartialPivLU<dmatrix>(workspace_dim);
 }
 
 void JointPathEx::setMaxIKError(double epos, double erot) {
@@ -147,6 +170,7 @@ bool JointPathEx::setInterlockingJointPairIndices (const std::vector<std::pair<L
 
 bool JointPathEx::setInterlockingJointPairIndices (const std::vector<std::pair<size_t, size_t> >& pairs) {
     interlocking_joint_pair_indices = pairs;
+    resizeIKWorkspace(6 + interlocking_joint_pair_indices.size());
     return true;
 };
 
@@ -154,10 +178,7 @@ void JointPathEx::getInterlockingJointPairIndices (std::vector<std::pair<size_t,
     pairs = interlocking_joint_pair_indices;
 };
 
-bool JointPathEx::calcJacobianInverseNullspace(dmatrix &J, dmatrix &Jinv, dmatrix &Jnull) {
-    const int n = numJoints();
-                
-    hrp::dmatrix w = hrp::dmatrix::Identity(n,n);
+double hrp::calcJointLimitAvoidanceWeight(const Link* joint, double& prev_cost, const double optional_weight, const bool use_inside_joint_weight_retrieval) {
     //
     // wmat/weight: weighting joint angle weight
     //
@@ -170,38 +191,52 @@ bool JointPathEx::calcJacobianInverseNullspace(dmatrix &J, dmatrix &Jinv, dmatri
     // scheme for avoiding joint limits for redundant manipulators", in IEEE
     // Trans. On Robotics and Automation, 11((2):286-292, April 1995.
     //
-    for ( int j = 0; j < n ; j++ ) {
-        double jang = joints[j]->q;
-        double jmax = joints[j]->ulimit;
-        double jmin = joints[j]->llimit;
-        double e = deg2rad(1);
-        if ( eps_eq(jang, jmax,e) && eps_eq(jang, jmin,e) ) {
-        } else if ( eps_eq(jang, jmax,e) ) {
-            jang = jmax - e;
-        } else if ( eps_eq(jang, jmin,e) ) {
-            jang = jmin + e;
-        }
+    double jang = joint->q;
+    double jmax = joint->ulimit;
+    double jmin = joint->llimit;
+    double e = deg2rad(1);
+    if ( eps_eq(jang, jmax,e) && eps_eq(jang, jmin,e) ) {
+    } else if ( eps_eq(jang, jmax,e) ) {
+        jang = jmax - e;
+    } else if ( eps_eq(jang, jmin,e) ) {
+        jang = jmin + e;
+    }
 
-        double r;
-        if ( eps_eq(jang, jmax,e) && eps_eq(jang, jmin,e) ) {
-            r = DBL_MAX;
-        } else {
-            r = fabs( (pow((jmax - jmin),2) * (( 2 * jang) - jmax - jmin)) /
-                      (4 * pow((jmax - jang),2) * pow((jang - jmin),2)) );
-            if (isnan(r)) r = 0;
-        }
+    double r;
+    if ( eps_eq(jang, jmax,e) && eps_eq(jang, jmin,e) ) {
+        r = DBL_MAX;
+    } else {
+        r = fabs( (pow((jmax - jmin),2) * (( 2 * jang) - jmax - jmin)) /
+                  (4 * pow((jmax - jang),2) * pow((jang - jmin),2)) );
+        if (isnan(r)) r = 0;
+    }
+
+    // If use_inside_joint_weight_retrieval = true (true by default), use T. F. Chang and R.-V. Dubeby weight retrieval inward.
+    // Otherwise, joint weight is always calculated from limit value to resolve https://github.com/fkanehiro/hrpsys-base/issues/516.
+    double w;
+    if (( r - prev_cost ) >= 0 ) {
+        w = optional_weight * ( 1.0 / ( 1.0 + r) );
+    } else {
+        if (use_inside_joint_weight_retrieval)
+            w = optional_weight * 1.0;
+        else
+            w = optional_weight * ( 1.0 / ( 1.0 + r) );
+    }
+    prev_cost = r;
+    return w;
+}
 
-        // If use_inside_joint_weight_retrieval = true (true by default), use T. F. Chang and R.-V. Dubeby weight retrieval inward.
-        // Otherwise, joint weight is always calculated from limit value to resolve https://github.com/fkanehiro/hrpsys-base/issues/516.
-        if (( r - avoid_weight_gain[j] ) >= 0 ) {
-	  w(j, j) = optional_weight_vector[j] * ( 1.0 / ( 1.0 + r) );
-	} else {
-            if (use_inside_joint_weight_retrieval)
-                w(j, j) = optional_weight_vector[j] * 1.0;
-            else
-                w(j, j) = optional_weight_vector[j] * ( 1.0 / ( 1.0 + r) );
-	}
-        avoid_weight_gain[j] = r;
+bool JointPathEx::calcJacobianInverseNullspace(dmatrix &J, dmatrix &Jinv, dmatrix &Jnull) {
+    const int n = numJoints();
+    const int c = J.rows();
+    resizeIKWorkspace(c);
+    Jinv.resize(n, c);
+    Jnull.resize(n, n);
+
+    // diagonal of w
+    hrp::dvector& w = ik_w;
+    for ( int j = 0; j < n ; j++ ) {
+        w(j) = calcJointLimitAvoidanceWeight(joints[j], avoid_weight_gain[j], optional_weight_vector[j], use_inside_joint_weight_retrieval);
     }
     if ( DEBUG ) {
         std::cerr << " cost :";
@@ -211,11 +246,13 @@ bool JointPathEx::calcJacobianInverseNullspace(dmatrix &J, dmatrix &Jinv, dmatri
         for(int j = 0; j < n; j++ ) { std::cerr << std::setw(8) << std::setiosflags(std::ios::fixed) << std::setprecision(4) << optional_weight_vector[j]; }
         std::cerr << std::endl;
         std::cerr << "    w :";
-        for(int j = 0; j < n; j++ ) { std::cerr << std::setw(8) << std::setiosflags(std::ios::fixed) << std::setprecision(4) << w(j, j); }
+        for(int j = 0; j < n; j++ ) { std::cerr << std::setw(8) << std::setiosflags(std::ios::fixed) << std::setprecision(4) << w(j); }
         std::cerr << std::endl;
     }
 
-    double manipulability = sqrt((J*J.transpose()).determinant());
+    ik_JJt.noalias() = J*J.transpose();
+    ik_lu.compute(ik_JJt);
+    double manipulability = sqrt(ik_lu.determinant());
     double k = 0;
     if ( manipulability < manipulability_limit ) {
 	k = manipulability_gain * pow((1 - ( manipulability / manipulability_limit )), 2);
@@ -224,9 +261,18 @@ bool JointPathEx::calcJacobianInverseNullspace(dmatrix &J, dmatrix &Jinv, dmatri
 	std::cerr << " manipulability = " <<  manipulability << " < " << manipulability_limit << ", k = " << k << " -> " << sr_gain * k << std::endl;
     }
 
-    calcSRInverse(J, Jinv, sr_gain * k, w);
+    // Same as calcSRInverse(J, Jinv, sr_gain * k, w) without allocation, J# = W Jt(J W Jt + kI)-1
+    ik_JW.noalias() = J * w.asDiagonal();
+    ik_JJt.noalias() = ik_JW * J.transpose();
+    ik_JJt.diagonal().array() += sr_gain * k;
+    ik_lu.compute(ik_JJt);
+    // inverse() copies the decomposition, solve() does not
+    ik_a1 = ik_lu.solve(dmatrix::Identity(ik_JJt.rows(), ik_JJt.cols()));
+    ik_WJt.noalias() = w.asDiagonal() * J.transpose();
+    Jinv.noalias() = ik_WJt * ik_a1;
 
-    Jnull = ( hrp::dmatrix::Identity(n, n) - Jinv * J);
+    Jnull.noalias() = - Jinv * J;
+    Jnull.diagonal().array() += 1.0;
 
     return true;
 }
@@ -248,29 +294,30 @@ bool JointPathEx::calcInverseKinematics2Loop(const Vector3& dp, const Vector3& o
     size_t workspace_dim = ee_workspace_dim + ij_workspace_dim;
 
     // Total jacobian, workspace velocty, and so on
-    hrp::dmatrix J(workspace_dim, n);
-    dvector v(workspace_dim);
-    hrp::dmatrix Jinv(n, workspace_dim);
-    hrp::dmatrix Jnull(n, n);
-    hrp::dvector dq(n);
-
+    resizeIKWorkspace(workspace_dim);
+    hrp::dmatrix& J = ik_J;
+    dvector& v = ik_v;
+    hrp::dmatrix& Jinv = ik_Jinv;
+    hrp::dmatrix& Jnull = ik_Jnull;
+    hrp::dvector& dq = ik_dq;
+
+    v.head<3>() = dp;
+    v.segment<3>(3) = omega;
     if (ij_workspace_dim > 0) {
-        v << dp, omega, dvector::Zero(ij_workspace_dim);
-        hrp::dmatrix ee_J = dmatrix::Zero(ee_workspace_dim, n);
-        calcJacobian(ee_J);
-        hrp::dmatrix ij_J = dmatrix::Zero(ij_workspace_dim, n);
+        v.tail(ij_workspace_dim).setZero();
+        calcJacobian(ik_ee_J);
+        J.topRows(ee_workspace_dim) = ik_ee_J;
+        J.bottomRows(ij_workspace_dim).setZero();
         for (size_t i = 0; i < ij_workspace_dim; i++) {
             std::pair<size_t, size_t>& pair = interlocking_joint_pair_indices[i];
-            ij_J(i, pair.first) = 1;
-            ij_J(i, pair.second) = -1;
+            J(ee_workspace_dim + i, pair.first) = 1;
+            J(ee_workspace_dim + i, pair.second) = -1;
         }
-        J << ee_J, ij_J;
     } else {
-        v << dp, omega;
         calcJacobian(J);
     }
     calcJacobianInverseNullspace(J, Jinv, Jnull);
-    dq = Jinv * v; // dq = pseudoInverse(J) * v
+    dq.noalias() = Jinv * v; // dq = pseudoInverse(J) * v
 
     if ( DEBUG ) {
         std::cerr << "    v :";
@@ -287,7 +334,7 @@ bool JointPathEx::calcInverseKinematics2Loop(const Vector3& dp, const Vector3& o
       // avoid-nspace-joint-limit: avoiding joint angle limit
       //
       // dH/dq = (((t_max + t_min)/2 - t) / ((t_max - t_min)/2)) ^2
-      hrp::dvector u(n);
+      hrp::dvector& u = ik_u;
       for ( int j = 0; j < n ; j++ ) {
         double jang = joint(j)->q;
         double jmax = joint(j)->ulimit;
@@ -309,13 +356,14 @@ bool JointPathEx::calcInverseKinematics2Loop(const Vector3& dp, const Vector3& o
         }
         std::cerr << std::endl;
       }
-      dq = dq + Jnull * u;
+      ik_Jnullu.noalias() = Jnull * u;
+      dq += ik_Jnullu;
     }
     // If reference_gain and reference_q are set, add following to reference_q by null space vector
     if ( reference_gain > 0.0 && reference_q != NULL ) {
       //
       // qref - qcurr
-      hrp::dvector u(n);
+      hrp::dvector& u = ik_u;
       for ( int j = 0; j < numJoints(); j++ ) {
         u[j] = optional_weight_vector[j] * reference_gain * ( (*reference_q)[joint(j)->jointId] - joint(j)->q );
       }
@@ -332,7 +380,8 @@ bool JointPathEx::calcInverseKinematics2Loop(const Vector3& dp, const Vector3& o
         }
         std::cerr << std::endl;
       }
-      dq = dq + Jnull * u;
+      ik_Jnullu.noalias() = Jnull * u;
+      dq += ik_Jnullu;
     }
     if ( DEBUG ) {
       std::cerr << "   dq :";
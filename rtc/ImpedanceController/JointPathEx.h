@@ -4,6 +4,7 @@
 #include <hrpModel/Link.h>
 #include <hrpModel/JointPath.h>
 #include <cmath>
+#include <Eigen/LU>
 #include <coil/stringutil.h>
 
 // hrplib/hrpUtil/MatrixSolvers.h
@@ -24,10 +25,13 @@ namespace hrp {
                                     const hrp::Vector3& localPos = hrp::Vector3::Zero(), const hrp::Matrix33& localR = hrp::Matrix33::Identity());
     bool calcInverseKinematics2(const Vector3& end_p, const Matrix33& end_R, const double avoid_gain = 0.0, const double reference_gain = 0.0, const dvector* reference_q = NULL);
     double getSRGain() { return sr_gain; }
-    bool setSRGain(double g) { sr_gain = g; }
+    bool setSRGain(double g) { sr_gain = g; return true; }
     double getManipulabilityLimit() { return manipulability_limit; }
-    bool setManipulabilityLimit(double l) { manipulability_limit = l; }
-    bool setManipulabilityGain(double l) { manipulability_gain = l; }
+    bool setManipulabilityLimit(double l) { manipulability_limit = l; return true; }
+    bool setManipulabilityGain(double l) { manipulability_gain = l; return true; }
+    double getManipulabilityGain() { return manipulability_gain; }
+    bool getUseInsideJointWeightRetrieval() { return use_inside_joint_weight_retrieval; }
+    double getControlCycle() { return dt; }
     void setMaxIKError(double epos, double erot);
     void setMaxIKError(double e);
     void setMaxIKIteration(int iter);
@@ -62,10 +66,19 @@ namespace hrp {
         std::vector<size_t> joint_limit_debug_print_counts;
         size_t debug_print_freq_count;
         bool use_inside_joint_weight_retrieval;
+        // Workspaces of calcInverseKinematics2Loop and calcJacobianInverseNullspace.
+        //  Sized by resizeIKWorkspace() for (6 + number of interlocking joint pairs) rows not to allocate memory in every IK iteration.
+        void resizeIKWorkspace(size_t workspace_dim);
+        dmatrix ik_J, ik_ee_J, ik_Jinv, ik_Jnull, ik_JW, ik_WJt, ik_JJt, ik_a1;
+        dvector ik_v, ik_dq, ik_u, ik_Jnullu, ik_w;
+        Eigen::PartialPivLU<dmatrix> ik_lu;
     };
 
     typedef boost::shared_ptr<JointPathEx> JointPathExPtr;
 
+    // Weight of a joint for the weighted SR-inverse avoiding joint limits. prev_cost is updated.
+    double calcJointLimitAvoidanceWeight(const Link* joint, double& prev_cost, const double optional_weight, const bool use_inside_joint_weight_retrieval);
+
     struct VirtualForceSensorParam {
         int id;
         hrp::Link* link;
@@ -84,6 +97,8 @@ namespace hrp {
                                                     const std::string& instance_name);
 };
 
+hrp::Vector3 matrix_logEx(const hrp::Matrix33& m);
+
 #include <iomanip>
 
 #endif //__JOINT_PATH_EX_H__
@@ -0,0 +1,245 @@
+/* -*- coding:utf-8-unix; mode:c++; -*- */
+/* benchmark of JointPathEx::calcInverseKinematics2Loop for 6-DOF and 7-DOF
+   chains. The end-effector follows a moving target with several IK
+   iterations per tick. Joint angles are compared with the IK which
+   allocates matrices in every iteration(calcSRInverse), and the IK must not
+   allocate memory.
+     testJointPathEx [--test0|--test1|--test2]
+*/
+#include "JointPathEx.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+#include <hrpUtil/MatrixSolvers.h>
+#include "util/AllocationCounter.h"
+#include "util/TestUtil.h"
+
+/*
+  calcInverseKinematics2Loop before the IK workspaces of JointPathEx,
+  which allocates J, Jinv, Jnull, w and dq in every iteration.
+*/
+class JointPathExAllocating : public hrp::JointPathEx
+{
+public:
+    JointPathExAllocating(hrp::BodyPtr& robot, hrp::Link* base, hrp::Link* end, double control_cycle)
+        : JointPathEx(robot, base, end, control_cycle, true, "testJointPathEx") {};
+    bool calcInverseKinematics2LoopAllocating(const hrp::Vector3& end_effector_p, const hrp::Matrix33& end_effector_R,
+                                              const double LAMBDA, const double avoid_gain, const double reference_gain, const hrp::dvector* reference_q)
+    {
+        const int n = numJoints();
+        hrp::Vector3 dp(end_effector_p - endLink()->p);
+        hrp::Vector3 omega(endLink()->R * matrix_logEx(endLink()->R.transpose() * end_effector_R));
+        size_t ij_workspace_dim = interlocking_joint_pair_indices.size();
+        size_t workspace_dim = 6 + ij_workspace_dim;
+        hrp::dmatrix J(workspace_dim, n);
+        hrp::dvector v(workspace_dim);
+        hrp::dmatrix Jinv(n, workspace_dim);
+        hrp::dmatrix Jnull(n, n);
+        hrp::dvector dq(n);
+        if (ij_workspace_dim > 0) {
+            v << dp, omega, hrp::dvector::Zero(ij_workspace_dim);
+            hrp::dmatrix ee_J = hrp::dmatrix::Zero(6, n);
+            calcJacobian(ee_J);
+            hrp::dmatrix ij_J = hrp::dmatrix::Zero(ij_workspace_dim, n);
+            for (size_t i = 0; i < ij_workspace_dim; i++) {
+                ij_J(i, interlocking_joint_pair_indices[i].first) = 1;
+                ij_J(i, interlocking_joint_pair_indices[i].second) = -1;
+            }
+            J << ee_J, ij_J;
+        } else {
+            v << dp, omega;
+            calcJacobian(J);
+        }
+        hrp::dmatrix w = hrp::dmatrix::Identity(n,n);
+        for ( int j = 0; j < n ; j++ ) {
+            w(j, j) = hrp::calcJointLimitAvoidanceWeight(joints[j], avoid_weight_gain[j], optional_weight_vector[j], use_inside_joint_weight_retrieval);
+        }
+        double manipulability = sqrt((J*J.transpose()).determinant());
+        double k = 0;
+        if ( manipulability < manipulability_limit ) {
+            k = manipulability_gain * pow((1 - ( manipulability / manipulability_limit )), 2);
+        }
+        hrp::calcSRInverse(J, Jinv, sr_gain * k, w);
+        Jnull = ( hrp::dmatrix::Identity(n, n) - Jinv * J);
+        dq = Jinv * v;
+        if ( avoid_gain > 0.0 ) {
+            hrp::dvector u(n);
+            for ( int j = 0; j < n ; j++ ) {
+                double r = ((( (joint(j)->ulimit + joint(j)->llimit) / 2.0) - joint(j)->q) / ((joint(j)->ulimit - joint(j)->llimit) / 2.0));
+                if ( r > 0 ) { r = r*r; } else { r = - r*r; }
+                u[j] = optional_weight_vector[j] * avoid_gain * r;
+            }
+            dq = dq + Jnull * u;
+        }
+        if ( reference_gain > 0.0 && reference_q != NULL ) {
+            hrp::dvector u(n);
+            for ( int j = 0; j < n; j++ ) {
+                u[j] = optional_weight_vector[j] * reference_gain * ( (*reference_q)[joint(j)->jointId] - joint(j)->q );
+            }
+            dq = dq + Jnull * u;
+        }
+        double min_speed_ratio = 1.0;
+        for(int j=0; j < n; ++j){
+            double speed_ratio = 1.0;
+            if (dq(j) < joints[j]->lvlimit * dt) {
+                speed_ratio = fabs(joints[j]->lvlimit * dt / dq(j));
+            } else if (dq(j) > joints[j]->uvlimit * dt) {
+                speed_ratio = fabs(joints[j]->uvlimit * dt / dq(j));
+            }
+            min_speed_ratio = std::max(std::min(min_speed_ratio, speed_ratio), 0.0);
+        }
+        if ( min_speed_ratio < 1.0 ) {
+            for(int j=0; j < n; ++j) dq(j) = dq(j) * min_speed_ratio;
+        }
+        for(int j=0; j < n; ++j){
+            if ( isnan(dq(j)) || isinf(dq(j)) ) return false;
+        }
+        for(int j=0; j < n; ++j) joints[j]->q += LAMBDA * dq(j);
+        for (size_t i = 0; i < interlocking_joint_pair_indices.size(); i++) {
+            double midp = (joints[interlocking_joint_pair_indices[i].first]->q + joints[interlocking_joint_pair_indices[i].second]->q)/2.0;
+            joints[interlocking_joint_pair_indices[i].first]->q = midp;
+            joints[interlocking_joint_pair_indices[i].second]->q = midp;
+        }
+        for(int j=0; j < n; ++j){
+            joints[j]->q = std::min(std::max(joints[j]->q, joints[j]->llimit), joints[j]->ulimit);
+        }
+        calcForwardKinematics();
+        return true;
+    };
+};
+
+class testJointPathEx
+{
+    struct Chain {
+        hrp::BodyPtr body;
+        boost::shared_ptr<JointPathExAllocating> manip;
+        hrp::dvector qref;
+    };
+    double dt;
+
+    // 6-DOF leg or 7-DOF arm from a fixed root link
+    void makeChain (Chain& c, const int dof, const bool use_interlocking_joints)
+    {
+        c.body = makeTestBody("ROOT", hrp::Link::FIXED_JOINT, hrp::Vector3::Zero());
+        hrp::Link* root = c.body->rootLink();
+        hrp::Link* l;
+        if (dof == 6) {
+            l = addTestLeg(c.body, root, "", hrp::Vector3::Zero());
+        } else {
+            l = addTestArm(c.body, root, "", hrp::Vector3::Zero(), -1);
+        }
+        c.body->calcForwardKinematics();
+        c.manip = boost::shared_ptr<JointPathExAllocating>(new JointPathExAllocating(c.body, root, l, dt));
+        if (use_interlocking_joints) {
+            std::vector<std::pair<size_t, size_t> > pairs;
+            pairs.push_back(std::pair<size_t, size_t>(2, 4));
+            c.manip->setInterlockingJointPairIndices(pairs);
+        }
+        c.qref.resize(c.body->numJoints());
+        for (int i = 0; i < c.body->numJoints(); i++) c.qref(i) = c.body->joint(i)->q;
+    };
+    /*
+      Follow a circle of the end-effector with max_iteration IK iterations
+      per tick by both IK. Returns false if the IK allocates memory or joint
+      angles are not the same as the allocating IK.
+    */
+    bool follow (const int dof, const bool use_interlocking_joints)
+    {
+        bool ret = true;
+        const size_t iterations[] = {1, 3, 10};
+        for (size_t it = 0; it < sizeof(iterations)/sizeof(iterations[0]); it++) {
+            const size_t max_iteration = iterations[it];
+            Chain c_ws, c_alloc;
+            makeChain(c_ws, dof, use_interlocking_joints);
+            makeChain(c_alloc, dof, use_interlocking_joints);
+            hrp::Vector3 p0 = c_ws.manip->endLink()->p;
+            hrp::Matrix33 R0 = c_ws.manip->endLink()->R;
+            const size_t ticks = 2000;
+            double q_diff = 0, tm_ws = 0, tm_alloc = 0;
+            int num_allocation_ws = 0, num_allocation_alloc = 0;
+            for (size_t i = 0; i < ticks; i++) {
+                double t = i * dt;
+                hrp::Vector3 target_p = p0 + hrp::Vector3(0.05*sin(2*M_PI*t), 0.05*cos(2*M_PI*t) - 0.05, 0.05*sin(2*M_PI*t/2));
+                hrp::Matrix33 target_R = R0 * hrp::rotFromRpy(0.2*sin(2*M_PI*t), 0.2*sin(2*M_PI*t/3), 0);
+                num_allocation = 0;
+                count_allocation = true;
+                double t1 = now();
+                for (size_t j = 0; j < max_iteration; j++) {
+                    c_alloc.manip->calcInverseKinematics2LoopAllocating(target_p, target_R, 1.0, 0.001, 0.01, &c_alloc.qref);
+                }
+                tm_alloc += now() - t1;
+                count_allocation = false;
+                num_allocation_alloc += num_allocation;
+                num_allocation = 0;
+                count_allocation = true;
+                t1 = now();
+                for (size_t j = 0; j < max_iteration; j++) {
+                    c_ws.manip->calcInverseKinematics2Loop(target_p, target_R, 1.0, 0.001, 0.01, &c_ws.qref);
+                }
+                tm_ws += now() - t1;
+                count_allocation = false;
+                num_allocation_ws += num_allocation;
+                for (int j = 0; j < c_ws.body->numJoints(); j++) {
+                    q_diff = std::max(q_diff, std::fabs(c_ws.body->joint(j)->q - c_alloc.body->joint(j)->q));
+                }
+            }
+            char buf[256];
+            sprintf(buf, "%d-DOF, %d iterations per tick : %.3f[us/iteration](allocating %.3f[us/iteration]), allocations = %d(allocating %d), max joint angle difference = %g[rad]",
+                    dof, (int)max_iteration, tm_ws/(ticks*max_iteration)*1e6, tm_alloc/(ticks*max_iteration)*1e6, num_allocation_ws, num_allocation_alloc, q_diff);
+            // the allocating path shows that allocations are counted
+            ret &= checkResult(num_allocation_ws == 0 && num_allocation_alloc > 0 && q_diff < 1e-12, buf);
+        }
+        return ret;
+    };
+public:
+    testJointPathEx () : dt(0.002) {};
+    bool test0 ()
+    {
+        std::cerr << "test0 : IK of a 6-DOF chain" << std::endl;
+        return follow(6, false);
+    };
+    bool test1 ()
+    {
+        std::cerr << "test1 : IK of a 7-DOF chain" << std::endl;
+        return follow(7, false);
+    };
+    bool test2 ()
+    {
+        std::cerr << "test2 : IK of a 7-DOF chain with interlocking joints" << std::endl;
+        return follow(7, true);
+    };
+};
+
+void print_usage ()
+{
+    std::cerr << "Usage : testJointPathEx [option]" << std::endl;
+    std::cerr << " [option] should be:" << std::endl;
+    std::cerr << "  --test0 : IK of a 6-DOF chain" << std::endl;
+    std::cerr << "  --test1 : IK of a 7-DOF chain" << std::endl;
+    std::cerr << "  --test2 : IK of a 7-DOF chain with interlocking joints" << std::endl;
+};
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+    if (argc >= 2) {
+        testJointPathEx tjpe;
+        if (std::string(argv[1]) == "--test0") {
+            ret = tjpe.test0() ? 0 : 2;
+        } else if (std::string(argv[1]) == "--test1") {
+            ret = tjpe.test1() ? 0 : 2;
+        } else if (std::string(argv[1]) == "--test2") {
+            ret = tjpe.test2() ? 0 : 2;
+        } else {
+            print_usage();
+            ret = 1;
+        }
+    } else {
+        print_usage();
+        ret = 1;
+    }
+    return ret;
+}
@@ -224,6 +224,9 @@ RTC::ReturnCode_t RobotHardware::onExecute(RTC::UniqueId ec_id)
   tm.sec  = coiltm.sec();
   tm.nsec = coiltm.usec() * 1000;
 
+  // read all joint and sensor states from iob at once, the checks below
+  // use them too
+  m_robot->readState();
   if (!m_isDemoMode){
       robot::emg_reason reason;
       int id;
@@ -265,7 +268,6 @@ RTC::ReturnCode_t RobotHardware::onExecute(RTC::UniqueId ec_id)
       m_robot->writeTorqueCommands(m_tauRef.data.get_buffer());
   }
 
-  // read from iob
   m_robot->readJointAngles(m_q.data.get_buffer());  
   m_q.tm = tm;
   m_robot->readJointVelocities(m_dq.data.get_buffer());  
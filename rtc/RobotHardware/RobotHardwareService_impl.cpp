@@ -15,14 +15,16 @@ RobotHardwareService_impl::~RobotHardwareService_impl()
 
 #define GetStatus                                                       \
                                                                         \
+    robot::state state;                                                 \
+    m_robot->readState(state);                                          \
     rs->angle.length(m_robot->numJoints());                             \
-    m_robot->readJointAngles(rs->angle.get_buffer());                   \
+    m_robot->readJointAngles(state, rs->angle.get_buffer());            \
                                                                         \
     rs->command.length(m_robot->numJoints());                           \
     m_robot->readJointCommands(rs->command.get_buffer());               \
                                                                         \
     rs->torque.length(m_robot->numJoints());                            \
-    if (!m_robot->readJointTorques(rs->torque.get_buffer())){           \
+    if (!m_robot->readJointTorques(state, rs->torque.get_buffer())){    \
         for (unsigned int i=0; i<rs->torque.length(); i++){             \
             rs->torque[i] = 0.0;                                        \
         }                                                               \
@@ -34,15 +36,15 @@ RobotHardwareService_impl::~RobotHardwareService_impl()
         size_t len = m_robot->lengthOfExtraServoState(i)+1;             \
         rs->servoState[i].length(len);                                  \
 	status = 0;                                                     \
-        v = m_robot->readCalibState(i);                                 \
+        v = m_robot->readCalibState(state, i);                          \
         status |= v<< OpenHRP::RobotHardwareService::CALIB_STATE_SHIFT; \
-        v = m_robot->readPowerState(i);                                 \
+        v = m_robot->readPowerState(state, i);                          \
         status |= v<< OpenHRP::RobotHardwareService::POWER_STATE_SHIFT; \
-        v = m_robot->readServoState(i);                                 \
+        v = m_robot->readServoState(state, i);                          \
         status |= v<< OpenHRP::RobotHardwareService::SERVO_STATE_SHIFT; \
-        v = m_robot->readServoAlarm(i);                                 \
+        v = m_robot->readServoAlarm(state, i);                          \
         status |= v<< OpenHRP::RobotHardwareService::SERVO_ALARM_SHIFT; \
-        v = m_robot->readDriverTemperature(i);                          \
+        v = m_robot->readDriverTemperature(state, i);                   \
         status |= v<< OpenHRP::RobotHardwareService::DRIVER_TEMP_SHIFT; \
         rs->servoState[i][0] = status;                                  \
         m_robot->readExtraServoState(i, (int *)(rs->servoState[i].get_buffer()+1)); \
@@ -51,19 +53,19 @@ RobotHardwareService_impl::~RobotHardwareService_impl()
     rs->rateGyro.length(m_robot->numSensors(Sensor::RATE_GYRO));        \
     for (unsigned int i=0; i<rs->rateGyro.length(); i++){               \
         rs->rateGyro[i].length(3);                                      \
-        m_robot->readGyroSensor(i, rs->rateGyro[i].get_buffer());       \
+        m_robot->readGyroSensor(state, i, rs->rateGyro[i].get_buffer()); \
     }                                                                   \
                                                                         \
     rs->accel.length(m_robot->numSensors(Sensor::ACCELERATION));        \
     for (unsigned int i=0; i<rs->accel.length(); i++){                  \
         rs->accel[i].length(3);                                         \
-        m_robot->readAccelerometer(i, rs->accel[i].get_buffer());       \
+        m_robot->readAccelerometer(state, i, rs->accel[i].get_buffer()); \
     }                                                                   \
                                                                         \
     rs->force.length(m_robot->numSensors(Sensor::FORCE));               \
     for (unsigned int i=0; i<rs->force.length(); i++){                  \
         rs->force[i].length(6);                                         \
-        m_robot->readForceSensor(i, rs->force[i].get_buffer());         \
+        m_robot->readForceSensor(state, i, rs->force[i].get_buffer());  \
     }									\
 									\
     m_robot->readPowerStatus(rs->voltage, rs->current);
@@ -2,11 +2,13 @@
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <algorithm>
 #include <sys/time.h>
 #include <hrpModel/Sensor.h>
 #include <hrpModel/Link.h>
 #include "defs.h"
 #include "io/iob.h"
+#include "io/iob_snapshot.h"
 #include "robot.h"
 #include "util/Hrpsys.h"
 
@@ -68,6 +70,9 @@ bool robot::init()
     set_number_of_gyro_sensors(numSensors(Sensor::RATE_GYRO));
     set_number_of_accelerometers(numSensors(Sensor::ACCELERATION));
 
+    initState(m_state);
+    m_commandAngles.resize(numJoints());
+
     gyro_sum.resize(numSensors(Sensor::RATE_GYRO));
     accel_sum.resize(numSensors(Sensor::ACCELERATION));
     force_sum.resize(numSensors(Sensor::FORCE));
@@ -177,17 +182,13 @@ void robot::calibrateInertiaSensorOneStep()
 {
     if (inertia_calib_counter>0) {
         for (int j=0; j<numSensors(Sensor::RATE_GYRO); j++){
-            double rate[3];
-            read_gyro_sensor(j, rate);
             for (int i=0; i<3; i++)
-                gyro_sum[j][i] += rate[i];
+                gyro_sum[j][i] += m_state.rates[j*3+i];
         }
         
         for (int j=0; j<numSensors(Sensor::ACCELERATION); j++){
-            double acc[3];
-            read_accelerometer(j, acc);
             for (int i=0; i<3; i++)
-                accel_sum[j][i] += acc[i];
+                accel_sum[j][i] += m_state.accels[j*3+i];
         }
 
 #if 0
@@ -237,10 +238,8 @@ void robot::calibrateForceSensorOneStep()
 {
     if (force_calib_counter>0) {
         for (int j=0; j<numSensors(Sensor::FORCE); j++){
-            double force[6];
-            read_force_sensor(j, force);
             for (int i=0; i<6; i++)
-                force_sum[j][i] += force[i];
+                force_sum[j][i] += m_state.forces[j*6+i];
         }
         force_calib_counter--;
         if (force_calib_counter==0) {
@@ -411,39 +410,146 @@ bool robot::isBusy() const
     return false; 
 }
 
+template <class T>
+static T *buffer(std::vector<T>& v)
+{
+    return v.empty() ? NULL : &v[0];
+}
+
+template <class T>
+static T *buffer(std::vector<T>& v, int i_mask, int i_flag)
+{
+    return (i_mask & i_flag) ? buffer(v) : NULL;
+}
+
+void robot::initState(state& o_state)
+{
+    o_state.angles.resize(numJoints());
+    o_state.velocities.resize(numJoints());
+    o_state.torques.resize(numJoints());
+    o_state.commandTorques.resize(numJoints());
+    o_state.calibStates.resize(numJoints());
+    o_state.powerStates.resize(numJoints());
+    o_state.servoStates.resize(numJoints());
+    o_state.servoAlarms.resize(numJoints());
+    o_state.driverTemperatures.resize(numJoints());
+    o_state.forces.resize(numSensors(Sensor::FORCE)*6);
+    o_state.rates.resize(numSensors(Sensor::RATE_GYRO)*3);
+    o_state.accels.resize(numSensors(Sensor::ACCELERATION)*3);
+}
+
+static void readState(robot::state& o_state, int i_mask)
+{
+    struct iob_state state;
+    state.angles = buffer(o_state.angles, i_mask, IOB_STATE_ANGLES);
+    state.velocities = buffer(o_state.velocities, i_mask, IOB_STATE_VELOCITIES);
+    state.torques = buffer(o_state.torques, i_mask, IOB_STATE_TORQUES);
+    state.command_torques = buffer(o_state.commandTorques, i_mask, IOB_STATE_COMMAND_TORQUES);
+    state.calib_states = buffer(o_state.calibStates, i_mask, IOB_STATE_CALIB_STATES);
+    state.power_states = buffer(o_state.powerStates, i_mask, IOB_STATE_POWER_STATES);
+    state.servo_states = buffer(o_state.servoStates, i_mask, IOB_STATE_SERVO_STATES);
+    state.servo_alarms = buffer(o_state.servoAlarms, i_mask, IOB_STATE_SERVO_ALARMS);
+    state.driver_temperatures = buffer(o_state.driverTemperatures, i_mask, IOB_STATE_DRIVER_TEMPERATURES);
+    state.forces = buffer(o_state.forces, i_mask, IOB_STATE_FORCES);
+    state.rates = buffer(o_state.rates, i_mask, IOB_STATE_RATES);
+    state.accels = buffer(o_state.accels, i_mask, IOB_STATE_ACCELS);
+#if defined(ROBOT_IOB_VERSION) && ROBOT_IOB_VERSION >= 3
+    if (read_iob_snapshot(&state) == FALSE) state.updated = 0;
+#else
+    read_iob_snapshot_by_id(&state);
+#endif
+    // states which are not read keep their flags
+    o_state.updated = (o_state.updated & ~i_mask) | (state.updated & i_mask);
+}
+
+void robot::readState(int i_mask)
+{
+    ::readState(m_state, i_mask);
+}
+
+void robot::readState(state& o_state)
+{
+    if (o_state.angles.size() != (unsigned int)numJoints()) initState(o_state);
+    ::readState(o_state, -1);
+}
+
 void robot::readJointAngles(double *o_angles)
 {
-    read_actual_angles(o_angles);
+    readJointAngles(m_state, o_angles);
+}
+
+void robot::readJointAngles(const state& i_state, double *o_angles)
+{
+    if (!(i_state.updated & IOB_STATE_ANGLES)) return;
+    std::copy(i_state.angles.begin(), i_state.angles.end(), o_angles);
 }
 
 void robot::readJointVelocities(double *o_velocities)
 {
-    read_actual_velocities(o_velocities);
+    readJointVelocities(m_state, o_velocities);
+}
+
+void robot::readJointVelocities(const state& i_state, double *o_velocities)
+{
+    if (!(i_state.updated & IOB_STATE_VELOCITIES)) return;
+    std::copy(i_state.velocities.begin(), i_state.velocities.end(), o_velocities);
 }
 
 int robot::readJointTorques(double *o_torques)
 {
-    return read_actual_torques(o_torques);
+    return readJointTorques(m_state, o_torques);
+}
+
+int robot::readJointTorques(const state& i_state, double *o_torques)
+{
+    if (!(i_state.updated & IOB_STATE_TORQUES)) return FALSE;
+    std::copy(i_state.torques.begin(), i_state.torques.end(), o_torques);
+    return TRUE;
 }
 
 int robot::readJointCommandTorques(double *o_torques)
 {
-    return read_command_torques(o_torques);
+    return readJointCommandTorques(m_state, o_torques);
+}
+
+int robot::readJointCommandTorques(const state& i_state, double *o_torques)
+{
+    if (!(i_state.updated & IOB_STATE_COMMAND_TORQUES)) return FALSE;
+    std::copy(i_state.commandTorques.begin(), i_state.commandTorques.end(), o_torques);
+    return TRUE;
 }
 
 void robot::readGyroSensor(unsigned int i_rank, double *o_rates)
 {
-    read_gyro_sensor(i_rank, o_rates);
+    readGyroSensor(m_state, i_rank, o_rates);
+}
+
+void robot::readGyroSensor(const state& i_state, unsigned int i_rank, double *o_rates)
+{
+    if (!(i_state.updated & IOB_STATE_RATES)) return;
+    std::copy(i_state.rates.begin()+i_rank*3, i_state.rates.begin()+i_rank*3+3, o_rates);
 }
 
 void robot::readAccelerometer(unsigned int i_rank, double *o_accs)
 {
-    read_accelerometer(i_rank, o_accs);
+    readAccelerometer(m_state, i_rank, o_accs);
+}
+
+void robot::readAccelerometer(const state& i_state, unsigned int i_rank, double *o_accs)
+{
+    if (!(i_state.updated & IOB_STATE_ACCELS)) return;
+    std::copy(i_state.accels.begin()+i_rank*3, i_state.accels.begin()+i_rank*3+3, o_accs);
 }
 
 void robot::readForceSensor(unsigned int i_rank, double *o_forces)
 {
-    read_force_sensor(i_rank, o_forces);
+    readForceSensor(m_state, i_rank, o_forces);
+}
+
+void robot::readForceSensor(const state& i_state, unsigned int i_rank, double *o_forces)
+{
+    if (!(i_state.updated & IOB_STATE_FORCES)) return;
+    std::copy(i_state.forces.begin()+i_rank*6, i_state.forces.begin()+i_rank*6+6, o_forces);
 }
 
 void robot::writeJointCommands(const double *i_commands)
@@ -481,37 +587,52 @@ void robot::readPowerStatus(double &o_voltage, double &o_current)
 
 int robot::readCalibState(int i)
 {
-    int v=0;
-    read_calib_state(i, &v);
-    return v;
+    return readCalibState(m_state, i);
+}
+
+int robot::readCalibState(const state& i_state, int i)
+{
+    return (i_state.updated & IOB_STATE_CALIB_STATES) ? i_state.calibStates[i] : 0;
 }
 
 int robot::readPowerState(int i)
 {
-    int v=0;
-    read_power_state(i, &v);
-    return v;
+    return readPowerState(m_state, i);
+}
+
+int robot::readPowerState(const state& i_state, int i)
+{
+    return (i_state.updated & IOB_STATE_POWER_STATES) ? i_state.powerStates[i] : 0;
 }
 
 int robot::readServoState(int i)
 {
-    int v=0;
-    read_servo_state(i, &v);
-    return v;
+    return readServoState(m_state, i);
+}
+
+int robot::readServoState(const state& i_state, int i)
+{
+    return (i_state.updated & IOB_STATE_SERVO_STATES) ? i_state.servoStates[i] : 0;
 }
 
 int robot::readServoAlarm(int i)
 {
-    int v=0;
-    read_servo_alarm(i, &v);
-    return v;
+    return readServoAlarm(m_state, i);
+}
+
+int robot::readServoAlarm(const state& i_state, int i)
+{
+    return (i_state.updated & IOB_STATE_SERVO_ALARMS) ? i_state.servoAlarms[i] : 0;
 }
 
 int robot::readDriverTemperature(int i)
 {
-    unsigned char temp=0;
-    read_driver_temperature(i, &temp);
-    return temp;
+    return readDriverTemperature(m_state, i);
+}
+
+int robot::readDriverTemperature(const state& i_state, int i)
+{
+    return (i_state.updated & IOB_STATE_DRIVER_TEMPERATURES) ? i_state.driverTemperatures[i] : 0;
 }
 
 char *time_string()
@@ -529,10 +650,9 @@ bool robot::checkJointCommands(const double *i_commands)
     if (!m_dt) return false;
     if (!m_commandOld.size()) return false;
 
-    int state;
+    if (!(m_state.updated & IOB_STATE_SERVO_STATES)) return false;
     for (int i=0; i<numJoints(); i++){
-        read_servo_state(i, &state);
-        if (state == ON){
+        if (m_state.servoStates[i] == ON){
             double command_old=m_commandOld[i], command=i_commands[i];
             double v = (command - command_old)/m_dt;
             if (fabs(v) > joint(i)->uvlimit){
@@ -561,13 +681,12 @@ bool robot::checkJointCommands(const double *i_commands)
 
 bool robot::checkEmergency(emg_reason &o_reason, int &o_id)
 {
-    int state;
+    read_command_angles(buffer(m_commandAngles));
+    int updated = m_state.updated;
     for (int i=0; i<numJoints(); i++){
-        read_servo_state(i, &state);
-        if (state == ON && m_servoErrorLimit[i] != 0){
-            double angle, command;
-            read_actual_angle(i, &angle);
-            read_command_angle(i, &command);
+        if ((updated & IOB_STATE_ANGLES) && (updated & IOB_STATE_SERVO_STATES)
+            && m_state.servoStates[i] == ON && m_servoErrorLimit[i] != 0){
+            double angle = m_state.angles[i], command = m_commandAngles[i];
             if (fabs(angle-command) > m_servoErrorLimit[i]){
                 std::cerr << time_string()
                           << ": servo error limit over: joint = " 
@@ -581,9 +700,8 @@ bool robot::checkEmergency(emg_reason &o_reason, int &o_id)
         }
     }
 
-    if (m_rLegForceSensorId >= 0){
-        double force[6];
-        read_force_sensor(m_rLegForceSensorId, force);
+    if (m_rLegForceSensorId >= 0 && (updated & IOB_STATE_FORCES)){
+        const double *force = &m_state.forces[m_rLegForceSensorId*6];
         if (force[FZ] > totalMass()*G(2)*m_fzLimitRatio){
 	    std::cerr << time_string() << ": right Fz limit over: Fz = " << force[FZ] << std::endl;
             o_reason = EMG_FZ;
@@ -591,9 +709,8 @@ bool robot::checkEmergency(emg_reason &o_reason, int &o_id)
             return true;
         }
     } 
-    if (m_lLegForceSensorId >= 0){
-        double force[6];
-        read_force_sensor(m_lLegForceSensorId, force);
+    if (m_lLegForceSensorId >= 0 && (updated & IOB_STATE_FORCES)){
+        const double *force = &m_state.forces[m_lLegForceSensorId*6];
         if (force[FZ] > totalMass()*G(2)*m_fzLimitRatio){
 	    std::cerr << time_string() << ": left Fz limit over: Fz = " << force[FZ] << std::endl;
             o_reason = EMG_FZ;
@@ -601,10 +718,8 @@ bool robot::checkEmergency(emg_reason &o_reason, int &o_id)
             return true;
         }
     } 
-    int alarm;
     for (int i=0; i<numJoints(); i++){
-        if (!read_servo_alarm(i, &alarm)) continue;
-        if (alarm & SS_EMERGENCY) {
+        if ((updated & IOB_STATE_SERVO_ALARMS) && (m_state.servoAlarms[i] & SS_EMERGENCY)) {
             if (!m_reportedEmergency) {
                 m_reportedEmergency = true;
                 o_reason = EMG_SERVO_ALARM;
@@ -89,12 +89,42 @@ public:
      */
     void oneStep();
 
+    /**
+       \brief states of joints and sensors of a frame
+     */
+    struct state
+    {
+        std::vector<double> angles, velocities, torques, commandTorques;
+        std::vector<int> calibStates, powerStates, servoStates, servoAlarms;
+        std::vector<unsigned char> driverTemperatures;
+        std::vector<double> forces, rates, accels;
+        int updated; ///< bitwise OR of IOB_STATE_* of valid buffers
+        state() : updated(0) {}
+    };
+
+    /**
+       \brief read states of joints and sensors of the current frame at
+       once. Following read functions of joint and sensor states without
+       a state return values of this snapshot, which is owned by the
+       thread calling oneStep().
+       \param i_mask bitwise OR of IOB_STATE_* to be read, all by default
+     */
+    void readState(int i_mask=-1);
+
+    /**
+       \brief read states of joints and sensors of the current frame at
+       once into a snapshot owned by the caller, e.g. a service thread
+       \param o_state snapshot, buffers are allocated on the first call
+     */
+    void readState(state& o_state);
+
     /**
        \brief read calibration status of a joint servo
        \param i joint id
        \return ON if the joint is already calibrated successfully, OFF otherwise
      */
     int readCalibState(int i);
+    int readCalibState(const state& i_state, int i);
 
     /**
        \brief read power status of a joint servo
@@ -102,6 +132,7 @@ public:
        \return ON if power for the joint servo is on, OFF otherwise
      */
     int readPowerState(int i);
+    int readPowerState(const state& i_state, int i);
 
     /**
        \brief read servo status of a joint servo
@@ -109,6 +140,7 @@ public:
        \return ON if the joint servo is on, OFF otherwise
      */
     int readServoState(int i);
+    int readServoState(const state& i_state, int i);
 
     /**
        \brief read alarm information of a joint servo
@@ -116,6 +148,7 @@ public:
        \return 0 if there is no alarm, see iob.h for more details.
      */
     int readServoAlarm(int i);
+    int readServoAlarm(const state& i_state, int i);
 
     /**
        \brief read temperature of motor driver
@@ -123,6 +156,7 @@ public:
        \return 0 if temperature can't be measured
      */
     int readDriverTemperature(int i);
+    int readDriverTemperature(const state& i_state, int i);
 
     /**
        \brief read voltage and current of the robot power source
@@ -154,12 +188,14 @@ public:
        \param o_angles array of all joint angles
      */
     void readJointAngles(double *o_angles);
+    void readJointAngles(const state& i_state, double *o_angles);
 
     /**
        \brief read array of all joint velocities[rad/s]
        \param o_angles array of all joint velocities
      */
     void readJointVelocities(double *o_velocities);
+    void readJointVelocities(const state& i_state, double *o_velocities);
 
     /**
        \brief read array of all joint torques[Nm]
@@ -167,6 +203,7 @@ public:
        \param TRUE if read successfully, FALSE otherwise
      */
     int readJointTorques(double *o_torques);
+    int readJointTorques(const state& i_state, double *o_torques);
 
     /**
        \brief read array of all commanded joint torques[Nm]
@@ -174,6 +211,7 @@ public:
        \param TRUE if read successfully, FALSE otherwise
      */
     int readJointCommandTorques(double *o_torques);
+    int readJointCommandTorques(const state& i_state, double *o_torques);
 
     /**
        \brief read gyro sensor output
@@ -181,6 +219,7 @@ public:
        \param o_rates array of angular velocities(length = 3) [rad/s]
     */
     void readGyroSensor(unsigned int i_rank, double *o_rates);
+    void readGyroSensor(const state& i_state, unsigned int i_rank, double *o_rates);
 
     /**
        \brief read accelerometer output
@@ -188,6 +227,7 @@ public:
        \param o_accs array of accelerations(length = 3)[rad/s^2]
     */
     void readAccelerometer(unsigned int i_rank, double *o_accs);
+    void readAccelerometer(const state& i_state, unsigned int i_rank, double *o_accs);
 
     /**
        \brief read force sensor output
@@ -195,6 +235,7 @@ public:
        \param o_forces array of force/torque(length = 6)[N, Nm]
     */
     void readForceSensor(unsigned int i_rank, double *o_forces);
+    void readForceSensor(const state& i_state, unsigned int i_rank, double *o_forces);
 
     /**
        \brief write array of reference angles of joint servo
@@ -240,7 +281,8 @@ public:
     typedef enum {EMG_SERVO_ERROR, EMG_FZ, EMG_SERVO_ALARM} emg_reason;
 
     /**
-       \brief check occurrence of emergency state
+       \brief check occurrence of emergency state with the snapshot read by
+       readState()
        \param o_reason kind of emergency source
        \param o_id id of sensor/joint of emergency source
        \return true if the robot is in emergency state, false otherwise
@@ -249,7 +291,8 @@ public:
 
 
     /**
-       \brief check joint commands are valid or not
+       \brief check joint commands are valid or not with the snapshot read
+       by readState()
        \return true if the joint command is invalid, false otherwise
      */
     bool checkJointCommands(const double *i_commands);
@@ -339,6 +382,9 @@ private:
     double m_dt;
     std::vector<double> m_commandOld, m_velocityOld;
     hrp::Vector3 G;
+    void initState(state& o_state);
+    state m_state; ///< snapshot read by readState(int)
+    std::vector<double> m_commandAngles;
 };
 
 #endif
@@ -0,0 +1,237 @@
+// -*- C++ -*-
+/*!
+ * @file  BinaryPattern.h
+ * @brief binary motion pattern format loaded by SequencePlayerService::loadPattern()
+ * @date  $Date$
+ *
+ * $Id$
+ */
+
+#ifndef BINARY_PATTERN_H
+#define BINARY_PATTERN_H
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+  A binary pattern file (basename.bpat) contains all pattern files of
+  loadPattern(basename.pos, basename.zmp, ...) and consists of a
+  BinaryPatternHeader, numChannels BinaryPatternChannels and doubles.
+  Each channel corresponds to a text pattern file whose extension is
+  stored in name, e.g. "pos" or "waist". Sample i of a channel is a
+  record of time and elements at
+
+    dataOffset + i*(numElements+1)*sizeof(double)
+
+  which is the same as a line of the text file. Records can be passed to
+  interpolator::load() directly from a memory mapped file.
+
+  All values are little-endian and 8 byte aligned.
+*/
+
+#define BINARY_PATTERN_MAGIC "HRPSYSPT"
+#define BINARY_PATTERN_VERSION 1
+
+struct BinaryPatternHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numChannels;
+};
+
+struct BinaryPatternChannel
+{
+    char name[16];
+    uint64_t numElements;
+    uint64_t numSamples;
+    uint64_t dataOffset;
+};
+
+/**
+   \brief extensions of text pattern files in the order of loadPattern()
+ */
+static const char * const binary_pattern_extensions[] = {
+    "pos", "zmp", "gsens", "hip", "waist", "torque", "wrenches", "optionaldata"
+};
+
+/**
+   \brief read a text pattern file
+   \param i_fname file name
+   \param o_numElements number of elements per line(without time)
+   \param o_records time and elements of all lines
+   \return true if all lines have the same number of columns
+ */
+inline bool readTextPattern(const char *i_fname, size_t& o_numElements,
+                            std::vector<double>& o_records)
+{
+    FILE *fp = fopen(i_fname, "r");
+    if (!fp) return false;
+    o_records.clear();
+    o_numElements = 0;
+    bool ret = true;
+    size_t nline = 0;
+    std::string line;
+    char buf[4096];
+    while (ret && fgets(buf, sizeof(buf), fp)){
+        line.append(buf);
+        if (line[line.size()-1] != '\n' && !feof(fp)) continue;
+        const char *p = line.c_str();
+        char *end;
+        size_t ncol = 0;
+        for (double v = strtod(p, &end); end != p; v = strtod(p, &end)){
+            o_records.push_back(v);
+            ncol++;
+            p = end;
+        }
+        line.clear();
+        if (ncol == 0) continue; // empty line
+        if (nline == 0) o_numElements = ncol - 1;
+        ret = ncol == o_numElements + 1;
+        nline++;
+    }
+    fclose(fp);
+    return ret && nline > 0;
+}
+
+/**
+   \brief write a binary pattern file
+ */
+class BinaryPatternWriter
+{
+public:
+    /**
+       \brief add a channel
+       \param i_name extension of the text pattern file, e.g. "pos"
+       \param i_numElements number of elements per sample(without time)
+       \param i_records time and elements of all samples
+     */
+    void addChannel(const char *i_name, size_t i_numElements,
+                    const std::vector<double>& i_records){
+        BinaryPatternChannel c;
+        memset(&c, 0, sizeof(c));
+        strncpy(c.name, i_name, sizeof(c.name)-1);
+        c.numElements = i_numElements;
+        c.numSamples = i_records.size()/(i_numElements+1);
+        m_channels.push_back(c);
+        m_records.push_back(&i_records);
+    }
+    size_t numChannels() const { return m_channels.size(); }
+    /**
+       \brief write added channels
+       \param i_fname file name
+       \return true if written successfully
+     */
+    bool write(const char *i_fname){
+        BinaryPatternHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, BINARY_PATTERN_MAGIC, sizeof(h.magic));
+        h.version = BINARY_PATTERN_VERSION;
+        h.numChannels = m_channels.size();
+        uint64_t offset = sizeof(h) + m_channels.size()*sizeof(BinaryPatternChannel);
+        for (size_t i=0; i<m_channels.size(); i++){
+            m_channels[i].dataOffset = offset;
+            offset += m_channels[i].numSamples*(m_channels[i].numElements+1)*sizeof(double);
+        }
+        FILE *fp = fopen(i_fname, "wb");
+        if (!fp) return false;
+        bool ret = fwrite(&h, sizeof(h), 1, fp) == 1;
+        if (ret && !m_channels.empty()){
+            ret = fwrite(&m_channels[0], sizeof(BinaryPatternChannel), m_channels.size(), fp) == m_channels.size();
+        }
+        for (size_t i=0; ret && i<m_channels.size(); i++){
+            size_t n = m_channels[i].numSamples*(m_channels[i].numElements+1);
+            if (n) ret = fwrite(&(*m_records[i])[0], sizeof(double), n, fp) == n;
+        }
+        return fclose(fp) == 0 && ret;
+    }
+private:
+    std::vector<BinaryPatternChannel> m_channels;
+    std::vector<const std::vector<double> *> m_records;
+};
+
+/**
+   \brief read-only memory mapped binary pattern
+ */
+class BinaryPatternReader
+{
+public:
+    BinaryPatternReader() : m_addr(NULL), m_size(0) {}
+    ~BinaryPatternReader() { close(); }
+    /**
+       \brief map a binary pattern file
+       \param i_fname file name
+       \return true if mapped and the header is valid, false otherwise
+     */
+    bool open(const char *i_fname){
+        close();
+        const uint16_t endian = 1;
+        if (*(const unsigned char *)&endian != 1) return false;
+        int fd = ::open(i_fname, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(BinaryPatternHeader)){
+            ::close(fd);
+            return false;
+        }
+        void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) return false;
+        m_addr = (const char *)addr;
+        m_size = st.st_size;
+        const BinaryPatternHeader& h = header();
+        bool valid = memcmp(h.magic, BINARY_PATTERN_MAGIC, sizeof(h.magic)) == 0
+            && h.version == BINARY_PATTERN_VERSION
+            && sizeof(h) + h.numChannels*sizeof(BinaryPatternChannel) <= m_size;
+        for (unsigned int i=0; valid && i<h.numChannels; i++){
+            const BinaryPatternChannel& c = channel(i);
+            valid = c.dataOffset % sizeof(double) == 0
+                && c.dataOffset + c.numSamples*(c.numElements+1)*sizeof(double) <= m_size;
+        }
+        if (!valid){
+            close();
+            return false;
+        }
+        return true;
+    }
+    void close(){
+        if (m_addr) munmap((void *)m_addr, m_size);
+        m_addr = NULL;
+        m_size = 0;
+    }
+    const BinaryPatternHeader& header() const {
+        return *(const BinaryPatternHeader *)m_addr;
+    }
+    const BinaryPatternChannel& channel(unsigned int i) const {
+        return ((const BinaryPatternChannel *)(m_addr + sizeof(BinaryPatternHeader)))[i];
+    }
+    /**
+       \brief find a channel
+       \param i_name extension of the text pattern file, e.g. "pos"
+       \return the channel, NULL if not found
+     */
+    const BinaryPatternChannel *find(const char *i_name) const {
+        for (unsigned int i=0; i<header().numChannels; i++){
+            if (strncmp(channel(i).name, i_name, sizeof(channel(i).name)) == 0) return &channel(i);
+        }
+        return NULL;
+    }
+    /**
+       \brief records of time and elements of a channel
+     */
+    const double *records(const BinaryPatternChannel& i_channel) const {
+        return (const double *)(m_addr + i_channel.dataOffset);
+    }
+private:
+    const char *m_addr;
+    size_t m_size;
+};
+
+#endif // BINARY_PATTERN_H
@@ -16,8 +16,6 @@
 #include <hrpUtil/MatrixSolvers.h>
 #include "../ImpedanceController/JointPathEx.h"
 
-typedef coil::Guard<coil::Mutex> Guard;
-
 // Module specification
 // <rtc-template block="module_spec">
 static const char* sequenceplayer_spec[] =
@@ -55,6 +53,7 @@ SequencePlayer::SequencePlayer(RTC::Manager* manager)
       m_optionalDataOut("optionalData", m_optionalData),
       m_SequencePlayerServicePort("SequencePlayerService"),
       // </rtc-template>
+      m_handoff(NULL),
       m_waitSem(0),
       m_robot(hrp::BodyPtr()),
       m_debugLevel(0),
@@ -64,12 +63,13 @@ SequencePlayer::SequencePlayer(RTC::Manager* manager)
       dummy(0)
 {
     m_service0.player(this);
-    m_clearFlag = false;
     m_waitFlag = false;
+    m_waitSeq = 0;
 }
 
 SequencePlayer::~SequencePlayer()
 {
+    delete m_handoff;
 }
 
 
@@ -160,7 +160,7 @@ RTC::ReturnCode_t SequencePlayer::onInitialize()
       optional_data_dim = 1;
     }
 
-    m_seq = new seqplay(dof, dt, nforce, optional_data_dim);
+    m_handoff = new seqplayHandoff(new seqplay(dof, dt, nforce, optional_data_dim), dof);
 
     m_qInit.data.length(dof);
     for (unsigned int i=0; i<dof; i++) m_qInit.data[i] = 0.0;
@@ -228,24 +228,25 @@ RTC::ReturnCode_t SequencePlayer::onExecute(RTC::UniqueId ec_id)
     if (m_baseRpyInitIn.isNew()) m_baseRpyInitIn.read();
     if (m_zmpRefInitIn.isNew()) m_zmpRefInitIn.read();
 
-    if (m_gname != "" && m_seq->isEmpty(m_gname.c_str())){
-        if (m_waitFlag){
+    // commands are queued by service threads and handed off without locking
+    seqplay *seq = m_handoff->update();
+    // wait until commands sent before waitInterpolation() are picked up
+    bool waiting = m_waitFlag && m_handoff->applied(m_waitSeq);
+    if (m_gname != "" && seq->isEmpty(m_gname.c_str())){
+        if (waiting){
             m_gname = "";
-            m_waitFlag = false;
+            m_waitFlag = waiting = false;
             m_waitSem.post();
         }
     }
-    if (m_seq->isEmpty()){
-        m_clearFlag = false;
-        if (m_waitFlag){
+    if (seq->isEmpty()){
+        if (waiting){
             m_waitFlag = false;
             m_waitSem.post();
         }
     }else{
-	Guard guard(m_mutex);
-
         double zmp[3], acc[3], pos[3], rpy[3], wrenches[6*m_wrenches.size()];
-        m_seq->get(m_qRef.data.get_buffer(), zmp, acc, pos, rpy, m_tqRef.data.get_buffer(), wrenches, m_optionalData.data.get_buffer());
+        seq->get(m_qRef.data.get_buffer(), zmp, acc, pos, rpy, m_tqRef.data.get_buffer(), wrenches, m_optionalData.data.get_buffer());
         m_zmpRef.data.x = zmp[0];
         m_zmpRef.data.y = zmp[1];
         m_zmpRef.data.z = zmp[2];
@@ -278,10 +279,6 @@ RTC::ReturnCode_t SequencePlayer::onExecute(RTC::UniqueId ec_id)
         for (size_t i = 0; i < m_wrenchesOut.size(); i++) {
           m_wrenchesOut[i]->write();
         }
-
-        if (m_clearFlag){
-            m_seq->clear(0.001);
-        }
     }
     return RTC::RTC_OK;
 }
@@ -321,12 +318,29 @@ RTC::ReturnCode_t SequencePlayer::onExecute(RTC::UniqueId ec_id)
   }
 */
 
-void SequencePlayer::setClearFlag()
+bool SequencePlayer::isEmpty()
+{
+    seqplayHandoff::Writer seq(*m_handoff, false);
+    return seq->isEmpty();
+}
+
+void SequencePlayer::clear()
 {
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    m_clearFlag = true;
+    seqplayHandoff::Writer seq(*m_handoff);
+    seq->clear();
+}
+
+bool SequencePlayer::clearOfGroup(const char *gname, double i_limitation)
+{
+    if ( m_debugLevel > 0 ) {
+        std::cerr << __PRETTY_FUNCTION__ << std::endl;
+    }
+    seqplayHandoff::Writer seq(*m_handoff);
+    seq->clearOfGroup(gname, i_limitation);
+    return true;
 }
 
 void SequencePlayer::waitInterpolation()
@@ -334,6 +348,8 @@ void SequencePlayer::waitInterpolation()
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
+    m_waitSeq = m_handoff->published();
+    __sync_synchronize();
     m_waitFlag = true;
     m_waitSem.wait();
 }
@@ -344,6 +360,8 @@ bool SequencePlayer::waitInterpolationOfGroup(const char *gname)
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
     m_gname = gname;
+    m_waitSeq = m_handoff->published();
+    __sync_synchronize();
     m_waitFlag = true;
     m_waitSem.wait();
     return true;
@@ -355,10 +373,10 @@ bool SequencePlayer::setJointAngle(short id, double angle, double tm)
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return false;
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (!setInitialState(*seq)) return false;
     dvector q(m_robot->numJoints());
-    m_seq->getJointAngles(q.data());
+    seq->getJointAngles(q.data());
     q[id] = angle;
     for (int i=0; i<m_robot->numJoints(); i++){
         hrp::Link *j = m_robot->joint(i);
@@ -369,8 +387,8 @@ bool SequencePlayer::setJointAngle(short id, double angle, double tm)
     absZmp[2] = 0;
     hrp::Link *root = m_robot->rootLink();
     hrp::Vector3 relZmp = root->R.transpose()*(absZmp - root->p);
-    m_seq->setJointAngles(q.data(), tm);
-    m_seq->setZmp(relZmp.data(), tm);
+    seq->setJointAngles(q.data(), tm);
+    seq->setZmp(relZmp.data(), tm);
     return true;
 }
 
@@ -379,8 +397,8 @@ bool SequencePlayer::setJointAngles(const double *angles, double tm)
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return false;
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (!setInitialState(*seq)) return false;
     for (int i=0; i<m_robot->numJoints(); i++){
         hrp::Link *j = m_robot->joint(i);
         if (j) j->q = angles[i];
@@ -394,8 +412,8 @@ bool SequencePlayer::setJointAngles(const double *angles, double tm)
     std::vector<double> v_tms;
     v_poss.push_back(angles);
     v_tms.push_back(tm);
-    m_seq->setJointAnglesSequence(v_poss, v_tms);
-    m_seq->setZmp(relZmp.data(), tm);
+    seq->setJointAnglesSequence(v_poss, v_tms);
+    seq->setZmp(relZmp.data(), tm);
     return true;
 }
 
@@ -405,15 +423,15 @@ bool SequencePlayer::setJointAngles(const double *angles, const bool *mask,
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
+    seqplayHandoff::Writer seq(*m_handoff);
 
-    if (!setInitialState()) return false;
+    if (!setInitialState(*seq)) return false;
 
     double pose[m_robot->numJoints()];
     for (int i=0; i<m_robot->numJoints(); i++){
         pose[i] = mask[i] ? angles[i] : m_qInit.data[i];
     }
-    m_seq->setJointAngles(pose, tm);
+    seq->setJointAngles(pose, tm);
     return true;
 }
 
@@ -422,9 +440,9 @@ bool SequencePlayer::setJointAnglesSequence(const OpenHRP::dSequenceSequence ang
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
+    seqplayHandoff::Writer seq(*m_handoff);
 
-    if (!setInitialState()) return false;
+    if (!setInitialState(*seq)) return false;
 
     bool tmp_mask[robot()->numJoints()];
     if (mask.length() != robot()->numJoints()) {
@@ -437,7 +455,7 @@ bool SequencePlayer::setJointAnglesSequence(const OpenHRP::dSequenceSequence ang
     std::vector<double> v_tms;
     for ( int i = 0; i < angless.length(); i++ ) v_poss.push_back(angless[i].get_buffer());
     for ( int i = 0; i <  times.length();  i++ )  v_tms.push_back(times[i]);
-    return m_seq->setJointAnglesSequence(v_poss, v_tms);
+    return seq->setJointAnglesSequence(v_poss, v_tms);
 }
 
 bool SequencePlayer::clearJointAngles()
@@ -445,11 +463,64 @@ bool SequencePlayer::clearJointAngles()
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
+    seqplayHandoff::Writer seq(*m_handoff);
 
-    if (!setInitialState()) return false;
+    if (!setInitialState(*seq)) return false;
 
-    return m_seq->clearJointAngles();
+    return seq->clearJointAngles();
+}
+
+bool SequencePlayer::openJointAnglesStream(double maxBufferTime)
+{
+    if ( m_debugLevel > 0 ) {
+        std::cerr << __PRETTY_FUNCTION__ << std::endl;
+    }
+    seqplayHandoff::Writer seq(*m_handoff);
+
+    if (!setInitialState(*seq)) return false;
+
+    return seq->openJointAnglesStream(maxBufferTime);
+}
+
+bool SequencePlayer::appendJointAnglesStream(const OpenHRP::dSequenceSequence& angless, const OpenHRP::dSequence& times)
+{
+    if ( m_debugLevel > 0 ) {
+        std::cerr << __PRETTY_FUNCTION__ << std::endl;
+    }
+    seqplayHandoff::Writer seq(*m_handoff);
+
+    std::vector<const double*> v_poss;
+    std::vector<double> v_tms;
+    for ( int i = 0; i < angless.length(); i++ ) v_poss.push_back(angless[i].get_buffer());
+    for ( int i = 0; i <  times.length();  i++ )  v_tms.push_back(times[i]);
+    return seq->appendJointAnglesStream(v_poss, v_tms);
+}
+
+bool SequencePlayer::closeJointAnglesStream()
+{
+    if ( m_debugLevel > 0 ) {
+        std::cerr << __PRETTY_FUNCTION__ << std::endl;
+    }
+    seqplayHandoff::Writer seq(*m_handoff);
+
+    return seq->closeJointAnglesStream();
+}
+
+bool SequencePlayer::getJointAnglesStreamState(OpenHRP::SequencePlayerService::JointAnglesStreamState& o_state)
+{
+    seqplayHandoff::Writer seq(*m_handoff, false);
+
+    bool open, underrun;
+    double buffered_time, max_buffer_time, underrun_time;
+    unsigned int underruns;
+    seq->getJointAnglesStreamState(open, underrun, buffered_time, max_buffer_time, underruns, underrun_time);
+    o_state.isOpen = open;
+    o_state.isUnderrun = underrun;
+    o_state.bufferedTime = buffered_time;
+    o_state.maxBufferTime = max_buffer_time;
+    o_state.numUnderruns = underruns;
+    o_state.underrunTime = underrun_time;
+    return true;
 }
 
 bool SequencePlayer::setJointAnglesSequenceOfGroup(const char *gname, const OpenHRP::dSequenceSequence angless, const OpenHRP::dSequence& times)
@@ -457,16 +528,16 @@ bool SequencePlayer::setJointAnglesSequenceOfGroup(const char *gname, const Open
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return false;
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (!setInitialState(*seq)) return false;
 
-    if (!m_seq->resetJointGroup(gname, m_qInit.data.get_buffer())) return false;
+    if (!seq->resetJointGroup(gname, m_qInit.data.get_buffer())) return false;
 
     std::vector<const double*> v_poss;
     std::vector<double> v_tms;
     for ( int i = 0; i < angless.length(); i++ ) v_poss.push_back(angless[i].get_buffer());
     for ( int i = 0; i <  times.length();  i++ )  v_tms.push_back(times[i]);
-    return m_seq->setJointAnglesSequenceOfGroup(gname, v_poss, v_tms, angless.length()>0?angless[0].length():0);
+    return seq->setJointAnglesSequenceOfGroup(gname, v_poss, v_tms, angless.length()>0?angless[0].length():0);
 }
 
 bool SequencePlayer::clearJointAnglesOfGroup(const char *gname)
@@ -474,12 +545,12 @@ bool SequencePlayer::clearJointAnglesOfGroup(const char *gname)
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return false;
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (!setInitialState(*seq)) return false;
 
-    if (!m_seq->resetJointGroup(gname, m_qInit.data.get_buffer())) return false;
+    if (!seq->resetJointGroup(gname, m_qInit.data.get_buffer())) return false;
 
-    return m_seq->clearJointAnglesOfGroup(gname);
+    return seq->clearJointAnglesOfGroup(gname);
 }
 
 bool SequencePlayer::setJointAnglesSequenceFull(const OpenHRP::dSequenceSequence i_jvss, const OpenHRP::dSequenceSequence i_vels, const OpenHRP::dSequenceSequence i_torques, const OpenHRP::dSequenceSequence i_poss, const OpenHRP::dSequenceSequence i_rpys, const OpenHRP::dSequenceSequence i_accs, const OpenHRP::dSequenceSequence i_zmps, const OpenHRP::dSequenceSequence i_wrenches, const OpenHRP::dSequenceSequence i_optionals, const dSequence i_tms)
@@ -487,9 +558,9 @@ bool SequencePlayer::setJointAnglesSequenceFull(const OpenHRP::dSequenceSequence
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
+    seqplayHandoff::Writer seq(*m_handoff);
 
-    if (!setInitialState()) return false;
+    if (!setInitialState(*seq)) return false;
 
     int len = i_jvss.length();
     std::vector<const double*> v_jvss, v_vels, v_torques, v_poss, v_rpys, v_accs, v_zmps, v_wrenches, v_optionals;
@@ -504,7 +575,7 @@ bool SequencePlayer::setJointAnglesSequenceFull(const OpenHRP::dSequenceSequence
     for ( int i = 0; i < i_wrenches.length(); i++ ) v_wrenches.push_back(i_wrenches[i].get_buffer());
     for ( int i = 0; i < i_optionals.length(); i++ ) v_optionals.push_back(i_optionals[i].get_buffer());
     for ( int i = 0; i < i_tms.length();  i++ )  v_tms.push_back(i_tms[i]);
-    return m_seq->setJointAnglesSequenceFull(v_jvss, v_vels, v_torques, v_poss, v_rpys, v_accs, v_zmps, v_wrenches, v_optionals, v_tms);
+    return seq->setJointAnglesSequenceFull(v_jvss, v_vels, v_torques, v_poss, v_rpys, v_accs, v_zmps, v_wrenches, v_optionals, v_tms);
 }
 
 bool SequencePlayer::setBasePos(const double *pos, double tm)
@@ -512,8 +583,8 @@ bool SequencePlayer::setBasePos(const double *pos, double tm)
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    m_seq->setBasePos(pos, tm);
+    seqplayHandoff::Writer seq(*m_handoff);
+    seq->setBasePos(pos, tm);
     return true;
 }
 
@@ -522,8 +593,8 @@ bool SequencePlayer::setBaseRpy(const double *rpy, double tm)
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    m_seq->setBaseRpy(rpy, tm);
+    seqplayHandoff::Writer seq(*m_handoff);
+    seq->setBaseRpy(rpy, tm);
     return true;
 }
 
@@ -532,15 +603,15 @@ bool SequencePlayer::setZmp(const double *zmp, double tm)
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    m_seq->setZmp(zmp, tm);
+    seqplayHandoff::Writer seq(*m_handoff);
+    seq->setZmp(zmp, tm);
     return true;
 }
 
 bool SequencePlayer::setWrenches(const double *wrenches, double tm)
 {
-    Guard guard(m_mutex);
-    m_seq->setWrenches(wrenches, tm);
+    seqplayHandoff::Writer seq(*m_handoff);
+    seq->setWrenches(wrenches, tm);
     return true;
 }
 
@@ -549,13 +620,19 @@ bool SequencePlayer::setTargetPose(const char* gname, const double *xyz, const d
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return false;
+    // onExecute is not blocked while IK is solved
+    seqplayHandoff::Writer seq(*m_handoff);
+    // joint angles being played, which are overwritten by m_qInit if empty
+    for (int i=0; i<m_robot->numJoints(); i++){
+        hrp::Link *j = m_robot->joint(i);
+        if (j) j->q = seq.playedJointAngles()[i];
+    }
+    if (!setInitialState(*seq)) return false;
     // setup
     std::vector<int> indices;
     hrp::dvector start_av, end_av;
     std::vector<hrp::dvector> avs;
-    if (! m_seq->getJointGroup(gname, indices) ) {
+    if (! seq->getJointGroup(gname, indices) ) {
         std::cerr << "[setTargetPose] Could not find joint group " << gname << std::endl;
         return false;
     }
@@ -573,10 +650,6 @@ bool SequencePlayer::setTargetPose(const char* gname, const double *xyz, const d
     hrp::JointPathExPtr manip = hrp::JointPathExPtr(new hrp::JointPathEx(m_robot, m_robot->link(base_parent_name), m_robot->link(target_name), dt, true, std::string(m_profile.instance_name)));
 
     // calc fk
-    for (int i=0; i<m_robot->numJoints(); i++){
-        hrp::Link *j = m_robot->joint(i);
-        if (j) j->q = m_qRef.data.get_buffer()[i];
-    }
     m_robot->calcForwardKinematics();
     for ( int i = 0; i < manip->numJoints(); i++ ){
         start_av[i] = manip->joint(i)->q;
@@ -653,7 +726,7 @@ bool SequencePlayer::setTargetPose(const char* gname, const double *xyz, const d
         }
     }
 
-    bool ret = m_seq->playPatternOfGroup(gname, v_pos, v_tm, m_qInit.data.get_buffer(), v_pos.size()>0?indices.size():0);
+    bool ret = seq->playPatternOfGroup(gname, v_pos, v_tm, m_qInit.data.get_buffer(), v_pos.size()>0?indices.size():0);
 
     // clean up memory, need to improve
     for (int i = 0; i < len; i++ ) {
@@ -668,28 +741,33 @@ void SequencePlayer::loadPattern(const char *basename, double tm)
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (setInitialState()){
-        m_seq->loadPattern(basename, tm);
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (setInitialState(*seq)){
+        seq->loadPattern(basename, tm);
     }
 }
 
 bool SequencePlayer::setInitialState(double tm)
+{
+    seqplayHandoff::Writer seq(*m_handoff);
+    return setInitialState(*seq, tm);
+}
+
+bool SequencePlayer::setInitialState(seqplay& seq, double tm)
 {
     if ( m_debugLevel > 0 ) {
-        std::cerr << __PRETTY_FUNCTION__ << "m_seq-isEmpty() " << m_seq->isEmpty() << ", m_Init.data.length() " << m_qInit.data.length() << std::endl;
+        std::cerr << __PRETTY_FUNCTION__ << "m_seq-isEmpty() " << seq.isEmpty() << ", m_Init.data.length() " << m_qInit.data.length() << std::endl;
     }
-    if (!m_seq->isEmpty()) return true;
+    if (!seq.isEmpty()) return true;
 
     if (m_qInit.data.length() == 0){
         std::cerr << "can't determine initial posture" << std::endl;
         return false;
     }else{
-        m_seq->setJointAngles(m_qInit.data.get_buffer(), tm);
+        seq.setJointAngles(m_qInit.data.get_buffer(), tm);
         for (int i=0; i<m_robot->numJoints(); i++){
             Link *l = m_robot->joint(i);
             l->q = m_qInit.data[i];
-            m_qRef.data[i] = m_qInit.data[i]; // update m_qRef for setTargetPose()
         }
 
         Link *root = m_robot->rootLink();
@@ -697,18 +775,18 @@ bool SequencePlayer::setInitialState(double tm)
         root->p << m_basePosInit.data.x,
             m_basePosInit.data.y,
             m_basePosInit.data.z;
-        m_seq->setBasePos(root->p.data(), tm);
+        seq.setBasePos(root->p.data(), tm);
 
         double rpy[] = {m_baseRpyInit.data.r,
                         m_baseRpyInit.data.p,
                         m_baseRpyInit.data.y};
-        m_seq->setBaseRpy(rpy, tm);
+        seq.setBaseRpy(rpy, tm);
         calcRotFromRpy(root->R, rpy[0], rpy[1], rpy[2]);
 
         double zmp[] = {m_zmpRefInit.data.x, m_zmpRefInit.data.y, m_zmpRefInit.data.z};
-        m_seq->setZmp(zmp, tm);
+        seq.setZmp(zmp, tm);
         double zero[] = {0,0,0};
-        m_seq->setBaseAcc(zero, tm);
+        seq.setBaseAcc(zero, tm);
         return true;
     }
 }
@@ -718,8 +796,8 @@ void SequencePlayer::playPattern(const dSequenceSequence& pos, const dSequenceSe
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return;
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (!setInitialState(*seq)) return;
 
     std::vector<const double *> v_pos, v_rpy, v_zmp;
     std::vector<double> v_tm;
@@ -727,7 +805,7 @@ void SequencePlayer::playPattern(const dSequenceSequence& pos, const dSequenceSe
     for ( int i = 0; i < rpy.length(); i++ ) v_rpy.push_back(rpy[i].get_buffer());
     for ( int i = 0; i < zmp.length(); i++ ) v_zmp.push_back(zmp[i].get_buffer());
     for ( int i = 0; i < tm.length() ; i++ ) v_tm.push_back(tm[i]);
-    return m_seq->playPattern(v_pos, v_rpy, v_zmp, v_tm, m_qInit.data.get_buffer(), pos.length()>0?pos[0].length():0);
+    return seq->playPattern(v_pos, v_rpy, v_zmp, v_tm, m_qInit.data.get_buffer(), pos.length()>0?pos[0].length():0);
 }
 
 bool SequencePlayer::setInterpolationMode(OpenHRP::SequencePlayerService::interpolationMode i_mode_)
@@ -735,7 +813,7 @@ bool SequencePlayer::setInterpolationMode(OpenHRP::SequencePlayerService::interp
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
+    seqplayHandoff::Writer seq(*m_handoff);
     interpolator::interpolation_mode new_mode;
     if (i_mode_ == OpenHRP::SequencePlayerService::LINEAR){
         new_mode = interpolator::LINEAR;
@@ -744,7 +822,7 @@ bool SequencePlayer::setInterpolationMode(OpenHRP::SequencePlayerService::interp
     }else{
         return false;
     }
-    return m_seq->setInterpolationMode(new_mode);
+    return seq->setInterpolationMode(new_mode);
 }
 
 bool SequencePlayer::addJointGroup(const char *gname, const OpenHRP::SequencePlayerService::StrSequence& jnames)
@@ -755,7 +833,7 @@ bool SequencePlayer::addJointGroup(const char *gname, const OpenHRP::SequencePla
     }
     if (!waitInterpolationOfGroup(gname)) return false;
 
-    Guard guard(m_mutex);
+    seqplayHandoff::Writer seq(*m_handoff);
     std::vector<int> indices;
     for (size_t i=0; i<jnames.length(); i++){
         hrp::Link *l = m_robot->link(std::string(jnames[i]));
@@ -766,19 +844,15 @@ bool SequencePlayer::addJointGroup(const char *gname, const OpenHRP::SequencePla
             return false;
         }
     }
-    return m_seq->addJointGroup(gname, indices);
+    return seq->addJointGroup(gname, indices);
 }
 
 bool SequencePlayer::removeJointGroup(const char *gname)
 {
     std::cerr << "[removeJointGroup] group name = " << gname << std::endl;
     if (!waitInterpolationOfGroup(gname)) return false;
-    bool ret;
-    {
-        Guard guard(m_mutex);
-        ret = m_seq->removeJointGroup(gname);
-    }
-    return ret;
+    seqplayHandoff::Writer seq(*m_handoff);
+    return seq->removeJointGroup(gname);
 }
 
 bool SequencePlayer::setJointAnglesOfGroup(const char *gname, const dSequence& jvs, double tm)
@@ -786,11 +860,11 @@ bool SequencePlayer::setJointAnglesOfGroup(const char *gname, const dSequence& j
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return false;
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (!setInitialState(*seq)) return false;
 
-    if (!m_seq->resetJointGroup(gname, m_qInit.data.get_buffer())) return false;
-    return m_seq->setJointAnglesOfGroup(gname, jvs.get_buffer(), jvs.length(), tm);
+    if (!seq->resetJointGroup(gname, m_qInit.data.get_buffer())) return false;
+    return seq->setJointAnglesOfGroup(gname, jvs.get_buffer(), jvs.length(), tm);
 }
 
 bool SequencePlayer::playPatternOfGroup(const char *gname, const dSequenceSequence& pos, const dSequence& tm)
@@ -798,14 +872,14 @@ bool SequencePlayer::playPatternOfGroup(const char *gname, const dSequenceSequen
     if ( m_debugLevel > 0 ) {
         std::cerr << __PRETTY_FUNCTION__ << std::endl;
     }
-    Guard guard(m_mutex);
-    if (!setInitialState()) return false;
+    seqplayHandoff::Writer seq(*m_handoff);
+    if (!setInitialState(*seq)) return false;
 
     std::vector<const double *> v_pos;
     std::vector<double> v_tm;
     for ( int i = 0; i < pos.length(); i++ ) v_pos.push_back(pos[i].get_buffer());
     for ( int i = 0; i < tm.length() ; i++ ) v_tm.push_back(tm[i]);
-    return m_seq->playPatternOfGroup(gname, v_pos, v_tm, m_qInit.data.get_buffer(), pos.length()>0?pos[0].length():0);
+    return seq->playPatternOfGroup(gname, v_pos, v_tm, m_qInit.data.get_buffer(), pos.length()>0?pos[0].length():0);
 }
 
 void SequencePlayer::setMaxIKError(double pos, double rot){
@@ -20,7 +20,7 @@
 #include <rtm/idl/ExtendedDataTypesSkel.h>
 #include <hrpModel/Body.h>
 #include <hrpModel/Sensor.h>
-#include "seqplay.h"
+#include "seqplayHandoff.h"
 
 // Service implementation headers
 // <rtc-template block="service_impl_h">
@@ -91,9 +91,10 @@ class SequencePlayer
   // virtual RTC::ReturnCode_t onRateChanged(RTC::UniqueId ec_id);
 
   double dt;
-  seqplay *player() { return m_seq; }
   hrp::BodyPtr robot() { return m_robot;}  
-  void setClearFlag();
+  bool isEmpty();
+  void clear();
+  bool clearOfGroup(const char *gname, double i_limitation);
   void waitInterpolation();
   bool waitInterpolationOfGroup(const char *gname);
   bool setJointAngle(short id, double angle, double tm);
@@ -117,6 +118,10 @@ class SequencePlayer
   bool setJointAnglesSequenceOfGroup(const char *gname, const OpenHRP::dSequenceSequence angless, const OpenHRP::dSequence& times);
     bool clearJointAnglesOfGroup(const char *gname);
   bool playPatternOfGroup(const char *gname, const OpenHRP::dSequenceSequence& pos, const OpenHRP::dSequence& tm);
+  bool openJointAnglesStream(double maxBufferTime);
+  bool appendJointAnglesStream(const OpenHRP::dSequenceSequence& angless, const OpenHRP::dSequence& times);
+  bool closeJointAnglesStream();
+  bool getJointAnglesStreamState(OpenHRP::SequencePlayerService::JointAnglesStreamState& o_state);
 
   void setMaxIKError(double pos, double rot);
   void setMaxIKIteration(short iter);
@@ -179,15 +184,16 @@ class SequencePlayer
   // </rtc-template>
 
  private:
-  seqplay *m_seq;
-  bool m_clearFlag, m_waitFlag;
+  bool setInitialState(seqplay& seq, double tm=0.0);
+  seqplayHandoff *m_handoff;
+  bool m_waitFlag;
+  unsigned long m_waitSeq;
   boost::interprocess::interprocess_semaphore m_waitSem;
   hrp::BodyPtr m_robot;
   std::string m_gname;
   unsigned int m_debugLevel;
   int dummy;
   size_t optional_data_dim;
-  coil::Mutex m_mutex;
   double m_error_pos, m_error_rot;
   short m_iteration;
 };
@@ -233,31 +233,28 @@ CORBA::Boolean SequencePlayerService_impl::setTargetPose(const char* gname, cons
 
 CORBA::Boolean SequencePlayerService_impl::isEmpty()
 {
-  return m_player->player()->isEmpty();
+  return m_player->isEmpty();
 }
 
 void SequencePlayerService_impl::loadPattern(const char* basename, CORBA::Double tm)
 {
-  if (!m_player->player()){
-    std::cerr << "player is not set"<< std::endl;
-    return;
-  }
   m_player->loadPattern(basename, tm);
 }
 
 void SequencePlayerService_impl::clear()
 {
-  m_player->player()->clear();
+  m_player->clear();
 }
 
 CORBA::Boolean  SequencePlayerService_impl::clearOfGroup(const char *gname, CORBA::Double i_limitation)
 {
-    m_player->player()->clearOfGroup(gname, i_limitation);
+    return m_player->clearOfGroup(gname, i_limitation);
 }
 
 void SequencePlayerService_impl::clearNoWait()
 {
-  m_player->setClearFlag();
+  // clear() doesn't wait for onExecute either
+  m_player->clear();
 }
 
 CORBA::Boolean SequencePlayerService_impl::setInterpolationMode(OpenHRP::SequencePlayerService::interpolationMode i_mode_)
@@ -310,6 +307,36 @@ CORBA::Boolean SequencePlayerService_impl::clearJointAnglesOfGroup(const char *g
     return m_player->clearJointAnglesOfGroup(gname);
 }
 
+CORBA::Boolean SequencePlayerService_impl::openJointAnglesStream(CORBA::Double maxBufferTime)
+{
+    return m_player->openJointAnglesStream(maxBufferTime);
+}
+
+CORBA::Boolean SequencePlayerService_impl::appendJointAnglesStream(const dSequenceSequence& jvss, const dSequence& tms)
+{
+    if (jvss.length() != tms.length()) {
+        std::cerr << __PRETTY_FUNCTION__ << " length of joint angles sequence and time sequence differ, joint angle:" << jvss.length() << ", time:" << tms.length() << std::endl;
+        return false;
+    }
+    for (unsigned int i=0; i<jvss.length(); i++) {
+        if (jvss[i].length() != (unsigned int)(m_player->robot()->numJoints())) {
+            std::cerr << __PRETTY_FUNCTION__ << " num of joint is differ, input:" << jvss[i].length() << ", robot:" << (unsigned int)(m_player->robot()->numJoints()) << std::endl;
+            return false;
+        }
+    }
+    return m_player->appendJointAnglesStream(jvss, tms);
+}
+
+CORBA::Boolean SequencePlayerService_impl::closeJointAnglesStream()
+{
+    return m_player->closeJointAnglesStream();
+}
+
+CORBA::Boolean SequencePlayerService_impl::getJointAnglesStreamState(OpenHRP::SequencePlayerService::JointAnglesStreamState_out state)
+{
+    return m_player->getJointAnglesStreamState(state);
+}
+
 CORBA::Boolean SequencePlayerService_impl::playPatternOfGroup(const char *gname, const dSequenceSequence& pos, const dSequence& tm)
 {
     return m_player->playPatternOfGroup(gname, pos, tm);
@@ -42,6 +42,10 @@ public:
   CORBA::Boolean setJointAnglesOfGroup(const char *gname, const dSequence& jvs, CORBA::Double tm);
   CORBA::Boolean setJointAnglesSequenceOfGroup(const char *gname, const dSequenceSequence& jvs, const dSequence &tms);
   CORBA::Boolean clearJointAnglesOfGroup(const char *gname);
+  CORBA::Boolean openJointAnglesStream(CORBA::Double maxBufferTime);
+  CORBA::Boolean appendJointAnglesStream(const dSequenceSequence& jvss, const dSequence& tms);
+  CORBA::Boolean closeJointAnglesStream();
+  CORBA::Boolean getJointAnglesStreamState(OpenHRP::SequencePlayerService::JointAnglesStreamState_out state);
   CORBA::Boolean clearOfGroup(const char *gname, CORBA::Double  i_timelimit);
   CORBA::Boolean playPatternOfGroup(const char *gname, const dSequenceSequence& pos, const dSequence& tm);
   void setMaxIKError(CORBA::Double pos, CORBA::Double rot);
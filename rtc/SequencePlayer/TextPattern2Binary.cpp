@@ -0,0 +1,46 @@
+/*
+  convert text pattern files loaded by SequencePlayerService::loadPattern()
+  (basename.pos, basename.zmp, ...) into a binary pattern file
+  (basename.bpat). loadPattern(basename) uses basename.bpat if it exists.
+
+  usage: TextPattern2Binary basename [output]
+*/
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BinaryPattern.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2){
+        std::cerr << "usage: " << argv[0] << " basename [output]" << std::endl;
+        return 1;
+    }
+    std::string basename(argv[1]);
+    std::string output = argc >= 3 ? argv[2] : basename + ".bpat";
+
+    const size_t n = sizeof(binary_pattern_extensions)/sizeof(binary_pattern_extensions[0]);
+    std::vector<double> records[n];
+    BinaryPatternWriter writer;
+    for (size_t i=0; i<n; i++){
+        std::string fname = basename + "." + binary_pattern_extensions[i];
+        if (access(fname.c_str(), 0) != 0) continue;
+        size_t numElements;
+        if (!readTextPattern(fname.c_str(), numElements, records[i])){
+            std::cerr << "failed to read(" << fname << ")" << std::endl;
+            return 1;
+        }
+        writer.addChannel(binary_pattern_extensions[i], numElements, records[i]);
+        std::cerr << fname << " : " << numElements << " elements, "
+                  << records[i].size()/(numElements+1) << " samples" << std::endl;
+    }
+    if (!writer.numChannels()){
+        std::cerr << "pattern not found(" << basename << ")" << std::endl;
+        return 1;
+    }
+    if (!writer.write(output.c_str())){
+        std::cerr << "failed to write(" << output << ")" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -12,6 +12,8 @@ interpolator::interpolator(int dim_, double dt_, interpolation_mode imode_, doub
   dim = dim_;
   dt = dt_;
   length = 0;
+  queue_buf = NULL;
+  queue_head = queue_size = queue_capacity = 0;
   gx = new double[dim];
   gv = new double[dim];
   ga = new double[dim];
@@ -32,6 +34,39 @@ interpolator::interpolator(int dim_, double dt_, interpolation_mode imode_, doub
   default_avg_vel = default_avg_vel_;
 }
 
+static double *copy_array(const double *src, int n)
+{
+  double *dst = new double[n];
+  memcpy(dst, src, sizeof(double)*n);
+  return dst;
+}
+
+interpolator::interpolator(const interpolator& src)
+  : imode(src.imode), length(src.length), dim(src.dim), dt(src.dt),
+    target_t(src.target_t), remain_t(src.remain_t),
+    default_avg_vel(src.default_avg_vel), name(src.name)
+{
+  queue_head = 0;
+  queue_size = src.queue_size;
+  queue_capacity = queue_size + 1;
+  queue_buf = new double[3*dim*queue_capacity];
+  for (size_t i=0; i<queue_size; i++){
+    memcpy(queue_buf+3*dim*i, src.queue_at(i), sizeof(double)*3*dim);
+  }
+  gx = copy_array(src.gx, dim);
+  gv = copy_array(src.gv, dim);
+  ga = copy_array(src.ga, dim);
+  a0 = copy_array(src.a0, dim);
+  a1 = copy_array(src.a1, dim);
+  a2 = copy_array(src.a2, dim);
+  a3 = copy_array(src.a3, dim);
+  a4 = copy_array(src.a4, dim);
+  a5 = copy_array(src.a5, dim);
+  x = copy_array(src.x, dim);
+  v = copy_array(src.v, dim);
+  a = copy_array(src.a, dim);
+}
+
 interpolator::~interpolator()
 {
   clear();
@@ -47,6 +82,7 @@ interpolator::~interpolator()
   delete [] x;
   delete [] v;
   delete [] a;
+  delete [] queue_buf;
 }
 
 void interpolator::clear()
@@ -92,8 +128,8 @@ void interpolator::linear_interpolation(double &remain_t_,
 
 void interpolator::sync()
 {
-  //cout << "sync:" << length << "," << q.size() << endl;
-  length = q.size();
+  //cout << "sync:" << length << "," << queue_size << endl;
+  length = queue_size;
 }
 
 double interpolator::calc_interpolation_time(const double *newg)
@@ -205,7 +241,8 @@ void interpolator::go(const double *newg, const double *newv, double time, bool
 {
   if (time == 0) time = calc_interpolation_time(newg);
   setGoal(newg, newv, time, false);
-  
+  reserve((size_t)ceil(time/dt) + 1);
+
   do{
       interpolate(time);
   }while(time>0);
@@ -246,23 +283,57 @@ void interpolator::load(const char *fname, double time_to_start, double scale,
   if (immediate) sync();
 }
 
+void interpolator::load(const double *records, size_t num_records, size_t record_size,
+                        double time_to_start, double scale, bool immediate, size_t offset)
+{
+  if (record_size < 1 + offset + dim) {
+    cerr << "[interpolator " << name << "] record size(" << record_size << ") is too small for dimension " << dim << endl;
+    return;
+  }
+  if (num_records == 0) return;
+  // reserve for all records, each of which is interpolated at least once
+  reserve((size_t)ceil((time_to_start + scale*(records[(num_records-1)*record_size] - records[0]))/dt) + 2*num_records);
+  for (size_t i=0; i<num_records; i++){
+    const double *r = records + i*record_size;
+    if (i == 0){
+      go(r+1+offset, time_to_start, false);
+    }else{
+      go(r+1+offset, scale*(r[0]-r[-(ptrdiff_t)record_size]), false);
+    }
+  }
+  if (immediate) sync();
+}
+
 void interpolator::load(string fname, double time_to_start, double scale,
 			bool immediate, size_t offset1, size_t offset2)
 {
   load(fname.c_str(), time_to_start, scale, immediate, offset1, offset2);
 }
 
+void interpolator::reserve(size_t n)
+{
+  n += queue_size;
+  if (n <= queue_capacity) return;
+  // at least double capacity not to reallocate buffer at every push() and go()
+  if (n < 2*queue_capacity) n = 2*queue_capacity;
+  double *buf = new double[3*dim*n];
+  for (size_t i=0; i<queue_size; i++){
+    memcpy(buf+3*dim*i, queue_at(i), sizeof(double)*3*dim);
+  }
+  delete [] queue_buf;
+  queue_buf = buf;
+  queue_head = 0;
+  queue_capacity = n;
+}
+
 void interpolator::push(const double *x_, const double *v_, const double *a_, bool immediate)
 {
-  double *p = new double[dim];
-  double *dp = new double[dim];
-  double *ddp = new double[dim];
+  if (queue_size == queue_capacity) reserve(1);
+  double *p = queue_at(queue_size);
   memcpy(p, x_, sizeof(double)*dim);
-  memcpy(dp, v_, sizeof(double)*dim);
-  memcpy(ddp, a_, sizeof(double)*dim);
-  q.push_back(p);
-  dq.push_back(dp);
-  ddq.push_back(ddp);
+  memcpy(p+dim, v_, sizeof(double)*dim);
+  memcpy(p+2*dim, a_, sizeof(double)*dim);
+  queue_size++;
   if (immediate) sync();
 }
 
@@ -271,15 +342,8 @@ void interpolator::pop()
   coil::Guard<coil::Mutex> lock(pop_mutex_);
   if (length > 0){
     length--;
-    double *&vs = q.front();
-    delete [] vs;
-    q.pop_front();
-    double *&dvs = dq.front();
-    delete [] dvs;
-    dq.pop_front();
-    double *&ddvs = ddq.front();
-    delete [] ddvs;
-    ddq.pop_front();
+    if (++queue_head == queue_capacity) queue_head = 0;
+    queue_size--;
   }
 }
 
@@ -288,28 +352,15 @@ void interpolator::pop_back()
   coil::Guard<coil::Mutex> lock(pop_mutex_);
   if (length > 0){
     length--;
-    double *&vs = q.back();
-    delete [] vs;
-    q.pop_back();
+    queue_size--;
     if (length > 0){
-      memcpy(x, q.back(), sizeof(double)*dim);
+      double *p = queue_at(queue_size-1);
+      memcpy(x, p, sizeof(double)*dim);
+      memcpy(v, p+dim, sizeof(double)*dim);
+      memcpy(a, p+2*dim, sizeof(double)*dim);
     }else{
       memcpy(x, gx, sizeof(double)*dim);
-    }
-    double *&dvs = dq.back();
-    delete [] dvs;
-    dq.pop_back();
-    if (length > 0){
-      memcpy(v, dq.back(), sizeof(double)*dim);
-    }else{
       memcpy(v, gv, sizeof(double)*dim);
-    }
-    double *&ddvs = ddq.back();
-    delete [] ddvs;
-    ddq.pop_back();
-    if (length > 0){
-      memcpy(a, ddq.back(), sizeof(double)*dim);
-    }else{
       memcpy(a, ga, sizeof(double)*dim);
     }
   } else if (remain_t > 0) {
@@ -333,7 +384,7 @@ void interpolator::set(const double *x_, const double *v_)
 double *interpolator::front()
 {
   if (length!=0){
-    return q.front();
+    return queue_at(0);
   }else{
     return gx;
   }
@@ -354,24 +405,10 @@ void interpolator::get(double *x_, double *v_, double *a_, bool popp)
   interpolate(remain_t);
 
   if (length!=0){
-    double *&vs = q.front();
-    if (vs == NULL) {
-      cerr << "[interpolator " << name << "] interpolator::get vs = NULL, q.size() = " << q.size() 
-	   << ", length = " << length << endl;
-    }
-    double *&dvs = dq.front();
-    if (dvs == NULL) {
-      cerr << "[interpolator " << name << "] interpolator::get dvs = NULL, dq.size() = " << dq.size() 
-	   << ", length = " << length << endl;
-    }
-    double *&ddvs = ddq.front();
-    if (ddvs == NULL) {
-      cerr << "[interpolator " << name << "] interpolator::get ddvs = NULL, ddq.size() = " << ddq.size() 
-	   << ", length = " << length << endl;
-    }
+    double *vs = queue_at(0);
     memcpy(x_, vs, sizeof(double)*dim);
-    if ( v_ != NULL ) memcpy(v_, dvs, sizeof(double)*dim);
-    if ( a_ != NULL ) memcpy(a_, ddvs, sizeof(double)*dim);
+    if ( v_ != NULL ) memcpy(v_, vs+dim, sizeof(double)*dim);
+    if ( a_ != NULL ) memcpy(a_, vs+2*dim, sizeof(double)*dim);
     if (popp) pop();
   }else{
     memcpy(x_, gx, sizeof(double)*dim);
@@ -1,7 +1,6 @@
 #ifndef __INTERPOLATOR_H__
 #define __INTERPOLATOR_H__
 
-#include <deque>
 #include <string>
 #include <coil/Mutex.h>
 
@@ -22,6 +21,9 @@ class interpolator
 public:
   typedef enum {LINEAR, HOFFARBIB,QUINTICSPLINE,CUBICSPLINE} interpolation_mode;
   interpolator(int dim_, double dt_, interpolation_mode imode_=HOFFARBIB, double default_avg_vel_=0.5); // default_avg_vel = [rad/s]
+  // Copy current state and queued values.
+  //   Capacity of the copy is the number of queued values plus one, which is enough to interpolate online.
+  interpolator(const interpolator& src);
   ~interpolator();
   void push(const double *x_, const double *v_, const double *a_, bool immediate=true);
   double *front();
@@ -38,6 +40,11 @@ public:
   //   After calling of go(), value queue (q, dq, ddq) is full and remain_t = 0.
   void go(const double *gx, const double *gv, double time, bool immediate=true);
   void go(const double *gx, double time, bool immediate=true);
+  // Reserve capacity of value queue (q, dq, ddq) for n values in addition to current ones.
+  //   go() and load() reserve capacity for interpolated values before interpolation.
+  //   Reserved capacity is kept and reused even after the queue becomes empty.
+  void reserve(size_t n);
+  size_t capacity() const { return queue_capacity; }
   void pop();
   void pop_back();
   void clear();
@@ -46,6 +53,10 @@ public:
 	    bool immediate=true, size_t offset1 = 0, size_t offset2 = 0);
   void load(const char *fname, double time_to_start=1.0, double scale=1.0,
 	    bool immediate=true, size_t offset1 = 0, size_t offset2 = 0);
+  // Load records of [time, values...] in memory like lines of a file, for example a memory mapped binary pattern.
+  //   Values from offset-th element of each record are used and each record has record_size doubles.
+  void load(const double *records, size_t num_records, size_t record_size, double time_to_start=1.0, double scale=1.0,
+            bool immediate=true, size_t offset = 0);
   bool isEmpty();
   double remain_time();
   double calc_interpolation_time(const double *g);
@@ -65,7 +76,14 @@ private:
   // Current interpolation mode
   interpolation_mode imode;
   // Queue of positions, velocities, and accelerations ([q_t, q_t+1, ...., q_t+n]).
-  deque<double *> q, dq, ddq;
+  //   i-th value of queue is stored in ring buffer as [q_i(dim), dq_i(dim), ddq_i(dim)], which is obtained by queue_at(i).
+  //   queue_size is the number of pushed values and values after length are not synced yet.
+  double *queue_buf;
+  size_t queue_head, queue_size, queue_capacity;
+  double *queue_at(size_t i) const {
+    size_t j = queue_head + i; // i < queue_capacity
+    return queue_buf + 3*dim*(j < queue_capacity ? j : j - queue_capacity);
+  }
   // Length of queue.
   int length;
   // Dimension of interpolated vector (dim of x, v, a, ... etc)
@@ -95,6 +113,8 @@ private:
 			    double &xx, double &vv, double &aa);
   //Mutex to avoid poping twice the same element
   coil::Mutex pop_mutex_;
+
+  interpolator& operator=(const interpolator&);
 };
 
 #endif
@@ -1,12 +1,45 @@
 // -*- mode: c++; indent-tabs-mode: t; tab-width: 4; c-basic-offset: 4; -*-
 
 #include <iostream>
+#include <cmath>
+#include <cstring>
 #include <unistd.h>
 #include "seqplay.h"
+#include "BinaryPattern.h"
 
 #define deg2rad(x)	((x)*M_PI/180)
 
-seqplay::seqplay(unsigned int i_dof, double i_dt, unsigned int i_fnum, unsigned int optional_data_dim) : m_dof(i_dof)
+// number of values interpolated for goals which take tm[i] [s]
+static size_t count_interpolated_values(const std::vector<double>& tm, double dt)
+{
+    size_t n = 0;
+    for (unsigned int i=0; i<tm.size(); i++) n += (size_t)ceil(tm[i]/dt) + 1;
+    return n;
+}
+
+// velocity at a via point q which is reached from q_prev in t0 [s] and
+// left for q_next in t1 [s]
+static void via_point_velocity(unsigned int dof, const double *q_prev, const double *q,
+                               const double *q_next, double t0, double t1, double *v)
+{
+	for (unsigned int j = 0; j < dof; j++) {
+		double d0, d1, v0, v1;
+		d0 = (q[j] - q_prev[j]);
+		d1 = (q_next[j] - q[j]);
+		v0 = d0/t0;
+		v1 = d1/t1;
+		if ( v0 * v1 >= 0 ) {
+			v[j] = 0.5 * (v0 + v1);
+		} else {
+			v[j] = 0;
+		}
+	}
+}
+
+seqplay::seqplay(unsigned int i_dof, double i_dt, unsigned int i_fnum, unsigned int optional_data_dim) : debug_level(0), m_dof(i_dof),
+    m_stream_open(false), m_stream_started(false), m_stream_underrun(false), m_stream_pending(false),
+    m_stream_max_buffer_time(0), m_stream_pending_tm(0), m_stream_underrun_time(0), m_stream_underruns(0),
+    m_stream_prev(i_dof), m_stream_q(i_dof)
 {
     interpolators[Q] = new interpolator(i_dof, i_dt);
     interpolators[ZMP] = new interpolator(3, i_dt);
@@ -45,11 +78,31 @@ seqplay::seqplay(unsigned int i_dof, double i_dt, unsigned int i_fnum, unsigned
 	interpolators[OPTIONAL_DATA]->set(initial_optional_data);
 }
 
+seqplay::seqplay(const seqplay& i_src) : debug_level(i_src.debug_level), m_dof(i_src.m_dof),
+    m_stream_open(i_src.m_stream_open), m_stream_started(i_src.m_stream_started),
+    m_stream_underrun(i_src.m_stream_underrun), m_stream_pending(i_src.m_stream_pending),
+    m_stream_max_buffer_time(i_src.m_stream_max_buffer_time), m_stream_pending_tm(i_src.m_stream_pending_tm),
+    m_stream_underrun_time(i_src.m_stream_underrun_time), m_stream_underruns(i_src.m_stream_underruns),
+    m_stream_prev(i_src.m_stream_prev), m_stream_q(i_src.m_stream_q)
+{
+	for (unsigned int i=0; i<NINTERPOLATOR; i++){
+		interpolators[i] = new interpolator(*i_src.interpolators[i]);
+	}
+	std::map<std::string, groupInterpolator *>::const_iterator it;
+	for (it=i_src.groupInterpolators.begin(); it!=i_src.groupInterpolators.end(); it++){
+		groupInterpolators[it->first] = it->second ? new groupInterpolator(*it->second) : NULL;
+	}
+}
+
 seqplay::~seqplay()
 {
 	for (unsigned int i=0; i<NINTERPOLATOR; i++){
 		delete interpolators[i];
 	}
+	std::map<std::string, groupInterpolator *>::iterator it;
+	for (it=groupInterpolators.begin(); it!=groupInterpolators.end(); it++){
+		delete it->second;
+	}
 }
 
 #if 0 // TODO
@@ -102,6 +155,8 @@ void seqplay::goInitial(double tm)
 
 bool seqplay::isEmpty() const
 {
+	// an open stream is not finished even if all values are played
+	if (m_stream_open) return false;
 	for (unsigned int i=0; i<NINTERPOLATOR; i++){
 		if (!interpolators[i]->isEmpty()) return false;
 	}
@@ -117,9 +172,10 @@ bool seqplay::isEmpty() const
 bool seqplay::isEmpty(const char *gname)
 {
 	char *s = (char *)gname; while(*s) {*s=toupper(*s);s++;}
-	groupInterpolator *i = groupInterpolators[gname];
-	if (!i) return true;
-	return i->isEmpty();
+	// find() not to insert an entry, isEmpty() is called by onExecute
+	std::map<std::string, groupInterpolator *>::iterator it = groupInterpolators.find(gname);
+	if (it == groupInterpolators.end() || !it->second) return true;
+	return it->second->isEmpty();
 }
 
 #if 0
@@ -262,6 +318,7 @@ void seqplay::playPattern(std::vector<const double*> pos, std::vector<const doub
 
 void seqplay::clear(double i_timeLimit)
 {
+	m_stream_open = false;
 	tick_t t1 = get_tick();
 	while (!isEmpty()){
 		if (i_timeLimit > 0 
@@ -274,6 +331,15 @@ void seqplay::loadPattern(const char *basename, double tm)
 {
     double scale = 1.0;
     bool found = false;
+    string bpat = basename; bpat.append(".bpat");
+    if (access(bpat.c_str(),0)==0){
+        if (debug_level > 0) cout << "bpat  = " << bpat << endl;
+        if (loadBinaryPattern(bpat.c_str(), tm)){
+            sync();
+            return;
+        }
+        cerr << "falling back to text pattern files(" << basename << ".*)" << endl;
+    }
     if (debug_level > 0) cout << "pos   = ";
     string pos = basename; pos.append(".pos");
     if (access(pos.c_str(),0)==0){
@@ -337,6 +403,29 @@ void seqplay::loadPattern(const char *basename, double tm)
     sync();
 }
 
+bool seqplay::loadBinaryPattern(const char *i_fname, double i_tm)
+{
+    BinaryPatternReader reader;
+    if (!reader.open(i_fname)){
+        cerr << "failed to open binary pattern(" << i_fname << ")" << endl;
+        return false;
+    }
+    // channels and interpolators in the same order as text pattern files
+    struct { const char *name; int id; size_t offset; } channels[] = {
+        {"pos", Q, 0}, {"zmp", ZMP, 0}, {"gsens", ACC, 0}, {"hip", RPY, 0},
+        {"waist", P, 0}, {"waist", RPY, 3}, {"torque", TQ, 0},
+        {"wrenches", WRENCHES, 0}, {"optionaldata", OPTIONAL_DATA, 0}};
+    bool has_hip = reader.find("hip") != NULL;
+    for (unsigned int i=0; i<sizeof(channels)/sizeof(channels[0]); i++){
+        const BinaryPatternChannel *c = reader.find(channels[i].name);
+        if (!c) continue;
+        if (has_hip && strcmp(channels[i].name, "waist") == 0) continue; // .hip has priority over .waist
+        interpolators[channels[i].id]->load(reader.records(*c), c->numSamples, c->numElements+1,
+                                            i_tm, 1.0, false, channels[i].offset);
+    }
+    return true;
+}
+
 void seqplay::sync()
 {
 	for (unsigned int i=0; i<NINTERPOLATOR; i++){
@@ -355,6 +444,18 @@ void seqplay::get(double *o_q, double *o_zmp, double *o_accel,
 				  double *o_basePos, double *o_baseRpy, double *o_tq, double *o_wrenches, double *o_optional_data)
 {
 	double v[m_dof];
+	if (m_stream_open && m_stream_started && interpolators[Q]->isEmpty()){
+		// the next chunk hasn't arrived in time. keep the current posture
+		// and restart from rest when it arrives
+		if (!m_stream_underrun){
+			m_stream_underrun = true;
+			m_stream_underruns++;
+			interpolators[Q]->set(interpolators[Q]->front());
+		}
+		m_stream_underrun_time += interpolators[Q]->deltaT();
+	}else{
+		m_stream_underrun = false;
+	}
 	interpolators[Q]->get(o_q, v);
 	std::map<std::string, groupInterpolator *>::iterator it;
 	for (it=groupInterpolators.begin(); it!=groupInterpolators.end();){
@@ -378,6 +479,17 @@ void seqplay::get(double *o_q, double *o_zmp, double *o_accel,
 	interpolators[OPTIONAL_DATA]->get(o_optional_data);
 }
 
+void seqplay::advance(unsigned long i_ticks, double *o_q)
+{
+	double q[m_dof], zmp[3], acc[3], pos[3], rpy[3], tq[m_dof];
+	double wrenches[(int)interpolators[WRENCHES]->dimension()];
+	double optional_data[(int)interpolators[OPTIONAL_DATA]->dimension()];
+	if (!o_q) o_q = q;
+	for (unsigned long i=0; i<i_ticks && !isEmpty(); i++){
+		get(o_q, zmp, acc, pos, rpy, tq, wrenches, optional_data);
+	}
+}
+
 void seqplay::go(const double *i_q, const double *i_zmp, const double *i_acc,
 				 const double *i_p, const double *i_rpy, const double *i_tq, const double *i_wrenches, const double *i_optional_data, double i_time, 
 				 bool immediate)
@@ -603,6 +715,7 @@ bool seqplay::setJointAnglesSequence(std::vector<const double*> pos, std::vector
 	interpolators[Q]->set(x, v);
 	interpolators[Q]->clear();
 	interpolators[Q]->push(x, v, a, true);
+	interpolators[Q]->reserve(count_interpolated_values(tm, interpolators[Q]->deltaT()));
 
     const double *q=NULL;
     for (unsigned int i=0; i<pos.size(); i++){
@@ -616,18 +729,7 @@ bool seqplay::setJointAnglesSequence(std::vector<const double*> pos, std::vector
 			}
 			const double *q_next = pos[i+1];
 			const double *q_prev = i==0?x:pos[i-1];
-			for (unsigned int j = 0; j < m_dof; j++) {
-				double d0, d1, v0, v1;
-				d0 = (q[j] - q_prev[j]);
-				d1 = (q_next[j] - q[j]);
-				v0 = d0/t0;
-				v1 = d1/t1;
-				if ( v0 * v1 >= 0 ) {
-					v[j] = 0.5 * (v0 + v1);
-				} else {
-					v[j] = 0;
-				}
-			}
+			via_point_velocity(m_dof, q_prev, q, q_next, t0, t1, v);
 		} else {
 			for (unsigned int j = 0; j < m_dof; j++) { v[j] = 0.0; }
 		}
@@ -643,6 +745,7 @@ bool seqplay::setJointAnglesSequence(std::vector<const double*> pos, std::vector
 
 bool seqplay::clearJointAngles()
 {
+	m_stream_open = false;
 	// setJointAngles to override curren tgoal
 	double x[m_dof], v[m_dof], a[m_dof];
 	interpolators[Q]->get(x, v, a, false);
@@ -657,6 +760,111 @@ bool seqplay::clearJointAngles()
 	return true;
 }
 
+bool seqplay::openJointAnglesStream(double i_maxBufferTime)
+{
+	if (i_maxBufferTime <= 0) {
+		std::cerr << "[seqplay] maxBufferTime(" << i_maxBufferTime << ") must be positive" << std::endl;
+		return false;
+	}
+	// start from the current state like setJointAnglesSequence
+	double x[m_dof], v[m_dof], a[m_dof];
+	interpolators[Q]->get(x, v, a, false);
+	interpolators[Q]->set(x, v);
+	interpolators[Q]->clear();
+	// reserve values for maxBufferTime not to allocate memory while streaming
+	interpolators[Q]->reserve((size_t)ceil(i_maxBufferTime/interpolators[Q]->deltaT()) + 1);
+	memcpy(&m_stream_prev[0], x, sizeof(double)*m_dof);
+	m_stream_max_buffer_time = i_maxBufferTime;
+	m_stream_open = true;
+	m_stream_started = m_stream_underrun = m_stream_pending = false;
+	m_stream_underrun_time = 0;
+	m_stream_underruns = 0;
+	return true;
+}
+
+double seqplay::streamBufferedTime()
+{
+	return interpolators[Q]->remain_time() + (m_stream_pending ? m_stream_pending_tm : 0);
+}
+
+void seqplay::pushJointAnglesStream(const double *v)
+{
+	double tm = m_stream_pending_tm;
+	interpolators[Q]->setGoal(&m_stream_q[0], v, tm, false);
+	do{
+		interpolators[Q]->interpolate(tm);
+	}while(tm>0);
+	m_stream_prev = m_stream_q;
+	m_stream_started = true;
+}
+
+bool seqplay::appendJointAnglesStream(const std::vector<const double*>& pos, const std::vector<double>& tm)
+{
+	if (!m_stream_open) {
+		std::cerr << "[seqplay] stream is not open" << std::endl;
+		return false;
+	}
+	if (pos.size() != tm.size()) {
+		std::cerr << "[seqplay] length of joint angles sequence and time sequence differ" << std::endl;
+		return false;
+	}
+	double total_tm = 0;
+	for (unsigned int i=0; i<tm.size(); i++) {
+		if (tm[i] <= 0) {
+			std::cerr << "[seqplay] duration(" << tm[i] << ") must be positive" << std::endl;
+			return false;
+		}
+		total_tm += tm[i];
+	}
+	// the caller should retry after buffered values are played
+	if (streamBufferedTime() + total_tm > m_stream_max_buffer_time) return false;
+
+	// velocity at a via point depends on the next one, so the last via
+	// point is held until the next chunk or closeJointAnglesStream()
+	double v[m_dof];
+	for (unsigned int i=0; i<pos.size(); i++){
+		if (m_stream_pending) {
+			via_point_velocity(m_dof, &m_stream_prev[0], &m_stream_q[0], pos[i],
+							   m_stream_pending_tm, tm[i], v);
+			pushJointAnglesStream(v);
+		}
+		memcpy(&m_stream_q[0], pos[i], sizeof(double)*m_dof);
+		m_stream_pending_tm = tm[i];
+		m_stream_pending = true;
+	}
+	sync();
+	return true;
+}
+
+bool seqplay::closeJointAnglesStream()
+{
+	if (!m_stream_open) {
+		std::cerr << "[seqplay] stream is not open" << std::endl;
+		return false;
+	}
+	if (m_stream_pending) {
+		double v[m_dof];
+		for (unsigned int j = 0; j < m_dof; j++) { v[j] = 0.0; }
+		pushJointAnglesStream(v);
+		m_stream_pending = false;
+		sync();
+	}
+	m_stream_open = false;
+	return true;
+}
+
+void seqplay::getJointAnglesStreamState(bool& o_open, bool& o_underrun, double& o_bufferedTime,
+										double& o_maxBufferTime, unsigned int& o_underruns,
+										double& o_underrunTime)
+{
+	o_open = m_stream_open;
+	o_underrun = m_stream_underrun;
+	o_bufferedTime = m_stream_open ? streamBufferedTime() : 0;
+	o_maxBufferTime = m_stream_max_buffer_time;
+	o_underruns = m_stream_underruns;
+	o_underrunTime = m_stream_underrun_time;
+}
+
 bool seqplay::setJointAnglesSequenceFull(std::vector<const double*> i_pos, std::vector<const double*> i_vel, std::vector<const double*> i_torques, std::vector<const double*> i_bpos, std::vector<const double*> i_brpy, std::vector<const double*> i_bacc,  std::vector<const double*> i_zmps, std::vector<const double*> i_wrenches, std::vector<const double*> i_optionals, std::vector<double> i_tm)
 {
 	// setJointAngles to override curren tgoal
@@ -700,6 +908,8 @@ bool seqplay::setJointAnglesSequenceFull(std::vector<const double*> i_pos, std::
 	interpolators[OPTIONAL_DATA]->set(optional);
 	interpolators[OPTIONAL_DATA]->clear();
 	interpolators[OPTIONAL_DATA]->push(optional, dummy_optional, dummy_optional, true);
+	size_t len = count_interpolated_values(i_tm, interpolators[Q]->deltaT());
+	for (unsigned int i=0; i<NINTERPOLATOR; i++) interpolators[i]->reserve(len);
 
     const double *q=NULL;
     for (unsigned int i=0; i<i_pos.size(); i++){
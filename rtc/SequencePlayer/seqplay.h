@@ -14,6 +14,8 @@ class seqplay
 {
 public:
     seqplay(unsigned int i_dof, double i_dt, unsigned int i_fnum = 0, unsigned int optional_data_dim = 1);
+    // copies interpolators and queued values, see seqplayHandoff
+    seqplay(const seqplay& i_src);
     ~seqplay();
     //
     bool isEmpty() const;
@@ -43,11 +45,21 @@ public:
     bool clearJointAngles();
     bool clearJointAnglesOfGroup(const char *gname);
     //
+    bool openJointAnglesStream(double i_maxBufferTime);
+    bool appendJointAnglesStream(const std::vector<const double*>& pos, const std::vector<double>& tm);
+    bool closeJointAnglesStream();
+    void getJointAnglesStreamState(bool& o_open, bool& o_underrun, double& o_bufferedTime,
+                                   double& o_maxBufferTime, unsigned int& o_underruns,
+                                   double& o_underrunTime);
+    //
     void setJointAngle(unsigned int i_rank, double jv, double tm);
     void loadPattern(const char *i_basename, double i_tm);
     void clear(double i_timeLimit=0);
     void get(double *o_q, double *o_zmp, double *o_accel,
 	     double *o_basePos, double *o_baseRpy, double *o_tq, double *o_wrenches, double *o_optional_data);
+    // calls get() i_ticks times while it is not empty, joint angles got
+    // last are stored to o_q if any
+    void advance(unsigned long i_ticks, double *o_q=NULL);
     void go(const double *i_q, const double *i_zmp, const double *i_acc,
             const double *i_p, const double *i_rpy, const double *i_tq, const double *i_wrenches, const double *i_optional_data, double i_time, 
             bool immediate=true);
@@ -59,12 +71,17 @@ public:
     void sync();
     bool setInterpolationMode(interpolator::interpolation_mode i_mode_);
 private:
+    seqplay& operator=(const seqplay&);
     class groupInterpolator{
     public:
         groupInterpolator(const std::vector<int>& i_indices, double i_dt)
             : indices(i_indices), state(created){
             inter = new interpolator(i_indices.size(), i_dt);
         }
+        groupInterpolator(const groupInterpolator& i_src)
+            : indices(i_src.indices), state(i_src.state), time2remove(i_src.time2remove){
+            inter = new interpolator(*i_src.inter);
+        }
         ~groupInterpolator(){
             delete inter;
         }
@@ -142,10 +159,18 @@ private:
         double time2remove;
     };
     void pop_back();
+    bool loadBinaryPattern(const char *i_fname, double i_tm);
+    double streamBufferedTime();
+    void pushJointAnglesStream(const double *v);
     enum {Q, ZMP, ACC, P, RPY, TQ, WRENCHES, OPTIONAL_DATA, NINTERPOLATOR};
     interpolator *interpolators[NINTERPOLATOR];
     std::map<std::string, groupInterpolator *> groupInterpolators; 
     int debug_level, m_dof;
+    // joint angles stream
+    bool m_stream_open, m_stream_started, m_stream_underrun, m_stream_pending;
+    double m_stream_max_buffer_time, m_stream_pending_tm, m_stream_underrun_time;
+    unsigned int m_stream_underruns;
+    std::vector<double> m_stream_prev, m_stream_q;
 };
 
 #endif
@@ -0,0 +1,153 @@
+// -*- C++ -*-
+#ifndef __SEQPLAY_HANDOFF_H__
+#define __SEQPLAY_HANDOFF_H__
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <coil/Mutex.h>
+#include <coil/Guard.h>
+#include "util/ParameterCell.h"
+#include "seqplay.h"
+
+/**
+   \brief hands off seqplay from service threads to onExecute without
+   blocking it.
+
+   Service threads edit a shadow of seqplay through Writer, which is
+   advanced to the tick of onExecute before it is edited. A copy of the
+   shadow is published by ParameterCell when Writer is destructed. So
+   values are interpolated and queued by service threads and onExecute
+   only picks up the latest copy by update(), advances it by ticks played
+   since it was published and plays it. Copies are freed by service
+   threads when slots of ParameterCell are overwritten, so up to four
+   copies of queued values(the shadow and three slots) are kept.
+ */
+class seqplayHandoff
+{
+public:
+    /**
+       \param i_seq initial seqplay, which is deleted by seqplayHandoff
+       \param i_dof number of joints
+     */
+    seqplayHandoff(seqplay *i_seq, unsigned int i_dof)
+        : m_cell(entry(i_seq, 0)), m_live(i_seq), m_shadow(new seqplay(*i_seq)),
+          m_shadowTick(0), m_q(i_dof), m_published(0), m_tick(0) {}
+    ~seqplayHandoff() { delete m_shadow; }
+
+    /**
+       \brief edits the shadow and publishes it when destructed. Writers
+       are serialized by a mutex which is never taken by onExecute.
+     */
+    class Writer
+    {
+    public:
+        /**
+           \param i_handoff seqplayHandoff
+           \param i_publish false if the shadow is only read
+         */
+        Writer(seqplayHandoff& i_handoff, bool i_publish=true)
+            : m_handoff(i_handoff), m_publish(i_publish)
+        {
+            m_handoff.m_mutex.lock();
+            m_handoff.catchUp();
+            m_wasEmpty = m_handoff.m_shadow->isEmpty();
+        }
+        ~Writer()
+        {
+            if (m_publish) m_handoff.publish(m_wasEmpty);
+            m_handoff.m_mutex.unlock();
+        }
+        seqplay& operator*() { return *m_handoff.m_shadow; }
+        seqplay* operator->() { return m_handoff.m_shadow; }
+        /**
+           \brief joint angles played by onExecute at the last tick, which
+           are not updated while it is empty
+         */
+        const double *playedJointAngles() const { return &m_handoff.m_q[0]; }
+    private:
+        Writer(const Writer&);
+        Writer& operator=(const Writer&);
+        seqplayHandoff& m_handoff;
+        bool m_publish, m_wasEmpty;
+    };
+
+    /**
+       \brief picks up the latest published seqplay. called by onExecute at
+       the beginning of every tick, which plays a value of the returned
+       seqplay by get() unless it is empty
+       \return seqplay to be played in this tick
+     */
+    seqplay *update()
+    {
+        if (m_cell.update()){
+            m_live = m_cell.value().seq.get();
+            m_live->advance(m_tick - m_cell.value().tick);
+        }
+        m_tick++;
+        return m_live;
+    }
+    /**
+       \brief sequence number of the last published seqplay, see applied()
+     */
+    unsigned long published()
+    {
+        coil::Guard<coil::Mutex> guard(m_mutex);
+        return m_published;
+    }
+    /**
+       \brief checks if seqplay of a sequence number or a newer one has
+       been picked up by update()
+     */
+    bool applied(unsigned long i_seq) const { return m_cell.applied(i_seq); }
+private:
+    struct entry
+    {
+        entry() : tick(0) {}
+        entry(seqplay *i_seq, unsigned long i_tick) : seq(i_seq), tick(i_tick) {}
+        boost::shared_ptr<seqplay> seq;
+        // number of ticks which have been played before seq
+        unsigned long tick;
+    };
+
+    seqplayHandoff(const seqplayHandoff&);
+    seqplayHandoff& operator=(const seqplayHandoff&);
+
+    // called with m_mutex locked
+    void catchUp()
+    {
+        unsigned long tick = m_tick;
+        m_shadow->advance(tick - m_shadowTick, &m_q[0]);
+        m_shadowTick = tick;
+    }
+    // called with m_mutex locked
+    void publish(bool i_wasEmpty)
+    {
+        if (i_wasEmpty){
+            // nothing has been played while it was edited, edits start
+            // from the current tick
+            m_shadowTick = m_tick;
+        }else{
+            // values played while it was edited are skipped, so that
+            // values appended to the queue by go(), e.g. playPattern() and
+            // loadPattern(), are played in time. Commands which override
+            // the queue, e.g. setJointAngles(), are expected to be edited
+            // within a tick.
+            catchUp();
+        }
+        m_published = m_cell.set(entry(new seqplay(*m_shadow), m_shadowTick));
+    }
+
+    ParameterCell<entry> m_cell;
+    // owned by onExecute
+    seqplay *m_live;
+    // owned by writers
+    seqplay *m_shadow;
+    unsigned long m_shadowTick;
+    std::vector<double> m_q;
+    unsigned long m_published;
+    coil::Mutex m_mutex;
+    // number of ticks started by update()
+    volatile unsigned long m_tick;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/* checks the value queue of interpolator and counts memory allocation
+   while a long sequence of a 40-DOF robot is played like
+   setJointAnglesSequence and while a goal is interpolated online like
+   setJointAngles. Time of get() corresponds to onExecute of SequencePlayer.
+     testInterpolator [--dof N] [--time T]
+*/
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <time.h>
+#include "interpolator.h"
+#include "util/AllocationCounter.h"
+#include "util/TestUtil.h"
+
+// plays a sequence of via points every 0.1[s] like setJointAnglesSequence
+static bool play_sequence(interpolator& ip, int dof, double total_time, const char *name)
+{
+    std::vector<double> g(dof), x(dof), v(dof);
+    int n = (int)(total_time/0.1 + 0.5);
+    num_allocation = 0;
+    count_allocation = true;
+    double t1 = now();
+    for (int i=0; i<n; i++){
+        for (int j=0; j<dof; j++) g[j] = 0.5*sin(2*M_PI*(i+1)*0.1/(2.0+0.1*j));
+        ip.go(&g[0], 0.1, false);
+    }
+    ip.sync();
+    double t_go = now() - t1;
+    int num_allocation_go = num_allocation;
+    num_allocation = 0;
+    int ticks = 0;
+    double max_tm = 0, sum_tm = 0;
+    while (!ip.isEmpty()){
+        t1 = now();
+        ip.get(&x[0], &v[0]);
+        double tm = now() - t1;
+        sum_tm += tm;
+        if (tm > max_tm) max_tm = tm;
+        ticks++;
+    }
+    count_allocation = false;
+    char buf[256];
+    sprintf(buf, "%s : %d samples, allocations = %d at go() (%.1f[ms]), %d at get(), get() avg = %.2f[us], max = %.2f[us]",
+            name, ticks, num_allocation_go, t_go*1e3, num_allocation, sum_tm/ticks*1e6, max_tm*1e6);
+    bool ret = checkResult(num_allocation == 0, buf);
+    ret &= checkResult(ticks == n*(int)(0.1/ip.deltaT() + 0.5), "  all samples are played");
+    bool reached = true;
+    for (int j=0; j<dof; j++) reached &= fabs(x[j] - g[j]) < 1e-9;
+    ret &= checkResult(reached, "  the last via point is reached");
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int dof = 40;
+    double total_time = 60, dt = 0.002;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dof") == 0 && ++i < argc) {
+            dof = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--time") == 0 && ++i < argc) {
+            total_time = atof(argv[i]);
+        }
+    }
+    bool ret = true;
+    interpolator ip(dof, dt);
+    std::vector<double> x0(dof, 0.0), x(dof);
+    ip.set(&x0[0]);
+    ret &= play_sequence(ip, dof, total_time, "first sequence");
+    size_t capacity = ip.capacity();
+    // the buffer is reused
+    ret &= play_sequence(ip, dof, total_time, "second sequence");
+    ret &= checkResult(ip.capacity() == capacity, "  capacity is not changed");
+
+    // setJointAngles
+    std::vector<double> g(dof, 0.3);
+    num_allocation = 0;
+    count_allocation = true;
+    ip.setGoal(&g[0], 1.0);
+    int ticks = 0;
+    while (!ip.isEmpty()){
+        ip.get(&x[0]);
+        ticks++;
+    }
+    count_allocation = false;
+    char buf[256];
+    sprintf(buf, "online interpolation : %d samples, allocations = %d", ticks, num_allocation);
+    ret &= checkResult(num_allocation == 0, buf);
+
+    // order of values is kept over the end of the ring buffer and reallocation
+    interpolator ip1(1, dt);
+    double tmp, zero = 0;
+    bool ordered = true;
+    int pushed = 0, popped = 0;
+    for (int i=0; i<100; i++){
+        for (int j=0; j<i%7+1; j++){
+            tmp = pushed++;
+            ip1.push(&tmp, &zero, &zero);
+        }
+        for (int j=0; j<i%5+1 && !ip1.isEmpty(); j++){
+            ip1.get(&tmp);
+            ordered &= (tmp == popped++);
+        }
+    }
+    while (!ip1.isEmpty()){
+        ip1.get(&tmp);
+        ordered &= (tmp == popped++);
+    }
+    ret &= checkResult(ordered && popped == pushed, "values are popped in order of push");
+    tmp = 1;
+    ip1.push(&tmp, &zero, &zero);
+    tmp = 2;
+    ip1.push(&tmp, &zero, &zero);
+    ip1.pop_back();
+    ip1.get(&tmp);
+    ret &= checkResult(tmp == 1 && ip1.isEmpty(), "pop_back removes the last value");
+    return ret ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/* checks the joint angles stream of seqplay. A trajectory of a 30-DOF
+   robot which is sent in chunks while it is played must be the same as
+   the one sent by setJointAnglesSequence at once, without allocating
+   memory after the stream is opened. Underruns are caused by delaying
+   a chunk.
+     testJointAnglesStream [--dof N] [--time T]
+*/
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include "seqplay.h"
+#include "util/AllocationCounter.h"
+#include "util/TestUtil.h"
+
+// plays all values and appends them to o_qs
+static void play(seqplay& seq, int dof, std::vector<double>& o_qs, int max_ticks=-1)
+{
+    std::vector<double> q(dof), tq(dof);
+    double zmp[3], acc[3], pos[3], rpy[3], wrenches[1], optional_data[1];
+    for (int i=0; !seq.isEmpty() && i != max_ticks; i++){
+        seq.get(&q[0], zmp, acc, pos, rpy, &tq[0], wrenches, optional_data);
+        o_qs.insert(o_qs.end(), q.begin(), q.end());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int dof = 30;
+    double total_time = 20, dt = 0.002, interval = 0.1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dof") == 0 && ++i < argc) {
+            dof = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--time") == 0 && ++i < argc) {
+            total_time = atof(argv[i]);
+        }
+    }
+    // via points every interval [s]
+    int n = (int)(total_time/interval + 0.5);
+    std::vector<std::vector<double> > points(n, std::vector<double>(dof));
+    std::vector<const double *> v_poss(n);
+    std::vector<double> v_tms(n, interval);
+    for (int i=0; i<n; i++){
+        for (int j=0; j<dof; j++) points[i][j] = 0.5*sin(2*M_PI*(i+1)*interval/(2.0+0.1*j));
+        v_poss[i] = &points[i][0];
+    }
+    std::vector<double> q0(dof, 0.0);
+    bool ret = true;
+
+    // reference
+    std::vector<double> q_seq;
+    {
+        seqplay seq(dof, dt);
+        seq.setJointAngles(&q0[0]);
+        seq.setJointAnglesSequence(v_poss, v_tms);
+        play(seq, dof, q_seq);
+        // setJointAnglesSequence starts from the current joint angles
+        q_seq.erase(q_seq.begin(), q_seq.begin() + dof);
+    }
+
+    // chunks of 1[s] are sent when less than 1[s] is buffered
+    const int chunk = (int)(1.0/interval + 0.5);
+    std::vector<std::vector<const double *> > c_poss;
+    std::vector<std::vector<double> > c_tms;
+    for (int i=0; i<n; i+=chunk){
+        int m = std::min(chunk, n - i);
+        c_poss.push_back(std::vector<const double *>(v_poss.begin() + i, v_poss.begin() + i + m));
+        c_tms.push_back(std::vector<double>(m, interval));
+    }
+    std::vector<double> q_stream;
+    q_stream.reserve(q_seq.size() + dof);
+    {
+        seqplay seq(dof, dt);
+        seq.setJointAngles(&q0[0]);
+        seq.openJointAnglesStream(2.0);
+        bool open, underrun;
+        double buffered_time, max_buffer_time, underrun_time;
+        unsigned int underruns;
+        std::vector<double> q(dof), tq(dof);
+        double zmp[3], acc[3], pos[3], rpy[3], wrenches[1], optional_data[1];
+        size_t sent = 0;
+        bool full = false;
+        num_allocation = 0;
+        count_allocation = true;
+        while (!seq.isEmpty()){
+            seq.getJointAnglesStreamState(open, underrun, buffered_time, max_buffer_time, underruns, underrun_time);
+            if (sent < c_poss.size() && buffered_time < 1.0){
+                ret &= seq.appendJointAnglesStream(c_poss[sent], c_tms[sent]);
+                // more than 1[s] is buffered now
+                if (sent > 0) full |= !seq.appendJointAnglesStream(c_poss[sent], c_tms[sent]);
+                if (++sent == c_poss.size()) seq.closeJointAnglesStream();
+            }
+            seq.get(&q[0], zmp, acc, pos, rpy, &tq[0], wrenches, optional_data);
+            q_stream.insert(q_stream.end(), q.begin(), q.end());
+        }
+        count_allocation = false;
+        seq.getJointAnglesStreamState(open, underrun, buffered_time, max_buffer_time, underruns, underrun_time);
+        char buf[256];
+        sprintf(buf, "%d via points in %d chunks : %d samples, allocations = %d, underruns = %d",
+                n, (int)c_poss.size(), (int)(q_stream.size()/dof), num_allocation, underruns);
+        ret &= checkResult(num_allocation == 0 && underruns == 0 && !open, buf);
+        ret &= checkResult(full, "  chunks over maxBufferTime are rejected");
+        bool same = q_stream.size() == q_seq.size();
+        for (size_t i=0; same && i<q_seq.size(); i++) same = fabs(q_stream[i] - q_seq[i]) < 1e-12;
+        ret &= checkResult(same, "  trajectory is the same as setJointAnglesSequence");
+    }
+
+    // underrun
+    {
+        seqplay seq(dof, dt);
+        seq.setJointAngles(&q0[0]);
+        seq.openJointAnglesStream(2.0);
+        std::vector<double> qs;
+        seq.appendJointAnglesStream(c_poss[0], c_tms[0]);
+        play(seq, dof, qs, (int)((chunk - 1)*interval/dt + 0.5));
+        ret &= checkResult(!seq.isEmpty(), "open stream is not empty after all values are played");
+        size_t played = qs.size();
+        play(seq, dof, qs, 50);
+        bool open, underrun;
+        double buffered_time, max_buffer_time, underrun_time;
+        unsigned int underruns;
+        seq.getJointAnglesStreamState(open, underrun, buffered_time, max_buffer_time, underruns, underrun_time);
+        char buf[256];
+        sprintf(buf, "underruns = %d, underrun time = %.3f[s]", underruns, underrun_time);
+        ret &= checkResult(underrun && underruns == 1 && fabs(underrun_time - 50*dt) < 1e-9, buf);
+        bool kept = true;
+        for (size_t i=played; i<qs.size(); i++) kept &= fabs(qs[i] - qs[played - dof + (i - played)%dof]) < 1e-12;
+        ret &= checkResult(kept, "  joint angles are kept during underrun");
+        seq.appendJointAnglesStream(c_poss[1], c_tms[1]);
+        seq.closeJointAnglesStream();
+        play(seq, dof, qs);
+        seq.getJointAnglesStreamState(open, underrun, buffered_time, max_buffer_time, underruns, underrun_time);
+        bool reached = true;
+        for (int j=0; j<dof; j++) reached &= fabs(qs[qs.size() - dof + j] - c_poss[1].back()[j]) < 1e-9;
+        ret &= checkResult(reached && !underrun && underruns == 1 && seq.isEmpty(),
+                     "  the last via point is reached after the stream is closed");
+    }
+    return ret ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/* compares seqplay::loadPattern() of text pattern files with the binary
+   pattern converted from them. A pattern of a 30-DOF robot(.pos, .zmp
+   and .waist) is generated and played by both loaders, and all samples
+   must be identical. A corrupt binary pattern must fall back to the text
+   pattern files.
+     testLoadPattern [--dof N] [--lines N]
+*/
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <time.h>
+#include "seqplay.h"
+#include "BinaryPattern.h"
+#include "util/TestUtil.h"
+
+static void writePattern(const std::string& fname, int nlines, int dim, double dt, double amp)
+{
+    FILE *fp = fopen(fname.c_str(), "w");
+    for (int i=0; i<nlines; i++){
+        fprintf(fp, "%.3f", i*dt);
+        for (int j=0; j<dim; j++){
+            fprintf(fp, " %.10g", amp*sin(2*M_PI*i*dt/(2.0+0.1*j)));
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+}
+
+// FNV-1a hash of values
+static void hash_values(unsigned long long& h, const double *v, int n)
+{
+    const unsigned char *p = (const unsigned char *)v;
+    for (size_t i=0; i<n*sizeof(double); i++){
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+}
+
+// loads a pattern and plays all samples
+static double play(const std::string& basename, int dof, double dt,
+                   unsigned long long& o_hash, int& o_samples)
+{
+    seqplay seq(dof, dt);
+    double t1 = now();
+    seq.loadPattern(basename.c_str(), 1.0);
+    double t_load = now() - t1;
+    std::vector<double> q(dof), tq(dof);
+    double zmp[3], acc[3], pos[3], rpy[3], wrenches[1], optional_data[1];
+    o_hash = 14695981039346656037ULL;
+    o_samples = 0;
+    while (!seq.isEmpty()){
+        seq.get(&q[0], zmp, acc, pos, rpy, &tq[0], wrenches, optional_data);
+        hash_values(o_hash, &q[0], dof);
+        hash_values(o_hash, zmp, 3);
+        hash_values(o_hash, pos, 3);
+        hash_values(o_hash, rpy, 3);
+        o_samples++;
+    }
+    return t_load;
+}
+
+int main(int argc, char *argv[])
+{
+    int dof = 30, nlines = 100000;
+    double dt = 0.002;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dof") == 0 && ++i < argc) {
+            dof = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--lines") == 0 && ++i < argc) {
+            nlines = atoi(argv[i]);
+        }
+    }
+    char buf[256];
+    sprintf(buf, "/tmp/testLoadPattern%d", getpid());
+    std::string basename(buf), text(basename + "-text"), binary(basename + "-binary");
+    writePattern(text + ".pos", nlines, dof, dt, 0.5);
+    writePattern(text + ".zmp", nlines, 3, dt, 0.05);
+    writePattern(text + ".waist", nlines, 6, dt, 0.1);
+
+    bool ret = true;
+    unsigned long long h_text, h_binary;
+    int n_text, n_binary;
+    double t_text = play(text, dof, dt, h_text, n_text);
+
+    double t1 = now();
+    const char *exts[] = {"pos", "zmp", "waist"};
+    std::vector<double> records[3];
+    BinaryPatternWriter writer;
+    for (int i=0; i<3; i++){
+        size_t numElements;
+        ret &= readTextPattern((text + "." + exts[i]).c_str(), numElements, records[i]);
+        writer.addChannel(exts[i], numElements, records[i]);
+    }
+    ret &= writer.write((binary + ".bpat").c_str());
+    double t_convert = now() - t1;
+    ret &= checkResult(ret, "text pattern is converted");
+
+    double t_binary = play(binary, dof, dt, h_binary, n_binary);
+    sprintf(buf, "%d lines, %d samples : text = %.1f[ms], binary = %.1f[ms](x%.1f), conversion = %.1f[ms]",
+            nlines, n_text, t_text*1e3, t_binary*1e3, t_text/t_binary, t_convert*1e3);
+    ret &= checkResult(n_text > nlines, buf);
+    ret &= checkResult(n_text == n_binary && h_text == h_binary, "  samples are identical");
+
+    // a corrupt binary pattern is ignored and text pattern files are loaded
+    FILE *fp = fopen((text + ".bpat").c_str(), "w");
+    fprintf(fp, "not a binary pattern\n");
+    fclose(fp);
+    play(text, dof, dt, h_binary, n_binary);
+    ret &= checkResult(n_text == n_binary && h_text == h_binary, "corrupt binary pattern falls back to text pattern files");
+    unlink((text + ".bpat").c_str());
+
+    for (int i=0; i<3; i++) unlink((text + "." + exts[i]).c_str());
+    unlink((binary + ".bpat").c_str());
+    return ret ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+/* checks seqplayHandoff, which hands off seqplay from service threads to
+   onExecute of SequencePlayer. Joint angles played through it must be
+   the same as those played by seqplay which is commanded directly, even
+   if a command is picked up some ticks after it is started. Then a
+   service thread keeps appending chunks to the joint angles stream while
+   a real-time thread plays every 2[ms] like onExecute. The worst-case
+   time of a tick is printed together with that of a mutex which is held
+   by the service thread while it sends a command.
+     testSeqplayHandoff [--dof N] [--ticks N]
+*/
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <coil/Mutex.h>
+#include <coil/Guard.h>
+#include "seqplayHandoff.h"
+#include "util/TestUtil.h"
+
+static int dof = 30;
+static const double dt = 0.002;
+
+// plays a tick like onExecute, joint angles are kept while it is empty
+struct player
+{
+    player() : q(dof, 0.0), tq(dof) {}
+    void play(seqplay *seq)
+    {
+        if (!seq->isEmpty()){
+            seq->get(&q[0], zmp, acc, pos, rpy, &tq[0], wrenches, optional_data);
+        }
+        qs.insert(qs.end(), q.begin(), q.end());
+    }
+    std::vector<double> q, tq, qs;
+    double zmp[3], acc[3], pos[3], rpy[3], wrenches[1], optional_data[1];
+};
+
+// n via points every interval [s] from i_phase
+static void makeSequence(int n, double interval, double i_phase,
+                         std::vector<std::vector<double> >& o_points,
+                         std::vector<const double *>& o_poss, std::vector<double>& o_tms)
+{
+    o_points.assign(n, std::vector<double>(dof));
+    o_poss.resize(n);
+    o_tms.assign(n, interval);
+    for (int i=0; i<n; i++){
+        for (int j=0; j<dof; j++) o_points[i][j] = 0.5*sin(2*M_PI*(i_phase + (i+1)*interval)/(2.0+0.1*j));
+        o_poss[i] = &o_points[i][0];
+    }
+}
+
+static bool same(const std::vector<double>& a, const std::vector<double>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i=0; i<a.size(); i++){
+        if (fabs(a[i] - b[i]) > 1e-12) return false;
+    }
+    return true;
+}
+
+// A pattern is appended by playPattern() at i_start while a sequence is
+// played, and another sequence is sent at i_idle after all are played.
+// Each of them takes i_delay ticks to be published.
+static bool compare(int i_start, int i_idle, int i_delay)
+{
+    std::vector<std::vector<double> > points[3];
+    std::vector<const double *> poss[3];
+    std::vector<double> tms[3];
+    for (int i=0; i<3; i++) makeSequence(10, 0.1, i, points[i], poss[i], tms[i]);
+    std::vector<double> q0(dof, 0.0);
+    std::vector<const double *> none;
+    const int ticks = i_idle + 1000;
+
+    // values played while a command is edited are skipped only if it is
+    // not empty, so the first one starts i_delay ticks later when idle
+    player direct;
+    {
+        seqplay seq(dof, dt);
+        seq.setJointAngles(&q0[0]);
+        seq.setJointAnglesSequence(poss[0], tms[0]);
+        for (int i=0; i<ticks; i++){
+            if (i == i_start) seq.playPattern(poss[1], none, none, tms[1], poss[0].back(), dof);
+            if (i == i_idle + i_delay) seq.setJointAnglesSequence(poss[2], tms[2]);
+            direct.play(&seq);
+        }
+    }
+    player handoff;
+    {
+        seqplayHandoff h(new seqplay(dof, dt), dof);
+        {
+            seqplayHandoff::Writer seq(h);
+            seq->setJointAngles(&q0[0]);
+            seq->setJointAnglesSequence(poss[0], tms[0]);
+        }
+        seqplayHandoff::Writer *w = NULL;
+        for (int i=0; i<ticks; i++){
+            if (i == i_start){
+                w = new seqplayHandoff::Writer(h);
+                (*w)->playPattern(poss[1], none, none, tms[1], poss[0].back(), dof);
+            }else if (i == i_idle){
+                w = new seqplayHandoff::Writer(h);
+                (*w)->setJointAnglesSequence(poss[2], tms[2]);
+            }
+            if (w && (i == i_start + i_delay || i == i_idle + i_delay)){
+                delete w;
+                w = NULL;
+            }
+            handoff.play(h.update());
+        }
+    }
+    return same(direct.qs, handoff.qs);
+}
+
+// stress test
+static seqplayHandoff *handoff;
+static seqplay *shared;
+static coil::Mutex mutex;
+static volatile bool running = true;
+static volatile unsigned long ncommands = 0;
+
+static int nchunks = 0;
+
+// appends a chunk of 2[s] to the joint angles stream when less than
+// 2[s] is buffered
+static void command(seqplay& seq)
+{
+    bool open, underrun;
+    double buffered_time, max_buffer_time, underrun_time;
+    unsigned int underruns;
+    seq.getJointAnglesStreamState(open, underrun, buffered_time, max_buffer_time, underruns, underrun_time);
+    if (buffered_time < 2.0){
+        std::vector<std::vector<double> > points;
+        std::vector<const double *> poss;
+        std::vector<double> tms;
+        makeSequence(20, 0.1, 2.0*nchunks++, points, poss, tms);
+        seq.appendJointAnglesStream(poss, tms);
+    }
+    __sync_add_and_fetch(&ncommands, 1);
+}
+
+static void *handoffService(void *)
+{
+    while (running){
+        {
+            seqplayHandoff::Writer seq(*handoff);
+            command(*seq);
+        }
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static void *mutexService(void *)
+{
+    while (running){
+        {
+            coil::Guard<coil::Mutex> guard(mutex);
+            command(*shared);
+        }
+        usleep(1000);
+    }
+    return NULL;
+}
+
+// plays every 2[ms] and returns the worst-case time of a tick
+static double play(bool use_handoff, int ticks, double& o_max_step)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double max_time = 0;
+    player p;
+    p.qs.reserve(dof*2);
+    o_max_step = 0;
+    for (int i=0; i<ticks; i++){
+        ts.tv_nsec += (long)(dt*1e9);
+        if (ts.tv_nsec >= 1000000000){
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        double t1 = now();
+        if (use_handoff){
+            p.play(handoff->update());
+        }else{
+            coil::Guard<coil::Mutex> guard(mutex);
+            p.play(shared);
+        }
+        double t2 = now();
+        if (t2 - t1 > max_time) max_time = t2 - t1;
+        if (i > 0){
+            for (int j=0; j<dof; j++){
+                double step = fabs(p.qs[dof + j] - p.qs[j]);
+                if (step > o_max_step) o_max_step = step;
+            }
+            p.qs.erase(p.qs.begin(), p.qs.begin() + dof);
+        }
+    }
+    return max_time;
+}
+
+static double run(bool use_handoff, int ticks, double& o_max_step)
+{
+    running = true;
+    pthread_t thread;
+    pthread_create(&thread, NULL, use_handoff ? handoffService : mutexService, NULL);
+    double max_time = play(use_handoff, ticks, o_max_step);
+    running = false;
+    pthread_join(thread, NULL);
+    return max_time;
+}
+
+int main(int argc, char *argv[])
+{
+    int ticks = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dof") == 0 && ++i < argc) {
+            dof = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--ticks") == 0 && ++i < argc) {
+            ticks = atoi(argv[i]);
+        }
+    }
+    bool ret = true;
+    char buf[256];
+
+    ret &= checkResult(compare(200, 2000, 0), "commands picked up at the next tick are played as they are sent directly");
+    ret &= checkResult(compare(200, 2000, 30), "patterns published 30 ticks after they are started are played in time");
+
+    // steps of joint angles played directly
+    std::vector<double> q0(dof, 0.0);
+    double max_step = 0;
+    {
+        seqplay seq(dof, dt);
+        seq.setJointAngles(&q0[0]);
+        seq.openJointAnglesStream(4.0);
+        player p;
+        for (int i=0; i<ticks; i++){
+            command(seq);
+            p.play(&seq);
+        }
+        for (size_t i=dof; i<p.qs.size(); i++){
+            max_step = std::max(max_step, fabs(p.qs[i] - p.qs[i - dof]));
+        }
+    }
+    shared = new seqplay(dof, dt);
+    shared->setJointAngles(&q0[0]);
+    shared->openJointAnglesStream(4.0);
+    handoff = new seqplayHandoff(new seqplay(dof, dt), dof);
+    {
+        seqplayHandoff::Writer seq(*handoff);
+        seq->setJointAngles(&q0[0]);
+        seq->openJointAnglesStream(4.0);
+    }
+    // underruns may be caused by the service thread, after which the
+    // stream restarts from rest
+    max_step *= 1.5;
+
+    double step;
+    unsigned long sent = ncommands;
+    nchunks = 0;
+    double t_mutex = run(false, ticks, step);
+    sprintf(buf, "mutex   : worst-case %.3f[ms], %lu commands in %d ticks, max step = %.4f[rad]",
+            t_mutex*1e3, ncommands - sent, ticks, step);
+    ret &= checkResult(step < max_step, buf);
+
+    sent = ncommands;
+    nchunks = 0;
+    double t_handoff = run(true, ticks, step);
+    sprintf(buf, "handoff : worst-case %.3f[ms], %lu commands in %d ticks, max step = %.4f[rad]",
+            t_handoff*1e3, ncommands - sent, ticks, step);
+    ret &= checkResult(step < max_step && ncommands > sent, buf);
+
+    delete handoff;
+    delete shared;
+    return ret ? 0 : 1;
+}
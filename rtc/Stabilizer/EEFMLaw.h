@@ -0,0 +1,110 @@
+// -*- C++ -*-
+/*!
+ * @file  EEFMLaw.h
+ * @brief Feedback laws of the EEFM stabilizer
+ * @date  $Date$
+ *
+ * $Id$
+ */
+
+#ifndef EEFM_LAW_H
+#define EEFM_LAW_H
+
+#include <hrpUtil/Eigen3d.h>
+#include <cmath>
+
+// Default gains of EEFM, which are set by Stabilizer::onInitialize
+struct EEFMGains
+{
+    double k1, k2, k3, zmp_delay_time_const;
+    hrp::Vector3 rot_damping_gain, rot_time_const, pos_damping_gain, pos_time_const_support;
+    double rot_compensation_limit, pos_compensation_limit;
+    EEFMGains ()
+    {
+        double k_ratio = 0.9;
+        k1 = -1.41429*k_ratio;
+        k2 = -0.404082*k_ratio;
+        k3 = -0.18*k_ratio;
+        zmp_delay_time_const = 0.055;
+        rot_damping_gain = hrp::Vector3(20*5, 20*5, 1e5);
+        rot_time_const = hrp::Vector3(1.5, 1.5, 1.5);
+        rot_compensation_limit = 10.0 * M_PI / 180.0;
+        pos_damping_gain = hrp::Vector3(3500*10, 3500*10, 3500);
+        pos_time_const_support = hrp::Vector3(1.5, 1.5, 1.5);
+        pos_compensation_limit = 0.025;
+    };
+};
+
+// Inverse system of the delay of ZMP
+inline hrp::Vector3 calcZMPDelayInverse (const hrp::Vector3& ref_zmp, const hrp::Vector3& prev_ref_zmp,
+                                         const double delay_time_const, const double dt)
+{
+    return ref_zmp + delay_time_const * (ref_zmp - prev_ref_zmp) / dt;
+};
+
+// Kajita's feedback law
+//   Basically Equation (26) in the paper [1].
+//   dcog, dcogvel and dzmp are reference minus actual values.
+inline void calcEEFMFeedbackZMP (hrp::Vector3& new_refzmp, const hrp::Vector3& dcog, const hrp::Vector3& dcogvel, const hrp::Vector3& dzmp,
+                                 const double k1[2], const double k2[2], const double k3[2], const double gain, const hrp::Vector3& ref_zmp_aux)
+{
+    for (size_t i = 0; i < 2; i++) {
+        new_refzmp(i) += k1[i] * gain * dcog(i) + k2[i] * gain * dcogvel(i) + k3[i] * gain * dzmp(i) + ref_zmp_aux(i);
+    }
+};
+
+// Damping control functions
+//   Basically Equation (14) in the paper [1]
+inline double calcDampingControl (const double tau_d, const double tau, const double prev_d,
+                                  const double DD, const double TT, const double dt)
+{
+    return (1/DD * (tau_d - tau) - 1/TT * prev_d) * dt + prev_d;
+};
+
+inline hrp::Vector3 calcDampingControl (const hrp::Vector3& tau_d, const hrp::Vector3& tau, const hrp::Vector3& prev_d,
+                                        const hrp::Vector3& DD, const hrp::Vector3& TT, const double dt)
+{
+    return ((tau_d - tau).cwiseQuotient(DD) - prev_d.cwiseQuotient(TT)) * dt + prev_d;
+};
+
+inline double vlimit (double value, double llimit_value, double ulimit_value)
+{
+    if (value > ulimit_value) {
+        return ulimit_value;
+    } else if (value < llimit_value) {
+        return llimit_value;
+    }
+    return value;
+};
+
+inline hrp::Vector3 vlimit (const hrp::Vector3& value, double llimit_value, double ulimit_value)
+{
+    hrp::Vector3 ret;
+    for (size_t i = 0; i < 3; i++) {
+        if (value(i) > ulimit_value) {
+            ret(i) = ulimit_value;
+        } else if (value(i) < llimit_value) {
+            ret(i) = llimit_value;
+        } else {
+            ret(i) = value(i);
+        }
+    }
+    return ret;
+};
+
+inline hrp::Vector3 vlimit (const hrp::Vector3& value, const hrp::Vector3& limit_value)
+{
+    hrp::Vector3 ret;
+    for (size_t i = 0; i < 3; i++) {
+        if (value(i) > limit_value(i)) {
+            ret(i) = limit_value(i);
+        } else if (value(i) < -1 * limit_value(i)) {
+            ret(i) = -1 * limit_value(i);
+        } else {
+            ret(i) = value(i);
+        }
+    }
+    return ret;
+};
+
+#endif // EEFM_LAW_H
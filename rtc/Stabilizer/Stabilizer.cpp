@@ -75,13 +75,8 @@ Stabilizer::Stabilizer(RTC::Manager* manager)
     m_currentBaseRpyOut("currentBaseRpy", m_currentBaseRpy),
     m_allRefWrenchOut("allRefWrench", m_allRefWrench),
     m_allEECompOut("allEEComp", m_allEEComp),
-    m_debugDataOut("debugData", m_debugData),
-    control_mode(MODE_IDLE),
-    st_algorithm(OpenHRP::StabilizerService::TPCC),
-    emergency_check_mode(OpenHRP::StabilizerService::NO_CHECK),
-    szd(NULL),
+    m_debugDataOut("debugData", m_debugData)
     // </rtc-template>
-    m_debugLevel(0)
 {
   m_service0.stabilizer(this);
 }
@@ -149,6 +144,7 @@ RTC::ReturnCode_t Stabilizer::onInitialize()
   // </rtc-template>
   RTC::Properties& prop = getProperties();
   coil::stringTo(dt, prop["dt"].c_str());
+  instance_name = m_profile.instance_name;
 
   // parameters for corba
   RTC::Manager& rtcManager = RTC::Manager::instance();
@@ -234,36 +230,10 @@ RTC::ReturnCode_t Stabilizer::onInitialize()
               }
           }
       }
-      ikp.avoid_gain = 0.001;
-      ikp.reference_gain = 0.01;
-      stikp.push_back(ikp);
-      jpe_v.push_back(hrp::JointPathExPtr(new hrp::JointPathEx(m_robot, m_robot->link(ee_base), m_robot->link(ee_target), dt, false, std::string(m_profile.instance_name))));
-      // Fix for toe joint
-      if (ee_name.find("leg") != std::string::npos && jpe_v.back()->numJoints() == 7) { // leg and has 7dof joint (6dof leg +1dof toe)
-          std::vector<double> optw;
-          for (int j = 0; j < jpe_v.back()->numJoints(); j++ ) {
-              if ( j == jpe_v.back()->numJoints()-1 ) optw.push_back(0.0);
-              else optw.push_back(1.0);
-          }
-          jpe_v.back()->setOptionalWeightVector(optw);
-      }
-      target_ee_p.push_back(hrp::Vector3::Zero());
-      target_ee_R.push_back(hrp::Matrix33::Identity());
-      act_ee_R.push_back(hrp::Matrix33::Identity());
-      target_ee_diff_p.push_back(hrp::Vector3::Zero());
-      target_ee_diff_r.push_back(hrp::Vector3::Zero());
-      prev_target_ee_diff_r.push_back(hrp::Vector3::Zero());
-      d_rpy_swing.push_back(hrp::Vector3::Zero());
-      d_pos_swing.push_back(hrp::Vector3::Zero());
-      target_ee_diff_p_filter.push_back(boost::shared_ptr<FirstOrderLowPassFilter<hrp::Vector3> >(new FirstOrderLowPassFilter<hrp::Vector3>(50.0, dt, hrp::Vector3::Zero()))); // [Hz]
-      contact_states_index_map.insert(std::pair<std::string, size_t>(ee_name, i));
-      is_ik_enable.push_back( (ee_name.find("leg") != std::string::npos ? true : false) ); // Hands ik => disabled, feet ik => enabled, by default
-      is_feedback_control_enable.push_back( (ee_name.find("leg") != std::string::npos ? true : false) ); // Hands feedback control => disabled, feet feedback control => enabled, by default
-      is_zmp_calc_enable.push_back( (ee_name.find("leg") != std::string::npos ? true : false) ); // To zmp calculation, hands are disabled and feet are enabled, by default
+      addEndEffector(ikp, ee_base);
       std::cerr << "[" << m_profile.instance_name << "] End Effector [" << ee_name << "]" << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   target = " << m_robot->link(ikp.target_name)->name << ", base = " << ee_base << ", sensor_name = " << ikp.sensor_name << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   offset_pos = " << ikp.localp.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[m]" << std::endl;
-      prev_act_force_z.push_back(0.0);
     }
     m_contactStates.data.length(num);
   }
@@ -278,108 +248,19 @@ RTC::ReturnCode_t Stabilizer::onInitialize()
   }
 
 
-  // parameters for TPCC
-  act_zmp = hrp::Vector3::Zero();
-  for (int i = 0; i < 2; i++) {
-    k_tpcc_p[i] = 0.2;
-    k_tpcc_x[i] = 4.0;
-    k_brot_p[i] = 0.1;
-    k_brot_tc[i] = 1.5;
-  }
-  // parameters for EEFM
-  double k_ratio = 0.9;
-  for (int i = 0; i < 2; i++) {
-    eefm_k1[i] = -1.41429*k_ratio;
-    eefm_k2[i] = -0.404082*k_ratio;
-    eefm_k3[i] = -0.18*k_ratio;
-    eefm_body_attitude_control_gain[i] = 0.5;
-    eefm_body_attitude_control_time_const[i] = 1e5;
-  }
-#define deg2rad(x) ((x) * M_PI / 180.0)
-  for (size_t i = 0; i < stikp.size(); i++) {
-      STIKParam& ikp = stikp[i];
-      ikp.eefm_rot_damping_gain = hrp::Vector3(20*5, 20*5, 1e5);
-      ikp.eefm_rot_time_const = hrp::Vector3(1.5, 1.5, 1.5);
-      ikp.eefm_rot_compensation_limit = deg2rad(10.0);
-      ikp.eefm_swing_rot_spring_gain = hrp::Vector3(0.0, 0.0, 0.0);
-      ikp.eefm_swing_rot_time_const = hrp::Vector3(1.5, 1.5, 1.5);
-      ikp.eefm_pos_damping_gain = hrp::Vector3(3500*10, 3500*10, 3500);
-      ikp.eefm_pos_time_const_support = hrp::Vector3(1.5, 1.5, 1.5);
-      ikp.eefm_pos_compensation_limit = 0.025;
-      ikp.eefm_swing_pos_spring_gain = hrp::Vector3(0.0, 0.0, 0.0);
-      ikp.eefm_swing_pos_time_const = hrp::Vector3(1.5, 1.5, 1.5);
-      ikp.eefm_ee_moment_limit = hrp::Vector3(1e4, 1e4, 1e4); // Default limit [Nm] is too large. Same as no limit.
-  }
-  eefm_pos_time_const_swing = 0.08;
-  eefm_pos_transition_time = 0.01;
-  eefm_pos_margin_time = 0.02;
-  eefm_zmp_delay_time_const[0] = eefm_zmp_delay_time_const[1] = 0.055;
-  //eefm_leg_inside_margin = 0.065; // [m]
-  //eefm_leg_front_margin = 0.05;
-  //eefm_leg_rear_margin = 0.05;
-  //fm_wrench_alpha_blending = 1.0; // fz_alpha
-  eefm_gravitational_acceleration = 9.80665; // [m/s^2]
-  eefm_ee_pos_error_p_gain = 0;
-  eefm_ee_rot_error_p_gain = 0;
-  cop_check_margin = 20.0*1e-3; // [m]
-  cp_check_margin.resize(4, 30*1e-3); // [m]
-  contact_decision_threshold = 50; // [N]
-  eefm_use_force_difference_control = true;
-  initial_cp_too_large_error = true;
-  is_walking = false;
-  is_estop_while_walking = false;
-  sbp_cog_offset = hrp::Vector3(0.0, 0.0, 0.0);
-
-  // parameters for RUNST
-  double ke = 0, tc = 0;
-  for (int i = 0; i < 2; i++) {
-    m_tau_x[i].setup(ke, tc, dt);
-    m_tau_x[i].setErrorPrefix(std::string(m_profile.instance_name));
-    m_tau_y[i].setup(ke, tc, dt);
-    m_tau_y[i].setErrorPrefix(std::string(m_profile.instance_name));
-    m_f_z.setup(ke, tc, dt);
-    m_f_z.setErrorPrefix(std::string(m_profile.instance_name));
-  }
-  pangx_ref = pangy_ref = pangx = pangy = 0;
-  rdx = rdy = rx = ry = 0;
-  pdr = hrp::Vector3::Zero();
-
-  // Check is legged robot or not
-  is_legged_robot = false;
-  for (size_t i = 0; i < stikp.size(); i++) {
-      if (stikp[i].ee_name.find("leg") == std::string::npos) continue;
-      hrp::Sensor* sen= m_robot->sensor<hrp::ForceSensor>(stikp[i].sensor_name);
-      if ( sen != NULL ) is_legged_robot = true;
-  }
-  is_emergency = false;
-  reset_emergency_flag = false;
+  initParameters();
 
   m_qCurrent.data.length(m_robot->numJoints());
   m_qRef.data.length(m_robot->numJoints());
   m_tau.data.length(m_robot->numJoints());
-  transition_joint_q.resize(m_robot->numJoints());
-  qorg.resize(m_robot->numJoints());
-  qrefv.resize(m_robot->numJoints());
-  transition_count = 0;
-  loop = 0;
-  total_mass = m_robot->totalMass();
-  ref_zmp_aux = hrp::Vector3::Zero();
   m_actContactStates.data.length(m_contactStates.data.length());
   for (size_t i = 0; i < m_contactStates.data.length(); i++) {
-    contact_states.push_back(true);
-    prev_contact_states.push_back(true);
     m_actContactStates.data[i] = false;
   }
   m_COPInfo.data.length(m_contactStates.data.length()*3); // nx, ny, fz for each end-effectors
   for (size_t i = 0; i < m_COPInfo.data.length(); i++) {
       m_COPInfo.data[i] = 0.0;
   }
-  transition_time = 2.0;
-  foot_origin_offset[0] = hrp::Vector3::Zero();
-  foot_origin_offset[1] = hrp::Vector3::Zero();
-
-  //
-  act_cogvel_filter = boost::shared_ptr<FirstOrderLowPassFilter<hrp::Vector3> >(new FirstOrderLowPassFilter<hrp::Vector3>(4.0, dt, hrp::Vector3::Zero())); // [Hz]
 
   // for debug output
   m_originRefZmp.data.x = m_originRefZmp.data.y = m_originRefZmp.data.z = 0.0;
@@ -393,18 +274,6 @@ RTC::ReturnCode_t Stabilizer::onInitialize()
   m_allEEComp.data.length(stikp.size() * 6); // 6 is pos+rot dim
   m_debugData.data.length(1); m_debugData.data[0] = 0.0;
 
-  //
-  szd = new SimpleZMPDistributor(dt);
-  std::vector<std::vector<Eigen::Vector2d> > support_polygon_vec;
-  for (size_t i = 0; i < stikp.size(); i++) {
-      support_polygon_vec.push_back(std::vector<Eigen::Vector2d>(1,Eigen::Vector2d::Zero()));
-  }
-  szd->set_vertices(support_polygon_vec);
-
-  rel_ee_pos.reserve(stikp.size());
-  rel_ee_rot.reserve(stikp.size());
-  rel_ee_name.reserve(stikp.size());
-
   return RTC::RTC_OK;
 }
 
@@ -450,30 +319,40 @@ RTC::ReturnCode_t Stabilizer::onDeactivated(RTC::UniqueId ec_id)
   return RTC::RTC_OK;
 }
 
-#define DEBUGP ((m_debugLevel==1 && loop%200==0) || m_debugLevel > 1 )
 #define DEBUGP2 (loop%10==0)
 RTC::ReturnCode_t Stabilizer::onExecute(RTC::UniqueId ec_id)
 {
-  loop++;
   // std::cout << m_profile.instance_name<< ": onExecute(" << ec_id << ")" << std::endl;
 
   if (m_qRefIn.isNew()) {
     m_qRefIn.read();
   }
+  // m_qRef is also the buffer of the q OutPort, so the last output is
+  // used as the reference until a new one arrives
+  if ( m_qRef.data.length() == input_q_ref.size() ) {
+    for ( size_t i = 0; i < m_qRef.data.length(); i++ ) input_q_ref[i] = m_qRef.data[i];
+  }
   if (m_qCurrentIn.isNew()) {
     m_qCurrentIn.read();
+    if ( m_qCurrent.data.length() == input_q_current.size() ) {
+      for ( size_t i = 0; i < m_qCurrent.data.length(); i++ ) input_q_current[i] = m_qCurrent.data[i];
+    }
   }
   if (m_rpyIn.isNew()) {
     m_rpyIn.read();
+    input_rpy = hrp::Vector3(m_rpy.data.r, m_rpy.data.p, m_rpy.data.y);
   }
   if (m_zmpRefIn.isNew()) {
     m_zmpRefIn.read();
+    input_zmp_ref = hrp::Vector3(m_zmpRef.data.x, m_zmpRef.data.y, m_zmpRef.data.z);
   }
   if (m_basePosIn.isNew()){
     m_basePosIn.read();
+    input_base_pos = hrp::Vector3(m_basePos.data.x, m_basePos.data.y, m_basePos.data.z);
   }
   if (m_baseRpyIn.isNew()){
     m_baseRpyIn.read();
+    input_base_rpy = hrp::Vector3(m_baseRpy.data.r, m_baseRpy.data.p, m_baseRpy.data.y);
   }
   if (m_contactStatesIn.isNew()){
     m_contactStatesIn.read();
@@ -483,18 +362,29 @@ RTC::ReturnCode_t Stabilizer::onExecute(RTC::UniqueId ec_id)
   }
   if (m_controlSwingSupportTimeIn.isNew()){
     m_controlSwingSupportTimeIn.read();
+    for (size_t i = 0; i < m_controlSwingSupportTime.data.length() && i < input_swing_support_time.size(); i++) {
+      input_swing_support_time[i] = m_controlSwingSupportTime.data[i];
+    }
   }
+  // wrenches are indexed by end effectors as well as by force sensors
   for (size_t i = 0; i < m_wrenchesIn.size(); ++i) {
     if ( m_wrenchesIn[i]->isNew() ) {
       m_wrenchesIn[i]->read();
+      if ( i < input_wrenches.size() ) {
+        for (size_t j = 0; j < 6; j++) input_wrenches[i](j) = m_wrenches[i].data[j];
+      }
     }
   }
   for (size_t i = 0; i < m_ref_wrenchesIn.size(); ++i) {
     if ( m_ref_wrenchesIn[i]->isNew() ) {
       m_ref_wrenchesIn[i]->read();
+      if ( i < input_ref_wrenches.size() ) {
+        for (size_t j = 0; j < 6; j++) input_ref_wrenches[i](j) = m_ref_wrenches[i].data[j];
+      }
     }
   }
   Guard guard(m_mutex);
+  if (m_stp_cell.update()) commitParameter(m_stp_cell.value());
   for (size_t i = 0; i < m_limbCOPOffsetIn.size(); ++i) {
     if ( m_limbCOPOffsetIn[i]->isNew() ) {
       m_limbCOPOffsetIn[i]->read();
@@ -519,35 +409,7 @@ RTC::ReturnCode_t Stabilizer::onExecute(RTC::UniqueId ec_id)
     sbp_cog_offset(2) = m_sbpCogOffset.data.z;
   }
 
-  if (is_legged_robot) {
-    getCurrentParameters();
-    getTargetParameters();
-    getActualParameters();
-    calcStateForEmergencySignal();
-    switch (control_mode) {
-    case MODE_IDLE:
-      break;
-    case MODE_AIR:
-      if ( transition_count == 0 && on_ground ) sync_2_st();
-      break;
-    case MODE_ST:
-      if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
-        calcEEForceMomentControl();
-      } else {
-        calcTPCC();
-      }
-      if ( transition_count == 0 && !on_ground ) control_mode = MODE_SYNC_TO_AIR;
-      break;
-    case MODE_SYNC_TO_IDLE:
-      sync_2_idle();
-      control_mode = MODE_IDLE;
-      break;
-    case MODE_SYNC_TO_AIR:
-      sync_2_idle();
-      control_mode = MODE_AIR;
-      break;
-    }
-  }
+  execute();
   if ( m_robot->numJoints() == m_qRef.data.length() ) {
     if (is_legged_robot) {
       for ( int i = 0; i < m_robot->numJoints(); i++ ){
@@ -569,8 +431,14 @@ RTC::ReturnCode_t Stabilizer::onExecute(RTC::UniqueId ec_id)
       m_actCP.data.z = rel_act_cp(2);
       m_actCP.tm = m_qRef.tm;
       m_actCPOut.write();
+      for (size_t i = 0; i < m_actContactStates.data.length(); i++) {
+        m_actContactStates.data[i] = act_contact_states[i];
+      }
       m_actContactStates.tm = m_qRef.tm;
       m_actContactStatesOut.write();
+      for (size_t i = 0; i < m_COPInfo.data.length(); i++) {
+        m_COPInfo.data[i] = cop_info[i];
+      }
       m_COPInfo.tm = m_qRef.tm;
       m_COPInfoOut.write();
       //m_tauOut.write();
@@ -641,790 +509,6 @@ RTC::ReturnCode_t Stabilizer::onExecute(RTC::UniqueId ec_id)
   return RTC::RTC_OK;
 }
 
-void Stabilizer::getCurrentParameters ()
-{
-  current_root_p = m_robot->rootLink()->p;
-  current_root_R = m_robot->rootLink()->R;
-  for ( int i = 0; i < m_robot->numJoints(); i++ ){
-    qorg[i] = m_robot->joint(i)->q;
-  }
-}
-
-void Stabilizer::calcFootOriginCoords (hrp::Vector3& foot_origin_pos, hrp::Matrix33& foot_origin_rot)
-{
-  rats::coordinates leg_c[2], tmpc;
-  hrp::Vector3 ez = hrp::Vector3::UnitZ();
-  hrp::Vector3 ex = hrp::Vector3::UnitX();
-  for (size_t i = 0; i < stikp.size(); i++) {
-    if (stikp[i].ee_name.find("leg") == std::string::npos) continue;
-    hrp::Link* target = m_robot->sensor<hrp::ForceSensor>(stikp[i].sensor_name)->link;
-    leg_c[i].pos = target->p + target->R * foot_origin_offset[i];
-    hrp::Vector3 xv1(target->R * ex);
-    xv1(2)=0.0;
-    xv1.normalize();
-    hrp::Vector3 yv1(ez.cross(xv1));
-    leg_c[i].rot(0,0) = xv1(0); leg_c[i].rot(1,0) = xv1(1); leg_c[i].rot(2,0) = xv1(2);
-    leg_c[i].rot(0,1) = yv1(0); leg_c[i].rot(1,1) = yv1(1); leg_c[i].rot(2,1) = yv1(2);
-    leg_c[i].rot(0,2) = ez(0); leg_c[i].rot(1,2) = ez(1); leg_c[i].rot(2,2) = ez(2);
-  }
-  if (contact_states[contact_states_index_map["rleg"]] &&
-      contact_states[contact_states_index_map["lleg"]]) {
-    rats::mid_coords(tmpc, 0.5, leg_c[0], leg_c[1]);
-    foot_origin_pos = tmpc.pos;
-    foot_origin_rot = tmpc.rot;
-  } else if (contact_states[contact_states_index_map["rleg"]]) {
-    foot_origin_pos = leg_c[contact_states_index_map["rleg"]].pos;
-    foot_origin_rot = leg_c[contact_states_index_map["rleg"]].rot;
-  } else {
-    foot_origin_pos = leg_c[contact_states_index_map["lleg"]].pos;
-    foot_origin_rot = leg_c[contact_states_index_map["lleg"]].rot;
-  }
-}
-
-void Stabilizer::getActualParameters ()
-{
-  // Actual world frame =>
-  hrp::Vector3 foot_origin_pos;
-  hrp::Matrix33 foot_origin_rot;
-  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
-    // update by current joint angles
-    for ( int i = 0; i < m_robot->numJoints(); i++ ){
-      m_robot->joint(i)->q = m_qCurrent.data[i];
-    }
-    // tempolary
-    m_robot->rootLink()->p = hrp::Vector3::Zero();
-    m_robot->calcForwardKinematics();
-    hrp::Sensor* sen = m_robot->sensor<hrp::RateGyroSensor>("gyrometer");
-    hrp::Matrix33 senR = sen->link->R * sen->localR;
-    hrp::Matrix33 act_Rs(hrp::rotFromRpy(m_rpy.data.r, m_rpy.data.p, m_rpy.data.y));
-    //hrp::Matrix33 act_Rs(hrp::rotFromRpy(m_rpy.data.r*0.5, m_rpy.data.p*0.5, m_rpy.data.y*0.5));
-    m_robot->rootLink()->R = act_Rs * (senR.transpose() * m_robot->rootLink()->R);
-    m_robot->calcForwardKinematics();
-    act_base_rpy = hrp::rpyFromRot(m_robot->rootLink()->R);
-    calcFootOriginCoords (foot_origin_pos, foot_origin_rot);
-  } else {
-    for ( int i = 0; i < m_robot->numJoints(); i++ ) {
-      m_robot->joint(i)->q = qorg[i];
-    }
-    m_robot->rootLink()->p = current_root_p;
-    m_robot->rootLink()->R = current_root_R;
-    m_robot->calcForwardKinematics();
-  }
-  // cog
-  act_cog = m_robot->calcCM();
-  // zmp
-  on_ground = false;
-  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
-    on_ground = calcZMP(act_zmp, zmp_origin_off+foot_origin_pos(2));
-  } else {
-    on_ground = calcZMP(act_zmp, ref_zmp(2));
-  }
-  // set actual contact states
-  for (size_t i = 0; i < stikp.size(); i++) {
-      std::string limb_name = stikp[i].ee_name;
-      m_actContactStates.data[contact_states_index_map[limb_name]] = isContact(contact_states_index_map[limb_name]);
-  }
-  // <= Actual world frame
-
-  // convert absolute (in st) -> root-link relative
-  rel_act_zmp = m_robot->rootLink()->R.transpose() * (act_zmp - m_robot->rootLink()->p);
-  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
-    // Actual foot_origin frame =>
-    act_zmp = foot_origin_rot.transpose() * (act_zmp - foot_origin_pos);
-    act_cog = foot_origin_rot.transpose() * (act_cog - foot_origin_pos);
-    //act_cogvel = foot_origin_rot.transpose() * act_cogvel;
-    if (contact_states != prev_contact_states) {
-      act_cogvel = (foot_origin_rot.transpose() * prev_act_foot_origin_rot) * act_cogvel;
-    } else {
-      act_cogvel = (act_cog - prev_act_cog)/dt;
-    }
-    prev_act_foot_origin_rot = foot_origin_rot;
-    act_cogvel = act_cogvel_filter->passFilter(act_cogvel);
-    prev_act_cog = act_cog;
-    //act_root_rot = m_robot->rootLink()->R;
-    for (size_t i = 0; i < stikp.size(); i++) {
-      hrp::Link* target = m_robot->link(stikp[i].target_name);
-      //hrp::Vector3 act_ee_p = target->p + target->R * stikp[i].localCOPPos;
-      hrp::Vector3 act_ee_p = target->p + target->R * stikp[i].localp;
-      //target_ee_R[i] = target->R * stikp[i].localR;
-      target_ee_diff_p[i] -= foot_origin_rot.transpose() * (act_ee_p - foot_origin_pos);
-      act_ee_R[i] = foot_origin_rot.transpose() * (target->R * stikp[i].localR);
-    }
-    // capture point
-    act_cp = act_cog + act_cogvel / std::sqrt(eefm_gravitational_acceleration / (act_cog - act_zmp)(2));
-    rel_act_cp = hrp::Vector3(act_cp(0), act_cp(1), act_zmp(2));
-    rel_act_cp = m_robot->rootLink()->R.transpose() * ((foot_origin_pos + foot_origin_rot * rel_act_cp) - m_robot->rootLink()->p);
-    // <= Actual foot_origin frame
-
-    // Actual world frame =>
-    // new ZMP calculation
-    // Kajita's feedback law
-    //   Basically Equation (26) in the paper [1].
-    hrp::Vector3 dcog=foot_origin_rot * (ref_cog - act_cog);
-    hrp::Vector3 dcogvel=foot_origin_rot * (ref_cogvel - act_cogvel);
-    hrp::Vector3 dzmp=foot_origin_rot * (ref_zmp - act_zmp);
-    new_refzmp = foot_origin_rot * new_refzmp + foot_origin_pos;
-    for (size_t i = 0; i < 2; i++) {
-      new_refzmp(i) += eefm_k1[i] * transition_smooth_gain * dcog(i) + eefm_k2[i] * transition_smooth_gain * dcogvel(i) + eefm_k3[i] * transition_smooth_gain * dzmp(i) + ref_zmp_aux(i);
-    }
-    if (DEBUGP) {
-      // All state variables are foot_origin coords relative
-      std::cerr << "[" << m_profile.instance_name << "] state values" << std::endl;
-      std::cerr << "[" << m_profile.instance_name << "]   "
-                << "ref_cog    = " << hrp::Vector3(ref_cog*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
-                << ", act_cog    = " << hrp::Vector3(act_cog*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
-      std::cerr << "[" << m_profile.instance_name << "]   "
-                << "ref_cogvel = " << hrp::Vector3(ref_cogvel*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
-                << ", act_cogvel = " << hrp::Vector3(act_cogvel*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm/s]" << std::endl;
-      std::cerr << "[" << m_profile.instance_name << "]   "
-                << "ref_zmp    = " << hrp::Vector3(ref_zmp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
-                << ", act_zmp    = " << hrp::Vector3(act_zmp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
-      hrp::Vector3 tmpnew_refzmp;
-      tmpnew_refzmp = foot_origin_rot.transpose()*(new_refzmp-foot_origin_pos); // Actual world -> foot origin relative
-      std::cerr << "[" << m_profile.instance_name << "]   "
-                << "new_zmp    = " << hrp::Vector3(tmpnew_refzmp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
-                << ", dif_zmp    = " << hrp::Vector3((tmpnew_refzmp-ref_zmp)*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
-    }
-
-    std::vector<std::string> ee_name;
-    // distribute new ZMP into foot force & moment
-    std::vector<hrp::Vector3> ref_force, ref_moment;
-    std::vector<double> limb_gains;
-    if (control_mode == MODE_ST) {
-      std::vector<hrp::Vector3> ee_pos, cop_pos;
-      std::vector<hrp::Matrix33> ee_rot;
-      for (size_t i = 0; i < stikp.size(); i++) {
-          STIKParam& ikp = stikp[i];
-          if (!is_feedback_control_enable[i]) continue;
-          hrp::Link* target = m_robot->link(ikp.target_name);
-          ee_pos.push_back(target->p + target->R * ikp.localp);
-          cop_pos.push_back(target->p + target->R * ikp.localCOPPos);
-          ee_rot.push_back(target->R * ikp.localR);
-          ee_name.push_back(ikp.ee_name);
-          limb_gains.push_back(ikp.swing_support_gain);
-          ref_force.push_back(hrp::Vector3(m_ref_wrenches[i].data[0], m_ref_wrenches[i].data[1], m_ref_wrenches[i].data[2]));
-          ref_moment.push_back(hrp::Vector3(m_ref_wrenches[i].data[3], m_ref_wrenches[i].data[4], m_ref_wrenches[i].data[5]));
-          rel_ee_pos.push_back(foot_origin_rot.transpose() * (ee_pos.back() - foot_origin_pos));
-          rel_ee_rot.push_back(foot_origin_rot.transpose() * ee_rot.back());
-          rel_ee_name.push_back(ee_name.back());
-      }
-      // All state variables are foot_origin coords relative
-      if (DEBUGP) {
-          std::cerr << "[" << m_profile.instance_name << "] ee values" << std::endl;
-          hrp::Vector3 tmpp;
-          for (size_t i = 0; i < ee_name.size(); i++) {
-              tmpp = foot_origin_rot.transpose()*(ee_pos[i]-foot_origin_pos);
-              std::cerr << "[" << m_profile.instance_name << "]   "
-                        << "ee_pos (" << ee_name[i] << ")    = " << hrp::Vector3(tmpp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"));
-              tmpp = foot_origin_rot.transpose()*(cop_pos[i]-foot_origin_pos);
-              std::cerr << ", cop_pos (" << ee_name[i] << ")    = " << hrp::Vector3(tmpp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
-          }
-      }
-
-      // Distribute ZMP into each EE force/moment at each COP
-      if (st_algorithm == OpenHRP::StabilizerService::EEFM) {
-          // Modified version of distribution in Equation (4)-(6) and (10)-(13) in the paper [1].
-          szd->distributeZMPToForceMoments(ref_force, ref_moment,
-                                           ee_pos, cop_pos, ee_rot, ee_name, limb_gains,
-                                           new_refzmp, hrp::Vector3(foot_origin_rot * ref_zmp + foot_origin_pos),
-                                           eefm_gravitational_acceleration * total_mass, dt,
-                                           DEBUGP, std::string(m_profile.instance_name));
-      } else if (st_algorithm == OpenHRP::StabilizerService::EEFMQP) {
-          szd->distributeZMPToForceMomentsQP(ref_force, ref_moment,
-                                             ee_pos, cop_pos, ee_rot, ee_name, limb_gains,
-                                             new_refzmp, hrp::Vector3(foot_origin_rot * ref_zmp + foot_origin_pos),
-                                             eefm_gravitational_acceleration * total_mass, dt,
-                                             DEBUGP, std::string(m_profile.instance_name),
-                                             (st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP));
-      } else if (st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
-          szd->distributeZMPToForceMomentsPseudoInverse(ref_force, ref_moment,
-                                             ee_pos, cop_pos, ee_rot, ee_name, limb_gains,
-                                             new_refzmp, hrp::Vector3(foot_origin_rot * ref_zmp + foot_origin_pos),
-                                             eefm_gravitational_acceleration * total_mass, dt,
-                                             DEBUGP, std::string(m_profile.instance_name),
-                                             (st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP));
-      }
-      // for debug output
-      new_refzmp = foot_origin_rot.transpose() * (new_refzmp - foot_origin_pos);
-    }
-
-    // foor modif
-    if (control_mode == MODE_ST) {
-      hrp::Vector3 f_diff(hrp::Vector3::Zero());
-      // moment control
-      for (size_t i = 0; i < stikp.size(); i++) {
-        STIKParam& ikp = stikp[i];
-        if (!is_feedback_control_enable[i]) continue;
-        hrp::Sensor* sensor = m_robot->sensor<hrp::ForceSensor>(ikp.sensor_name);
-        hrp::Link* target = m_robot->link(ikp.target_name);
-        // Convert moment at COP => moment at ee
-        size_t idx = contact_states_index_map[ikp.ee_name];
-        ikp.ref_moment = ref_moment[idx] + ((target->R * ikp.localCOPPos + target->p) - (target->R * ikp.localp + target->p)).cross(ref_force[idx]);
-        ikp.ref_force = ref_force[idx];
-        // Actual world frame =>
-        hrp::Vector3 sensor_force = (sensor->link->R * sensor->localR) * hrp::Vector3(m_wrenches[i].data[0], m_wrenches[i].data[1], m_wrenches[i].data[2]);
-        hrp::Vector3 sensor_moment = (sensor->link->R * sensor->localR) * hrp::Vector3(m_wrenches[i].data[3], m_wrenches[i].data[4], m_wrenches[i].data[5]);
-        //hrp::Vector3 ee_moment = ((sensor->link->R * sensor->localPos + sensor->link->p) - (target->R * ikp.localCOPPos + target->p)).cross(sensor_force) + sensor_moment;
-        hrp::Vector3 ee_moment = ((sensor->link->R * sensor->localPos + sensor->link->p) - (target->R * ikp.localp + target->p)).cross(sensor_force) + sensor_moment;
-        // <= Actual world frame
-        // Convert force & moment as foot origin coords relative
-        ikp.ref_moment = foot_origin_rot.transpose() * ikp.ref_moment;
-        ikp.ref_force = foot_origin_rot.transpose() * ikp.ref_force;
-        sensor_force = foot_origin_rot.transpose() * sensor_force;
-        ee_moment = foot_origin_rot.transpose() * ee_moment;
-        if ( i == 0 ) f_diff += -1*sensor_force;
-        else f_diff += sensor_force;
-        // Moment limitation
-        hrp::Matrix33 ee_R(target->R * ikp.localR);
-        ikp.ref_moment = ee_R * vlimit((ee_R.transpose() * ikp.ref_moment), ikp.eefm_ee_moment_limit);
-        // calcDampingControl
-        // d_foot_rpy and d_foot_pos is (actual) foot origin coords relative value because these use foot origin coords relative force & moment
-        { // Rot
-          //   Basically Equation (16) and (17) in the paper [1]
-            hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * ikp.eefm_rot_damping_gain * 10 + transition_smooth_gain * ikp.eefm_rot_damping_gain;
-            ikp.d_foot_rpy = calcDampingControl(ikp.ref_moment, ee_moment, ikp.d_foot_rpy, tmp_damping_gain, ikp.eefm_rot_time_const);
-            ikp.d_foot_rpy = vlimit(ikp.d_foot_rpy, -1 * ikp.eefm_rot_compensation_limit, ikp.eefm_rot_compensation_limit);
-        }
-        if (!eefm_use_force_difference_control) { // Pos
-            hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * ikp.eefm_pos_damping_gain * 10 + transition_smooth_gain * ikp.eefm_pos_damping_gain;
-            ikp.d_foot_pos = calcDampingControl(ikp.ref_force, sensor_force, ikp.d_foot_pos, tmp_damping_gain, ikp.eefm_pos_time_const_support);
-            ikp.d_foot_pos = vlimit(ikp.d_foot_pos, -1 * ikp.eefm_pos_compensation_limit, ikp.eefm_pos_compensation_limit);
-        }
-        // Actual ee frame =>
-        ikp.ee_d_foot_rpy = ee_R.transpose() * (foot_origin_rot * ikp.d_foot_rpy);
-      }
-
-      if (eefm_use_force_difference_control) {
-          // fxyz control
-          // foot force difference control version
-          //   Basically Equation (18) in the paper [1]
-          hrp::Vector3 ref_f_diff = (stikp[1].ref_force-stikp[0].ref_force);
-          if ( (contact_states[contact_states_index_map["rleg"]] && contact_states[contact_states_index_map["lleg"]]) // Reference : double support phase
-               || (isContact(0) && isContact(1)) ) { // Actual : double support phase
-              // Temporarily use first pos damping gain (stikp[0])
-              hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * stikp[0].eefm_pos_damping_gain * 10 + transition_smooth_gain * stikp[0].eefm_pos_damping_gain;
-              pos_ctrl = calcDampingControl (ref_f_diff, f_diff, pos_ctrl,
-                                             tmp_damping_gain, stikp[0].eefm_pos_time_const_support);
-          } else {
-              double remain_swing_time;
-              if ( !contact_states[contact_states_index_map["rleg"]] ) { // rleg swing
-                  remain_swing_time = m_controlSwingSupportTime.data[contact_states_index_map["rleg"]];
-              } else { // lleg swing
-                  remain_swing_time = m_controlSwingSupportTime.data[contact_states_index_map["lleg"]];
-              }
-              // std::cerr << "st " << remain_swing_time << " rleg " << contact_states[contact_states_index_map["rleg"]] << " lleg " << contact_states[contact_states_index_map["lleg"]] << std::endl;
-              double tmp_ratio = std::max(0.0, std::min(1.0, 1.0 - (remain_swing_time-eefm_pos_margin_time)/eefm_pos_transition_time)); // 0=>1
-              // Temporarily use first pos damping gain (stikp[0])
-              hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * stikp[0].eefm_pos_damping_gain * 10 + transition_smooth_gain * stikp[0].eefm_pos_damping_gain;
-              hrp::Vector3 tmp_time_const = (1-tmp_ratio)*eefm_pos_time_const_swing*hrp::Vector3::Ones()+tmp_ratio*stikp[0].eefm_pos_time_const_support;
-              pos_ctrl = calcDampingControl (tmp_ratio * ref_f_diff, tmp_ratio * f_diff, pos_ctrl, tmp_damping_gain, tmp_time_const);
-          }
-          // zctrl = vlimit(zctrl, -0.02, 0.02);
-          // Temporarily use first pos compensation limit (stikp[0])
-          pos_ctrl = vlimit(pos_ctrl, -1 * stikp[0].eefm_pos_compensation_limit * 2, stikp[0].eefm_pos_compensation_limit * 2);
-          // Divide pos_ctrl into rfoot and lfoot
-          stikp[0].d_foot_pos = -0.5 * pos_ctrl;
-          stikp[1].d_foot_pos = 0.5 * pos_ctrl;
-      }
-      if (DEBUGP) {
-        std::cerr << "[" << m_profile.instance_name << "] Control values" << std::endl;
-        if (eefm_use_force_difference_control) {
-            std::cerr << "[" << m_profile.instance_name << "]   "
-                      << "pos_ctrl    = [" << pos_ctrl(0)*1e3 << " " << pos_ctrl(1)*1e3 << " "<< pos_ctrl(2)*1e3 << "] [mm]" << std::endl;
-        }
-        for (size_t i = 0; i < ee_name.size(); i++) {
-            std::cerr << "[" << m_profile.instance_name << "]   "
-                      << "d_foot_pos (" << ee_name[i] << ")  = [" << stikp[i].d_foot_pos(0)*1e3 << " " << stikp[i].d_foot_pos(1)*1e3 << " " << stikp[i].d_foot_pos(2)*1e3 << "] [mm]" << std::endl;
-            std::cerr << "[" << m_profile.instance_name << "]   "
-                      << "d_foot_rpy (" << ee_name[i] << ")  = [" << stikp[i].d_foot_rpy(0)*180.0/M_PI << " " << stikp[i].d_foot_rpy(1)*180.0/M_PI << " " << stikp[i].d_foot_rpy(2)*180.0/M_PI << "] [deg]" << std::endl;
-        }
-      }
-      // foot force independent damping control
-      // for (size_t i = 0; i < 2; i++) {
-      //   f_zctrl[i] = calcDampingControl (ref_force[i](2),
-      //                                    fz[i], f_zctrl[i], eefm_pos_damping_gain, eefm_pos_time_const);
-      //   f_zctrl[i] = vlimit(f_zctrl[i], -0.05, 0.05);
-      // }
-    }
-  } // st_algorithm == OpenHRP::StabilizerService::EEFM
-
-  for ( int i = 0; i < m_robot->numJoints(); i++ ){
-    m_robot->joint(i)->q = qrefv[i];
-  }
-  m_robot->rootLink()->p = target_root_p;
-  m_robot->rootLink()->R = target_root_R;
-  if ( !(control_mode == MODE_IDLE || control_mode == MODE_AIR) ) {
-    for (size_t i = 0; i < jpe_v.size(); i++) {
-      if (is_ik_enable[i]) {
-        for ( int j = 0; j < jpe_v[i]->numJoints(); j++ ){
-          int idx = jpe_v[i]->joint(j)->jointId;
-          m_robot->joint(idx)->q = qorg[idx];
-        }
-      }
-    }
-    m_robot->rootLink()->p(0) = current_root_p(0);
-    m_robot->rootLink()->p(1) = current_root_p(1);
-    m_robot->rootLink()->R = current_root_R;
-    m_robot->calcForwardKinematics();
-  }
-  copy (contact_states.begin(), contact_states.end(), prev_contact_states.begin());
-}
-
-void Stabilizer::getTargetParameters ()
-{
-  // Reference world frame =>
-  // update internal robot model
-  if ( transition_count == 0 ) {
-    transition_smooth_gain = 1.0;
-  } else {
-    double max_transition_count = transition_time / dt;
-    transition_smooth_gain = 1/(1+exp(-9.19*(((max_transition_count - std::fabs(transition_count)) / max_transition_count) - 0.5)));
-  }
-  if (transition_count > 0) {
-    for ( int i = 0; i < m_robot->numJoints(); i++ ){
-      m_robot->joint(i)->q = ( m_qRef.data[i] - transition_joint_q[i] ) * transition_smooth_gain + transition_joint_q[i];
-    }
-  } else {
-    for ( int i = 0; i < m_robot->numJoints(); i++ ){
-      m_robot->joint(i)->q = m_qRef.data[i];
-    }
-  }
-  if ( transition_count < 0 ) {
-    transition_count++;
-  } else if ( transition_count > 0 ) {
-    if ( transition_count == 1 ) {
-      std::cerr << "[" << m_profile.instance_name << "] Move to MODE_IDLE" << std::endl;
-      reset_emergency_flag = true;
-    }
-    transition_count--;
-  }
-  for ( int i = 0; i < m_robot->numJoints(); i++ ){
-    qrefv[i] = m_robot->joint(i)->q;
-  }
-  m_robot->rootLink()->p = hrp::Vector3(m_basePos.data.x, m_basePos.data.y, m_basePos.data.z);
-  target_root_p = m_robot->rootLink()->p;
-  target_root_R = hrp::rotFromRpy(m_baseRpy.data.r, m_baseRpy.data.p, m_baseRpy.data.y);
-  m_robot->rootLink()->R = target_root_R;
-  m_robot->calcForwardKinematics();
-  ref_zmp = m_robot->rootLink()->R * hrp::Vector3(m_zmpRef.data.x, m_zmpRef.data.y, m_zmpRef.data.z) + m_robot->rootLink()->p; // base frame -> world frame
-  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
-    // apply inverse system
-    hrp::Vector3 tmp_ref_zmp = ref_zmp + eefm_zmp_delay_time_const[0] * (ref_zmp - prev_ref_zmp) / dt;
-    prev_ref_zmp = ref_zmp;
-    ref_zmp = tmp_ref_zmp;
-  }
-  ref_cog = m_robot->calcCM();
-  for (size_t i = 0; i < stikp.size(); i++) {
-    hrp::Link* target = m_robot->link(stikp[i].target_name);
-    //target_ee_p[i] = target->p + target->R * stikp[i].localCOPPos;
-    target_ee_p[i] = target->p + target->R * stikp[i].localp;
-    target_ee_R[i] = target->R * stikp[i].localR;
-  }
-  // <= Reference world frame
-
-  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
-    // Reference foot_origin frame =>
-    hrp::Vector3 foot_origin_pos;
-    hrp::Matrix33 foot_origin_rot;
-    calcFootOriginCoords (foot_origin_pos, foot_origin_rot);
-    // initialize for new_refzmp
-    new_refzmp = ref_zmp;
-    rel_cog = m_robot->rootLink()->R.transpose() * (ref_cog-m_robot->rootLink()->p);
-    // convert world (current-tmp) => local (foot_origin)
-    zmp_origin_off = ref_zmp(2) - foot_origin_pos(2);
-    ref_zmp = foot_origin_rot.transpose() * (ref_zmp - foot_origin_pos);
-    ref_cog = foot_origin_rot.transpose() * (ref_cog - foot_origin_pos);
-    new_refzmp = foot_origin_rot.transpose() * (new_refzmp - foot_origin_pos);
-    if (contact_states != prev_contact_states) {
-      ref_cogvel = (foot_origin_rot.transpose() * prev_ref_foot_origin_rot) * ref_cogvel;
-    } else {
-      ref_cogvel = (ref_cog - prev_ref_cog)/dt;
-    }
-    prev_ref_foot_origin_rot = foot_origin_rot;
-    for (size_t i = 0; i < stikp.size(); i++) {
-      //target_ee_diff_p[i] += foot_origin_rot.transpose() * (target_ee_p[i] - foot_origin_pos);
-      target_ee_diff_p[i] = foot_origin_rot.transpose() * (target_ee_p[i] - foot_origin_pos);
-    }
-    target_foot_origin_rot = foot_origin_rot;
-    // capture point
-    ref_cp = ref_cog + ref_cogvel / std::sqrt(eefm_gravitational_acceleration / (ref_cog - ref_zmp)(2));
-    rel_ref_cp = hrp::Vector3(ref_cp(0), ref_cp(1), ref_zmp(2));
-    rel_ref_cp = m_robot->rootLink()->R.transpose() * ((foot_origin_pos + foot_origin_rot * rel_ref_cp) - m_robot->rootLink()->p);
-    // <= Reference foot_origin frame
-  } else {
-    ref_cogvel = (ref_cog - prev_ref_cog)/dt;
-  } // st_algorithm == OpenHRP::StabilizerService::EEFM
-  prev_ref_cog = ref_cog;
-  // Calc swing support limb gain param
-  calcSwingSupportLimbGain();
-}
-
-bool Stabilizer::calcZMP(hrp::Vector3& ret_zmp, const double zmp_z)
-{
-  double tmpzmpx = 0;
-  double tmpzmpy = 0;
-  double tmpfz = 0, tmpfz2 = 0.0;
-  for (size_t i = 0; i < stikp.size(); i++) {
-    if (!is_zmp_calc_enable[i]) continue;
-    hrp::ForceSensor* sensor = m_robot->sensor<hrp::ForceSensor>(stikp[i].sensor_name);
-    hrp::Vector3 fsp = sensor->link->p + sensor->link->R * sensor->localPos;
-    hrp::Matrix33 tmpR;
-    rats::rotm3times(tmpR, sensor->link->R, sensor->localR);
-    hrp::Vector3 nf = tmpR * hrp::Vector3(m_wrenches[i].data[0], m_wrenches[i].data[1], m_wrenches[i].data[2]);
-    hrp::Vector3 nm = tmpR * hrp::Vector3(m_wrenches[i].data[3], m_wrenches[i].data[4], m_wrenches[i].data[5]);
-    tmpzmpx += nf(2) * fsp(0) - (fsp(2) - zmp_z) * nf(0) - nm(1);
-    tmpzmpy += nf(2) * fsp(1) - (fsp(2) - zmp_z) * nf(1) + nm(0);
-    tmpfz += nf(2);
-    // calc ee-local COP
-    hrp::Link* target = m_robot->link(stikp[i].target_name);
-    hrp::Matrix33 eeR = target->R * stikp[i].localR;
-    hrp::Vector3 ee_fsp = eeR.transpose() * (fsp - (target->p + target->R * stikp[i].localp)); // ee-local force sensor pos
-    nf = eeR.transpose() * nf;
-    nm = eeR.transpose() * nm;
-    // ee-local total moment and total force at ee position
-    double tmpcopmy = nf(2) * ee_fsp(0) - nf(0) * ee_fsp(2) - nm(1);
-    double tmpcopmx = nf(2) * ee_fsp(1) - nf(1) * ee_fsp(2) + nm(0);
-    double tmpcopfz = nf(2);
-    m_COPInfo.data[i*3] = tmpcopmx;
-    m_COPInfo.data[i*3+1] = tmpcopmy;
-    m_COPInfo.data[i*3+2] = tmpcopfz;
-    prev_act_force_z[i] = 0.85 * prev_act_force_z[i] + 0.15 * nf(2); // filter, cut off 5[Hz]
-    tmpfz2 += prev_act_force_z[i];
-  }
-  if (tmpfz2 < contact_decision_threshold) {
-    ret_zmp = act_zmp;
-    return false; // in the air
-  } else {
-    ret_zmp = hrp::Vector3(tmpzmpx / tmpfz, tmpzmpy / tmpfz, zmp_z);
-    return true; // on ground
-  }
-};
-
-void Stabilizer::calcStateForEmergencySignal()
-{
-  // COP Check
-  bool is_cop_outside = false;
-  if (DEBUGP) {
-      std::cerr << "[" << m_profile.instance_name << "] Check Emergency State (seq = " << (is_seq_interpolating?"interpolating":"empty") << ")" << std::endl;
-  }
-  if (on_ground && transition_count == 0 && control_mode == MODE_ST) {
-    if (DEBUGP) {
-        std::cerr << "[" << m_profile.instance_name << "] COP check" << std::endl;
-    }
-    for (size_t i = 0; i < stikp.size(); i++) {
-      if (stikp[i].ee_name.find("leg") == std::string::npos) continue;
-      // check COP inside
-      if (m_COPInfo.data[i*3+2] > 20.0 ) {
-        hrp::Vector3 tmpcop(m_COPInfo.data[i*3+1]/m_COPInfo.data[i*3+2], m_COPInfo.data[i*3]/m_COPInfo.data[i*3+2], 0);
-        is_cop_outside = is_cop_outside ||
-            (!szd->is_inside_foot(tmpcop, stikp[i].ee_name=="lleg", cop_check_margin) ||
-             szd->is_front_of_foot(tmpcop, cop_check_margin) ||
-             szd->is_rear_of_foot(tmpcop, cop_check_margin));
-        if (DEBUGP) {
-            std::cerr << "[" << m_profile.instance_name << "]   [" << stikp[i].ee_name << "] "
-                      << "outside(" << !szd->is_inside_foot(tmpcop, stikp[i].ee_name=="lleg", cop_check_margin) << ") "
-                      << "front(" << szd->is_front_of_foot(tmpcop, cop_check_margin) << ") "
-                      << "rear(" << szd->is_rear_of_foot(tmpcop, cop_check_margin) << ")" << std::endl;
-        }
-      } else {
-        is_cop_outside = true;
-      }
-    }
-  } else {
-    is_cop_outside = false;
-  }
-  // CP Check
-  bool is_cp_outside = false;
-  if (on_ground && transition_count == 0 && control_mode == MODE_ST) {
-    SimpleZMPDistributor::leg_type support_leg;
-    size_t l_idx, r_idx;
-    Eigen::Vector2d tmp_cp;
-    for (size_t i = 0; i < rel_ee_name.size(); i++) {
-      if (rel_ee_name[i]=="rleg") r_idx = i;
-      else if (rel_ee_name[i]=="lleg") l_idx = i;
-    }
-    for (size_t i = 0; i < 2; i++) {
-      tmp_cp(i) = act_cp(i);
-    }
-    if (isContact(contact_states_index_map["rleg"]) && isContact(contact_states_index_map["lleg"])) support_leg = SimpleZMPDistributor::BOTH;
-    else if (isContact(contact_states_index_map["rleg"])) support_leg = SimpleZMPDistributor::RLEG;
-    else if (isContact(contact_states_index_map["lleg"])) support_leg = SimpleZMPDistributor::LLEG;
-    if (!is_walking || is_estop_while_walking) is_cp_outside = !szd->is_inside_support_polygon(tmp_cp, rel_ee_pos, rel_ee_rot, rel_ee_name, support_leg, cp_check_margin, - sbp_cog_offset);
-    if (DEBUGP) {
-      std::cerr << "[" << m_profile.instance_name << "] CP value " << "[" << act_cp(0) << "," << act_cp(1) << "] [m]" << std::endl;
-    }
-    if (is_cp_outside) {
-      if (initial_cp_too_large_error || loop % static_cast <int>(0.2/dt) == 0 ) { // once per 0.2[s]
-        std::cerr << "[" << m_profile.instance_name << "] CP too large error " << "[" << act_cp(0) << "," << act_cp(1) << "] [m]" << std::endl;
-      }
-      initial_cp_too_large_error = false;
-    } else {
-      initial_cp_too_large_error = true;
-    }
-  }
-  // Total check for emergency signal
-  switch (emergency_check_mode) {
-  case OpenHRP::StabilizerService::NO_CHECK:
-      is_emergency = false;
-      break;
-  case OpenHRP::StabilizerService::COP:
-      is_emergency = is_cop_outside && is_seq_interpolating;
-      break;
-  case OpenHRP::StabilizerService::CP:
-      is_emergency = is_cp_outside;
-      break;
-  default:
-      break;
-  }
-  if (DEBUGP) {
-      std::cerr << "[" << m_profile.instance_name << "] EmergencyCheck ("
-                << (emergency_check_mode == OpenHRP::StabilizerService::NO_CHECK?"NO_CHECK": (emergency_check_mode == OpenHRP::StabilizerService::COP?"COP":"CP") )
-                << ") " << (is_emergency?"emergency":"non-emergency") << std::endl;
-  }
-  rel_ee_pos.clear();
-  rel_ee_rot.clear();
-  rel_ee_name.clear();
-};
-
-void Stabilizer::moveBasePosRotForBodyRPYControl ()
-{
-    // Body rpy control
-    //   Basically Equation (1) and (2) in the paper [1]
-    hrp::Vector3 ref_root_rpy = hrp::rpyFromRot(target_root_R);
-    for (size_t i = 0; i < 2; i++) {
-        d_rpy[i] = transition_smooth_gain * (eefm_body_attitude_control_gain[i] * (ref_root_rpy(i) - act_base_rpy(i)) - 1/eefm_body_attitude_control_time_const[i] * d_rpy[i]) * dt + d_rpy[i];
-    }
-    rats::rotm3times(current_root_R, target_root_R, hrp::rotFromRpy(d_rpy[0], d_rpy[1], 0));
-    m_robot->rootLink()->R = current_root_R;
-    m_robot->rootLink()->p = target_root_p + target_root_R * rel_cog - current_root_R * rel_cog;
-    m_robot->calcForwardKinematics();
-    current_base_rpy = hrp::rpyFromRot(m_robot->rootLink()->R);
-    current_base_pos = m_robot->rootLink()->p;
-};
-
-void Stabilizer::calcSwingSupportLimbGain ()
-{
-    for (size_t i = 0; i < stikp.size(); i++) {
-        STIKParam& ikp = stikp[i];
-        if (contact_states[i]) { // Support
-            ikp.support_time += dt;
-            if (ikp.support_time > eefm_pos_transition_time) {
-                ikp.swing_support_gain = (m_controlSwingSupportTime.data[i] / eefm_pos_transition_time);
-            } else {
-                ikp.swing_support_gain = (ikp.support_time / eefm_pos_transition_time);
-            }
-            ikp.swing_support_gain = std::max(0.0, std::min(1.0, ikp.swing_support_gain));
-        } else { // Swing
-            ikp.swing_support_gain = 0.0;
-            ikp.support_time = 0.0;
-        }
-    }
-    if (DEBUGP) {
-        std::cerr << "[" << m_profile.instance_name << "] SwingSupportLimbGain = [";
-        for (size_t i = 0; i < stikp.size(); i++) std::cerr << stikp[i].swing_support_gain << " ";
-        std::cerr << "], contact_states = [";
-        for (size_t i = 0; i < stikp.size(); i++) std::cerr << contact_states[i] << " ";
-        std::cerr << "], sstime = [";
-        for (size_t i = 0; i < stikp.size(); i++) std::cerr << m_controlSwingSupportTime.data[i] << " ";
-        std::cerr << "]" << std::endl;
-    }
-}
-
-void Stabilizer::calcTPCC() {
-    // stabilizer loop
-      // Choi's feedback law
-      hrp::Vector3 cog = m_robot->calcCM();
-      hrp::Vector3 newcog = hrp::Vector3::Zero();
-      hrp::Vector3 dcog(ref_cog - act_cog);
-      hrp::Vector3 dzmp(ref_zmp - act_zmp);
-      for (size_t i = 0; i < 2; i++) {
-        double uu = ref_cogvel(i) - k_tpcc_p[i] * transition_smooth_gain * dzmp(i)
-                                  + k_tpcc_x[i] * transition_smooth_gain * dcog(i);
-        newcog(i) = uu * dt + cog(i);
-      }
-
-      moveBasePosRotForBodyRPYControl ();
-
-      // target at ee => target at link-origin
-      hrp::Vector3 target_link_p[stikp.size()];
-      hrp::Matrix33 target_link_R[stikp.size()];
-      for (size_t i = 0; i < stikp.size(); i++) {
-        rats::rotm3times(target_link_R[i], target_ee_R[i], stikp[i].localR.transpose());
-        target_link_p[i] = target_ee_p[i] - target_ee_R[i] * stikp[i].localCOPPos;
-      }
-      // solveIK
-      //   IK target is link origin pos and rot, not ee pos and rot.
-      //for (size_t jj = 0; jj < 5; jj++) {
-      for (size_t jj = 0; jj < 3; jj++) {
-        hrp::Vector3 tmpcm = m_robot->calcCM();
-        for (size_t i = 0; i < 2; i++) {
-          m_robot->rootLink()->p(i) = m_robot->rootLink()->p(i) + 0.9 * (newcog(i) - tmpcm(i));
-        }
-        m_robot->calcForwardKinematics();
-        for (size_t i = 0; i < stikp.size(); i++) {
-          if (is_ik_enable[i]) {
-              jpe_v[i]->calcInverseKinematics2Loop(target_link_p[i], target_link_R[i], 1.0, stikp[i].avoid_gain, stikp[i].reference_gain, &qrefv, transition_smooth_gain);
-          }
-        }
-      }
-}
-
-
-void Stabilizer::calcEEForceMomentControl() {
-
-    // stabilizer loop
-      // return to referencea
-      m_robot->rootLink()->R = target_root_R;
-      m_robot->rootLink()->p = target_root_p;
-      for ( int i = 0; i < m_robot->numJoints(); i++ ) {
-        m_robot->joint(i)->q = qrefv[i];
-      }
-      for (size_t i = 0; i < jpe_v.size(); i++) {
-        if (is_ik_enable[i]) {
-          for ( int j = 0; j < jpe_v[i]->numJoints(); j++ ){
-            int idx = jpe_v[i]->joint(j)->jointId;
-            m_robot->joint(idx)->q = qorg[idx];
-          }
-        }
-      }
-      // Fix for toe joint
-      for (size_t i = 0; i < jpe_v.size(); i++) {
-          if (is_ik_enable[i]) {
-              if (jpe_v[i]->numJoints() == 7) {
-                  int idx = jpe_v[i]->joint(jpe_v[i]->numJoints() -1)->jointId;
-                  m_robot->joint(idx)->q = qrefv[idx];
-              }
-          }
-      }
-
-      moveBasePosRotForBodyRPYControl ();
-
-      // Convert d_foot_pos in foot origin frame => "current" world frame
-      hrp::Vector3 foot_origin_pos;
-      hrp::Matrix33 foot_origin_rot;
-      calcFootOriginCoords (foot_origin_pos, foot_origin_rot);
-      std::vector<hrp::Vector3> current_d_foot_pos;
-      for (size_t i = 0; i < stikp.size(); i++)
-          current_d_foot_pos.push_back(foot_origin_rot * stikp[i].d_foot_pos);
-
-      // Feet and hands modification
-      std::vector<hrp::Vector3> tmpp_list; // modified ee Pos
-      std::vector<hrp::Matrix33> tmpR_list; // modified ee Rot
-#define deg2rad(x) ((x) * M_PI / 180.0)
-      for (size_t i = 0; i < stikp.size(); i++) {
-          hrp::Vector3 tmpp; // modified ee Pos
-          hrp::Matrix33 tmpR; // modified ee Rot
-          if (is_feedback_control_enable[i]) {
-              // moment control
-              rats::rotm3times(tmpR, target_ee_R[i], hrp::rotFromRpy(-stikp[i].ee_d_foot_rpy(0), -stikp[i].ee_d_foot_rpy(1), 0));
-              // total_target_foot_p[i](0) = target_foot_p[i](0);
-              // total_target_foot_p[i](1) = target_foot_p[i](1);
-              // foot force difference control version
-              // total_target_foot_p[i](2) = target_foot_p[i](2) + (i==0?0.5:-0.5)*zctrl;
-              // foot force independent damping control
-              tmpp = target_ee_p[i] - current_d_foot_pos[i];
-          } else {
-            target_ee_diff_p[i] *= transition_smooth_gain;
-            tmpp = target_ee_p[i] + eefm_ee_pos_error_p_gain * target_foot_origin_rot * target_ee_diff_p_filter[i]->passFilter(target_ee_diff_p[i]);// tempolarily disabled
-            tmpR = target_ee_R[i];
-          }
-          tmpR_list.push_back(tmpR);
-          tmpp_list.push_back(tmpp);
-      }
-      // follow swing foot rotation to target one in single support phase on the assumption that the robot rotates around support foot.
-      {
-          hrp::Matrix33 cur_sup_R, act_sup_R;
-          hrp::Vector3 cur_sup_p;
-          for (size_t i = 0; i < stikp.size(); i++) {
-              if (isContact(i)) {
-                  cur_sup_R = tmpR_list.at(i);
-                  cur_sup_p = tmpp_list.at(i);
-                  act_sup_R = act_ee_R.at(i);
-                  break;
-              }
-          }
-          for (size_t i = 0; i < stikp.size(); i++) {
-              if (isContact(i) or contact_states[contact_states_index_map[stikp[i].ee_name]]) {
-                  /* method A */
-                  // for (size_t j = 0; j < 3; j++) {
-                  //     d_rpy_swing.at(i)[j] = (-1 / stikp[i].eefm_swing_rot_time_const[j] * d_rpy_swing.at(i)[j]) * dt + d_rpy_swing.at(i)[j];
-                  //     d_pos_swing.at(i)[j] = (-1 / stikp[i].eefm_swing_pos_time_const[j] * d_pos_swing.at(i)[j]) * dt + d_pos_swing.at(i)[j];
-                  // }
-                  /* method B */
-                  d_rpy_swing.at(i) = hrp::Vector3::Zero();
-                  d_pos_swing.at(i) = hrp::Vector3::Zero();
-              } else {
-                  /* rotation */
-                  {
-                      hrp::Matrix33 cur_swg_R = tmpR_list.at(i);
-                      hrp::Matrix33 swg_R_relative_to_sup_R = cur_sup_R.transpose() * cur_swg_R;
-                      hrp::Matrix33 new_swg_R;
-                      rats::rotm3times(new_swg_R, act_sup_R, swg_R_relative_to_sup_R);
-                      rats::rotm3times(new_swg_R, foot_origin_rot, new_swg_R);
-                      hrp::Vector3 tmp_diff_rpy = hrp::rpyFromRot(new_swg_R.transpose() * tmpR_list.at(i));
-                      for (size_t j = 0; j < 3; j++) {
-                          /* method A */
-                          // d_rpy_swing.at(i)[j] = (stikp[i].eefm_swing_rot_spring_gain[j] * tmp_diff_rpy[j] - 1 / stikp[i].eefm_swing_rot_time_const[j] * d_rpy_swing.at(i)[j]) * dt + d_rpy_swing.at(i)[j];
-                          /* method B */
-                          d_rpy_swing.at(i)[j] = tmp_diff_rpy[j] * stikp[i].eefm_swing_rot_spring_gain[j];
-                      }
-                      rats::rotm3times(tmpR_list.at(i), tmpR_list.at(i), hrp::rotFromRpy(d_rpy_swing.at(i)));
-                  }
-                  /* position */
-                  {
-                      hrp::Vector3 cur_swg_p = tmpp_list.at(i);
-                      hrp::Vector3 swg_p_relative_to_sup_R = cur_sup_R.transpose() * (cur_swg_p - cur_sup_p);
-                      hrp::Vector3 new_swg_p = (foot_origin_rot * act_sup_R) * swg_p_relative_to_sup_R + cur_sup_p;
-                      hrp::Vector3 tmp_diff_pos = tmpp_list.at(i) - new_swg_p;
-                      for (size_t j = 0; j < 3; j++) {
-                          /* method A */
-                          // d_pos_swing.at(i)[j] = (stikp[i].eefm_swing_pos_spring_gain[j] * tmp_diff_pos[j] - 1 / stikp[i].eefm_swing_pos_time_const[j] * d_pos_swing.at(i)[j]) * dt + d_pos_swing.at(i)[j];
-                          /* method B */
-                          d_pos_swing.at(i)[j] = tmp_diff_pos[j] * stikp[i].eefm_swing_pos_spring_gain[j];
-                      }
-                      tmpp_list.at(i) = tmpp_list.at(i) + d_pos_swing.at(i);
-                  }
-              }
-          }
-          if (DEBUGP) {
-              for (size_t i = 0; i < stikp.size(); i++) {
-                  if (is_feedback_control_enable[i]) {
-                      std::cerr << "[" << m_profile.instance_name << "]   "
-                                << "d_rpy_swing (" << stikp[i].ee_name << ")  = " << (d_rpy_swing.at(i) / M_PI * 180.0).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[deg]" << std::endl;
-                      std::cerr << "[" << m_profile.instance_name << "]   "
-                                << "d_pos_swing (" << stikp[i].ee_name << ")  = " << (d_pos_swing.at(i) * 1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[mm]" << std::endl;
-                  }
-              }
-          }
-      }
-      // solveIK
-      //   IK target is link origin pos and rot, not ee pos and rot.
-      for (size_t jj = 0; jj < 3; jj++) {
-        for (size_t i = 0; i < stikp.size(); i++) {
-          if (is_ik_enable[i]) {
-              jpe_v[i]->calcInverseKinematics2Loop(tmpp_list.at(i), tmpR_list.at(i), 1.0, 0.001, 0.01, &qrefv, transition_smooth_gain,
-                                                   //stikp[i].localCOPPos;
-                                                   stikp[i].localp,
-                                                   stikp[i].localR);
-          }
-        }
-      }
-}
-
-// Damping control functions
-//   Basically Equation (14) in the paper [1]
-double Stabilizer::calcDampingControl (const double tau_d, const double tau, const double prev_d,
-                                       const double DD, const double TT)
-{
-  return (1/DD * (tau_d - tau) - 1/TT * prev_d) * dt + prev_d;
-};
-
-hrp::Vector3 Stabilizer::calcDampingControl (const hrp::Vector3& tau_d, const hrp::Vector3& tau, const hrp::Vector3& prev_d,
-                                             const hrp::Vector3& DD, const hrp::Vector3& TT)
-{
-  return ((tau_d - tau).cwiseQuotient(DD) - prev_d.cwiseQuotient(TT)) * dt + prev_d;
-};
-
 /*
 RTC::ReturnCode_t Stabilizer::onAborting(RTC::UniqueId ec_id)
 {
@@ -1460,41 +544,6 @@ RTC::ReturnCode_t Stabilizer::onRateChanged(RTC::UniqueId ec_id)
 }
 */
 
-void Stabilizer::sync_2_st ()
-{
-  std::cerr << "[" << m_profile.instance_name << "] " << "Sync IDLE => ST"  << std::endl;
-  pangx_ref = pangy_ref = pangx = pangy = 0;
-  rdx = rdy = rx = ry = 0;
-  d_rpy[0] = d_rpy[1] = 0;
-  pdr = hrp::Vector3::Zero();
-  pos_ctrl = hrp::Vector3::Zero();
-  for (size_t i = 0; i < stikp.size(); i++) {
-    target_ee_diff_p[i] = hrp::Vector3::Zero();
-    target_ee_diff_r[i] = hrp::Vector3::Zero();
-    prev_target_ee_diff_r[i] = hrp::Vector3::Zero();
-    d_rpy_swing[i] = hrp::Vector3::Zero();
-    d_pos_swing[i] = hrp::Vector3::Zero();
-    STIKParam& ikp = stikp[i];
-    ikp.d_foot_pos = ikp.d_foot_rpy = ikp.ee_d_foot_rpy = hrp::Vector3::Zero();
-  }
-  if (on_ground) {
-    transition_count = -1 * transition_time / dt;
-    control_mode = MODE_ST;
-  } else {
-    transition_count = 0;
-    control_mode = MODE_AIR;
-  }
-}
-
-void Stabilizer::sync_2_idle ()
-{
-  std::cerr << "[" << m_profile.instance_name << "] " << "Sync ST => IDLE"  << std::endl;
-  transition_count = transition_time / dt;
-  for (int i = 0; i < m_robot->numJoints(); i++ ) {
-    transition_joint_q[i] = m_robot->joint(i)->q;
-  }
-}
-
 void Stabilizer::startStabilizer(void)
 {
   if ( transition_count == 0 && control_mode == MODE_IDLE ) {
@@ -1518,6 +567,12 @@ void Stabilizer::stopStabilizer(void)
 
 void Stabilizer::getParameter(OpenHRP::StabilizerService::stParam& i_stp)
 {
+  {
+    // parameters which onExecute has not picked up yet are applied here,
+    // so that those of the last setParameter are returned
+    Guard guard(m_mutex);
+    if (m_stp_cell.update()) commitParameter(m_stp_cell.value());
+  }
   std::cerr << "[" << m_profile.instance_name << "] getParameter" << std::endl;
   for (size_t i = 0; i < 2; i++) {
     // i_stp.k_run_b[i] = k_run_b[i];
@@ -1681,19 +736,28 @@ void Stabilizer::getParameter(OpenHRP::StabilizerService::stParam& i_stp)
 
 void Stabilizer::setParameter(const OpenHRP::StabilizerService::stParam& i_stp)
 {
-  Guard guard(m_mutex);
+  // parameters are validated, printed and converted here, and onExecute
+  // only swaps them into members, so that this call never blocks onExecute
+  ParameterCell<STParamUpdate>::Writer stp(m_stp_cell);
+  prepareParameter(i_stp, *stp);
+}
+
+void Stabilizer::prepareParameter(const OpenHRP::StabilizerService::stParam& i_stp, STParamUpdate& o_stp)
+{
+  // members which are read here are set only in onInitialize, or they are
+  // only printed
   std::cerr << "[" << m_profile.instance_name << "] setParameter" << std::endl;
   for (size_t i = 0; i < 2; i++) {
-    k_tpcc_p[i] = i_stp.k_tpcc_p[i];
-    k_tpcc_x[i] = i_stp.k_tpcc_x[i];
-    k_brot_p[i] = i_stp.k_brot_p[i];
-    k_brot_tc[i] = i_stp.k_brot_tc[i];
+    o_stp.k_tpcc_p[i] = i_stp.k_tpcc_p[i];
+    o_stp.k_tpcc_x[i] = i_stp.k_tpcc_x[i];
+    o_stp.k_brot_p[i] = i_stp.k_brot_p[i];
+    o_stp.k_brot_tc[i] = i_stp.k_brot_tc[i];
   }
   std::cerr << "[" << m_profile.instance_name << "]  TPCC" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   k_tpcc_p  = [" << k_tpcc_p[0] << ", " <<  k_tpcc_p[1] << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   k_tpcc_x  = [" << k_tpcc_x[0] << ", " << k_tpcc_x[1] << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   k_brot_p  = [" << k_brot_p[0] << ", " << k_brot_p[1] << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   k_brot_tc = [" << k_brot_tc[0] << ", " << k_brot_tc[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   k_tpcc_p  = [" << o_stp.k_tpcc_p[0] << ", " <<  o_stp.k_tpcc_p[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   k_tpcc_x  = [" << o_stp.k_tpcc_x[0] << ", " << o_stp.k_tpcc_x[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   k_brot_p  = [" << o_stp.k_brot_p[0] << ", " << o_stp.k_brot_p[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   k_brot_tc = [" << o_stp.k_brot_tc[0] << ", " << o_stp.k_brot_tc[1] << "]" << std::endl;
   // for (size_t i = 0; i < 2; i++) {
   //   k_run_b[i] = i_stp.k_run_b[i];
   //   d_run_b[i] = i_stp.d_run_b[i];
@@ -1712,17 +776,17 @@ void Stabilizer::setParameter(const OpenHRP::StabilizerService::stParam& i_stp)
   // std::cerr << "[" << m_profile.instance_name << "]   d_run_b  = [" << d_run_b[0] << ", " <<  d_run_b[1] << "]" << std::endl;
   std::cerr << "[" << m_profile.instance_name << "]  EEFM" << std::endl;
   for (size_t i = 0; i < 2; i++) {
-    eefm_k1[i] = i_stp.eefm_k1[i];
-    eefm_k2[i] = i_stp.eefm_k2[i];
-    eefm_k3[i] = i_stp.eefm_k3[i];
-    eefm_zmp_delay_time_const[i] = i_stp.eefm_zmp_delay_time_const[i];
-    ref_zmp_aux(i) = i_stp.eefm_ref_zmp_aux[i];
-    eefm_body_attitude_control_gain[i] = i_stp.eefm_body_attitude_control_gain[i];
-    eefm_body_attitude_control_time_const[i] = i_stp.eefm_body_attitude_control_time_const[i];
-    ref_cp(i) = i_stp.ref_capture_point[i];
-    act_cp(i) = i_stp.act_capture_point[i];
-  }
-  bool is_damping_parameter_ok = true;
+    o_stp.eefm_k1[i] = i_stp.eefm_k1[i];
+    o_stp.eefm_k2[i] = i_stp.eefm_k2[i];
+    o_stp.eefm_k3[i] = i_stp.eefm_k3[i];
+    o_stp.eefm_zmp_delay_time_const[i] = i_stp.eefm_zmp_delay_time_const[i];
+    o_stp.ref_zmp_aux[i] = i_stp.eefm_ref_zmp_aux[i];
+    o_stp.eefm_body_attitude_control_gain[i] = i_stp.eefm_body_attitude_control_gain[i];
+    o_stp.eefm_body_attitude_control_time_const[i] = i_stp.eefm_body_attitude_control_time_const[i];
+    o_stp.ref_cp[i] = i_stp.ref_capture_point[i];
+    o_stp.act_cp[i] = i_stp.act_capture_point[i];
+  }
+  o_stp.stikp.resize(stikp.size());
   if ( i_stp.eefm_pos_damping_gain.length () == stikp.size() &&
        i_stp.eefm_pos_time_const_support.length () == stikp.size() &&
        i_stp.eefm_pos_compensation_limit.length () == stikp.size() &&
@@ -1734,178 +798,190 @@ void Stabilizer::setParameter(const OpenHRP::StabilizerService::stParam& i_stp)
        i_stp.eefm_swing_rot_spring_gain.length () == stikp.size() &&
        i_stp.eefm_swing_rot_time_const.length () == stikp.size() &&
        i_stp.eefm_ee_moment_limit.length () == stikp.size() ) {
-      is_damping_parameter_ok = true;
+      o_stp.is_damping_parameter_ok = true;
       for (size_t j = 0; j < stikp.size(); j++) {
           for (size_t i = 0; i < 3; i++) {
-              stikp[j].eefm_pos_damping_gain(i) = i_stp.eefm_pos_damping_gain[j][i];
-              stikp[j].eefm_pos_time_const_support(i) = i_stp.eefm_pos_time_const_support[j][i];
-              stikp[j].eefm_swing_pos_spring_gain(i) = i_stp.eefm_swing_pos_spring_gain[j][i];
-              stikp[j].eefm_swing_pos_time_const(i) = i_stp.eefm_swing_pos_time_const[j][i];
-              stikp[j].eefm_rot_damping_gain(i) = i_stp.eefm_rot_damping_gain[j][i];
-              stikp[j].eefm_rot_time_const(i) = i_stp.eefm_rot_time_const[j][i];
-              stikp[j].eefm_swing_rot_spring_gain(i) = i_stp.eefm_swing_rot_spring_gain[j][i];
-              stikp[j].eefm_swing_rot_time_const(i) = i_stp.eefm_swing_rot_time_const[j][i];
-              stikp[j].eefm_ee_moment_limit(i) = i_stp.eefm_ee_moment_limit[j][i];
+              o_stp.stikp[j].eefm_pos_damping_gain(i) = i_stp.eefm_pos_damping_gain[j][i];
+              o_stp.stikp[j].eefm_pos_time_const_support(i) = i_stp.eefm_pos_time_const_support[j][i];
+              o_stp.stikp[j].eefm_swing_pos_spring_gain(i) = i_stp.eefm_swing_pos_spring_gain[j][i];
+              o_stp.stikp[j].eefm_swing_pos_time_const(i) = i_stp.eefm_swing_pos_time_const[j][i];
+              o_stp.stikp[j].eefm_rot_damping_gain(i) = i_stp.eefm_rot_damping_gain[j][i];
+              o_stp.stikp[j].eefm_rot_time_const(i) = i_stp.eefm_rot_time_const[j][i];
+              o_stp.stikp[j].eefm_swing_rot_spring_gain(i) = i_stp.eefm_swing_rot_spring_gain[j][i];
+              o_stp.stikp[j].eefm_swing_rot_time_const(i) = i_stp.eefm_swing_rot_time_const[j][i];
+              o_stp.stikp[j].eefm_ee_moment_limit(i) = i_stp.eefm_ee_moment_limit[j][i];
           }
-          stikp[j].eefm_pos_compensation_limit = i_stp.eefm_pos_compensation_limit[j];
-          stikp[j].eefm_rot_compensation_limit = i_stp.eefm_rot_compensation_limit[j];
+          o_stp.stikp[j].eefm_pos_compensation_limit = i_stp.eefm_pos_compensation_limit[j];
+          o_stp.stikp[j].eefm_rot_compensation_limit = i_stp.eefm_rot_compensation_limit[j];
       }
   } else {
-      is_damping_parameter_ok = false;
+      o_stp.is_damping_parameter_ok = false;
   }
-  eefm_pos_time_const_swing = i_stp.eefm_pos_time_const_swing;
-  eefm_pos_transition_time = i_stp.eefm_pos_transition_time;
-  eefm_pos_margin_time = i_stp.eefm_pos_margin_time;
-  szd->set_leg_inside_margin(i_stp.eefm_leg_inside_margin);
-  szd->set_leg_outside_margin(i_stp.eefm_leg_outside_margin);
-  szd->set_leg_front_margin(i_stp.eefm_leg_front_margin);
-  szd->set_leg_rear_margin(i_stp.eefm_leg_rear_margin);
-  szd->set_vertices_from_margin_params();
+  o_stp.eefm_pos_time_const_swing = i_stp.eefm_pos_time_const_swing;
+  o_stp.eefm_pos_transition_time = i_stp.eefm_pos_transition_time;
+  o_stp.eefm_pos_margin_time = i_stp.eefm_pos_margin_time;
+  o_stp.leg_inside_margin = i_stp.eefm_leg_inside_margin;
+  o_stp.leg_outside_margin = i_stp.eefm_leg_outside_margin;
+  o_stp.leg_front_margin = i_stp.eefm_leg_front_margin;
+  o_stp.leg_rear_margin = i_stp.eefm_leg_rear_margin;
 
   if (i_stp.eefm_support_polygon_vertices_sequence.length() != stikp.size()) {
       std::cerr << "[" << m_profile.instance_name << "]   eefm_support_polygon_vertices_sequence cannot be set. Length " << i_stp.eefm_support_polygon_vertices_sequence.length() << " != " << stikp.size() << std::endl;
+      SimpleZMPDistributor::calc_vertices_from_margin_params(o_stp.support_polygon_vertices,
+                                                            o_stp.leg_front_margin, o_stp.leg_rear_margin,
+                                                            o_stp.leg_inside_margin, o_stp.leg_outside_margin);
   } else {
       std::cerr << "[" << m_profile.instance_name << "]   eefm_support_polygon_vertices_sequence set" << std::endl;
-      std::vector<std::vector<Eigen::Vector2d> > support_polygon_vec;
+      o_stp.support_polygon_vertices.clear();
       for (size_t ee_idx = 0; ee_idx < i_stp.eefm_support_polygon_vertices_sequence.length(); ee_idx++) {
           std::vector<Eigen::Vector2d> tvec;
           for (size_t v_idx = 0; v_idx < i_stp.eefm_support_polygon_vertices_sequence[ee_idx].vertices.length(); v_idx++) {
               tvec.push_back(Eigen::Vector2d(i_stp.eefm_support_polygon_vertices_sequence[ee_idx].vertices[v_idx].pos[0],
                                              i_stp.eefm_support_polygon_vertices_sequence[ee_idx].vertices[v_idx].pos[1]));
           }
-          support_polygon_vec.push_back(tvec);
+          o_stp.support_polygon_vertices.push_back(tvec);
       }
-      szd->set_vertices(support_polygon_vec);
-      szd->print_vertices(std::string(m_profile.instance_name));
-  }
-  eefm_use_force_difference_control = i_stp.eefm_use_force_difference_control;
-
-  act_cogvel_filter->setCutOffFreq(i_stp.eefm_cogvel_cutoff_freq);
-  szd->set_wrench_alpha_blending(i_stp.eefm_wrench_alpha_blending);
-  szd->set_alpha_cutoff_freq(i_stp.eefm_alpha_cutoff_freq);
-  eefm_gravitational_acceleration = i_stp.eefm_gravitational_acceleration;
-  eefm_ee_pos_error_p_gain = i_stp.eefm_ee_pos_error_p_gain;
-  eefm_ee_rot_error_p_gain = i_stp.eefm_ee_rot_error_p_gain;
-  for (size_t i = 0; i < target_ee_diff_p_filter.size(); i++) {
-      target_ee_diff_p_filter[i]->setCutOffFreq(i_stp.eefm_ee_error_cutoff_freq);
-  }
-  setBoolSequenceParam(is_ik_enable, i_stp.is_ik_enable, std::string("is_ik_enable"));
-  setBoolSequenceParam(is_feedback_control_enable, i_stp.is_feedback_control_enable, std::string("is_feedback_control_enable"));
-  setBoolSequenceParam(is_zmp_calc_enable, i_stp.is_zmp_calc_enable, std::string("is_zmp_calc_enable"));
-  emergency_check_mode = i_stp.emergency_check_mode;
-
-  transition_time = i_stp.transition_time;
-  cop_check_margin = i_stp.cop_check_margin;
+      FootSupportPolygon::print_vertices(std::string(m_profile.instance_name), o_stp.support_polygon_vertices);
+  }
+  o_stp.eefm_use_force_difference_control = i_stp.eefm_use_force_difference_control;
+
+  o_stp.eefm_cogvel_cutoff_freq = i_stp.eefm_cogvel_cutoff_freq;
+  o_stp.eefm_wrench_alpha_blending = i_stp.eefm_wrench_alpha_blending;
+  o_stp.eefm_alpha_cutoff_freq = i_stp.eefm_alpha_cutoff_freq;
+  o_stp.eefm_gravitational_acceleration = i_stp.eefm_gravitational_acceleration;
+  o_stp.eefm_ee_pos_error_p_gain = i_stp.eefm_ee_pos_error_p_gain;
+  o_stp.eefm_ee_rot_error_p_gain = i_stp.eefm_ee_rot_error_p_gain;
+  o_stp.eefm_ee_error_cutoff_freq = i_stp.eefm_ee_error_cutoff_freq;
+  o_stp.is_ik_enable_set = prepareBoolSequenceParam(o_stp.is_ik_enable, is_ik_enable, i_stp.is_ik_enable, std::string("is_ik_enable"));
+  o_stp.is_feedback_control_enable_set = prepareBoolSequenceParam(o_stp.is_feedback_control_enable, is_feedback_control_enable, i_stp.is_feedback_control_enable, std::string("is_feedback_control_enable"));
+  o_stp.is_zmp_calc_enable_set = prepareBoolSequenceParam(o_stp.is_zmp_calc_enable, is_zmp_calc_enable, i_stp.is_zmp_calc_enable, std::string("is_zmp_calc_enable"));
+  o_stp.emergency_check_mode = i_stp.emergency_check_mode;
+
+  o_stp.transition_time = i_stp.transition_time;
+  o_stp.cop_check_margin = i_stp.cop_check_margin;
+  o_stp.cp_check_margin.resize(cp_check_margin.size());
   for (size_t i = 0; i < cp_check_margin.size(); i++) {
-    cp_check_margin[i] = i_stp.cp_check_margin[i];
+    o_stp.cp_check_margin[i] = i_stp.cp_check_margin[i];
   }
-  contact_decision_threshold = i_stp.contact_decision_threshold;
-  is_estop_while_walking = i_stp.is_estop_while_walking;
+  o_stp.contact_decision_threshold = i_stp.contact_decision_threshold;
+  o_stp.is_estop_while_walking = i_stp.is_estop_while_walking;
+  o_stp.is_end_effector_set.assign(stikp.size(), false);
   if (control_mode == MODE_IDLE) {
       for (size_t i = 0; i < i_stp.end_effector_list.length(); i++) {
           std::vector<STIKParam>::iterator it = std::find_if(stikp.begin(), stikp.end(), (&boost::lambda::_1->* &std::vector<STIKParam>::value_type::ee_name == std::string(i_stp.end_effector_list[i].leg)));
-          memcpy(it->localp.data(), i_stp.end_effector_list[i].pos, sizeof(double)*3);
-          it->localR = (Eigen::Quaternion<double>(i_stp.end_effector_list[i].rot[0], i_stp.end_effector_list[i].rot[1], i_stp.end_effector_list[i].rot[2], i_stp.end_effector_list[i].rot[3])).normalized().toRotationMatrix();
+          if (it == stikp.end()) continue;
+          size_t j = it - stikp.begin();
+          memcpy(o_stp.stikp[j].localp.data(), i_stp.end_effector_list[i].pos, sizeof(double)*3);
+          o_stp.stikp[j].localR = (Eigen::Quaternion<double>(i_stp.end_effector_list[i].rot[0], i_stp.end_effector_list[i].rot[1], i_stp.end_effector_list[i].rot[2], i_stp.end_effector_list[i].rot[3])).normalized().toRotationMatrix();
+          o_stp.is_end_effector_set[j] = true;
       }
   } else {
       std::cerr << "[" << m_profile.instance_name << "] cannot change end-effectors except during MODE_IDLE" << std::endl;
   }
-  for (std::vector<STIKParam>::const_iterator it = stikp.begin(); it != stikp.end(); it++) {
-      std::cerr << "[" << m_profile.instance_name << "] End Effector [" << it->ee_name << "]" << std::endl;
-      std::cerr << "[" << m_profile.instance_name << "]   localpos = " << it->localp.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[m]" << std::endl;
-      std::cerr << "[" << m_profile.instance_name << "]   localR = " << it->localR.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
+  for (size_t j = 0; j < stikp.size(); j++) {
+      const STIKParam& param = o_stp.is_end_effector_set[j] ? o_stp.stikp[j] : stikp[j];
+      std::cerr << "[" << m_profile.instance_name << "] End Effector [" << stikp[j].ee_name << "]" << std::endl;
+      std::cerr << "[" << m_profile.instance_name << "]   localpos = " << param.localp.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[m]" << std::endl;
+      std::cerr << "[" << m_profile.instance_name << "]   localR = " << param.localR.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", "\n", "    [", "]")) << std::endl;
   }
+  o_stp.is_foot_origin_offset_set = false;
   if (i_stp.foot_origin_offset.length () != 2) {
       std::cerr << "[" << m_profile.instance_name << "]   foot_origin_offset cannot be set. Length " << i_stp.foot_origin_offset.length() << " != " << 2 << std::endl;
   } else if (control_mode != MODE_IDLE) {
       std::cerr << "[" << m_profile.instance_name << "]   foot_origin_offset cannot be set. Current control_mode is " << control_mode << std::endl;
   } else {
       for (size_t i = 0; i < i_stp.foot_origin_offset.length(); i++) {
-          foot_origin_offset[i](0) = i_stp.foot_origin_offset[i][0];
-          foot_origin_offset[i](1) = i_stp.foot_origin_offset[i][1];
-          foot_origin_offset[i](2) = i_stp.foot_origin_offset[i][2];
+          o_stp.foot_origin_offset[i](0) = i_stp.foot_origin_offset[i][0];
+          o_stp.foot_origin_offset[i](1) = i_stp.foot_origin_offset[i][1];
+          o_stp.foot_origin_offset[i](2) = i_stp.foot_origin_offset[i][2];
       }
+      o_stp.is_foot_origin_offset_set = true;
   }
   std::cerr << "[" << m_profile.instance_name << "]   foot_origin_offset is ";
   for (size_t i = 0; i < 2; i++) {
-      std::cerr << foot_origin_offset[i].format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"));
+      std::cerr << (o_stp.is_foot_origin_offset_set ? o_stp.foot_origin_offset[i] : foot_origin_offset[i]).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"));
   }
   std::cerr << "[m]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_k1  = [" << eefm_k1[0] << ", " << eefm_k1[1] << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_k2  = [" << eefm_k2[0] << ", " << eefm_k2[1] << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_k3  = [" << eefm_k3[0] << ", " << eefm_k3[1] << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_zmp_delay_time_const  = [" << eefm_zmp_delay_time_const[0] << ", " << eefm_zmp_delay_time_const[1] << "][s]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_ref_zmp_aux  = [" << ref_zmp_aux(0) << ", " << ref_zmp_aux(1) << "][m]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_body_attitude_control_gain  = [" << eefm_body_attitude_control_gain[0] << ", " << eefm_body_attitude_control_gain[1] << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_body_attitude_control_time_const  = [" << eefm_body_attitude_control_time_const[0] << ", " << eefm_body_attitude_control_time_const[1] << "][s]" << std::endl;
-  if (is_damping_parameter_ok) {
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_k1  = [" << o_stp.eefm_k1[0] << ", " << o_stp.eefm_k1[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_k2  = [" << o_stp.eefm_k2[0] << ", " << o_stp.eefm_k2[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_k3  = [" << o_stp.eefm_k3[0] << ", " << o_stp.eefm_k3[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_zmp_delay_time_const  = [" << o_stp.eefm_zmp_delay_time_const[0] << ", " << o_stp.eefm_zmp_delay_time_const[1] << "][s]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_ref_zmp_aux  = [" << o_stp.ref_zmp_aux[0] << ", " << o_stp.ref_zmp_aux[1] << "][m]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_body_attitude_control_gain  = [" << o_stp.eefm_body_attitude_control_gain[0] << ", " << o_stp.eefm_body_attitude_control_gain[1] << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_body_attitude_control_time_const  = [" << o_stp.eefm_body_attitude_control_time_const[0] << ", " << o_stp.eefm_body_attitude_control_time_const[1] << "][s]" << std::endl;
+  if (o_stp.is_damping_parameter_ok) {
       for (size_t j = 0; j < stikp.size(); j++) {
           std::cerr << "[" << m_profile.instance_name << "]   [" << stikp[j].ee_name << "] eefm_rot_damping_gain = "
-                    << stikp[j].eefm_rot_damping_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
+                    << o_stp.stikp[j].eefm_rot_damping_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
                     << ", eefm_rot_time_const = "
-                    << stikp[j].eefm_rot_time_const.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
+                    << o_stp.stikp[j].eefm_rot_time_const.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
                     << "[s]" << std::endl;
           std::cerr << "[" << m_profile.instance_name << "]   [" << stikp[j].ee_name << "] eefm_pos_damping_gain = "
-                    << stikp[j].eefm_pos_damping_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
+                    << o_stp.stikp[j].eefm_pos_damping_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
                     << ", eefm_pos_time_const_support = "
-                    << stikp[j].eefm_pos_time_const_support.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
+                    << o_stp.stikp[j].eefm_pos_time_const_support.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]"))
                     << "[s]" << std::endl;
           std::cerr << "[" << m_profile.instance_name << "]   [" << stikp[j].ee_name << "] "
-                    << "eefm_pos_compensation_limit = " << stikp[j].eefm_pos_compensation_limit << "[m], " << " "
-                    << "eefm_rot_compensation_limit = " << stikp[j].eefm_rot_compensation_limit << "[rad]" << std::endl;
+                    << "eefm_pos_compensation_limit = " << o_stp.stikp[j].eefm_pos_compensation_limit << "[m], " << " "
+                    << "eefm_rot_compensation_limit = " << o_stp.stikp[j].eefm_rot_compensation_limit << "[rad]" << std::endl;
           std::cerr << "[" << m_profile.instance_name << "]   [" << stikp[j].ee_name << "] "
-                    << "eefm_swing_pos_spring_gain = " << stikp[j].eefm_swing_pos_spring_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
-                    << "eefm_swing_pos_time_const = " << stikp[j].eefm_swing_pos_time_const.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
-                    << "eefm_swing_rot_spring_gain = " << stikp[j].eefm_swing_rot_spring_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
-                    << "eefm_swing_pos_time_const = " << stikp[j].eefm_swing_pos_time_const.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
+                    << "eefm_swing_pos_spring_gain = " << o_stp.stikp[j].eefm_swing_pos_spring_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
+                    << "eefm_swing_pos_time_const = " << o_stp.stikp[j].eefm_swing_pos_time_const.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
+                    << "eefm_swing_rot_spring_gain = " << o_stp.stikp[j].eefm_swing_rot_spring_gain.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
+                    << "eefm_swing_pos_time_const = " << o_stp.stikp[j].eefm_swing_pos_time_const.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << ", "
                     << std::endl;
           std::cerr << "[" << m_profile.instance_name << "]   [" << stikp[j].ee_name << "] "
-                    << "eefm_ee_moment_limit = " << stikp[j].eefm_ee_moment_limit.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[Nm]" << std::endl;
+                    << "eefm_ee_moment_limit = " << o_stp.stikp[j].eefm_ee_moment_limit.format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[Nm]" << std::endl;
       }
   } else {
       std::cerr << "[" << m_profile.instance_name << "]   eefm damping parameters cannot be set because of invalid param." << std::endl;
   }
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_pos_transition_time = " << eefm_pos_transition_time << "[s], eefm_pos_margin_time = " << eefm_pos_margin_time << "[s] eefm_pos_time_const_swing = " << eefm_pos_time_const_swing << "[s]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   cogvel_cutoff_freq = " << act_cogvel_filter->getCutOffFreq() << "[Hz]" << std::endl;
-  szd->print_params(std::string(m_profile.instance_name));
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_gravitational_acceleration = " << eefm_gravitational_acceleration << "[m/s^2], eefm_use_force_difference_control = " << (eefm_use_force_difference_control? "true":"false") << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]   eefm_ee_pos_error_p_gain = " << eefm_ee_pos_error_p_gain << ", eefm_ee_rot_error_p_gain = " << eefm_ee_rot_error_p_gain << ", eefm_ee_error_cutoff_freq = " << target_ee_diff_p_filter[0]->getCutOffFreq() << "[Hz]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_pos_transition_time = " << o_stp.eefm_pos_transition_time << "[s], eefm_pos_margin_time = " << o_stp.eefm_pos_margin_time << "[s] eefm_pos_time_const_swing = " << o_stp.eefm_pos_time_const_swing << "[s]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   cogvel_cutoff_freq = " << o_stp.eefm_cogvel_cutoff_freq << "[Hz]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   leg_inside_margin = " << o_stp.leg_inside_margin << "[m], leg_outside_margin = " << o_stp.leg_outside_margin << "[m], leg_front_margin = " << o_stp.leg_front_margin << "[m], leg_rear_margin = " << o_stp.leg_rear_margin << "[m]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   wrench_alpha_blending = " << o_stp.eefm_wrench_alpha_blending << ", alpha_cutoff_freq = " << o_stp.eefm_alpha_cutoff_freq << "[Hz]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_gravitational_acceleration = " << o_stp.eefm_gravitational_acceleration << "[m/s^2], eefm_use_force_difference_control = " << (o_stp.eefm_use_force_difference_control? "true":"false") << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]   eefm_ee_pos_error_p_gain = " << o_stp.eefm_ee_pos_error_p_gain << ", eefm_ee_rot_error_p_gain = " << o_stp.eefm_ee_rot_error_p_gain << ", eefm_ee_error_cutoff_freq = " << o_stp.eefm_ee_error_cutoff_freq << "[Hz]" << std::endl;
   std::cerr << "[" << m_profile.instance_name << "]  COMMON" << std::endl;
   if (control_mode == MODE_IDLE) {
-    st_algorithm = i_stp.st_algorithm;
-    std::cerr << "[" << m_profile.instance_name << "]   st_algorithm changed to [" << getStabilizerAlgorithmString(st_algorithm) << "]" << std::endl;
+    o_stp.st_algorithm = i_stp.st_algorithm;
+    o_stp.is_st_algorithm_set = true;
+    std::cerr << "[" << m_profile.instance_name << "]   st_algorithm changed to [" << getStabilizerAlgorithmString(o_stp.st_algorithm) << "]" << std::endl;
   } else {
-    std::cerr << "[" << m_profile.instance_name << "]   st_algorithm cannot be changed to [" << getStabilizerAlgorithmString(st_algorithm) << "] during MODE_AIR or MODE_ST." << std::endl;
-  }
-  std::cerr << "[" << m_profile.instance_name << "]   emergency_check_mode changed to [" << (emergency_check_mode == OpenHRP::StabilizerService::NO_CHECK?"NO_CHECK": (emergency_check_mode == OpenHRP::StabilizerService::COP?"COP":"CP") ) << "]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]  transition_time = " << transition_time << "[s]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]  cop_check_margin = " << cop_check_margin << "[m]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]  cp_check_margin = [" << cp_check_margin[0] << ", " << cp_check_margin[1] << ", " << cp_check_margin[2] << ", " << cp_check_margin[3] << "] [m]" << std::endl;
-  std::cerr << "[" << m_profile.instance_name << "]  contact_decision_threshold = " << contact_decision_threshold << "[N]" << std::endl;
+    o_stp.is_st_algorithm_set = false;
+    std::cerr << "[" << m_profile.instance_name << "]   st_algorithm cannot be changed to [" << getStabilizerAlgorithmString(i_stp.st_algorithm) << "] during MODE_AIR or MODE_ST." << std::endl;
+  }
+  std::cerr << "[" << m_profile.instance_name << "]   emergency_check_mode changed to [" << (o_stp.emergency_check_mode == OpenHRP::StabilizerService::NO_CHECK?"NO_CHECK": (o_stp.emergency_check_mode == OpenHRP::StabilizerService::COP?"COP":"CP") ) << "]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]  transition_time = " << o_stp.transition_time << "[s]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]  cop_check_margin = " << o_stp.cop_check_margin << "[m]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]  cp_check_margin = [" << o_stp.cp_check_margin[0] << ", " << o_stp.cp_check_margin[1] << ", " << o_stp.cp_check_margin[2] << ", " << o_stp.cp_check_margin[3] << "] [m]" << std::endl;
+  std::cerr << "[" << m_profile.instance_name << "]  contact_decision_threshold = " << o_stp.contact_decision_threshold << "[N]" << std::endl;
   // IK limb parameters
   std::cerr << "[" << m_profile.instance_name << "]  IK limb parameters" << std::endl;
-  bool is_ik_limb_parameter_valid_length = true;
+  o_stp.is_ik_limb_parameter_valid = true;
   if (i_stp.ik_limb_parameters.length() != jpe_v.size()) {
-      is_ik_limb_parameter_valid_length = false;
+      o_stp.is_ik_limb_parameter_valid = false;
       std::cerr << "[" << m_profile.instance_name << "]   ik_limb_parameters invalid length! Cannot be set. (input = " << i_stp.ik_limb_parameters.length() << ", desired = " << jpe_v.size() << ")" << std::endl;
   } else {
       for (size_t i = 0; i < jpe_v.size(); i++) {
           if (jpe_v[i]->numJoints() != i_stp.ik_limb_parameters[i].ik_optional_weight_vector.length())
-              is_ik_limb_parameter_valid_length = false;
+              o_stp.is_ik_limb_parameter_valid = false;
       }
-      if (is_ik_limb_parameter_valid_length) {
+      if (o_stp.is_ik_limb_parameter_valid) {
+          o_stp.ik_optional_weight_vectors.resize(jpe_v.size());
+          o_stp.sr_gains.resize(jpe_v.size());
+          o_stp.manipulability_limits.resize(jpe_v.size());
           for (size_t i = 0; i < jpe_v.size(); i++) {
               const OpenHRP::StabilizerService::IKLimbParameters& ilp = i_stp.ik_limb_parameters[i];
-              std::vector<double> ov;
+              std::vector<double>& ov = o_stp.ik_optional_weight_vectors[i];
               ov.resize(jpe_v[i]->numJoints());
               for (size_t j = 0; j < jpe_v[i]->numJoints(); j++) {
                   ov[j] = ilp.ik_optional_weight_vector[j];
               }
-              jpe_v[i]->setOptionalWeightVector(ov);
-              jpe_v[i]->setSRGain(ilp.sr_gain);
-              stikp[i].avoid_gain = ilp.avoid_gain;
-              stikp[i].reference_gain = ilp.reference_gain;
-              jpe_v[i]->setManipulabilityLimit(ilp.manipulability_limit);
+              o_stp.sr_gains[i] = ilp.sr_gain;
+              o_stp.stikp[i].avoid_gain = ilp.avoid_gain;
+              o_stp.stikp[i].reference_gain = ilp.reference_gain;
+              o_stp.manipulability_limits[i] = ilp.manipulability_limit;
           }
       } else {
           std::cerr << "[" << m_profile.instance_name << "]   ik_optional_weight_vector invalid length! Cannot be set. (input = [";
@@ -1919,37 +995,34 @@ void Stabilizer::setParameter(const OpenHRP::StabilizerService::stParam& i_stp)
           std::cerr << "])" << std::endl;
       }
   }
-  if (is_ik_limb_parameter_valid_length) {
+  if (o_stp.is_ik_limb_parameter_valid) {
       std::cerr << "[" << m_profile.instance_name << "]   ik_optional_weight_vectors = ";
       for (size_t i = 0; i < jpe_v.size(); i++) {
-          std::vector<double> ov;
-          ov.resize(jpe_v[i]->numJoints());
-          jpe_v[i]->getOptionalWeightVector(ov);
           std::cerr << "[";
           for (size_t j = 0; j < jpe_v[i]->numJoints(); j++) {
-              std::cerr << ov[j] << " ";
+              std::cerr << o_stp.ik_optional_weight_vectors[i][j] << " ";
           }
           std::cerr << "]";
       }
       std::cerr << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   sr_gains = [";
       for (size_t i = 0; i < jpe_v.size(); i++) {
-          std::cerr << jpe_v[i]->getSRGain() << ", ";
+          std::cerr << o_stp.sr_gains[i] << ", ";
       }
       std::cerr << "]" << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   avoid_gains = [";
       for (size_t i = 0; i < stikp.size(); i++) {
-          std::cerr << stikp[i].avoid_gain << ", ";
+          std::cerr << o_stp.stikp[i].avoid_gain << ", ";
       }
       std::cerr << "]" << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   reference_gains = [";
       for (size_t i = 0; i < stikp.size(); i++) {
-          std::cerr << stikp[i].reference_gain << ", ";
+          std::cerr << o_stp.stikp[i].reference_gain << ", ";
       }
       std::cerr << "]" << std::endl;
       std::cerr << "[" << m_profile.instance_name << "]   manipulability_limits = [";
       for (size_t i = 0; i < jpe_v.size(); i++) {
-          std::cerr << jpe_v[i]->getManipulabilityLimit() << ", ";
+          std::cerr << o_stp.manipulability_limits[i] << ", ";
       }
       std::cerr << "]" << std::endl;
   }
@@ -1971,22 +1044,26 @@ std::string Stabilizer::getStabilizerAlgorithmString (OpenHRP::StabilizerService
     }
 };
 
-void Stabilizer::setBoolSequenceParam (std::vector<bool>& st_bool_values, const OpenHRP::StabilizerService::BoolSequence& output_bool_values, const std::string& prop_name)
+bool Stabilizer::prepareBoolSequenceParam (std::vector<bool>& o_values, const std::vector<bool>& st_bool_values, const OpenHRP::StabilizerService::BoolSequence& output_bool_values, const std::string& prop_name)
 {
+  bool is_set = false;
+  o_values = st_bool_values;
   if (st_bool_values.size() != output_bool_values.length()) {
       std::cerr << "[" << m_profile.instance_name << "]   " << prop_name << " cannot be set. Length " << st_bool_values.size() << " != " << output_bool_values.length() << std::endl;
   } else if (control_mode != MODE_IDLE) {
       std::cerr << "[" << m_profile.instance_name << "]   " << prop_name << " cannot be set. Current control_mode is " << control_mode << std::endl;
   } else {
-      for (size_t i = 0; i < st_bool_values.size(); i++) {
-          st_bool_values[i] = output_bool_values[i];
+      for (size_t i = 0; i < o_values.size(); i++) {
+          o_values[i] = output_bool_values[i];
       }
+      is_set = true;
   }
   std::cerr << "[" << m_profile.instance_name << "]   " << prop_name << " is ";
-  for (size_t i = 0; i < st_bool_values.size(); i++) {
-      std::cerr <<"[" << st_bool_values[i] << "]";
+  for (size_t i = 0; i < o_values.size(); i++) {
+      std::cerr <<"[" << o_values[i] << "]";
   }
   std::cerr << std::endl;
+  return is_set;
 };
 
 void Stabilizer::waitSTTransition()
@@ -1995,46 +1072,6 @@ void Stabilizer::waitSTTransition()
   usleep(10);
 }
 
-double Stabilizer::vlimit(double value, double llimit_value, double ulimit_value)
-{
-  if (value > ulimit_value) {
-    return ulimit_value;
-  } else if (value < llimit_value) {
-    return llimit_value;
-  }
-  return value;
-}
-
-hrp::Vector3 Stabilizer::vlimit(const hrp::Vector3& value, double llimit_value, double ulimit_value)
-{
-  hrp::Vector3 ret;
-  for (size_t i = 0; i < 3; i++) {
-      if (value(i) > ulimit_value) {
-          ret(i) = ulimit_value;
-      } else if (value(i) < llimit_value) {
-          ret(i) = llimit_value;
-      } else {
-          ret(i) = value(i);
-      }
-  }
-  return ret;
-}
-
-hrp::Vector3 Stabilizer::vlimit(const hrp::Vector3& value, const hrp::Vector3& limit_value)
-{
-  hrp::Vector3 ret;
-  for (size_t i = 0; i < 3; i++) {
-      if (value(i) > limit_value(i)) {
-          ret(i) = limit_value(i);
-      } else if (value(i) < -1 * limit_value(i)) {
-          ret(i) = -1 * limit_value(i);
-      } else {
-          ret(i) = value(i);
-      }
-  }
-  return ret;
-}
-
 static double switching_inpact_absorber(double force, double lower_th, double upper_th)
 {
   double gradient, intercept;
@@ -22,11 +22,8 @@
 // Service implementation headers
 // <rtc-template block="service_impl_h">
 #include "StabilizerService_impl.h"
-#include "TwoDofController.h"
-#include "ZMPDistributor.h"
-#include "../ImpedanceController/JointPathEx.h"
-#include "../ImpedanceController/RatsMatrix.h"
-#include "../TorqueFilter/IIRFilter.h"
+#include "StabilizerCore.h"
+#include "util/ParameterCell.h"
 
 // </rtc-template>
 
@@ -40,7 +37,7 @@
  */
 
 class Stabilizer
-  : public RTC::DataFlowComponentBase
+  : public RTC::DataFlowComponentBase, public StabilizerCore
 {
  public:
   /**
@@ -103,22 +100,10 @@ class Stabilizer
 
   void startStabilizer(void);
   void stopStabilizer(void);
-  void getCurrentParameters ();
-  void getActualParameters ();
-  void getTargetParameters ();
-  void calcFootOriginCoords (hrp::Vector3& foot_origin_pos, hrp::Matrix33& foot_origin_rot);
-  void sync_2_st ();
-  void sync_2_idle();
-  bool calcZMP(hrp::Vector3& ret_zmp, const double zmp_z);
-  void calcStateForEmergencySignal();
   void calcRUNST();
-  void moveBasePosRotForBodyRPYControl ();
-  void calcSwingSupportLimbGain();
-  void calcTPCC();
-  void calcEEForceMomentControl();
   void getParameter(OpenHRP::StabilizerService::stParam& i_stp);
   void setParameter(const OpenHRP::StabilizerService::stParam& i_stp);
-  void setBoolSequenceParam (std::vector<bool>& st_bool_values, const OpenHRP::StabilizerService::BoolSequence& output_bool_values, const std::string& prop_name);
+  bool prepareBoolSequenceParam (std::vector<bool>& o_values, const std::vector<bool>& st_bool_values, const OpenHRP::StabilizerService::BoolSequence& output_bool_values, const std::string& prop_name);
   std::string getStabilizerAlgorithmString (OpenHRP::StabilizerService::STAlgorithm _st_algorithm);
   void waitSTTransition();
   // funcitons for calc final torque output
@@ -126,18 +111,6 @@ class Stabilizer
   void calcTorque ();
   void fixLegToCoords (const std::string& leg, const rats::coordinates& coords);
   void getFootmidCoords (rats::coordinates& ret);
-  double calcDampingControl (const double tau_d, const double tau, const double prev_d,
-                             const double DD, const double TT);
-  hrp::Vector3 calcDampingControl (const hrp::Vector3& tau_d, const hrp::Vector3& tau, const hrp::Vector3& prev_d,
-                                   const hrp::Vector3& DD, const hrp::Vector3& TT);
-  double vlimit(double value, double llimit_value, double ulimit_value);
-  hrp::Vector3 vlimit(const hrp::Vector3& value, double llimit_value, double ulimit_value);
-  hrp::Vector3 vlimit(const hrp::Vector3& value, const hrp::Vector3& limit_value);
-
-  inline bool isContact (const size_t idx) // 0 = right, 1 = left
-  {
-    return (prev_act_force_z[idx] > 25.0);
-  };
 
  protected:
   // Configuration variable declaration
@@ -235,69 +208,11 @@ class Stabilizer
   // </rtc-template>
 
  private:
-  // Stabilizer Parameters
-  struct STIKParam {
-    std::string target_name; // Name of end link
-    std::string ee_name; // Name of ee (e.g., rleg, lleg, ...)
-    std::string sensor_name; // Name of force sensor in the limb
-    hrp::Vector3 localp; // Position of ee in end link frame (^{l}p_e = R_l^T (p_e - p_l))
-    hrp::Vector3 localCOPPos; // Position offset of reference COP in end link frame (^{l}p_{cop} = R_l^T (p_{cop} - p_l) - ^{l}p_e)
-    hrp::Matrix33 localR; // Rotation of ee in end link frame (^{l}R_e = R_l^T R_e)
-    // For eefm
-    hrp::Vector3 d_foot_pos, d_foot_rpy, ee_d_foot_rpy;
-    hrp::Vector3 eefm_pos_damping_gain, eefm_pos_time_const_support, eefm_rot_damping_gain, eefm_rot_time_const, eefm_swing_rot_spring_gain, eefm_swing_pos_spring_gain, eefm_swing_rot_time_const, eefm_swing_pos_time_const, eefm_ee_moment_limit;
-    double eefm_pos_compensation_limit, eefm_rot_compensation_limit;
-    hrp::Vector3 ref_force, ref_moment;
-    double swing_support_gain, support_time;
-    // IK parameter
-    double avoid_gain, reference_gain;
-  };
-  enum cmode {MODE_IDLE, MODE_AIR, MODE_ST, MODE_SYNC_TO_IDLE, MODE_SYNC_TO_AIR} control_mode;
+  void prepareParameter(const OpenHRP::StabilizerService::stParam& i_stp, STParamUpdate& o_stp);
   // members
-  std::vector<hrp::JointPathExPtr> jpe_v;
-  hrp::BodyPtr m_robot;
   coil::Mutex m_mutex;
-  unsigned int m_debugLevel;
-  hrp::dvector transition_joint_q, qorg, qrefv;
-  std::vector<STIKParam> stikp;
-  std::map<std::string, size_t> contact_states_index_map;
-  std::vector<bool> contact_states, prev_contact_states, is_ik_enable, is_feedback_control_enable, is_zmp_calc_enable;
-  double dt;
-  int transition_count, loop;
-  bool is_legged_robot, on_ground, is_emergency, is_seq_interpolating, reset_emergency_flag, eefm_use_force_difference_control, initial_cp_too_large_error;
-  bool is_walking, is_estop_while_walking;
-  hrp::Vector3 current_root_p, target_root_p;
-  hrp::Matrix33 current_root_R, target_root_R, prev_act_foot_origin_rot, prev_ref_foot_origin_rot, target_foot_origin_rot;
-  std::vector <hrp::Vector3> target_ee_p, target_ee_diff_p, target_ee_diff_r, prev_target_ee_diff_r, rel_ee_pos, d_pos_swing, d_rpy_swing;
-  std::vector <hrp::Matrix33> target_ee_R, rel_ee_rot, act_ee_R;
-  std::vector<std::string> rel_ee_name;
-  rats::coordinates target_foot_midcoords;
-  hrp::Vector3 ref_zmp, ref_cog, ref_cp, ref_cogvel, rel_ref_cp, prev_ref_cog, prev_ref_zmp;
-  hrp::Vector3 act_zmp, act_cog, act_cogvel, act_cp, rel_act_zmp, rel_act_cp, prev_act_cog, act_base_rpy, current_base_rpy, current_base_pos, sbp_cog_offset;
-  hrp::Vector3 foot_origin_offset[2];
-  std::vector<double> prev_act_force_z;
-  double zmp_origin_off, transition_smooth_gain;
-  boost::shared_ptr<FirstOrderLowPassFilter<hrp::Vector3> > act_cogvel_filter;
-  std::vector<boost::shared_ptr<FirstOrderLowPassFilter<hrp::Vector3> > > target_ee_diff_p_filter;
-  OpenHRP::StabilizerService::STAlgorithm st_algorithm;
-  SimpleZMPDistributor* szd;
-  // TPCC
-  double k_tpcc_p[2], k_tpcc_x[2], d_rpy[2], k_brot_p[2], k_brot_tc[2];
-  // RUN ST
-  TwoDofController m_tau_x[2], m_tau_y[2], m_f_z;
-  hrp::Vector3 pdr;
-  double m_torque_k[2], m_torque_d[2]; // 3D-LIP parameters (0: x, 1: y)
-  double pangx_ref, pangy_ref, pangx, pangy;
-  double k_run_b[2], d_run_b[2];
-  double rdx, rdy, rx, ry;
-  // EEFM ST
-  double eefm_k1[2], eefm_k2[2], eefm_k3[2], eefm_zmp_delay_time_const[2], eefm_body_attitude_control_gain[2], eefm_body_attitude_control_time_const[2];
-  double eefm_pos_time_const_swing, eefm_pos_transition_time, eefm_pos_margin_time, eefm_gravitational_acceleration, eefm_ee_pos_error_p_gain, eefm_ee_rot_error_p_gain;
-  hrp::Vector3 new_refzmp, rel_cog, ref_zmp_aux;
-  hrp::Vector3 pos_ctrl;
-  double total_mass, transition_time, cop_check_margin, contact_decision_threshold;
-  std::vector<double> cp_check_margin;
-  OpenHRP::StabilizerService::EmergencyCheckMode emergency_check_mode;
+  // parameters set by setParameter, which are applied by onExecute
+  ParameterCell<STParamUpdate> m_stp_cell;
 };
 
 
@@ -0,0 +1,1188 @@
+// -*- C++ -*-
+/*!
+ * @file  StabilizerCore.cpp
+ * @brief control core of Stabilizer without RTC ports
+ * $Date$
+ *
+ * $Id$
+ */
+
+#include <iostream>
+#include <math.h>
+#include <hrpModel/Link.h>
+#include <hrpModel/Sensor.h>
+#include "StabilizerCore.h"
+
+#define DEBUGP ((m_debugLevel==1 && loop%200==0) || m_debugLevel > 1 )
+
+StabilizerCore::StabilizerCore()
+  : control_mode(MODE_IDLE),
+    m_debugLevel(0),
+    dt(0.002),
+    loop(0),
+    st_algorithm(OpenHRP::StabilizerService::TPCC),
+    szd(NULL),
+    emergency_check_mode(OpenHRP::StabilizerService::NO_CHECK)
+{
+}
+
+StabilizerCore::~StabilizerCore()
+{
+  delete szd;
+}
+
+void StabilizerCore::addEndEffector (const STIKParam& ikp, const std::string& ee_base)
+{
+  const std::string& ee_name = ikp.ee_name;
+  contact_states_index_map.insert(std::pair<std::string, size_t>(ee_name, stikp.size()));
+  stikp.push_back(ikp);
+  stikp.back().avoid_gain = 0.001;
+  stikp.back().reference_gain = 0.01;
+  jpe_v.push_back(hrp::JointPathExPtr(new hrp::JointPathEx(m_robot, m_robot->link(ee_base), m_robot->link(ikp.target_name), dt, false, instance_name)));
+  // Fix for toe joint
+  if (ee_name.find("leg") != std::string::npos && jpe_v.back()->numJoints() == 7) { // leg and has 7dof joint (6dof leg +1dof toe)
+      std::vector<double> optw;
+      for (int j = 0; j < jpe_v.back()->numJoints(); j++ ) {
+          if ( j == jpe_v.back()->numJoints()-1 ) optw.push_back(0.0);
+          else optw.push_back(1.0);
+      }
+      jpe_v.back()->setOptionalWeightVector(optw);
+  }
+  target_ee_p.push_back(hrp::Vector3::Zero());
+  target_ee_R.push_back(hrp::Matrix33::Identity());
+  act_ee_R.push_back(hrp::Matrix33::Identity());
+  target_ee_diff_p.push_back(hrp::Vector3::Zero());
+  target_ee_diff_r.push_back(hrp::Vector3::Zero());
+  prev_target_ee_diff_r.push_back(hrp::Vector3::Zero());
+  d_rpy_swing.push_back(hrp::Vector3::Zero());
+  d_pos_swing.push_back(hrp::Vector3::Zero());
+  target_ee_diff_p_filter.push_back(boost::shared_ptr<FirstOrderLowPassFilter<hrp::Vector3> >(new FirstOrderLowPassFilter<hrp::Vector3>(50.0, dt, hrp::Vector3::Zero()))); // [Hz]
+  is_ik_enable.push_back( (ee_name.find("leg") != std::string::npos ? true : false) ); // Hands ik => disabled, feet ik => enabled, by default
+  is_feedback_control_enable.push_back( (ee_name.find("leg") != std::string::npos ? true : false) ); // Hands feedback control => disabled, feet feedback control => enabled, by default
+  is_zmp_calc_enable.push_back( (ee_name.find("leg") != std::string::npos ? true : false) ); // To zmp calculation, hands are disabled and feet are enabled, by default
+  prev_act_force_z.push_back(0.0);
+}
+
+void StabilizerCore::initParameters ()
+{
+  // parameters for TPCC
+  act_zmp = hrp::Vector3::Zero();
+  for (int i = 0; i < 2; i++) {
+    k_tpcc_p[i] = 0.2;
+    k_tpcc_x[i] = 4.0;
+    k_brot_p[i] = 0.1;
+    k_brot_tc[i] = 1.5;
+  }
+  // parameters for EEFM
+  EEFMGains eefm_gains;
+  for (int i = 0; i < 2; i++) {
+    eefm_k1[i] = eefm_gains.k1;
+    eefm_k2[i] = eefm_gains.k2;
+    eefm_k3[i] = eefm_gains.k3;
+    eefm_body_attitude_control_gain[i] = 0.5;
+    eefm_body_attitude_control_time_const[i] = 1e5;
+  }
+  for (size_t i = 0; i < stikp.size(); i++) {
+      STIKParam& ikp = stikp[i];
+      ikp.eefm_rot_damping_gain = eefm_gains.rot_damping_gain;
+      ikp.eefm_rot_time_const = eefm_gains.rot_time_const;
+      ikp.eefm_rot_compensation_limit = eefm_gains.rot_compensation_limit;
+      ikp.eefm_swing_rot_spring_gain = hrp::Vector3(0.0, 0.0, 0.0);
+      ikp.eefm_swing_rot_time_const = hrp::Vector3(1.5, 1.5, 1.5);
+      ikp.eefm_pos_damping_gain = eefm_gains.pos_damping_gain;
+      ikp.eefm_pos_time_const_support = eefm_gains.pos_time_const_support;
+      ikp.eefm_pos_compensation_limit = eefm_gains.pos_compensation_limit;
+      ikp.eefm_swing_pos_spring_gain = hrp::Vector3(0.0, 0.0, 0.0);
+      ikp.eefm_swing_pos_time_const = hrp::Vector3(1.5, 1.5, 1.5);
+      ikp.eefm_ee_moment_limit = hrp::Vector3(1e4, 1e4, 1e4); // Default limit [Nm] is too large. Same as no limit.
+  }
+  eefm_pos_time_const_swing = 0.08;
+  eefm_pos_transition_time = 0.01;
+  eefm_pos_margin_time = 0.02;
+  eefm_zmp_delay_time_const[0] = eefm_zmp_delay_time_const[1] = eefm_gains.zmp_delay_time_const;
+  //eefm_leg_inside_margin = 0.065; // [m]
+  //eefm_leg_front_margin = 0.05;
+  //eefm_leg_rear_margin = 0.05;
+  //fm_wrench_alpha_blending = 1.0; // fz_alpha
+  eefm_gravitational_acceleration = 9.80665; // [m/s^2]
+  eefm_ee_pos_error_p_gain = 0;
+  eefm_ee_rot_error_p_gain = 0;
+  cop_check_margin = 20.0*1e-3; // [m]
+  cp_check_margin.resize(4, 30*1e-3); // [m]
+  contact_decision_threshold = 50; // [N]
+  eefm_use_force_difference_control = true;
+  initial_cp_too_large_error = true;
+  is_walking = false;
+  is_estop_while_walking = false;
+  sbp_cog_offset = hrp::Vector3(0.0, 0.0, 0.0);
+
+  // parameters for RUNST
+  double ke = 0, tc = 0;
+  for (int i = 0; i < 2; i++) {
+    m_tau_x[i].setup(ke, tc, dt);
+    m_tau_x[i].setErrorPrefix(instance_name);
+    m_tau_y[i].setup(ke, tc, dt);
+    m_tau_y[i].setErrorPrefix(instance_name);
+    m_f_z.setup(ke, tc, dt);
+    m_f_z.setErrorPrefix(instance_name);
+  }
+  pangx_ref = pangy_ref = pangx = pangy = 0;
+  rdx = rdy = rx = ry = 0;
+  pdr = hrp::Vector3::Zero();
+
+  // Check is legged robot or not
+  is_legged_robot = false;
+  for (size_t i = 0; i < stikp.size(); i++) {
+      if (stikp[i].ee_name.find("leg") == std::string::npos) continue;
+      hrp::Sensor* sen= m_robot->sensor<hrp::ForceSensor>(stikp[i].sensor_name);
+      if ( sen != NULL ) is_legged_robot = true;
+  }
+  is_emergency = false;
+  reset_emergency_flag = false;
+  is_seq_interpolating = false;
+  on_ground = false;
+
+  transition_joint_q.resize(m_robot->numJoints());
+  qorg.resize(m_robot->numJoints());
+  qrefv.resize(m_robot->numJoints());
+  transition_count = 0;
+  loop = 0;
+  total_mass = m_robot->totalMass();
+  ref_zmp_aux = hrp::Vector3::Zero();
+  contact_states.assign(stikp.size(), true);
+  prev_contact_states.assign(stikp.size(), true);
+  act_contact_states.assign(stikp.size(), false);
+  cop_info.assign(stikp.size()*3, 0.0);
+  transition_time = 2.0;
+  foot_origin_offset[0] = hrp::Vector3::Zero();
+  foot_origin_offset[1] = hrp::Vector3::Zero();
+
+  // inputs
+  input_q_ref = hrp::dvector::Zero(m_robot->numJoints());
+  input_q_current = hrp::dvector::Zero(m_robot->numJoints());
+  input_rpy = input_zmp_ref = input_base_pos = input_base_rpy = hrp::Vector3::Zero();
+  input_swing_support_time.assign(stikp.size(), 1.0);
+  input_wrenches.assign(stikp.size(), hrp::dvector6::Zero());
+  input_ref_wrenches.assign(stikp.size(), hrp::dvector6::Zero());
+
+  //
+  act_cogvel_filter = boost::shared_ptr<FirstOrderLowPassFilter<hrp::Vector3> >(new FirstOrderLowPassFilter<hrp::Vector3>(4.0, dt, hrp::Vector3::Zero())); // [Hz]
+
+  //
+  delete szd;
+  szd = new SimpleZMPDistributor(dt);
+  std::vector<std::vector<Eigen::Vector2d> > support_polygon_vec;
+  for (size_t i = 0; i < stikp.size(); i++) {
+      support_polygon_vec.push_back(std::vector<Eigen::Vector2d>(1,Eigen::Vector2d::Zero()));
+  }
+  szd->set_vertices(support_polygon_vec);
+
+  rel_ee_pos.reserve(stikp.size());
+  rel_ee_rot.reserve(stikp.size());
+  rel_ee_name.reserve(stikp.size());
+  fmd_buffer.reserve(stikp.size());
+  current_d_foot_pos.resize(stikp.size());
+  tmpp_list.resize(stikp.size());
+  tmpR_list.resize(stikp.size());
+}
+
+void StabilizerCore::execute ()
+{
+  loop++;
+  if (is_legged_robot) {
+    getCurrentParameters();
+    getTargetParameters();
+    getActualParameters();
+    calcStateForEmergencySignal();
+    switch (control_mode) {
+    case MODE_IDLE:
+      break;
+    case MODE_AIR:
+      if ( transition_count == 0 && on_ground ) sync_2_st();
+      break;
+    case MODE_ST:
+      if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
+        calcEEForceMomentControl();
+      } else {
+        calcTPCC();
+      }
+      if ( transition_count == 0 && !on_ground ) control_mode = MODE_SYNC_TO_AIR;
+      break;
+    case MODE_SYNC_TO_IDLE:
+      sync_2_idle();
+      control_mode = MODE_IDLE;
+      break;
+    case MODE_SYNC_TO_AIR:
+      sync_2_idle();
+      control_mode = MODE_AIR;
+      break;
+    }
+  }
+}
+
+void StabilizerCore::getCurrentParameters ()
+{
+  current_root_p = m_robot->rootLink()->p;
+  current_root_R = m_robot->rootLink()->R;
+  for ( int i = 0; i < m_robot->numJoints(); i++ ){
+    qorg[i] = m_robot->joint(i)->q;
+  }
+}
+
+void StabilizerCore::calcFootOriginCoords (hrp::Vector3& foot_origin_pos, hrp::Matrix33& foot_origin_rot)
+{
+  rats::coordinates leg_c[2], tmpc;
+  hrp::Vector3 ez = hrp::Vector3::UnitZ();
+  hrp::Vector3 ex = hrp::Vector3::UnitX();
+  for (size_t i = 0; i < stikp.size(); i++) {
+    if (stikp[i].ee_name.find("leg") == std::string::npos) continue;
+    hrp::Link* target = m_robot->sensor<hrp::ForceSensor>(stikp[i].sensor_name)->link;
+    leg_c[i].pos = target->p + target->R * foot_origin_offset[i];
+    hrp::Vector3 xv1(target->R * ex);
+    xv1(2)=0.0;
+    xv1.normalize();
+    hrp::Vector3 yv1(ez.cross(xv1));
+    leg_c[i].rot(0,0) = xv1(0); leg_c[i].rot(1,0) = xv1(1); leg_c[i].rot(2,0) = xv1(2);
+    leg_c[i].rot(0,1) = yv1(0); leg_c[i].rot(1,1) = yv1(1); leg_c[i].rot(2,1) = yv1(2);
+    leg_c[i].rot(0,2) = ez(0); leg_c[i].rot(1,2) = ez(1); leg_c[i].rot(2,2) = ez(2);
+  }
+  if (contact_states[contact_states_index_map["rleg"]] &&
+      contact_states[contact_states_index_map["lleg"]]) {
+    rats::mid_coords(tmpc, 0.5, leg_c[0], leg_c[1]);
+    foot_origin_pos = tmpc.pos;
+    foot_origin_rot = tmpc.rot;
+  } else if (contact_states[contact_states_index_map["rleg"]]) {
+    foot_origin_pos = leg_c[contact_states_index_map["rleg"]].pos;
+    foot_origin_rot = leg_c[contact_states_index_map["rleg"]].rot;
+  } else {
+    foot_origin_pos = leg_c[contact_states_index_map["lleg"]].pos;
+    foot_origin_rot = leg_c[contact_states_index_map["lleg"]].rot;
+  }
+}
+
+void StabilizerCore::getActualParameters ()
+{
+  // Actual world frame =>
+  hrp::Vector3 foot_origin_pos;
+  hrp::Matrix33 foot_origin_rot;
+  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
+    // update by current joint angles
+    for ( int i = 0; i < m_robot->numJoints(); i++ ){
+      m_robot->joint(i)->q = input_q_current[i];
+    }
+    // tempolary
+    m_robot->rootLink()->p = hrp::Vector3::Zero();
+    m_robot->calcForwardKinematics();
+    hrp::Sensor* sen = m_robot->sensor<hrp::RateGyroSensor>("gyrometer");
+    hrp::Matrix33 senR = sen->link->R * sen->localR;
+    hrp::Matrix33 act_Rs(hrp::rotFromRpy(input_rpy(0), input_rpy(1), input_rpy(2)));
+    //hrp::Matrix33 act_Rs(hrp::rotFromRpy(input_rpy(0)*0.5, input_rpy(1)*0.5, input_rpy(2)*0.5));
+    m_robot->rootLink()->R = act_Rs * (senR.transpose() * m_robot->rootLink()->R);
+    m_robot->calcForwardKinematics();
+    act_base_rpy = hrp::rpyFromRot(m_robot->rootLink()->R);
+    calcFootOriginCoords (foot_origin_pos, foot_origin_rot);
+  } else {
+    for ( int i = 0; i < m_robot->numJoints(); i++ ) {
+      m_robot->joint(i)->q = qorg[i];
+    }
+    m_robot->rootLink()->p = current_root_p;
+    m_robot->rootLink()->R = current_root_R;
+    m_robot->calcForwardKinematics();
+  }
+  // cog
+  act_cog = m_robot->calcCM();
+  // zmp
+  on_ground = false;
+  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
+    on_ground = calcZMP(act_zmp, zmp_origin_off+foot_origin_pos(2));
+  } else {
+    on_ground = calcZMP(act_zmp, ref_zmp(2));
+  }
+  // set actual contact states
+  for (size_t i = 0; i < stikp.size(); i++) {
+      const std::string& limb_name = stikp[i].ee_name;
+      act_contact_states[contact_states_index_map[limb_name]] = isContact(contact_states_index_map[limb_name]);
+  }
+  // <= Actual world frame
+
+  // convert absolute (in st) -> root-link relative
+  rel_act_zmp = m_robot->rootLink()->R.transpose() * (act_zmp - m_robot->rootLink()->p);
+  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
+    // Actual foot_origin frame =>
+    act_zmp = foot_origin_rot.transpose() * (act_zmp - foot_origin_pos);
+    act_cog = foot_origin_rot.transpose() * (act_cog - foot_origin_pos);
+    //act_cogvel = foot_origin_rot.transpose() * act_cogvel;
+    if (contact_states != prev_contact_states) {
+      act_cogvel = (foot_origin_rot.transpose() * prev_act_foot_origin_rot) * act_cogvel;
+    } else {
+      act_cogvel = (act_cog - prev_act_cog)/dt;
+    }
+    prev_act_foot_origin_rot = foot_origin_rot;
+    act_cogvel = act_cogvel_filter->passFilter(act_cogvel);
+    prev_act_cog = act_cog;
+    //act_root_rot = m_robot->rootLink()->R;
+    for (size_t i = 0; i < stikp.size(); i++) {
+      hrp::Link* target = m_robot->link(stikp[i].target_name);
+      //hrp::Vector3 act_ee_p = target->p + target->R * stikp[i].localCOPPos;
+      hrp::Vector3 act_ee_p = target->p + target->R * stikp[i].localp;
+      //target_ee_R[i] = target->R * stikp[i].localR;
+      target_ee_diff_p[i] -= foot_origin_rot.transpose() * (act_ee_p - foot_origin_pos);
+      act_ee_R[i] = foot_origin_rot.transpose() * (target->R * stikp[i].localR);
+    }
+    // capture point
+    act_cp = act_cog + act_cogvel / std::sqrt(eefm_gravitational_acceleration / (act_cog - act_zmp)(2));
+    rel_act_cp = hrp::Vector3(act_cp(0), act_cp(1), act_zmp(2));
+    rel_act_cp = m_robot->rootLink()->R.transpose() * ((foot_origin_pos + foot_origin_rot * rel_act_cp) - m_robot->rootLink()->p);
+    // <= Actual foot_origin frame
+
+    // Actual world frame =>
+    // new ZMP calculation
+    // Kajita's feedback law
+    //   Basically Equation (26) in the paper [1].
+    hrp::Vector3 dcog=foot_origin_rot * (ref_cog - act_cog);
+    hrp::Vector3 dcogvel=foot_origin_rot * (ref_cogvel - act_cogvel);
+    hrp::Vector3 dzmp=foot_origin_rot * (ref_zmp - act_zmp);
+    new_refzmp = foot_origin_rot * new_refzmp + foot_origin_pos;
+    calcEEFMFeedbackZMP(new_refzmp, dcog, dcogvel, dzmp, eefm_k1, eefm_k2, eefm_k3, transition_smooth_gain, ref_zmp_aux);
+    if (DEBUGP) {
+      // All state variables are foot_origin coords relative
+      std::cerr << "[" << instance_name << "] state values" << std::endl;
+      std::cerr << "[" << instance_name << "]   "
+                << "ref_cog    = " << hrp::Vector3(ref_cog*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
+                << ", act_cog    = " << hrp::Vector3(act_cog*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
+      std::cerr << "[" << instance_name << "]   "
+                << "ref_cogvel = " << hrp::Vector3(ref_cogvel*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
+                << ", act_cogvel = " << hrp::Vector3(act_cogvel*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm/s]" << std::endl;
+      std::cerr << "[" << instance_name << "]   "
+                << "ref_zmp    = " << hrp::Vector3(ref_zmp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
+                << ", act_zmp    = " << hrp::Vector3(act_zmp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
+      hrp::Vector3 tmpnew_refzmp;
+      tmpnew_refzmp = foot_origin_rot.transpose()*(new_refzmp-foot_origin_pos); // Actual world -> foot origin relative
+      std::cerr << "[" << instance_name << "]   "
+                << "new_zmp    = " << hrp::Vector3(tmpnew_refzmp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"))
+                << ", dif_zmp    = " << hrp::Vector3((tmpnew_refzmp-ref_zmp)*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
+    }
+
+    // distribute new ZMP into foot force & moment
+    fmd_buffer.clear();
+    std::vector<hrp::Vector3>& ref_force = fmd_buffer.ref_force;
+    std::vector<hrp::Vector3>& ref_moment = fmd_buffer.ref_moment;
+    const std::vector<std::string>& ee_names = fmd_buffer.ee_names;
+    if (control_mode == MODE_ST) {
+      for (size_t i = 0; i < stikp.size(); i++) {
+          STIKParam& ikp = stikp[i];
+          if (!is_feedback_control_enable[i]) continue;
+          hrp::Link* target = m_robot->link(ikp.target_name);
+          fmd_buffer.push_back(target->p + target->R * ikp.localp,
+                               target->p + target->R * ikp.localCOPPos,
+                               target->R * ikp.localR,
+                               ikp.ee_name,
+                               ikp.swing_support_gain,
+                               hrp::Vector3(input_ref_wrenches[i].head<3>()),
+                               hrp::Vector3(input_ref_wrenches[i].tail<3>()));
+          rel_ee_pos.push_back(foot_origin_rot.transpose() * (fmd_buffer.ee_pos.back() - foot_origin_pos));
+          rel_ee_rot.push_back(foot_origin_rot.transpose() * fmd_buffer.ee_rot.back());
+          rel_ee_name.push_back(ee_names.back());
+      }
+      // All state variables are foot_origin coords relative
+      if (DEBUGP) {
+          std::cerr << "[" << instance_name << "] ee values" << std::endl;
+          hrp::Vector3 tmpp;
+          for (size_t i = 0; i < ee_names.size(); i++) {
+              tmpp = foot_origin_rot.transpose()*(fmd_buffer.ee_pos[i]-foot_origin_pos);
+              std::cerr << "[" << instance_name << "]   "
+                        << "ee_pos (" << ee_names[i] << ")    = " << hrp::Vector3(tmpp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]"));
+              tmpp = foot_origin_rot.transpose()*(fmd_buffer.cop_pos[i]-foot_origin_pos);
+              std::cerr << ", cop_pos (" << ee_names[i] << ")    = " << hrp::Vector3(tmpp*1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "[", "]")) << "[mm]" << std::endl;
+          }
+      }
+
+      // Distribute ZMP into each EE force/moment at each COP
+      if (st_algorithm == OpenHRP::StabilizerService::EEFM) {
+          // Modified version of distribution in Equation (4)-(6) and (10)-(13) in the paper [1].
+          szd->distributeZMPToForceMoments(ref_force, ref_moment,
+                                           fmd_buffer.ee_pos, fmd_buffer.cop_pos, fmd_buffer.ee_rot, ee_names, fmd_buffer.limb_gains,
+                                           new_refzmp, hrp::Vector3(foot_origin_rot * ref_zmp + foot_origin_pos),
+                                           eefm_gravitational_acceleration * total_mass, dt,
+                                           DEBUGP, std::string(instance_name));
+      } else if (st_algorithm == OpenHRP::StabilizerService::EEFMQP) {
+          szd->distributeZMPToForceMomentsQP(ref_force, ref_moment,
+                                             fmd_buffer.ee_pos, fmd_buffer.cop_pos, fmd_buffer.ee_rot, ee_names, fmd_buffer.limb_gains,
+                                             new_refzmp, hrp::Vector3(foot_origin_rot * ref_zmp + foot_origin_pos),
+                                             eefm_gravitational_acceleration * total_mass, dt,
+                                             DEBUGP, std::string(instance_name),
+                                             (st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP));
+      } else if (st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
+          szd->distributeZMPToForceMomentsPseudoInverse(ref_force, ref_moment,
+                                             fmd_buffer.ee_pos, fmd_buffer.cop_pos, fmd_buffer.ee_rot, ee_names, fmd_buffer.limb_gains,
+                                             new_refzmp, hrp::Vector3(foot_origin_rot * ref_zmp + foot_origin_pos),
+                                             eefm_gravitational_acceleration * total_mass, dt,
+                                             DEBUGP, std::string(instance_name),
+                                             (st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP));
+      }
+      // for debug output
+      new_refzmp = foot_origin_rot.transpose() * (new_refzmp - foot_origin_pos);
+    }
+
+    // foor modif
+    if (control_mode == MODE_ST) {
+      hrp::Vector3 f_diff(hrp::Vector3::Zero());
+      // moment control
+      for (size_t i = 0; i < stikp.size(); i++) {
+        STIKParam& ikp = stikp[i];
+        if (!is_feedback_control_enable[i]) continue;
+        hrp::Sensor* sensor = m_robot->sensor<hrp::ForceSensor>(ikp.sensor_name);
+        hrp::Link* target = m_robot->link(ikp.target_name);
+        // Convert moment at COP => moment at ee
+        size_t idx = contact_states_index_map[ikp.ee_name];
+        ikp.ref_moment = ref_moment[idx] + ((target->R * ikp.localCOPPos + target->p) - (target->R * ikp.localp + target->p)).cross(ref_force[idx]);
+        ikp.ref_force = ref_force[idx];
+        // Actual world frame =>
+        hrp::Vector3 sensor_force = (sensor->link->R * sensor->localR) * hrp::Vector3(input_wrenches[i].head<3>());
+        hrp::Vector3 sensor_moment = (sensor->link->R * sensor->localR) * hrp::Vector3(input_wrenches[i].tail<3>());
+        //hrp::Vector3 ee_moment = ((sensor->link->R * sensor->localPos + sensor->link->p) - (target->R * ikp.localCOPPos + target->p)).cross(sensor_force) + sensor_moment;
+        hrp::Vector3 ee_moment = ((sensor->link->R * sensor->localPos + sensor->link->p) - (target->R * ikp.localp + target->p)).cross(sensor_force) + sensor_moment;
+        // <= Actual world frame
+        // Convert force & moment as foot origin coords relative
+        ikp.ref_moment = foot_origin_rot.transpose() * ikp.ref_moment;
+        ikp.ref_force = foot_origin_rot.transpose() * ikp.ref_force;
+        sensor_force = foot_origin_rot.transpose() * sensor_force;
+        ee_moment = foot_origin_rot.transpose() * ee_moment;
+        if ( i == 0 ) f_diff += -1*sensor_force;
+        else f_diff += sensor_force;
+        // Moment limitation
+        hrp::Matrix33 ee_R(target->R * ikp.localR);
+        ikp.ref_moment = ee_R * vlimit((ee_R.transpose() * ikp.ref_moment), ikp.eefm_ee_moment_limit);
+        // calcDampingControl
+        // d_foot_rpy and d_foot_pos is (actual) foot origin coords relative value because these use foot origin coords relative force & moment
+        { // Rot
+          //   Basically Equation (16) and (17) in the paper [1]
+            hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * ikp.eefm_rot_damping_gain * 10 + transition_smooth_gain * ikp.eefm_rot_damping_gain;
+            ikp.d_foot_rpy = calcDampingControl(ikp.ref_moment, ee_moment, ikp.d_foot_rpy, tmp_damping_gain, ikp.eefm_rot_time_const);
+            ikp.d_foot_rpy = vlimit(ikp.d_foot_rpy, -1 * ikp.eefm_rot_compensation_limit, ikp.eefm_rot_compensation_limit);
+        }
+        if (!eefm_use_force_difference_control) { // Pos
+            hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * ikp.eefm_pos_damping_gain * 10 + transition_smooth_gain * ikp.eefm_pos_damping_gain;
+            ikp.d_foot_pos = calcDampingControl(ikp.ref_force, sensor_force, ikp.d_foot_pos, tmp_damping_gain, ikp.eefm_pos_time_const_support);
+            ikp.d_foot_pos = vlimit(ikp.d_foot_pos, -1 * ikp.eefm_pos_compensation_limit, ikp.eefm_pos_compensation_limit);
+        }
+        // Actual ee frame =>
+        ikp.ee_d_foot_rpy = ee_R.transpose() * (foot_origin_rot * ikp.d_foot_rpy);
+      }
+
+      if (eefm_use_force_difference_control) {
+          // fxyz control
+          // foot force difference control version
+          //   Basically Equation (18) in the paper [1]
+          hrp::Vector3 ref_f_diff = (stikp[1].ref_force-stikp[0].ref_force);
+          if ( (contact_states[contact_states_index_map["rleg"]] && contact_states[contact_states_index_map["lleg"]]) // Reference : double support phase
+               || (isContact(0) && isContact(1)) ) { // Actual : double support phase
+              // Temporarily use first pos damping gain (stikp[0])
+              hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * stikp[0].eefm_pos_damping_gain * 10 + transition_smooth_gain * stikp[0].eefm_pos_damping_gain;
+              pos_ctrl = calcDampingControl (ref_f_diff, f_diff, pos_ctrl,
+                                             tmp_damping_gain, stikp[0].eefm_pos_time_const_support);
+          } else {
+              double remain_swing_time;
+              if ( !contact_states[contact_states_index_map["rleg"]] ) { // rleg swing
+                  remain_swing_time = input_swing_support_time[contact_states_index_map["rleg"]];
+              } else { // lleg swing
+                  remain_swing_time = input_swing_support_time[contact_states_index_map["lleg"]];
+              }
+              // std::cerr << "st " << remain_swing_time << " rleg " << contact_states[contact_states_index_map["rleg"]] << " lleg " << contact_states[contact_states_index_map["lleg"]] << std::endl;
+              double tmp_ratio = std::max(0.0, std::min(1.0, 1.0 - (remain_swing_time-eefm_pos_margin_time)/eefm_pos_transition_time)); // 0=>1
+              // Temporarily use first pos damping gain (stikp[0])
+              hrp::Vector3 tmp_damping_gain = (1-transition_smooth_gain) * stikp[0].eefm_pos_damping_gain * 10 + transition_smooth_gain * stikp[0].eefm_pos_damping_gain;
+              hrp::Vector3 tmp_time_const = (1-tmp_ratio)*eefm_pos_time_const_swing*hrp::Vector3::Ones()+tmp_ratio*stikp[0].eefm_pos_time_const_support;
+              pos_ctrl = calcDampingControl (tmp_ratio * ref_f_diff, tmp_ratio * f_diff, pos_ctrl, tmp_damping_gain, tmp_time_const);
+          }
+          // zctrl = vlimit(zctrl, -0.02, 0.02);
+          // Temporarily use first pos compensation limit (stikp[0])
+          pos_ctrl = vlimit(pos_ctrl, -1 * stikp[0].eefm_pos_compensation_limit * 2, stikp[0].eefm_pos_compensation_limit * 2);
+          // Divide pos_ctrl into rfoot and lfoot
+          stikp[0].d_foot_pos = -0.5 * pos_ctrl;
+          stikp[1].d_foot_pos = 0.5 * pos_ctrl;
+      }
+      if (DEBUGP) {
+        std::cerr << "[" << instance_name << "] Control values" << std::endl;
+        if (eefm_use_force_difference_control) {
+            std::cerr << "[" << instance_name << "]   "
+                      << "pos_ctrl    = [" << pos_ctrl(0)*1e3 << " " << pos_ctrl(1)*1e3 << " "<< pos_ctrl(2)*1e3 << "] [mm]" << std::endl;
+        }
+        for (size_t i = 0; i < ee_names.size(); i++) {
+            std::cerr << "[" << instance_name << "]   "
+                      << "d_foot_pos (" << ee_names[i] << ")  = [" << stikp[i].d_foot_pos(0)*1e3 << " " << stikp[i].d_foot_pos(1)*1e3 << " " << stikp[i].d_foot_pos(2)*1e3 << "] [mm]" << std::endl;
+            std::cerr << "[" << instance_name << "]   "
+                      << "d_foot_rpy (" << ee_names[i] << ")  = [" << stikp[i].d_foot_rpy(0)*180.0/M_PI << " " << stikp[i].d_foot_rpy(1)*180.0/M_PI << " " << stikp[i].d_foot_rpy(2)*180.0/M_PI << "] [deg]" << std::endl;
+        }
+      }
+      // foot force independent damping control
+      // for (size_t i = 0; i < 2; i++) {
+      //   f_zctrl[i] = calcDampingControl (ref_force[i](2),
+      //                                    fz[i], f_zctrl[i], eefm_pos_damping_gain, eefm_pos_time_const);
+      //   f_zctrl[i] = vlimit(f_zctrl[i], -0.05, 0.05);
+      // }
+    }
+  } // st_algorithm == OpenHRP::StabilizerService::EEFM
+
+  for ( int i = 0; i < m_robot->numJoints(); i++ ){
+    m_robot->joint(i)->q = qrefv[i];
+  }
+  m_robot->rootLink()->p = target_root_p;
+  m_robot->rootLink()->R = target_root_R;
+  if ( !(control_mode == MODE_IDLE || control_mode == MODE_AIR) ) {
+    for (size_t i = 0; i < jpe_v.size(); i++) {
+      if (is_ik_enable[i]) {
+        for ( int j = 0; j < jpe_v[i]->numJoints(); j++ ){
+          int idx = jpe_v[i]->joint(j)->jointId;
+          m_robot->joint(idx)->q = qorg[idx];
+        }
+      }
+    }
+    m_robot->rootLink()->p(0) = current_root_p(0);
+    m_robot->rootLink()->p(1) = current_root_p(1);
+    m_robot->rootLink()->R = current_root_R;
+    m_robot->calcForwardKinematics();
+  }
+  copy (contact_states.begin(), contact_states.end(), prev_contact_states.begin());
+}
+
+void StabilizerCore::getTargetParameters ()
+{
+  // Reference world frame =>
+  // update internal robot model
+  if ( transition_count == 0 ) {
+    transition_smooth_gain = 1.0;
+  } else {
+    double max_transition_count = transition_time / dt;
+    transition_smooth_gain = 1/(1+exp(-9.19*(((max_transition_count - std::fabs(transition_count)) / max_transition_count) - 0.5)));
+  }
+  if (transition_count > 0) {
+    for ( int i = 0; i < m_robot->numJoints(); i++ ){
+      m_robot->joint(i)->q = ( input_q_ref[i] - transition_joint_q[i] ) * transition_smooth_gain + transition_joint_q[i];
+    }
+  } else {
+    for ( int i = 0; i < m_robot->numJoints(); i++ ){
+      m_robot->joint(i)->q = input_q_ref[i];
+    }
+  }
+  if ( transition_count < 0 ) {
+    transition_count++;
+  } else if ( transition_count > 0 ) {
+    if ( transition_count == 1 ) {
+      std::cerr << "[" << instance_name << "] Move to MODE_IDLE" << std::endl;
+      reset_emergency_flag = true;
+    }
+    transition_count--;
+  }
+  for ( int i = 0; i < m_robot->numJoints(); i++ ){
+    qrefv[i] = m_robot->joint(i)->q;
+  }
+  m_robot->rootLink()->p = input_base_pos;
+  target_root_p = m_robot->rootLink()->p;
+  target_root_R = hrp::rotFromRpy(input_base_rpy);
+  m_robot->rootLink()->R = target_root_R;
+  m_robot->calcForwardKinematics();
+  ref_zmp = m_robot->rootLink()->R * input_zmp_ref + m_robot->rootLink()->p; // base frame -> world frame
+  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
+    // apply inverse system
+    hrp::Vector3 tmp_ref_zmp = calcZMPDelayInverse(ref_zmp, prev_ref_zmp, eefm_zmp_delay_time_const[0], dt);
+    prev_ref_zmp = ref_zmp;
+    ref_zmp = tmp_ref_zmp;
+  }
+  ref_cog = m_robot->calcCM();
+  for (size_t i = 0; i < stikp.size(); i++) {
+    hrp::Link* target = m_robot->link(stikp[i].target_name);
+    //target_ee_p[i] = target->p + target->R * stikp[i].localCOPPos;
+    target_ee_p[i] = target->p + target->R * stikp[i].localp;
+    target_ee_R[i] = target->R * stikp[i].localR;
+  }
+  // <= Reference world frame
+
+  if (st_algorithm == OpenHRP::StabilizerService::EEFM || st_algorithm == OpenHRP::StabilizerService::EEFMQP || st_algorithm == OpenHRP::StabilizerService::EEFMQPCOP) {
+    // Reference foot_origin frame =>
+    hrp::Vector3 foot_origin_pos;
+    hrp::Matrix33 foot_origin_rot;
+    calcFootOriginCoords (foot_origin_pos, foot_origin_rot);
+    // initialize for new_refzmp
+    new_refzmp = ref_zmp;
+    rel_cog = m_robot->rootLink()->R.transpose() * (ref_cog-m_robot->rootLink()->p);
+    // convert world (current-tmp) => local (foot_origin)
+    zmp_origin_off = ref_zmp(2) - foot_origin_pos(2);
+    ref_zmp = foot_origin_rot.transpose() * (ref_zmp - foot_origin_pos);
+    ref_cog = foot_origin_rot.transpose() * (ref_cog - foot_origin_pos);
+    new_refzmp = foot_origin_rot.transpose() * (new_refzmp - foot_origin_pos);
+    if (contact_states != prev_contact_states) {
+      ref_cogvel = (foot_origin_rot.transpose() * prev_ref_foot_origin_rot) * ref_cogvel;
+    } else {
+      ref_cogvel = (ref_cog - prev_ref_cog)/dt;
+    }
+    prev_ref_foot_origin_rot = foot_origin_rot;
+    for (size_t i = 0; i < stikp.size(); i++) {
+      //target_ee_diff_p[i] += foot_origin_rot.transpose() * (target_ee_p[i] - foot_origin_pos);
+      target_ee_diff_p[i] = foot_origin_rot.transpose() * (target_ee_p[i] - foot_origin_pos);
+    }
+    target_foot_origin_rot = foot_origin_rot;
+    // capture point
+    ref_cp = ref_cog + ref_cogvel / std::sqrt(eefm_gravitational_acceleration / (ref_cog - ref_zmp)(2));
+    rel_ref_cp = hrp::Vector3(ref_cp(0), ref_cp(1), ref_zmp(2));
+    rel_ref_cp = m_robot->rootLink()->R.transpose() * ((foot_origin_pos + foot_origin_rot * rel_ref_cp) - m_robot->rootLink()->p);
+    // <= Reference foot_origin frame
+  } else {
+    ref_cogvel = (ref_cog - prev_ref_cog)/dt;
+  } // st_algorithm == OpenHRP::StabilizerService::EEFM
+  prev_ref_cog = ref_cog;
+  // Calc swing support limb gain param
+  calcSwingSupportLimbGain();
+}
+
+bool StabilizerCore::calcZMP(hrp::Vector3& ret_zmp, const double zmp_z)
+{
+  double tmpzmpx = 0;
+  double tmpzmpy = 0;
+  double tmpfz = 0, tmpfz2 = 0.0;
+  for (size_t i = 0; i < stikp.size(); i++) {
+    if (!is_zmp_calc_enable[i]) continue;
+    hrp::ForceSensor* sensor = m_robot->sensor<hrp::ForceSensor>(stikp[i].sensor_name);
+    hrp::Vector3 fsp = sensor->link->p + sensor->link->R * sensor->localPos;
+    hrp::Matrix33 tmpR;
+    rats::rotm3times(tmpR, sensor->link->R, sensor->localR);
+    hrp::Vector3 nf = tmpR * hrp::Vector3(input_wrenches[i].head<3>());
+    hrp::Vector3 nm = tmpR * hrp::Vector3(input_wrenches[i].tail<3>());
+    tmpzmpx += nf(2) * fsp(0) - (fsp(2) - zmp_z) * nf(0) - nm(1);
+    tmpzmpy += nf(2) * fsp(1) - (fsp(2) - zmp_z) * nf(1) + nm(0);
+    tmpfz += nf(2);
+    // calc ee-local COP
+    hrp::Link* target = m_robot->link(stikp[i].target_name);
+    hrp::Matrix33 eeR = target->R * stikp[i].localR;
+    hrp::Vector3 ee_fsp = eeR.transpose() * (fsp - (target->p + target->R * stikp[i].localp)); // ee-local force sensor pos
+    nf = eeR.transpose() * nf;
+    nm = eeR.transpose() * nm;
+    // ee-local total moment and total force at ee position
+    double tmpcopmy = nf(2) * ee_fsp(0) - nf(0) * ee_fsp(2) - nm(1);
+    double tmpcopmx = nf(2) * ee_fsp(1) - nf(1) * ee_fsp(2) + nm(0);
+    double tmpcopfz = nf(2);
+    cop_info[i*3] = tmpcopmx;
+    cop_info[i*3+1] = tmpcopmy;
+    cop_info[i*3+2] = tmpcopfz;
+    prev_act_force_z[i] = 0.85 * prev_act_force_z[i] + 0.15 * nf(2); // filter, cut off 5[Hz]
+    tmpfz2 += prev_act_force_z[i];
+  }
+  if (tmpfz2 < contact_decision_threshold) {
+    ret_zmp = act_zmp;
+    return false; // in the air
+  } else {
+    ret_zmp = hrp::Vector3(tmpzmpx / tmpfz, tmpzmpy / tmpfz, zmp_z);
+    return true; // on ground
+  }
+};
+
+void StabilizerCore::calcStateForEmergencySignal()
+{
+  // COP Check
+  bool is_cop_outside = false;
+  if (DEBUGP) {
+      std::cerr << "[" << instance_name << "] Check Emergency State (seq = " << (is_seq_interpolating?"interpolating":"empty") << ")" << std::endl;
+  }
+  if (on_ground && transition_count == 0 && control_mode == MODE_ST) {
+    if (DEBUGP) {
+        std::cerr << "[" << instance_name << "] COP check" << std::endl;
+    }
+    for (size_t i = 0; i < stikp.size(); i++) {
+      if (stikp[i].ee_name.find("leg") == std::string::npos) continue;
+      // check COP inside
+      if (cop_info[i*3+2] > 20.0 ) {
+        hrp::Vector3 tmpcop(cop_info[i*3+1]/cop_info[i*3+2], cop_info[i*3]/cop_info[i*3+2], 0);
+        is_cop_outside = is_cop_outside ||
+            (!szd->is_inside_foot(tmpcop, stikp[i].ee_name=="lleg", cop_check_margin) ||
+             szd->is_front_of_foot(tmpcop, cop_check_margin) ||
+             szd->is_rear_of_foot(tmpcop, cop_check_margin));
+        if (DEBUGP) {
+            std::cerr << "[" << instance_name << "]   [" << stikp[i].ee_name << "] "
+                      << "outside(" << !szd->is_inside_foot(tmpcop, stikp[i].ee_name=="lleg", cop_check_margin) << ") "
+                      << "front(" << szd->is_front_of_foot(tmpcop, cop_check_margin) << ") "
+                      << "rear(" << szd->is_rear_of_foot(tmpcop, cop_check_margin) << ")" << std::endl;
+        }
+      } else {
+        is_cop_outside = true;
+      }
+    }
+  } else {
+    is_cop_outside = false;
+  }
+  // CP Check
+  bool is_cp_outside = false;
+  if (on_ground && transition_count == 0 && control_mode == MODE_ST) {
+    SimpleZMPDistributor::leg_type support_leg;
+    size_t l_idx, r_idx;
+    Eigen::Vector2d tmp_cp;
+    for (size_t i = 0; i < rel_ee_name.size(); i++) {
+      if (rel_ee_name[i]=="rleg") r_idx = i;
+      else if (rel_ee_name[i]=="lleg") l_idx = i;
+    }
+    for (size_t i = 0; i < 2; i++) {
+      tmp_cp(i) = act_cp(i);
+    }
+    if (isContact(contact_states_index_map["rleg"]) && isContact(contact_states_index_map["lleg"])) support_leg = SimpleZMPDistributor::BOTH;
+    else if (isContact(contact_states_index_map["rleg"])) support_leg = SimpleZMPDistributor::RLEG;
+    else if (isContact(contact_states_index_map["lleg"])) support_leg = SimpleZMPDistributor::LLEG;
+    if (!is_walking || is_estop_while_walking) is_cp_outside = !szd->is_inside_support_polygon(tmp_cp, rel_ee_pos, rel_ee_rot, rel_ee_name, support_leg, cp_check_margin, - sbp_cog_offset);
+    if (DEBUGP) {
+      std::cerr << "[" << instance_name << "] CP value " << "[" << act_cp(0) << "," << act_cp(1) << "] [m]" << std::endl;
+    }
+    if (is_cp_outside) {
+      if (initial_cp_too_large_error || loop % static_cast <int>(0.2/dt) == 0 ) { // once per 0.2[s]
+        std::cerr << "[" << instance_name << "] CP too large error " << "[" << act_cp(0) << "," << act_cp(1) << "] [m]" << std::endl;
+      }
+      initial_cp_too_large_error = false;
+    } else {
+      initial_cp_too_large_error = true;
+    }
+  }
+  // Total check for emergency signal
+  switch (emergency_check_mode) {
+  case OpenHRP::StabilizerService::NO_CHECK:
+      is_emergency = false;
+      break;
+  case OpenHRP::StabilizerService::COP:
+      is_emergency = is_cop_outside && is_seq_interpolating;
+      break;
+  case OpenHRP::StabilizerService::CP:
+      is_emergency = is_cp_outside;
+      break;
+  default:
+      break;
+  }
+  if (DEBUGP) {
+      std::cerr << "[" << instance_name << "] EmergencyCheck ("
+                << (emergency_check_mode == OpenHRP::StabilizerService::NO_CHECK?"NO_CHECK": (emergency_check_mode == OpenHRP::StabilizerService::COP?"COP":"CP") )
+                << ") " << (is_emergency?"emergency":"non-emergency") << std::endl;
+  }
+  rel_ee_pos.clear();
+  rel_ee_rot.clear();
+  rel_ee_name.clear();
+};
+
+void StabilizerCore::moveBasePosRotForBodyRPYControl ()
+{
+    // Body rpy control
+    //   Basically Equation (1) and (2) in the paper [1]
+    hrp::Vector3 ref_root_rpy = hrp::rpyFromRot(target_root_R);
+    for (size_t i = 0; i < 2; i++) {
+        d_rpy[i] = transition_smooth_gain * (eefm_body_attitude_control_gain[i] * (ref_root_rpy(i) - act_base_rpy(i)) - 1/eefm_body_attitude_control_time_const[i] * d_rpy[i]) * dt + d_rpy[i];
+    }
+    rats::rotm3times(current_root_R, target_root_R, hrp::rotFromRpy(d_rpy[0], d_rpy[1], 0));
+    m_robot->rootLink()->R = current_root_R;
+    m_robot->rootLink()->p = target_root_p + target_root_R * rel_cog - current_root_R * rel_cog;
+    m_robot->calcForwardKinematics();
+    current_base_rpy = hrp::rpyFromRot(m_robot->rootLink()->R);
+    current_base_pos = m_robot->rootLink()->p;
+};
+
+void StabilizerCore::calcSwingSupportLimbGain ()
+{
+    for (size_t i = 0; i < stikp.size(); i++) {
+        STIKParam& ikp = stikp[i];
+        if (contact_states[i]) { // Support
+            ikp.support_time += dt;
+            if (ikp.support_time > eefm_pos_transition_time) {
+                ikp.swing_support_gain = (input_swing_support_time[i] / eefm_pos_transition_time);
+            } else {
+                ikp.swing_support_gain = (ikp.support_time / eefm_pos_transition_time);
+            }
+            ikp.swing_support_gain = std::max(0.0, std::min(1.0, ikp.swing_support_gain));
+        } else { // Swing
+            ikp.swing_support_gain = 0.0;
+            ikp.support_time = 0.0;
+        }
+    }
+    if (DEBUGP) {
+        std::cerr << "[" << instance_name << "] SwingSupportLimbGain = [";
+        for (size_t i = 0; i < stikp.size(); i++) std::cerr << stikp[i].swing_support_gain << " ";
+        std::cerr << "], contact_states = [";
+        for (size_t i = 0; i < stikp.size(); i++) std::cerr << contact_states[i] << " ";
+        std::cerr << "], sstime = [";
+        for (size_t i = 0; i < stikp.size(); i++) std::cerr << input_swing_support_time[i] << " ";
+        std::cerr << "]" << std::endl;
+    }
+}
+
+void StabilizerCore::calcTPCC() {
+    // stabilizer loop
+      // Choi's feedback law
+      hrp::Vector3 cog = m_robot->calcCM();
+      hrp::Vector3 newcog = hrp::Vector3::Zero();
+      hrp::Vector3 dcog(ref_cog - act_cog);
+      hrp::Vector3 dzmp(ref_zmp - act_zmp);
+      for (size_t i = 0; i < 2; i++) {
+        double uu = ref_cogvel(i) - k_tpcc_p[i] * transition_smooth_gain * dzmp(i)
+                                  + k_tpcc_x[i] * transition_smooth_gain * dcog(i);
+        newcog(i) = uu * dt + cog(i);
+      }
+
+      moveBasePosRotForBodyRPYControl ();
+
+      // target at ee => target at link-origin
+      hrp::Vector3 target_link_p[stikp.size()];
+      hrp::Matrix33 target_link_R[stikp.size()];
+      for (size_t i = 0; i < stikp.size(); i++) {
+        rats::rotm3times(target_link_R[i], target_ee_R[i], stikp[i].localR.transpose());
+        target_link_p[i] = target_ee_p[i] - target_ee_R[i] * stikp[i].localCOPPos;
+      }
+      // solveIK
+      //   IK target is link origin pos and rot, not ee pos and rot.
+      //for (size_t jj = 0; jj < 5; jj++) {
+      for (size_t jj = 0; jj < 3; jj++) {
+        hrp::Vector3 tmpcm = m_robot->calcCM();
+        for (size_t i = 0; i < 2; i++) {
+          m_robot->rootLink()->p(i) = m_robot->rootLink()->p(i) + 0.9 * (newcog(i) - tmpcm(i));
+        }
+        m_robot->calcForwardKinematics();
+        for (size_t i = 0; i < stikp.size(); i++) {
+          if (is_ik_enable[i]) {
+              jpe_v[i]->calcInverseKinematics2Loop(target_link_p[i], target_link_R[i], 1.0, stikp[i].avoid_gain, stikp[i].reference_gain, &qrefv, transition_smooth_gain);
+          }
+        }
+      }
+}
+
+
+void StabilizerCore::calcEEForceMomentControl() {
+
+    // stabilizer loop
+      // return to referencea
+      m_robot->rootLink()->R = target_root_R;
+      m_robot->rootLink()->p = target_root_p;
+      for ( int i = 0; i < m_robot->numJoints(); i++ ) {
+        m_robot->joint(i)->q = qrefv[i];
+      }
+      for (size_t i = 0; i < jpe_v.size(); i++) {
+        if (is_ik_enable[i]) {
+          for ( int j = 0; j < jpe_v[i]->numJoints(); j++ ){
+            int idx = jpe_v[i]->joint(j)->jointId;
+            m_robot->joint(idx)->q = qorg[idx];
+          }
+        }
+      }
+      // Fix for toe joint
+      for (size_t i = 0; i < jpe_v.size(); i++) {
+          if (is_ik_enable[i]) {
+              if (jpe_v[i]->numJoints() == 7) {
+                  int idx = jpe_v[i]->joint(jpe_v[i]->numJoints() -1)->jointId;
+                  m_robot->joint(idx)->q = qrefv[idx];
+              }
+          }
+      }
+
+      moveBasePosRotForBodyRPYControl ();
+
+      // Convert d_foot_pos in foot origin frame => "current" world frame
+      hrp::Vector3 foot_origin_pos;
+      hrp::Matrix33 foot_origin_rot;
+      calcFootOriginCoords (foot_origin_pos, foot_origin_rot);
+      for (size_t i = 0; i < stikp.size(); i++)
+          current_d_foot_pos[i] = foot_origin_rot * stikp[i].d_foot_pos;
+
+      // Feet and hands modification
+      //   tmpp_list and tmpR_list are modified ee Pos and Rot
+#define deg2rad(x) ((x) * M_PI / 180.0)
+      for (size_t i = 0; i < stikp.size(); i++) {
+          hrp::Vector3 tmpp; // modified ee Pos
+          hrp::Matrix33 tmpR; // modified ee Rot
+          if (is_feedback_control_enable[i]) {
+              // moment control
+              rats::rotm3times(tmpR, target_ee_R[i], hrp::rotFromRpy(-stikp[i].ee_d_foot_rpy(0), -stikp[i].ee_d_foot_rpy(1), 0));
+              // total_target_foot_p[i](0) = target_foot_p[i](0);
+              // total_target_foot_p[i](1) = target_foot_p[i](1);
+              // foot force difference control version
+              // total_target_foot_p[i](2) = target_foot_p[i](2) + (i==0?0.5:-0.5)*zctrl;
+              // foot force independent damping control
+              tmpp = target_ee_p[i] - current_d_foot_pos[i];
+          } else {
+            target_ee_diff_p[i] *= transition_smooth_gain;
+            tmpp = target_ee_p[i] + eefm_ee_pos_error_p_gain * target_foot_origin_rot * target_ee_diff_p_filter[i]->passFilter(target_ee_diff_p[i]);// tempolarily disabled
+            tmpR = target_ee_R[i];
+          }
+          tmpR_list[i] = tmpR;
+          tmpp_list[i] = tmpp;
+      }
+      // follow swing foot rotation to target one in single support phase on the assumption that the robot rotates around support foot.
+      {
+          hrp::Matrix33 cur_sup_R, act_sup_R;
+          hrp::Vector3 cur_sup_p;
+          for (size_t i = 0; i < stikp.size(); i++) {
+              if (isContact(i)) {
+                  cur_sup_R = tmpR_list.at(i);
+                  cur_sup_p = tmpp_list.at(i);
+                  act_sup_R = act_ee_R.at(i);
+                  break;
+              }
+          }
+          for (size_t i = 0; i < stikp.size(); i++) {
+              if (isContact(i) or contact_states[contact_states_index_map[stikp[i].ee_name]]) {
+                  /* method A */
+                  // for (size_t j = 0; j < 3; j++) {
+                  //     d_rpy_swing.at(i)[j] = (-1 / stikp[i].eefm_swing_rot_time_const[j] * d_rpy_swing.at(i)[j]) * dt + d_rpy_swing.at(i)[j];
+                  //     d_pos_swing.at(i)[j] = (-1 / stikp[i].eefm_swing_pos_time_const[j] * d_pos_swing.at(i)[j]) * dt + d_pos_swing.at(i)[j];
+                  // }
+                  /* method B */
+                  d_rpy_swing.at(i) = hrp::Vector3::Zero();
+                  d_pos_swing.at(i) = hrp::Vector3::Zero();
+              } else {
+                  /* rotation */
+                  {
+                      hrp::Matrix33 cur_swg_R = tmpR_list.at(i);
+                      hrp::Matrix33 swg_R_relative_to_sup_R = cur_sup_R.transpose() * cur_swg_R;
+                      hrp::Matrix33 new_swg_R;
+                      rats::rotm3times(new_swg_R, act_sup_R, swg_R_relative_to_sup_R);
+                      rats::rotm3times(new_swg_R, foot_origin_rot, new_swg_R);
+                      hrp::Vector3 tmp_diff_rpy = hrp::rpyFromRot(new_swg_R.transpose() * tmpR_list.at(i));
+                      for (size_t j = 0; j < 3; j++) {
+                          /* method A */
+                          // d_rpy_swing.at(i)[j] = (stikp[i].eefm_swing_rot_spring_gain[j] * tmp_diff_rpy[j] - 1 / stikp[i].eefm_swing_rot_time_const[j] * d_rpy_swing.at(i)[j]) * dt + d_rpy_swing.at(i)[j];
+                          /* method B */
+                          d_rpy_swing.at(i)[j] = tmp_diff_rpy[j] * stikp[i].eefm_swing_rot_spring_gain[j];
+                      }
+                      rats::rotm3times(tmpR_list.at(i), tmpR_list.at(i), hrp::rotFromRpy(d_rpy_swing.at(i)));
+                  }
+                  /* position */
+                  {
+                      hrp::Vector3 cur_swg_p = tmpp_list.at(i);
+                      hrp::Vector3 swg_p_relative_to_sup_R = cur_sup_R.transpose() * (cur_swg_p - cur_sup_p);
+                      hrp::Vector3 new_swg_p = (foot_origin_rot * act_sup_R) * swg_p_relative_to_sup_R + cur_sup_p;
+                      hrp::Vector3 tmp_diff_pos = tmpp_list.at(i) - new_swg_p;
+                      for (size_t j = 0; j < 3; j++) {
+                          /* method A */
+                          // d_pos_swing.at(i)[j] = (stikp[i].eefm_swing_pos_spring_gain[j] * tmp_diff_pos[j] - 1 / stikp[i].eefm_swing_pos_time_const[j] * d_pos_swing.at(i)[j]) * dt + d_pos_swing.at(i)[j];
+                          /* method B */
+                          d_pos_swing.at(i)[j] = tmp_diff_pos[j] * stikp[i].eefm_swing_pos_spring_gain[j];
+                      }
+                      tmpp_list.at(i) = tmpp_list.at(i) + d_pos_swing.at(i);
+                  }
+              }
+          }
+          if (DEBUGP) {
+              for (size_t i = 0; i < stikp.size(); i++) {
+                  if (is_feedback_control_enable[i]) {
+                      std::cerr << "[" << instance_name << "]   "
+                                << "d_rpy_swing (" << stikp[i].ee_name << ")  = " << (d_rpy_swing.at(i) / M_PI * 180.0).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[deg]" << std::endl;
+                      std::cerr << "[" << instance_name << "]   "
+                                << "d_pos_swing (" << stikp[i].ee_name << ")  = " << (d_pos_swing.at(i) * 1e3).format(Eigen::IOFormat(Eigen::StreamPrecision, 0, ", ", ", ", "", "", "    [", "]")) << "[mm]" << std::endl;
+                  }
+              }
+          }
+      }
+      // solveIK
+      //   IK target is link origin pos and rot, not ee pos and rot.
+      for (size_t jj = 0; jj < 3; jj++) {
+        for (size_t i = 0; i < stikp.size(); i++) {
+          if (is_ik_enable[i]) {
+              jpe_v[i]->calcInverseKinematics2Loop(tmpp_list.at(i), tmpR_list.at(i), 1.0, 0.001, 0.01, &qrefv, transition_smooth_gain,
+                                                   //stikp[i].localCOPPos;
+                                                   stikp[i].localp,
+                                                   stikp[i].localR);
+          }
+        }
+      }
+}
+
+// Damping control functions with the control period, see EEFMLaw.h
+double StabilizerCore::calcDampingControl (const double tau_d, const double tau, const double prev_d,
+                                       const double DD, const double TT)
+{
+  return ::calcDampingControl(tau_d, tau, prev_d, DD, TT, dt);
+};
+
+hrp::Vector3 StabilizerCore::calcDampingControl (const hrp::Vector3& tau_d, const hrp::Vector3& tau, const hrp::Vector3& prev_d,
+                                             const hrp::Vector3& DD, const hrp::Vector3& TT)
+{
+  return ::calcDampingControl(tau_d, tau, prev_d, DD, TT, dt);
+};
+
+void StabilizerCore::sync_2_st ()
+{
+  std::cerr << "[" << instance_name << "] " << "Sync IDLE => ST"  << std::endl;
+  pangx_ref = pangy_ref = pangx = pangy = 0;
+  rdx = rdy = rx = ry = 0;
+  d_rpy[0] = d_rpy[1] = 0;
+  pdr = hrp::Vector3::Zero();
+  pos_ctrl = hrp::Vector3::Zero();
+  for (size_t i = 0; i < stikp.size(); i++) {
+    target_ee_diff_p[i] = hrp::Vector3::Zero();
+    target_ee_diff_r[i] = hrp::Vector3::Zero();
+    prev_target_ee_diff_r[i] = hrp::Vector3::Zero();
+    d_rpy_swing[i] = hrp::Vector3::Zero();
+    d_pos_swing[i] = hrp::Vector3::Zero();
+    STIKParam& ikp = stikp[i];
+    ikp.d_foot_pos = ikp.d_foot_rpy = ikp.ee_d_foot_rpy = hrp::Vector3::Zero();
+  }
+  if (on_ground) {
+    transition_count = -1 * transition_time / dt;
+    control_mode = MODE_ST;
+  } else {
+    transition_count = 0;
+    control_mode = MODE_AIR;
+  }
+}
+
+void StabilizerCore::sync_2_idle ()
+{
+  std::cerr << "[" << instance_name << "] " << "Sync ST => IDLE"  << std::endl;
+  transition_count = transition_time / dt;
+  for (int i = 0; i < m_robot->numJoints(); i++ ) {
+    transition_joint_q[i] = m_robot->joint(i)->q;
+  }
+}
+
+void StabilizerCore::commitParameter(STParamUpdate& i_stp)
+{
+  // called by Stabilizer with m_mutex locked. Only values are copied or
+  // swapped, so that no memory is allocated
+  for (size_t i = 0; i < 2; i++) {
+    k_tpcc_p[i] = i_stp.k_tpcc_p[i];
+    k_tpcc_x[i] = i_stp.k_tpcc_x[i];
+    k_brot_p[i] = i_stp.k_brot_p[i];
+    k_brot_tc[i] = i_stp.k_brot_tc[i];
+    eefm_k1[i] = i_stp.eefm_k1[i];
+    eefm_k2[i] = i_stp.eefm_k2[i];
+    eefm_k3[i] = i_stp.eefm_k3[i];
+    eefm_zmp_delay_time_const[i] = i_stp.eefm_zmp_delay_time_const[i];
+    ref_zmp_aux(i) = i_stp.ref_zmp_aux[i];
+    eefm_body_attitude_control_gain[i] = i_stp.eefm_body_attitude_control_gain[i];
+    eefm_body_attitude_control_time_const[i] = i_stp.eefm_body_attitude_control_time_const[i];
+    ref_cp(i) = i_stp.ref_cp[i];
+    act_cp(i) = i_stp.act_cp[i];
+  }
+  for (size_t j = 0; j < stikp.size(); j++) {
+      const STIKParam& param = i_stp.stikp[j];
+      if (i_stp.is_damping_parameter_ok) {
+          stikp[j].eefm_pos_damping_gain = param.eefm_pos_damping_gain;
+          stikp[j].eefm_pos_time_const_support = param.eefm_pos_time_const_support;
+          stikp[j].eefm_swing_pos_spring_gain = param.eefm_swing_pos_spring_gain;
+          stikp[j].eefm_swing_pos_time_const = param.eefm_swing_pos_time_const;
+          stikp[j].eefm_rot_damping_gain = param.eefm_rot_damping_gain;
+          stikp[j].eefm_rot_time_const = param.eefm_rot_time_const;
+          stikp[j].eefm_swing_rot_spring_gain = param.eefm_swing_rot_spring_gain;
+          stikp[j].eefm_swing_rot_time_const = param.eefm_swing_rot_time_const;
+          stikp[j].eefm_ee_moment_limit = param.eefm_ee_moment_limit;
+          stikp[j].eefm_pos_compensation_limit = param.eefm_pos_compensation_limit;
+          stikp[j].eefm_rot_compensation_limit = param.eefm_rot_compensation_limit;
+      }
+      if (i_stp.is_ik_limb_parameter_valid) {
+          jpe_v[j]->setOptionalWeightVector(i_stp.ik_optional_weight_vectors[j]);
+          jpe_v[j]->setSRGain(i_stp.sr_gains[j]);
+          stikp[j].avoid_gain = param.avoid_gain;
+          stikp[j].reference_gain = param.reference_gain;
+          jpe_v[j]->setManipulabilityLimit(i_stp.manipulability_limits[j]);
+      }
+  }
+  eefm_pos_time_const_swing = i_stp.eefm_pos_time_const_swing;
+  eefm_pos_transition_time = i_stp.eefm_pos_transition_time;
+  eefm_pos_margin_time = i_stp.eefm_pos_margin_time;
+  szd->set_leg_inside_margin(i_stp.leg_inside_margin);
+  szd->set_leg_outside_margin(i_stp.leg_outside_margin);
+  szd->set_leg_front_margin(i_stp.leg_front_margin);
+  szd->set_leg_rear_margin(i_stp.leg_rear_margin);
+  szd->swap_vertices(i_stp.support_polygon_vertices);
+  eefm_use_force_difference_control = i_stp.eefm_use_force_difference_control;
+  act_cogvel_filter->setCutOffFreq(i_stp.eefm_cogvel_cutoff_freq);
+  szd->set_wrench_alpha_blending(i_stp.eefm_wrench_alpha_blending);
+  szd->set_alpha_cutoff_freq(i_stp.eefm_alpha_cutoff_freq);
+  eefm_gravitational_acceleration = i_stp.eefm_gravitational_acceleration;
+  eefm_ee_pos_error_p_gain = i_stp.eefm_ee_pos_error_p_gain;
+  eefm_ee_rot_error_p_gain = i_stp.eefm_ee_rot_error_p_gain;
+  for (size_t i = 0; i < target_ee_diff_p_filter.size(); i++) {
+      target_ee_diff_p_filter[i]->setCutOffFreq(i_stp.eefm_ee_error_cutoff_freq);
+  }
+  emergency_check_mode = i_stp.emergency_check_mode;
+  transition_time = i_stp.transition_time;
+  cop_check_margin = i_stp.cop_check_margin;
+  for (size_t i = 0; i < cp_check_margin.size(); i++) {
+    cp_check_margin[i] = i_stp.cp_check_margin[i];
+  }
+  contact_decision_threshold = i_stp.contact_decision_threshold;
+  is_estop_while_walking = i_stp.is_estop_while_walking;
+  // the following parameters were checked against control_mode by
+  // setParameter, and they are skipped if it has changed since then
+  if (control_mode == MODE_IDLE) {
+      if (i_stp.is_ik_enable_set) {
+          for (size_t i = 0; i < is_ik_enable.size(); i++) is_ik_enable[i] = i_stp.is_ik_enable[i];
+      }
+      if (i_stp.is_feedback_control_enable_set) {
+          for (size_t i = 0; i < is_feedback_control_enable.size(); i++) is_feedback_control_enable[i] = i_stp.is_feedback_control_enable[i];
+      }
+      if (i_stp.is_zmp_calc_enable_set) {
+          for (size_t i = 0; i < is_zmp_calc_enable.size(); i++) is_zmp_calc_enable[i] = i_stp.is_zmp_calc_enable[i];
+      }
+      for (size_t j = 0; j < stikp.size(); j++) {
+          if (i_stp.is_end_effector_set[j]) {
+              stikp[j].localp = i_stp.stikp[j].localp;
+              stikp[j].localR = i_stp.stikp[j].localR;
+          }
+      }
+      if (i_stp.is_foot_origin_offset_set) {
+          for (size_t i = 0; i < 2; i++) foot_origin_offset[i] = i_stp.foot_origin_offset[i];
+      }
+      if (i_stp.is_st_algorithm_set) st_algorithm = i_stp.st_algorithm;
+  }
+}
+void StabilizerCore::getParameterUpdate(STParamUpdate& o_stp)
+{
+  for (size_t i = 0; i < 2; i++) {
+    o_stp.k_tpcc_p[i] = k_tpcc_p[i];
+    o_stp.k_tpcc_x[i] = k_tpcc_x[i];
+    o_stp.k_brot_p[i] = k_brot_p[i];
+    o_stp.k_brot_tc[i] = k_brot_tc[i];
+    o_stp.eefm_k1[i] = eefm_k1[i];
+    o_stp.eefm_k2[i] = eefm_k2[i];
+    o_stp.eefm_k3[i] = eefm_k3[i];
+    o_stp.eefm_zmp_delay_time_const[i] = eefm_zmp_delay_time_const[i];
+    o_stp.ref_zmp_aux[i] = ref_zmp_aux(i);
+    o_stp.eefm_body_attitude_control_gain[i] = eefm_body_attitude_control_gain[i];
+    o_stp.eefm_body_attitude_control_time_const[i] = eefm_body_attitude_control_time_const[i];
+    o_stp.ref_cp[i] = ref_cp(i);
+    o_stp.act_cp[i] = act_cp(i);
+  }
+  o_stp.stikp = stikp;
+  o_stp.is_damping_parameter_ok = true;
+  o_stp.is_ik_limb_parameter_valid = true;
+  o_stp.is_end_effector_set.assign(stikp.size(), false);
+  o_stp.ik_optional_weight_vectors.resize(stikp.size());
+  o_stp.sr_gains.resize(stikp.size());
+  o_stp.manipulability_limits.resize(stikp.size());
+  for (size_t j = 0; j < stikp.size(); j++) {
+      o_stp.ik_optional_weight_vectors[j].resize(jpe_v[j]->numJoints());
+      jpe_v[j]->getOptionalWeightVector(o_stp.ik_optional_weight_vectors[j]);
+      o_stp.sr_gains[j] = jpe_v[j]->getSRGain();
+      o_stp.manipulability_limits[j] = jpe_v[j]->getManipulabilityLimit();
+  }
+  o_stp.eefm_pos_time_const_swing = eefm_pos_time_const_swing;
+  o_stp.eefm_pos_transition_time = eefm_pos_transition_time;
+  o_stp.eefm_pos_margin_time = eefm_pos_margin_time;
+  o_stp.leg_inside_margin = szd->get_leg_inside_margin();
+  o_stp.leg_outside_margin = szd->get_leg_outside_margin();
+  o_stp.leg_front_margin = szd->get_leg_front_margin();
+  o_stp.leg_rear_margin = szd->get_leg_rear_margin();
+  szd->get_vertices(o_stp.support_polygon_vertices);
+  o_stp.eefm_use_force_difference_control = eefm_use_force_difference_control;
+  o_stp.eefm_cogvel_cutoff_freq = act_cogvel_filter->getCutOffFreq();
+  o_stp.eefm_wrench_alpha_blending = szd->get_wrench_alpha_blending();
+  o_stp.eefm_alpha_cutoff_freq = szd->get_alpha_cutoff_freq();
+  o_stp.eefm_gravitational_acceleration = eefm_gravitational_acceleration;
+  o_stp.eefm_ee_pos_error_p_gain = eefm_ee_pos_error_p_gain;
+  o_stp.eefm_ee_rot_error_p_gain = eefm_ee_rot_error_p_gain;
+  o_stp.eefm_ee_error_cutoff_freq = target_ee_diff_p_filter[0]->getCutOffFreq();
+  o_stp.is_ik_enable = is_ik_enable;
+  o_stp.is_feedback_control_enable = is_feedback_control_enable;
+  o_stp.is_zmp_calc_enable = is_zmp_calc_enable;
+  o_stp.is_ik_enable_set = o_stp.is_feedback_control_enable_set = o_stp.is_zmp_calc_enable_set = false;
+  o_stp.emergency_check_mode = emergency_check_mode;
+  o_stp.transition_time = transition_time;
+  o_stp.cop_check_margin = cop_check_margin;
+  o_stp.cp_check_margin = cp_check_margin;
+  o_stp.contact_decision_threshold = contact_decision_threshold;
+  o_stp.is_estop_while_walking = is_estop_while_walking;
+  o_stp.is_foot_origin_offset_set = false;
+  for (size_t i = 0; i < 2; i++) o_stp.foot_origin_offset[i] = foot_origin_offset[i];
+  o_stp.is_st_algorithm_set = false;
+  o_stp.st_algorithm = st_algorithm;
+}
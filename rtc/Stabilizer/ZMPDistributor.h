@@ -11,8 +11,10 @@
 #define ZMP_DISTRIBUTOR_H
 
 #include <hrpModel/Body.h>
+#include <algorithm>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include "../ImpedanceController/JointPathEx.h"
 #include "../TorqueFilter/IIRFilter.h"
 #include <hrpUtil/MatrixSolvers.h>
@@ -35,20 +37,68 @@ public:
     {
         return foot_vertices[foot_idx][vtx_idx];
     };
+    size_t get_foot_vertex_num (const size_t foot_idx) const { return foot_vertices[foot_idx].size(); };
     void set_vertices (const std::vector<std::vector<Eigen::Vector2d> >& vs) { foot_vertices = vs; };
+    void swap_vertices (std::vector<std::vector<Eigen::Vector2d> >& vs) { foot_vertices.swap(vs); };
     void get_vertices (std::vector<std::vector<Eigen::Vector2d> >& vs) { vs = foot_vertices; };
     void print_vertices (const std::string& str)
     {
-        for (size_t i = 0; i < foot_vertices.size(); i++) {
+        print_vertices(str, foot_vertices);
+    }
+    static void print_vertices (const std::string& str, const std::vector<std::vector<Eigen::Vector2d> >& vs)
+    {
+        for (size_t i = 0; i < vs.size(); i++) {
             std::cerr << "[" << str << "]   vs = ";
-            for (size_t j = 0; j < foot_vertices[i].size(); j++) {
-                std::cerr << "[" << foot_vertices[i][j](0) << " " << foot_vertices[i][j](1) << "] ";
+            for (size_t j = 0; j < vs[i].size(); j++) {
+                std::cerr << "[" << vs[i][j](0) << " " << vs[i][j](1) << "] ";
             }
             std::cerr << "[m]" << std::endl;;
         }
     }
 };
 
+// Inputs and outputs of the force moment distribution of one control cycle, one element per feedback-controlled end effector.
+//   They are reserved once and cleared in every cycle, so that memory is not allocated after the first cycle.
+struct ForceMomentDistributionBuffer
+{
+    std::vector<hrp::Vector3> ee_pos, cop_pos, ref_force, ref_moment;
+    std::vector<hrp::Matrix33> ee_rot;
+    std::vector<std::string> ee_names;
+    std::vector<double> limb_gains;
+    void reserve (const size_t n)
+    {
+        ee_pos.reserve(n);
+        cop_pos.reserve(n);
+        ee_rot.reserve(n);
+        ee_names.reserve(n);
+        limb_gains.reserve(n);
+        ref_force.reserve(n);
+        ref_moment.reserve(n);
+    };
+    void clear ()
+    {
+        ee_pos.clear();
+        cop_pos.clear();
+        ee_rot.clear();
+        ee_names.clear();
+        limb_gains.clear();
+        ref_force.clear();
+        ref_moment.clear();
+    };
+    void push_back (const hrp::Vector3& _ee_pos, const hrp::Vector3& _cop_pos, const hrp::Matrix33& _ee_rot, const std::string& _ee_name,
+                    const double _limb_gain, const hrp::Vector3& _ref_force, const hrp::Vector3& _ref_moment)
+    {
+        ee_pos.push_back(_ee_pos);
+        cop_pos.push_back(_cop_pos);
+        ee_rot.push_back(_ee_rot);
+        ee_names.push_back(_ee_name);
+        limb_gains.push_back(_limb_gain);
+        ref_force.push_back(_ref_force);
+        ref_moment.push_back(_ref_moment);
+    };
+    size_t size () const { return ee_names.size(); };
+};
+
 //
 
 class SimpleZMPDistributor
@@ -56,9 +106,10 @@ class SimpleZMPDistributor
     FootSupportPolygon fs;
     double leg_inside_margin, leg_outside_margin, leg_front_margin, leg_rear_margin, wrench_alpha_blending;
     boost::shared_ptr<FirstOrderLowPassFilter<double> > alpha_filter;
+    std::vector<double> eefm_alpha_vector, eefm_fz_alpha_vector; // buffers of distributeZMPToForceMoments
 public:
     enum leg_type {RLEG, LLEG, RARM, LARM, BOTH, ALL};
-    SimpleZMPDistributor (const double _dt) : wrench_alpha_blending (0.5)
+    SimpleZMPDistributor (const double _dt) : wrench_alpha_blending (0.5), eefm_alpha_vector(2), eefm_fz_alpha_vector(2)
     {
         alpha_filter = boost::shared_ptr<FirstOrderLowPassFilter<double> >(new FirstOrderLowPassFilter<double>(1e7, _dt, 0.5)); // [Hz], Almost no filter by default
     };
@@ -153,9 +204,22 @@ public:
         // leg_front_margin = fs.get_foot_vertex(0, 0)(0);
         // leg_rear_margin = std::fabs(fs.get_foot_vertex(0, 3)(0));
     };
+    // swap vertices with vs, which is used not to allocate memory in the real-time thread
+    void swap_vertices (std::vector<std::vector<Eigen::Vector2d> >& vs)
+    {
+        fs.swap_vertices(vs);
+    };
     void set_vertices_from_margin_params ()
     {
         std::vector<std::vector<Eigen::Vector2d> > vec;
+        calc_vertices_from_margin_params(vec, leg_front_margin, leg_rear_margin, leg_inside_margin, leg_outside_margin);
+        set_vertices(vec);
+    };
+    static void calc_vertices_from_margin_params (std::vector<std::vector<Eigen::Vector2d> >& vec,
+                                                  const double leg_front_margin, const double leg_rear_margin,
+                                                  const double leg_inside_margin, const double leg_outside_margin)
+    {
+        vec.clear();
         // RLEG
         {
             std::vector<Eigen::Vector2d> tvec;
@@ -190,7 +254,6 @@ public:
         //     tvec.push_back(Eigen::Vector2d(-1*leg_rear_margin, leg_inside_margin));
         //     vec.push_back(tvec);
         // }
-        set_vertices(vec);
     };
     // getter
     double get_wrench_alpha_blending () { return wrench_alpha_blending; };
@@ -320,14 +383,12 @@ public:
                                                const std::vector<std::string>& ee_name,
                                                const hrp::Vector3& ref_zmp)
     {
-        std::vector<double> distances;
         double tmpdistance = 0;
         for (size_t i = 0; i < ee_name.size(); i++) {
-            distances.push_back((cop_pos[i]-ref_zmp).norm());
             tmpdistance += (cop_pos[i]-ref_zmp).norm();
         }
         for (size_t i = 0; i < ee_name.size(); i++) {
-            alpha_vector[i] = tmpdistance/distances[i];
+            alpha_vector[i] = tmpdistance/(cop_pos[i]-ref_zmp).norm();
         }
     };
 
@@ -353,7 +414,8 @@ public:
                                       const hrp::Vector3& new_refzmp, const hrp::Vector3& ref_zmp,
                                       const double total_fz, const double dt, const bool printp = true, const std::string& print_str = "")
     {
-        std::vector<double> alpha_vector(2), fz_alpha_vector(2);
+        std::vector<double>& alpha_vector = eefm_alpha_vector;
+        std::vector<double>& fz_alpha_vector = eefm_fz_alpha_vector;
         calcAlphaVector(alpha_vector, fz_alpha_vector, ee_pos, ee_rot, ee_name, new_refzmp, ref_zmp);
         ref_foot_force[0] = hrp::Vector3(0,0, fz_alpha_vector[0] * total_fz);
         ref_foot_force[1] = hrp::Vector3(0,0, fz_alpha_vector[1] * total_fz);
@@ -512,49 +574,103 @@ public:
     };
 
 #ifdef USE_QPOASES
-    void solveForceMomentQPOASES (std::vector<hrp::dvector>& fret,
-                                  const size_t state_dim,
-                                  const size_t ee_num,
-                                  const hrp::dmatrix& Hmat,
-                                  const hrp::dvector& gvec)
-    {
-        real_t* H = new real_t[state_dim*state_dim];
-        real_t* g = new real_t[state_dim];
-        real_t* lb = new real_t[state_dim];
-        real_t* ub = new real_t[state_dim];
-        for (size_t i = 0; i < state_dim; i++) {
-            for (size_t j = 0; j < state_dim; j++) {
-                H[i*state_dim+j] = Hmat(i,j);
+    // QP solver and buffers of distributeZMPToForceMomentsQP for a number of
+    // end effectors. They are kept to hot start from the previous solution
+    // and not to allocate memory in every cycle.
+    struct QPForceMomentSolver
+    {
+        // vertex_nums is the number of vertices of the support polygon of each end effector
+        QPForceMomentSolver (const std::vector<size_t>& _vertex_nums, const size_t state_dim)
+            : problem(state_dim, 0), initialized(false),
+              vertex_nums(_vertex_nums), state_offsets(_vertex_nums.size(), 0),
+              H(state_dim, state_dim), Hmat(state_dim, state_dim, state_dim, H.data()), Amat(0, state_dim, state_dim, NULL),
+              g(state_dim), lb(state_dim), ub(state_dim), xopt(state_dim),
+              Gmat(3, state_dim), total_fm(3),
+              alpha_vector(_vertex_nums.size()), fz_alpha_vector(_vertex_nums.size()),
+              num_cold_starts(0), num_hot_starts(0)
+        {
+            Options options;
+            //options.enableFlippingBounds = BT_FALSE;
+            options.initialStatusBounds = ST_INACTIVE;
+            options.numRefinementSteps = 1;
+            options.enableCholeskyRefactorisation = 1;
+            //options.printLevel = PL_LOW;
+            options.printLevel = PL_NONE;
+            problem.setOptions( options );
+            lb.setZero();
+            ub.setConstant(1e10);
+            size_t max_num = 0;
+            for (size_t j = 0; j < vertex_nums.size(); j++) {
+                if (j > 0) state_offsets[j] = state_offsets[j-1] + vertex_nums[j-1];
+                ff.push_back(hrp::dvector(vertex_nums[j]));
+                mm.push_back(hrp::dmatrix(3, vertex_nums[j]));
+                max_num = std::max(max_num, vertex_nums[j]);
             }
-            g[i] = gvec(i);
-            lb[i] = 0.0;
-            ub[i] = 1e10;
-        }
-        QProblemB example( state_dim );
-        Options options;
-        //options.enableFlippingBounds = BT_FALSE;
-        options.initialStatusBounds = ST_INACTIVE;
-        options.numRefinementSteps = 1;
-        options.enableCholeskyRefactorisation = 1;
-        //options.printLevel = PL_LOW;
-        options.printLevel = PL_NONE;
-        example.setOptions( options );
-        /* Solve first QP. */
+            cx.resize(max_num);
+            cy.resize(max_num);
+        };
+        // hotstart of SQProblem accepts a new H, which changes every cycle.
+        // There are no constraints other than bounds.
+        SQProblem problem;
+        bool initialized;
+        std::vector<size_t> vertex_nums, state_offsets;
+        hrp::dmatrix H;
+        // wrap H and the empty constraint matrix for qpOASES without copying them.
+        // H is symmetric, so its column-major data is passed as it is
+        SymDenseMat Hmat;
+        DenseMatrix Amat;
+        hrp::dvector g, lb, ub, xopt;
+        hrp::dmatrix Gmat;
+        hrp::dvector total_fm;
+        std::vector<hrp::dvector> ff;
+        std::vector<hrp::dmatrix> mm;
+        std::vector<double> cx, cy;
+        std::vector<double> alpha_vector, fz_alpha_vector;
+        size_t num_cold_starts, num_hot_starts;
+    };
+    std::map<size_t, boost::shared_ptr<QPForceMomentSolver> > qp_solvers; // key is the number of end effectors
+
+    QPForceMomentSolver& getQPForceMomentSolver (const size_t ee_num)
+    {
+        boost::shared_ptr<QPForceMomentSolver>& s = qp_solvers[ee_num];
+        bool changed = !s;
+        for (size_t j = 0; !changed && j < ee_num; j++) {
+            changed = (s->vertex_nums[j] != fs.get_foot_vertex_num(j));
+        }
+        // made again only when vertices of support polygons are changed
+        if (changed) {
+            std::vector<size_t> vertex_nums(ee_num);
+            size_t state_dim = 0;
+            for (size_t j = 0; j < ee_num; j++) {
+                vertex_nums[j] = fs.get_foot_vertex_num(j);
+                state_dim += vertex_nums[j];
+            }
+            s = boost::shared_ptr<QPForceMomentSolver>(new QPForceMomentSolver(vertex_nums, state_dim));
+        }
+        return *s;
+    };
+
+    void solveForceMomentQPOASES (QPForceMomentSolver& s)
+    {
+        bool solved = false;
         int nWSR = 10;
-        example.init( H,g,lb,ub, nWSR,0 );
-        real_t* xOpt = new real_t[state_dim];
-        example.getPrimalSolution( xOpt );
-        size_t state_dim_one = state_dim / ee_num;
-        for (size_t fidx = 0; fidx < ee_num; fidx++) {
-            for (size_t i = 0; i < state_dim_one; i++) {
-                fret[fidx](i) = xOpt[i+state_dim_one*fidx];
+        if (s.initialized) {
+            // the new H is factorized starting from the previous active set
+            solved = s.problem.hotstart( &s.Hmat,s.g.data(),&s.Amat,s.lb.data(),s.ub.data(),NULL,NULL, nWSR,0 ) == SUCCESSFUL_RETURN;
+            if (solved) s.num_hot_starts++;
+        }
+        if (!solved) {
+            /* Solve first QP. */
+            nWSR = 10;
+            s.initialized = s.problem.init( &s.Hmat,s.g.data(),&s.Amat,s.lb.data(),s.ub.data(),NULL,NULL, nWSR,0 ) == SUCCESSFUL_RETURN;
+            s.num_cold_starts++;
+        }
+        s.problem.getPrimalSolution( s.xopt.data() );
+        for (size_t fidx = 0; fidx < s.vertex_nums.size(); fidx++) {
+            for (size_t i = 0; i < s.vertex_nums[fidx]; i++) {
+                s.ff[fidx](i) = s.xopt(s.state_offsets[fidx]+i);
             }
         }
-        delete[] H;
-        delete[] g;
-        delete[] lb;
-        delete[] ub;
-        delete[] xOpt;
     };
 
     void distributeZMPToForceMomentsQP (std::vector<hrp::Vector3>& ref_foot_force, std::vector<hrp::Vector3>& ref_foot_moment,
@@ -568,7 +684,13 @@ public:
                                         const bool use_cop_distribution = false)
     {
         size_t ee_num = ee_name.size();
-        std::vector<double> alpha_vector(ee_num), fz_alpha_vector(ee_num);
+        // forces at vertices of each support polygon
+        QPForceMomentSolver& qp = getQPForceMomentSolver(ee_num);
+        const std::vector<size_t>& vertex_nums = qp.vertex_nums;
+        const std::vector<size_t>& offsets = qp.state_offsets;
+        size_t state_dim = qp.H.rows();
+        std::vector<double>& alpha_vector = qp.alpha_vector;
+        std::vector<double>& fz_alpha_vector = qp.fz_alpha_vector;
         if ( use_cop_distribution ) {
             //calcAlphaVectorFromCOP(alpha_vector, fz_alpha_vector, cop_pos, ee_name, new_refzmp, ref_zmp);
             calcAlphaVectorFromCOPDistance(alpha_vector, fz_alpha_vector, cop_pos, ee_name, new_refzmp, ref_zmp);
@@ -579,82 +701,88 @@ public:
         // QP
         double norm_weight = 1e-7;
         double cop_weight = 1e-3;
-        hrp::dvector total_fm(3);
+        hrp::dvector& total_fm = qp.total_fm;
         total_fm(0) = total_fz;
         total_fm(1) = 0;
         total_fm(2) = 0;
-        size_t state_dim = 4*ee_num, state_dim_one = 4; // TODO
         //
-        std::vector<hrp::dvector> ff(ee_num, hrp::dvector(state_dim_one));
-        std::vector<hrp::dmatrix> mm(ee_num, hrp::dmatrix(3, state_dim_one));
+        std::vector<hrp::dvector>& ff = qp.ff;
+        std::vector<hrp::dmatrix>& mm = qp.mm;
         //
-        hrp::dmatrix Hmat = hrp::dmatrix::Zero(state_dim,state_dim);
-        hrp::dvector gvec = hrp::dvector::Zero(state_dim);
+        hrp::dmatrix& Hmat = qp.H;
+        hrp::dvector& gvec = qp.g;
+        Hmat.setZero();
+        gvec.setZero();
         double alpha_thre = 1e-20;
         // fz_alpha inversion for weighing matrix
         for (size_t i = 0; i < fz_alpha_vector.size(); i++) {
             fz_alpha_vector[i] = (fz_alpha_vector[i] < alpha_thre) ? 1/alpha_thre : 1/fz_alpha_vector[i];
         }
         for (size_t j = 0; j < fz_alpha_vector.size(); j++) {
-            for (size_t i = 0; i < state_dim_one; i++) {
-                Hmat(i+j*state_dim_one,i+j*state_dim_one) = norm_weight * fz_alpha_vector[j];
+            for (size_t i = 0; i < vertex_nums[j]; i++) {
+                Hmat(offsets[j]+i,offsets[j]+i) = norm_weight * fz_alpha_vector[j];
             }
         }
-        hrp::dmatrix Gmat(3,state_dim);
+        hrp::dmatrix& Gmat = qp.Gmat;
         for (size_t i = 0; i < state_dim; i++) {
             Gmat(0,i) = 1.0;
         }
         for (size_t fidx = 0; fidx < ee_num; fidx++) {
-            for (size_t i = 0; i < state_dim_one; i++) {
+            for (size_t i = 0; i < vertex_nums[fidx]; i++) {
                 hrp::Vector3 fpos = ee_rot[fidx]*hrp::Vector3(fs.get_foot_vertex(fidx,i)(0), fs.get_foot_vertex(fidx,i)(1), 0) + ee_pos[fidx];
                 mm[fidx](0,i) = 1.0;
                 mm[fidx](1,i) = -(fpos(1)-cop_pos[fidx](1));
                 mm[fidx](2,i) = (fpos(0)-cop_pos[fidx](0));
-                Gmat(1,i+state_dim_one*fidx) = -(fpos(1)-new_refzmp(1));
-                Gmat(2,i+state_dim_one*fidx) = (fpos(0)-new_refzmp(0));
+                Gmat(1,offsets[fidx]+i) = -(fpos(1)-new_refzmp(1));
+                Gmat(2,offsets[fidx]+i) = (fpos(0)-new_refzmp(0));
             }
             //std::cerr << "fpos " << fpos[0] << " " << fpos[1] << std::endl;
         }
-        Hmat += Gmat.transpose() * Gmat;
-        gvec += -1 * Gmat.transpose() * total_fm;
+        Hmat.noalias() += Gmat.transpose() * Gmat;
+        gvec.noalias() -= Gmat.transpose() * total_fm;
         // std::cerr << "Gmat " << std::endl;
         // std::cerr << Gmat << std::endl;
         // std::cerr << "total_fm " << std::endl;
         // std::cerr << total_fm << std::endl;
         //
+        // Kmat^T * KW * Kmat and Kmat^T * KW * reff, where Kmat sums forces of
+        // each end effector and KW = diag(fz_weight)
         {
-            hrp::dmatrix Kmat = hrp::dmatrix::Zero(ee_num,state_dim);
-            hrp::dmatrix KW = hrp::dmatrix::Zero(ee_num, ee_num);
-            hrp::dvector reff(ee_num);
+            double fz_weight = 0.0, reff = total_fz/2.0;
             for (size_t j = 0; j < ee_num; j++) {
-                for (size_t i = 0; i < state_dim_one; i++) {
-                    Kmat(j,i+j*state_dim_one) = 1.0;
+                for (size_t i = 0; i < vertex_nums[j]; i++) {
+                    for (size_t k = 0; k < vertex_nums[j]; k++) {
+                        Hmat(offsets[j]+i,offsets[j]+k) += fz_weight;
+                    }
+                    gvec(offsets[j]+i) -= fz_weight * reff;
                 }
-                reff(j) = total_fz/2.0;
             }
-            Hmat += Kmat.transpose() * KW * Kmat;
-            gvec += -1 * Kmat.transpose() * KW * reff;
         }
+        // Cmat^T * CW * Cmat, where Cmat is moments of vertices around COP
+        // of each end effector and CW = diag(cop_weight)
         {
-            hrp::dmatrix Cmat = hrp::dmatrix::Zero(ee_num*2,state_dim);
-            hrp::dmatrix CW = hrp::dmatrix::Zero(ee_num*2,ee_num*2);
             hrp::Vector3 fpos;
+            std::vector<double>& cx = qp.cx;
+            std::vector<double>& cy = qp.cy;
             for (size_t j = 0; j < ee_num; j++) {
-                for (size_t i = 0; i < state_dim_one; i++) {
+                for (size_t i = 0; i < vertex_nums[j]; i++) {
                     fpos = ee_rot[j]*hrp::Vector3(fs.get_foot_vertex(j,i)(0), fs.get_foot_vertex(j,i)(1), 0) + ee_pos[j];
-                    Cmat(j*2,  i+j*state_dim_one) = fpos(0) - cop_pos[j](0);
-                    Cmat(j*2+1,i+j*state_dim_one) = fpos(1) - cop_pos[j](1);
+                    cx[i] = fpos(0) - cop_pos[j](0);
+                    cy[i] = fpos(1) - cop_pos[j](1);
+                }
+                for (size_t i = 0; i < vertex_nums[j]; i++) {
+                    for (size_t k = 0; k < vertex_nums[j]; k++) {
+                        Hmat(offsets[j]+i,offsets[j]+k) += cop_weight * cx[i] * cx[k] + cop_weight * cy[i] * cy[k];
+                    }
                 }
-                CW(j*2,j*2) = CW(j*2+1,j*2+1) = cop_weight;
             }
-            Hmat += Cmat.transpose() * CW * Cmat;
         }
         // std::cerr << "H " << Hmat << std::endl;
         // std::cerr << "g " << gvec << std::endl;
-        solveForceMomentQPOASES(ff, state_dim, ee_num, Hmat, gvec);
-        hrp::dvector tmpv(3);
+        solveForceMomentQPOASES(qp);
+        hrp::Vector3 tmpv;
         for (size_t fidx = 0; fidx < ee_num; fidx++) {
-            tmpv = mm[fidx] * ff[fidx];
+            tmpv.noalias() = mm[fidx] * ff[fidx];
             ref_foot_force[fidx] = hrp::Vector3(0,0,tmpv(0));
             ref_foot_moment[fidx] = -1*hrp::Vector3(tmpv(1),tmpv(2),0);
         }
@@ -0,0 +1,459 @@
+/* -*- coding:utf-8-unix; mode:c++; -*- */
+/* offline closed loop of gait_generator of AutoBalancer and StabilizerCore,
+   the control core of Stabilizer without RTC ports, which runs as fast as
+   possible.
+   In every tick, gait_generator makes the reference ZMP, COG and feet, from
+   which the reference joint angles, base and contact states are made as
+   AutoBalancer sends them to Stabilizer. StabilizerCore runs a control cycle
+   of Stabilizer from them and the state of a plant, i.e. the EEFM law, the
+   distribution of the ZMP into foot wrenches, foot damping control and IK of
+   legs. Its parameters are set by commitParameter as setParameter does.
+   The plant is a linear inverted pendulum whose ZMP follows the new ZMP of
+   StabilizerCore with a delay, or only kinematics (--test2). Joint angles,
+   the gyrometer and force sensors of the plant are made from the COG of the
+   pendulum and feet of StabilizerCore.
+   Time of a control cycle of StabilizerCore is reported as percentiles, and
+   trajectories every 10 ticks can be saved as a golden file and compared
+   with it. ctest compares them with testBalancerLoopTest*.golden.
+     testBalancerLoop [--test0|--test1|--test2] [--input file] [--save-golden file] [--golden file] [--tolerance value]
+   --input file : external force [N] on COG for each tick, "fx fy" in a line.
+                  Default is a lateral push of 40[N] for 0.1[s] at 2.0[s].
+*/
+#include "StabilizerCore.h"
+#include "../AutoBalancer/GaitGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <time.h>
+#include <hrpModel/Sensor.h>
+#include <boost/assign.hpp>
+#include "util/TestUtil.h"
+
+using namespace rats;
+
+class testBalancerLoop
+{
+    enum plant_type {LIPM, KINEMATICS};
+    // biped whose mass is at the root, so that its COG is the root
+    struct Biped {
+        hrp::BodyPtr body;
+        hrp::Link* ends[2];
+        hrp::JointPathExPtr legs[2];
+        hrp::dvector q;
+    };
+    double dt, total_mass, root_height, gravitational_acceleration, transition_time;
+    hrp::Vector3 cog, sole_offset;
+    std::vector<hrp::Vector3> leg_pos;
+    // options
+    std::string input_file, save_golden_file, golden_file;
+    double tolerance;
+    std::vector<std::vector<double> > input_force;
+    // results
+    std::vector<std::vector<double> > log;
+    std::vector<double> tick_times;
+
+    // biped with 6-DOF legs, root is WAIST, force sensors are at ankles and
+    // the gyrometer is at WAIST
+    void makeBiped (Biped& b)
+    {
+        b.body = makeTestBiped(root_height, leg_pos, b.ends);
+        hrp::Link* root = b.body->rootLink();
+        root->m = total_mass;
+        root->c = hrp::Vector3::Zero();
+        b.body->calcTotalMass();
+        const char* sensor_names[] = {"rfsensor", "lfsensor"};
+        for (int i = 0; i < 2; i++) {
+            b.legs[i] = hrp::JointPathExPtr(new hrp::JointPathEx(b.body, root, b.ends[i], dt, false, "testBalancerLoop"));
+            hrp::Sensor* s = b.body->createSensor(b.ends[i], hrp::Sensor::FORCE, i, sensor_names[i]);
+            s->localPos = hrp::Vector3::Zero();
+            s->localR = hrp::Matrix33::Identity();
+        }
+        hrp::Sensor* s = b.body->createSensor(root, hrp::Sensor::RATE_GYRO, 0, "gyrometer");
+        s->localPos = hrp::Vector3::Zero();
+        s->localR = hrp::Matrix33::Identity();
+        b.q.resize(b.body->numJoints());
+        for (int i = 0; i < b.body->numJoints(); i++) b.q(i) = b.body->joint(i)->q;
+        b.body->calcForwardKinematics();
+    };
+    // IK of legs from the root, localp is the position of targets in ankles
+    void solveLegs (Biped& b, const hrp::Vector3& root_p, const hrp::Matrix33& root_R,
+                    const hrp::Vector3 foot_p[2], const hrp::Matrix33 foot_R[2], const hrp::Vector3& localp)
+    {
+        b.body->rootLink()->p = root_p;
+        b.body->rootLink()->R = root_R;
+        b.body->calcForwardKinematics();
+        for (size_t jj = 0; jj < 3; jj++) {
+            for (size_t i = 0; i < 2; i++) {
+                b.legs[i]->calcInverseKinematics2Loop(foot_p[i], foot_R[i], 1.0, 0.001, 0.01, &b.q, 1.0, localp);
+            }
+        }
+        for (int i = 0; i < b.body->numJoints(); i++) b.q(i) = b.body->joint(i)->q;
+    };
+    void setZMPDistributor (SimpleZMPDistributor& szd)
+    {
+        szd.set_leg_inside_margin(0.070104);
+        szd.set_leg_outside_margin(0.070104);
+        szd.set_leg_front_margin(0.137525);
+        szd.set_leg_rear_margin(0.106925);
+        szd.set_vertices_from_margin_params();
+    };
+    // sets parameters as Stabilizer::setParameter does
+    void setParameter (StabilizerCore& st, const OpenHRP::StabilizerService::STAlgorithm st_algorithm)
+    {
+        StabilizerCore::STParamUpdate stp;
+        st.getParameterUpdate(stp);
+        stp.is_st_algorithm_set = true;
+        stp.st_algorithm = st_algorithm;
+        stp.transition_time = transition_time;
+        SimpleZMPDistributor szd(dt);
+        setZMPDistributor(szd);
+        stp.leg_inside_margin = szd.get_leg_inside_margin();
+        stp.leg_outside_margin = szd.get_leg_outside_margin();
+        stp.leg_front_margin = szd.get_leg_front_margin();
+        stp.leg_rear_margin = szd.get_leg_rear_margin();
+        szd.get_vertices(stp.support_polygon_vertices);
+        st.commitParameter(stp);
+    };
+    // inputs of Stabilizer which AutoBalancer sends
+    void setReference (StabilizerCore& st, Biped& ref, gait_generator& gg, const bool walking)
+    {
+        coordinates feet[2];
+        const std::vector<step_node>* steps[] = {&gg.get_support_leg_steps(), &gg.get_swing_leg_steps()};
+        for (size_t i = 0; i < 2; i++) {
+            for (size_t j = 0; j < steps[i]->size(); j++) {
+                feet[steps[i]->at(j).l_r == RLEG ? 0 : 1] = steps[i]->at(j).worldcoords;
+            }
+        }
+        coordinates mid;
+        mid_coords(mid, 0.5, feet[0], feet[1]);
+        hrp::Vector3 foot_p[2];
+        hrp::Matrix33 foot_R[2];
+        for (size_t i = 0; i < 2; i++) {
+            foot_p[i] = feet[i].pos;
+            foot_R[i] = feet[i].rot;
+        }
+        hrp::Vector3 root_p(gg.get_cog()(0), gg.get_cog()(1), root_height);
+        solveLegs(ref, root_p, mid.rot, foot_p, foot_R, sole_offset);
+        st.input_q_ref = ref.q;
+        st.input_base_pos = root_p;
+        st.input_base_rpy = hrp::rpyFromRot(mid.rot);
+        st.input_zmp_ref = mid.rot.transpose() * (gg.get_refzmp() - root_p);
+        std::vector<leg_type> support_states = gg.get_current_support_states();
+        const leg_type lr[] = {RLEG, LLEG};
+        for (size_t i = 0; i < 2; i++) {
+            if (walking) {
+                st.contact_states[i] = std::find(support_states.begin(), support_states.end(), lr[i]) != support_states.end();
+                st.input_swing_support_time[i] = gg.get_current_swing_time(lr[i]);
+            } else {
+                st.contact_states[i] = true;
+                st.input_swing_support_time[i] = 1.0;
+            }
+        }
+        st.is_walking = walking;
+    };
+    // inputs of Stabilizer which the plant sends. Legs of the plant reach
+    // ankles of Stabilizer from its root at the COG
+    void setActual (StabilizerCore& st, Biped& act, SimpleZMPDistributor& act_szd, const hrp::Vector3& act_cog, const hrp::Vector3& act_zmp)
+    {
+        hrp::Link* out_root = st.m_robot->rootLink();
+        hrp::Vector3 foot_p[2];
+        hrp::Matrix33 foot_R[2];
+        for (size_t i = 0; i < 2; i++) {
+            hrp::Link* target = st.m_robot->link(st.stikp[i].target_name);
+            foot_p[i] = target->p;
+            foot_R[i] = target->R;
+        }
+        solveLegs(act, hrp::Vector3(act_cog(0), act_cog(1), out_root->p(2)), out_root->R, foot_p, foot_R, hrp::Vector3::Zero());
+        st.input_q_current = act.q;
+        st.input_rpy = hrp::rpyFromRot(act.body->rootLink()->R);
+        // foot wrenches which realize the ZMP, in frames of force sensors
+        std::vector<std::string> ee_names = boost::assign::list_of("rleg")("lleg");
+        std::vector<double> limb_gains(2, 1.0);
+        std::vector<hrp::Vector3> ee_pos(2), force(2), moment(2);
+        std::vector<hrp::Matrix33> ee_rot(2);
+        for (size_t i = 0; i < 2; i++) {
+            ee_pos[i] = act.ends[i]->p + act.ends[i]->R * sole_offset;
+            ee_rot[i] = act.ends[i]->R;
+        }
+        act_szd.distributeZMPToForceMoments(force, moment, ee_pos, ee_pos, ee_rot, ee_names, limb_gains,
+                                            act_zmp, act_zmp, total_mass * gravitational_acceleration, dt, false, "");
+        for (size_t i = 0; i < 2; i++) {
+            const hrp::Matrix33& R = act.ends[i]->R;
+            st.input_wrenches[i].head<3>() = R.transpose() * force[i];
+            st.input_wrenches[i].tail<3>() = R.transpose() * (moment[i] + (ee_pos[i] - act.ends[i]->p).cross(force[i]));
+        }
+    };
+    hrp::Vector3 externalForce (const size_t tick)
+    {
+        if (input_force.empty()) {
+            double t = tick * dt;
+            return hrp::Vector3(0, (t >= 2.0 && t < 2.1) ? 40.0 : 0.0, 0);
+        }
+        if (tick >= input_force.size()) return hrp::Vector3::Zero();
+        const std::vector<double>& f = input_force[tick];
+        return hrp::Vector3(f.size() > 0 ? f[0] : 0, f.size() > 1 ? f[1] : 0, 0);
+    };
+    bool readRows (const std::string& fname, std::vector<std::vector<double> >& rows)
+    {
+        std::ifstream ifs(fname.c_str());
+        if (!ifs) {
+            std::cerr << "[ng] cannot open " << fname << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(ifs, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream iss(line);
+            std::vector<double> row;
+            double v;
+            while (iss >> v) row.push_back(v);
+            rows.push_back(row);
+        }
+        return true;
+    };
+    /*
+      Start Stabilizer while standing and walk forward with the closed loop.
+      Returns false if COG of the plant deviates from the reference.
+    */
+    bool walk (const plant_type plant, const OpenHRP::StabilizerService::STAlgorithm st_algorithm)
+    {
+        Biped ref, act;
+        makeBiped(ref);
+        makeBiped(act);
+
+        // Stabilizer
+        StabilizerCore st;
+        st.dt = dt;
+        st.instance_name = "testBalancerLoop";
+        Biped out;
+        makeBiped(out);
+        st.m_robot = out.body;
+        const char* ee_names[] = {"rleg", "lleg"};
+        for (size_t i = 0; i < 2; i++) {
+            StabilizerCore::STIKParam ikp;
+            ikp.ee_name = ee_names[i];
+            ikp.target_name = out.ends[i]->name;
+            ikp.sensor_name = out.body->sensor(hrp::Sensor::FORCE, i)->name;
+            ikp.localp = ikp.localCOPPos = sole_offset;
+            ikp.localR = hrp::Matrix33::Identity();
+            st.addEndEffector(ikp, out.body->rootLink()->name);
+        }
+        st.initParameters();
+        setParameter(st, st_algorithm);
+
+        // AutoBalancer
+        std::vector<std::string> all_limbs = boost::assign::list_of("rleg")("lleg");
+        gait_generator gg(dt, leg_pos, all_limbs, 1e-3*150, 1e-3*50, 10, 1e-3*50);
+        coordinates start_ref_coords;
+        mid_coords(start_ref_coords, 0.5, coordinates(leg_pos[0]), coordinates(leg_pos[1]));
+        gg.go_pos_param_2_footstep_nodes_list(400*1e-3, 100*1e-3, 20, boost::assign::list_of(coordinates(leg_pos[0])), start_ref_coords, boost::assign::list_of(RLEG));
+        gg.initialize_gait_parameter(cog, boost::assign::list_of(step_node(LLEG, coordinates(leg_pos[1]), 0, 0, 0, 0)),
+                                     boost::assign::list_of(step_node(RLEG, coordinates(leg_pos[0]), 0, 0, 0, 0)));
+        while ( !gg.proc_one_tick() );
+
+        // plant
+        SimpleZMPDistributor act_szd(dt);
+        setZMPDistributor(act_szd);
+        hrp::Vector3 act_cog(gg.get_cog()), act_cogvel(hrp::Vector3::Zero()), act_zmp(gg.get_refzmp()), new_zmp(act_zmp);
+        act_zmp(2) = 0;
+        const double plant_height = cog(2);
+
+        // start Stabilizer as startStabilizer does, while standing
+        setReference(st, ref, gg, false);
+        st.execute();
+        setActual(st, act, act_szd, act_cog, act_zmp);
+        st.execute();
+        st.sync_2_st();
+        while (st.transition_count != 0) {
+            setReference(st, ref, gg, false);
+            st.execute();
+            setActual(st, act, act_szd, act_cog, act_zmp);
+        }
+        if (st.control_mode != StabilizerCore::MODE_ST) return checkResult(false, "Stabilizer has not started");
+
+        log.clear();
+        tick_times.clear();
+        tick_times.reserve(20/dt);
+        double max_cog_error = 0, wall_start = now();
+        size_t tick = 0;
+        bool walking = true;
+        while (walking) {
+            walking = gg.proc_one_tick();
+            setReference(st, ref, gg, walking);
+            if (plant == KINEMATICS) {
+                act_cog = gg.get_cog();
+                act_zmp = new_zmp;
+                setActual(st, act, act_szd, act_cog, act_zmp);
+            }
+            double t1 = now();
+            st.execute();
+            tick_times.push_back(now() - t1);
+            // new ZMP in the actual foot origin coordinates => world
+            hrp::Vector3 foot_origin_pos;
+            hrp::Matrix33 foot_origin_rot;
+            st.calcFootOriginCoords(foot_origin_pos, foot_origin_rot);
+            new_zmp = foot_origin_rot * st.new_refzmp + foot_origin_pos;
+            new_zmp(2) = 0;
+
+            // plant
+            if (plant == LIPM) {
+                act_zmp += (new_zmp - act_zmp) * dt / (st.eefm_zmp_delay_time_const[0] + dt);
+                hrp::Vector3 cogacc = gravitational_acceleration / plant_height * (act_cog - act_zmp) + externalForce(tick) / total_mass;
+                cogacc(2) = 0;
+                act_cogvel += cogacc * dt;
+                act_cog += act_cogvel * dt;
+                setActual(st, act, act_szd, act_cog, act_zmp);
+            }
+            max_cog_error = std::max(max_cog_error, hrp::Vector3(act_cog - gg.get_cog()).head<2>().norm());
+            if (tick % 10 == 0) {
+                std::vector<double> row;
+                row.push_back(tick * dt);
+                for (size_t i = 0; i < 2; i++) row.push_back(gg.get_refzmp()(i));
+                for (size_t i = 0; i < 2; i++) row.push_back(new_zmp(i));
+                for (size_t i = 0; i < 2; i++) row.push_back(act_zmp(i));
+                for (size_t i = 0; i < 2; i++) row.push_back(gg.get_cog()(i));
+                for (size_t i = 0; i < 2; i++) row.push_back(act_cog(i));
+                for (size_t i = 0; i < 2; i++) row.push_back(st.stikp[i].ref_force(2));
+                for (int i = 0; i < st.m_robot->numJoints(); i++) row.push_back(st.m_robot->joint(i)->q);
+                log.push_back(row);
+            }
+            tick++;
+        }
+        double wall_time = now() - wall_start;
+
+        bool ret = true;
+        char buf[256];
+        std::vector<double> sorted(tick_times);
+        std::sort(sorted.begin(), sorted.end());
+        const size_t n = sorted.size();
+        sprintf(buf, "%d ticks in %.3f[s] (%.1f times faster than real time), cycle time of Stabilizer p50 = %.2f[us], p90 = %.2f[us], p99 = %.2f[us], max = %.2f[us]",
+                (int)n, wall_time, n*dt/wall_time, sorted[n/2]*1e6, sorted[n*9/10]*1e6, sorted[n*99/100]*1e6, sorted[n-1]*1e6);
+        ret &= checkResult(true, buf);
+        sprintf(buf, "max COG error = %.2f[mm]", max_cog_error*1e3);
+        ret &= checkResult(max_cog_error < 0.04, buf);
+        if (!save_golden_file.empty()) ret &= saveGolden();
+        if (!golden_file.empty()) ret &= compareGolden();
+        return ret;
+    };
+    bool saveGolden ()
+    {
+        FILE* fp = fopen(save_golden_file.c_str(), "w");
+        if (fp == NULL) return checkResult(false, "cannot open " + save_golden_file);
+        fprintf(fp, "# time ref_zmp(x y) new_zmp(x y) act_zmp(x y) ref_cog(x y) act_cog(x y) ref_fz(r l) q...\n");
+        for (size_t i = 0; i < log.size(); i++) {
+            for (size_t j = 0; j < log[i].size(); j++) fprintf(fp, "%.12g ", log[i][j]);
+            fprintf(fp, "\n");
+        }
+        fclose(fp);
+        return checkResult(true, "saved " + save_golden_file);
+    };
+    bool compareGolden ()
+    {
+        std::vector<std::vector<double> > golden;
+        if (!readRows(golden_file, golden)) return false;
+        char buf[256];
+        if (golden.size() != log.size()) {
+            sprintf(buf, "number of rows is %d, but %d in %s", (int)log.size(), (int)golden.size(), golden_file.c_str());
+            return checkResult(false, buf);
+        }
+        double max_diff = 0;
+        size_t max_row = 0, max_col = 0;
+        for (size_t i = 0; i < log.size(); i++) {
+            if (golden[i].size() != log[i].size()) {
+                sprintf(buf, "number of columns at row %d is %d, but %d in %s", (int)i, (int)log[i].size(), (int)golden[i].size(), golden_file.c_str());
+                return checkResult(false, buf);
+            }
+            for (size_t j = 0; j < log[i].size(); j++) {
+                double d = std::fabs(log[i][j] - golden[i][j]);
+                if (d > max_diff) {
+                    max_diff = d;
+                    max_row = i;
+                    max_col = j;
+                }
+            }
+        }
+        sprintf(buf, "max difference from %s = %g at row %d, column %d", golden_file.c_str(), max_diff, (int)max_row, (int)max_col);
+        return checkResult(max_diff <= tolerance, buf);
+    };
+public:
+    std::vector<std::string> arg_strs;
+    testBalancerLoop () : dt(0.002), total_mass(56.0), root_height(0.64), gravitational_acceleration(9.80665), transition_time(1.0), tolerance(1e-6)
+    {
+        cog = 1e-3*hrp::Vector3(6.785, 1.54359, 806.831);
+        leg_pos.push_back(hrp::Vector3(0,1e-3*-105,0)); /* rleg */
+        leg_pos.push_back(hrp::Vector3(0,1e-3* 105,0)); /* lleg */
+        sole_offset = hrp::Vector3(0, 0, -0.07);
+    };
+    bool parse_params ()
+    {
+        for (size_t i = 0; i < arg_strs.size(); ++ i) {
+            if ( arg_strs[i]== "--input" ) {
+                if (++i < arg_strs.size()) input_file = arg_strs[i];
+            } else if ( arg_strs[i]== "--save-golden" ) {
+                if (++i < arg_strs.size()) save_golden_file = arg_strs[i];
+            } else if ( arg_strs[i]== "--golden" ) {
+                if (++i < arg_strs.size()) golden_file = arg_strs[i];
+            } else if ( arg_strs[i]== "--tolerance" ) {
+                if (++i < arg_strs.size()) tolerance = atof(arg_strs[i].c_str());
+            }
+        }
+        if (!input_file.empty()) return readRows(input_file, input_force);
+        return true;
+    };
+    bool test0 ()
+    {
+        std::cerr << "test0 : Walk with EEFM on a LIPM plant which is pushed" << std::endl;
+        return parse_params() && walk(LIPM, OpenHRP::StabilizerService::EEFM);
+    };
+    bool test1 ()
+    {
+        std::cerr << "test1 : Walk with EEFMQP on a LIPM plant which is pushed" << std::endl;
+        return parse_params() && walk(LIPM, OpenHRP::StabilizerService::EEFMQP);
+    };
+    bool test2 ()
+    {
+        std::cerr << "test2 : Walk with EEFM and kinematics-only feedback" << std::endl;
+        return parse_params() && walk(KINEMATICS, OpenHRP::StabilizerService::EEFM);
+    };
+};
+
+void print_usage ()
+{
+    std::cerr << "Usage : testBalancerLoop [test-type] [option]" << std::endl;
+    std::cerr << " [test-type] should be:" << std::endl;
+    std::cerr << "  --test0 : Walk with EEFM on a LIPM plant which is pushed" << std::endl;
+    std::cerr << "  --test1 : Walk with EEFMQP on a LIPM plant which is pushed" << std::endl;
+    std::cerr << "  --test2 : Walk with EEFM and kinematics-only feedback" << std::endl;
+    std::cerr << " [option] should be:" << std::endl;
+    std::cerr << "  --input file : external force on COG for each tick" << std::endl;
+    std::cerr << "  --save-golden file : save trajectories" << std::endl;
+    std::cerr << "  --golden file : compare trajectories with a saved file" << std::endl;
+    std::cerr << "  --tolerance value : tolerance of the comparison, 1e-6 by default" << std::endl;
+};
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+    if (argc >= 2) {
+        testBalancerLoop tbl;
+        for (int i = 2; i < argc; ++ i) {
+            tbl.arg_strs.push_back(std::string(argv[i]));
+        }
+        if (std::string(argv[1]) == "--test0") {
+            ret = tbl.test0() ? 0 : 2;
+        } else if (std::string(argv[1]) == "--test1") {
+            ret = tbl.test1() ? 0 : 2;
+        } else if (std::string(argv[1]) == "--test2") {
+            ret = tbl.test2() ? 0 : 2;
+        } else {
+            print_usage();
+            ret = 1;
+        }
+    } else {
+        print_usage();
+        ret = 1;
+    }
+    return ret;
+}
@@ -5,7 +5,11 @@
 #include <stdio.h>
 #include <cstdio>
 #include <iostream>
+#include <cstdlib>
+#include <time.h>
 #include "util/Hrpsys.h" // added for QNX compile
+#include "util/AllocationCounter.h"
+#include "util/TestUtil.h"
 
 class testZMPDistributor
 {
@@ -232,6 +236,145 @@ public:
         ee_rot.push_back(tmpr);
         gen_and_plot();
     };
+
+    bool test3 ()
+    {
+        std::cerr << "test3 : Benchmark of QP distribution with 2 and 4 end effectors" << std::endl;
+        parse_params();
+#ifdef USE_QPOASES
+        // arms have triangles of three vertices of support polygons of legs,
+        // so that the numbers of vertices differ among end effectors
+        std::vector<std::vector<Eigen::Vector2d> > vs;
+        szd->get_vertices(vs);
+        vs.push_back(std::vector<Eigen::Vector2d>(vs[0].begin(), vs[0].begin()+3));
+        vs.push_back(std::vector<Eigen::Vector2d>(vs[1].begin(), vs[1].begin()+3));
+        szd->set_vertices(vs);
+        std::vector<std::string> all_names;
+        all_names.push_back("rleg");
+        all_names.push_back("lleg");
+        all_names.push_back("rarm");
+        all_names.push_back("larm");
+        std::vector<hrp::Vector3> all_pos(leg_pos);
+        all_pos.push_back(hrp::Vector3(0.4,-0.2,0));
+        all_pos.push_back(hrp::Vector3(0.4,0.2,0));
+        bool ret = true;
+        for (size_t ee_num = 2; ee_num <= 4; ee_num += 2) {
+            std::vector<std::string> names(all_names.begin(), all_names.begin()+ee_num);
+            ee_pos.assign(all_pos.begin(), all_pos.begin()+ee_num);
+            cop_pos = ee_pos;
+            ee_rot.assign(ee_num, hrp::Matrix33::Identity());
+            std::vector<double> limb_gains(ee_num, 1.0);
+            std::vector<hrp::Vector3> ref_foot_force(ee_num, hrp::Vector3::Zero()), ref_foot_moment(ee_num, hrp::Vector3::Zero());
+            std::vector<hrp::Vector3> cold_force(ee_num, hrp::Vector3::Zero()), cold_moment(ee_num, hrp::Vector3::Zero());
+            // the same QP is solved from scratch every cycle for comparison
+            SimpleZMPDistributor cold(dt);
+            cold.set_leg_front_margin(szd->get_leg_front_margin());
+            cold.set_leg_rear_margin(szd->get_leg_rear_margin());
+            cold.set_leg_inside_margin(szd->get_leg_inside_margin());
+            cold.set_leg_outside_margin(szd->get_leg_outside_margin());
+            cold.set_vertices(vs);
+            // ZMP sways between feet for 8[s] and stays for 2[s]
+            size_t n = (size_t)(10/dt);
+            double sum_tm = 0, max_tm = 0, max_diff = 0, max_fz_error = 0;
+            num_allocation = 0;
+            for (size_t i = 0; i < n; i++) {
+                double t = std::min(i*dt, 8.0);
+                hrp::Vector3 refzmp(0.02*sin(2*M_PI*t/2.0), 0.08*sin(2*M_PI*t/4.0+0.5), 0);
+                count_allocation = i > 0;
+                double t1 = now();
+                szd->distributeZMPToForceMomentsQP(ref_foot_force, ref_foot_moment,
+                                                   ee_pos, cop_pos, ee_rot, names, limb_gains,
+                                                   refzmp, refzmp,
+                                                   total_fz, dt, false, "", (distribution_algorithm == EEFMQP2));
+                double tm = now() - t1;
+                count_allocation = false;
+                if (i > 0) {
+                    sum_tm += tm;
+                    if (tm > max_tm) max_tm = tm;
+                }
+                double fz = 0;
+                for (size_t j = 0; j < ee_num; j++) fz += ref_foot_force[j](2);
+                max_fz_error = std::max(max_fz_error, std::fabs(fz - total_fz));
+                cold.qp_solvers.clear();
+                cold.distributeZMPToForceMomentsQP(cold_force, cold_moment,
+                                                   ee_pos, cop_pos, ee_rot, names, limb_gains,
+                                                   refzmp, refzmp,
+                                                   total_fz, dt, false, "", (distribution_algorithm == EEFMQP2));
+                for (size_t j = 0; j < ee_num; j++) {
+                    max_diff = std::max(max_diff, (ref_foot_force[j] - cold_force[j]).norm());
+                    max_diff = std::max(max_diff, (ref_foot_moment[j] - cold_moment[j]).norm());
+                }
+            }
+            const SimpleZMPDistributor::QPForceMomentSolver& qp = *szd->qp_solvers[ee_num];
+            std::cerr << "  " << ee_num << " end effectors : avg = " << sum_tm/(n-1)*1e6 << "[us], max = " << max_tm*1e6
+                      << "[us], allocations = " << num_allocation << ", cold/hot starts = " << qp.num_cold_starts
+                      << "/" << qp.num_hot_starts << std::endl;
+            std::cerr << "    difference from cold start = " << max_diff << ", error of total fz = " << max_fz_error << "[N]" << std::endl;
+            ret &= (num_allocation == 0 && max_diff < 1e-3*total_fz && max_fz_error < 1e-2*total_fz);
+        }
+        return ret;
+#else
+        std::cerr << "  skipped because qpOASES is not used" << std::endl;
+        return false;
+#endif
+    };
+
+    bool test4 ()
+    {
+        std::cerr << "test4 : Allocations of the force moment distribution in the EEFM stabilizer cycle" << std::endl;
+        parse_params();
+        // end effectors of Stabilizer. Arms are not feedback-controlled.
+        std::vector<std::string> st_names;
+        st_names.push_back("rleg");
+        st_names.push_back("lleg");
+        st_names.push_back("rarm");
+        st_names.push_back("larm");
+        std::vector<bool> is_feedback_control_enable(st_names.size(), false);
+        is_feedback_control_enable[0] = is_feedback_control_enable[1] = true;
+        // buffer of Stabilizer, which is reserved in Stabilizer::onInitialize
+        ForceMomentDistributionBuffer fmd_buffer;
+        fmd_buffer.reserve(st_names.size());
+        bool ret = true;
+        for (size_t alg = 0; alg < 2; alg++) {
+            // walk in place for 4[s]
+            size_t n = (size_t)(4/dt);
+            double max_fz_error = 0;
+            num_allocation = 0;
+            for (size_t i = 0; i < n; i++) {
+                double t = i*dt;
+                hrp::Vector3 refzmp(0.02*sin(2*M_PI*t/2.0), 0.08*sin(2*M_PI*t/2.0+0.5), 0);
+                count_allocation = i > 0;
+                // Stabilizer::getActualParameters
+                fmd_buffer.clear();
+                for (size_t j = 0; j < st_names.size(); j++) {
+                    if (!is_feedback_control_enable[j]) continue;
+                    hrp::Matrix33 rot(hrp::rotFromRpy(0, 0, 0.1*sin(2*M_PI*t)*(j==0?1:-1)));
+                    hrp::Vector3 pos(leg_pos[j] + hrp::Vector3(0.05*sin(2*M_PI*t)*(j==0?1:-1), 0, 0));
+                    fmd_buffer.push_back(pos, pos + rot * hrp::Vector3(0.01, 0, 0), rot, st_names[j], 1.0,
+                                         hrp::Vector3(0, 0, total_fz/2), hrp::Vector3::Zero());
+                }
+                if (alg == 0) {
+                    szd->distributeZMPToForceMoments(fmd_buffer.ref_force, fmd_buffer.ref_moment,
+                                                     fmd_buffer.ee_pos, fmd_buffer.cop_pos, fmd_buffer.ee_rot, fmd_buffer.ee_names, fmd_buffer.limb_gains,
+                                                     refzmp, refzmp,
+                                                     total_fz, dt, false, "");
+                } else {
+                    szd->distributeZMPToForceMomentsQP(fmd_buffer.ref_force, fmd_buffer.ref_moment,
+                                                       fmd_buffer.ee_pos, fmd_buffer.cop_pos, fmd_buffer.ee_rot, fmd_buffer.ee_names, fmd_buffer.limb_gains,
+                                                       refzmp, refzmp,
+                                                       total_fz, dt, false, "", (distribution_algorithm == EEFMQP2));
+                }
+                count_allocation = false;
+                double fz = 0;
+                for (size_t j = 0; j < fmd_buffer.size(); j++) fz += fmd_buffer.ref_force[j](2);
+                max_fz_error = std::max(max_fz_error, std::fabs(fz - total_fz));
+            }
+            std::cerr << "  " << (alg == 0 ? "EEFM" : "EEFMQP") << " : allocations = " << num_allocation
+                      << " in " << n-1 << " cycles, error of total fz = " << max_fz_error << "[N]" << std::endl;
+            ret &= (num_allocation == 0 && max_fz_error < 1e-2*total_fz);
+        }
+        return ret;
+    };
 };
 
 class testZMPDistributorHRP2JSK : public testZMPDistributor
@@ -274,6 +417,8 @@ void print_usage ()
     std::cerr << "  --test0 : Default foot pos" << std::endl;
     std::cerr << "  --test1 : Fwd foot pos" << std::endl;
     std::cerr << "  --test2 : Rot foot pos" << std::endl;
+    std::cerr << "  --test3 : Benchmark of QP distribution with 2 and 4 end effectors" << std::endl;
+    std::cerr << "  --test4 : Allocations of the force moment distribution in the EEFM stabilizer cycle" << std::endl;
 };
 
 int main(int argc, char* argv[])
@@ -299,6 +444,10 @@ int main(int argc, char* argv[])
                 tzd->test1();
             } else if (std::string(argv[2]) == "--test2") {
                 tzd->test2();
+            } else if (std::string(argv[2]) == "--test3") {
+                ret = tzd->test3() ? 0 : 1;
+            } else if (std::string(argv[2]) == "--test4") {
+                ret = tzd->test4() ? 0 : 1;
             } else {
                 print_usage();
                 ret = 1;
@@ -220,6 +220,8 @@ RTC::ReturnCode_t TorqueController::onInitialize()
     }
   }
 
+  m_tauRefs.set(std::vector<double>(m_motorTorqueControllers.size(), 0.0));
+
   // allocate memory for outPorts
   m_qRefOut.data.length(m_robot->numJoints());
   return RTC::RTC_OK;
@@ -395,6 +397,11 @@ void TorqueController::executeTorqueControl(hrp::dvector &dq)
     std::cerr << std::endl;
   }
 
+  if (m_tauRefs.update()) {
+    for (int i = 0; i < numJoints; i++) {
+      m_motorTorqueControllers[i].setReferenceTorque(m_tauRefs.value()[i]);
+    }
+  }
   Guard guard(m_mutex);
   for (int i = 0; i < numJoints; i++) {
     dq[i] = m_motorTorqueControllers[i].execute(m_tauCurrentIn.data[i], tauMax[i]); // twoDofController: tau = -K(q - qRef)
@@ -535,21 +542,9 @@ bool TorqueController::stopMultipleTorqueControls(const OpenHRP::TorqueControlle
 
 bool TorqueController::setReferenceTorque(std::string jname, double tauRef)
 {
-  bool succeed = false;
-  
-  // lock mutex
-  Guard guard(m_mutex);
-
-  // search target joint
-  for (std::vector<MotorTorqueController>::iterator it = m_motorTorqueControllers.begin(); it != m_motorTorqueControllers.end(); ++it) {
-    if ((*it).getJointName() == jname) {
-      if (m_debugLevel > 0) {
-        std::cerr << "[" <<  m_profile.instance_name << "]" << "Set " << jname << " reference torque to " << tauRef << std::endl;
-      }
-      succeed = (*it).setReferenceTorque(tauRef);
-    }
-  }
-  return succeed;
+  // reference torques are picked up by onExecute without locking m_mutex
+  ParameterCell<std::vector<double> >::Writer tauRefs(m_tauRefs);
+  return updateReferenceTorque(*tauRefs, jname, tauRef);
 }
 
 bool TorqueController::setMultipleReferenceTorques(const OpenHRP::TorqueControllerService::StrSequence& jnames, const OpenHRP::TorqueControllerService::dSequence& tauRefs)
@@ -561,9 +556,10 @@ bool TorqueController::setMultipleReferenceTorques(const OpenHRP::TorqueControll
     std::cerr << "[" <<  m_profile.instance_name << "]" << "Length of jnames and tauRefs are different." << std::endl;
     return false;
   }
-  // set reference torques
+  // set reference torques, which are picked up at once
+  ParameterCell<std::vector<double> >::Writer new_tauRefs(m_tauRefs);
   for (int i = 0; i < jnames.length(); i++) {
-    retval = setReferenceTorque(std::string(jnames[i]), tauRefs[i]);
+    retval = updateReferenceTorque(*new_tauRefs, std::string(jnames[i]), tauRefs[i]);
     if (!retval) { // return false when once failed
       succeed = false;
     }
@@ -571,6 +567,23 @@ bool TorqueController::setMultipleReferenceTorques(const OpenHRP::TorqueControll
   return succeed;
 }
 
+bool TorqueController::updateReferenceTorque(std::vector<double>& o_tauRefs, const std::string& jname, double tauRef)
+{
+  bool succeed = false;
+
+  // search target joint
+  for (size_t i = 0; i < m_motorTorqueControllers.size(); i++) {
+    if (m_motorTorqueControllers[i].getJointName() == jname) {
+      if (m_debugLevel > 0) {
+        std::cerr << "[" <<  m_profile.instance_name << "]" << "Set " << jname << " reference torque to " << tauRef << std::endl;
+      }
+      o_tauRefs[i] = tauRef;
+      succeed = true;
+    }
+  }
+  return succeed;
+}
+
 bool TorqueController::setTorqueControllerParam(const std::string jname, const OpenHRP::TorqueControllerService::torqueControllerParam& i_param)
 {
   Guard guard(m_mutex);
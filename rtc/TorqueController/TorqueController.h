@@ -22,6 +22,7 @@
 #include <hrpModel/JointPath.h>
 
 #include "MotorTorqueController.h"
+#include "util/ParameterCell.h"
 
 // Service implementation headers
 // <rtc-template block="service_impl_h">
@@ -164,8 +165,11 @@ private:
   long long m_loop;
   hrp::BodyPtr m_robot;
   std::vector<MotorTorqueController> m_motorTorqueControllers;
+  // reference torques of m_motorTorqueControllers, which are picked up at the beginning of executeTorqueControl
+  ParameterCell<std::vector<double> > m_tauRefs;
   coil::Mutex m_mutex;
   void executeTorqueControl(hrp::dvector &dq);
+  bool updateReferenceTorque(std::vector<double>& o_tauRefs, const std::string& jname, double tauRef);
   void updateParam(double &val, double &val_new);
   bool isDebug(int cycle = 20);
 };
@@ -358,6 +358,8 @@ BOOST_PYTHON_MODULE( hrpsysext )
         .def("simulate", (void(PySimulator::*)(double))&PySimulator::simulate)
         .def("realTime", &PySimulator::realTime)
         .def("useBBox", &PySimulator::setUseBBox)
+        .def("useBroadPhase", &PySimulator::useBroadPhase)
+        .def("printCollisionScaling", &PySimulator::printCollisionScaling)
         .def("windowSize", &PySimulator::setWindowSize)
         .def("endless", &PySimulator::endless)
         .def("start", &PySimulator::start)
@@ -381,6 +383,8 @@ BOOST_PYTHON_MODULE( hrpsysext )
                       &PySimulator::showSensors, &PySimulator::setShowSensors)
         .add_property("maxLogLength", 
                       &PySimulator::maxLogLength, &PySimulator::setMaxLogLength)
+        .add_property("collisionThreads", 
+                      &PySimulator::collisionThreads, &PySimulator::setCollisionThreads)
         ;
 
     class_<PyBody, boost::noncopyable>("Body", no_init)
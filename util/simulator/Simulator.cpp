@@ -1,8 +1,14 @@
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <hrpCollision/ColdetModel.h>
 #include "Simulator.h"
 #include "util/BodyRTC.h"
 
 Simulator::Simulator(LogManager<SceneState> *i_log) 
-  : log(i_log), adjustTime(false)
+  : log(i_log), m_realTime(0), adjustTime(false), m_checkedCollisions(NULL), m_collisionScalingFrames(0), m_useBroadPhase(false)
 {
 }
 
@@ -26,6 +32,7 @@ void Simulator::init(Project &prj, BodyFactory &factory){
         pair.linkName1 = CORBA::string_dup(link0->name.c_str());
         pair.linkName2 = CORBA::string_dup(link1->name.c_str());
     }
+    setupBroadPhase();
 
     m_nextLogTime = 0;
     appendLog();
@@ -50,41 +57,188 @@ void Simulator::checkCollision(OpenHRP::CollisionSequence &collisions)
     for (int i=0; i<numBodies(); i++){
         body(i)->updateLinkColdetModelPositions();
     }
+    if (m_useBroadPhase) updateBroadPhase();
+    m_jobs.clear();
     for(size_t colIndex=0; colIndex < pairs.size(); ++colIndex){
-        hrp::ColdetLinkPairPtr linkPair = pairs[colIndex];
-        OpenHRP::Collision& collision = collisions[colIndex];
-        OpenHRP::CollisionPointSequence* pCollisionPoints = &collision.points;
-        std::vector<hrp::collision_data>& cdata = linkPair->detectCollisions();
-            
-        if(cdata.empty()){
-            pCollisionPoints->length(0);
-        } else {
-            int npoints = 0;
-            for(int i = 0; i < cdata.size(); i++) {
-                for(int j = 0; j < cdata[i].num_of_i_points; j++){
-                    if(cdata[i].i_point_new[j]) npoints++;
-                }
+        if (!m_useBroadPhase || m_overlap[colIndex]){
+            m_jobs.push_back(colIndex);
+        }else{
+            collisions[colIndex].points.length(0);
+        }
+    }
+    // each job writes only points of its own pair
+    m_checkedCollisions = &collisions;
+    m_executor.execute(m_jobs, checkCollisionPair, this);
+}
+
+void Simulator::checkCollisionPair(void *arg, int colIndex)
+{
+    Simulator *self = (Simulator *)arg;
+    hrp::ColdetLinkPairPtr linkPair = self->pairs[colIndex];
+    OpenHRP::Collision& collision = (*self->m_checkedCollisions)[colIndex];
+    OpenHRP::CollisionPointSequence* pCollisionPoints = &collision.points;
+    std::vector<hrp::collision_data>& cdata = linkPair->detectCollisions();
+
+    if(cdata.empty()){
+        pCollisionPoints->length(0);
+    } else {
+        int npoints = 0;
+        for(int i = 0; i < cdata.size(); i++) {
+            for(int j = 0; j < cdata[i].num_of_i_points; j++){
+                if(cdata[i].i_point_new[j]) npoints++;
             }
-            pCollisionPoints->length(npoints);
-            int idx = 0;
-            for (int i = 0; i < cdata.size(); i++) {
-                hrp::collision_data& cd = cdata[i];
-                for(int j=0; j < cd.num_of_i_points; j++){
-                    if (cd.i_point_new[j]){
-                        OpenHRP::CollisionPoint& point = (*pCollisionPoints)[idx];
-                        for(int k=0; k < 3; k++){
-                            point.position[k] = cd.i_points[j][k];
-                        }
-                        for(int k=0; k < 3; k++){
-                            point.normal[k] = cd.n_vector[k];
-                        }
-                        point.idepth = cd.depth;
-                        idx++;
+        }
+        pCollisionPoints->length(npoints);
+        int idx = 0;
+        for (int i = 0; i < cdata.size(); i++) {
+            hrp::collision_data& cd = cdata[i];
+            for(int j=0; j < cd.num_of_i_points; j++){
+                if (cd.i_point_new[j]){
+                    OpenHRP::CollisionPoint& point = (*pCollisionPoints)[idx];
+                    for(int k=0; k < 3; k++){
+                        point.position[k] = cd.i_points[j][k];
                     }
+                    for(int k=0; k < 3; k++){
+                        point.normal[k] = cd.n_vector[k];
+                    }
+                    point.idepth = cd.depth;
+                    idx++;
+                }
+            }
+        }
+    }
+}
+
+void Simulator::setupBroadPhase()
+{
+    m_links.clear();
+    m_localCenter.clear();
+    m_localHalfSize.clear();
+    m_hasShape.clear();
+    m_linkPairs.clear();
+    std::map<hrp::Link *, int> index;
+    for(size_t colIndex=0; colIndex < pairs.size(); ++colIndex){
+        int idx[2];
+        for (int i=0; i<2; i++){
+            hrp::Link *l = pairs[colIndex]->link(i);
+            std::map<hrp::Link *, int>::iterator it = index.find(l);
+            if (it != index.end()){
+                idx[i] = it->second;
+                continue;
+            }
+            idx[i] = index[l] = m_links.size();
+            m_links.push_back(l);
+            m_linkPairs.push_back(std::vector<std::pair<int, int> >());
+            // AABB of vertices in attitude() frame
+            int nverts = l->coldetModel ? l->coldetModel->getNumVertices() : 0;
+            hrp::Vector3 vmin(0,0,0), vmax(0,0,0);
+            for (int j=0; j<nverts; j++){
+                float v[3];
+                l->coldetModel->getVertex(j, v[0], v[1], v[2]);
+                for (int k=0; k<3; k++){
+                    if (j == 0 || v[k] < vmin[k]) vmin[k] = v[k];
+                    if (j == 0 || v[k] > vmax[k]) vmax[k] = v[k];
                 }
             }
+            m_localCenter.push_back((vmin + vmax)/2);
+            m_localHalfSize.push_back((vmax - vmin)/2);
+            m_hasShape.push_back(nverts > 0);
+        }
+        if (idx[0] > idx[1]) std::swap(idx[0], idx[1]);
+        m_linkPairs[idx[0]].push_back(std::make_pair(idx[1], (int)colIndex));
+    }
+    for (size_t i=0; i<m_linkPairs.size(); i++){
+        std::sort(m_linkPairs[i].begin(), m_linkPairs[i].end());
+    }
+    m_min.resize(m_links.size());
+    m_max.resize(m_links.size());
+    m_sortedLinks.resize(m_links.size());
+    for (size_t i=0; i<m_links.size(); i++) m_sortedLinks[i] = i;
+    m_overlap.resize(pairs.size());
+    m_jobs.reserve(pairs.size());
+}
+
+void Simulator::updateBroadPhase()
+{
+    int n = m_links.size();
+    for (int i=0; i<n; i++){
+        if (!m_hasShape[i]){
+            // pairs of links without vertices are always checked as before
+            m_min[i] = hrp::Vector3(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+            m_max[i] = hrp::Vector3(DBL_MAX, DBL_MAX, DBL_MAX);
+            continue;
+        }
+        hrp::Matrix33 R(m_links[i]->attitude());
+        hrp::Vector3 c(m_links[i]->p + R*m_localCenter[i]);
+        hrp::Vector3 h(R.cwiseAbs()*m_localHalfSize[i]);
+        m_min[i] = c - h;
+        m_max[i] = c + h;
+    }
+    // insertion sort by the lower bound of x, which is almost sorted in
+    // the last frame
+    for (int i=1; i<n; i++){
+        int k = m_sortedLinks[i], j = i - 1;
+        while (j >= 0 && m_min[m_sortedLinks[j]][0] > m_min[k][0]){
+            m_sortedLinks[j+1] = m_sortedLinks[j];
+            j--;
+        }
+        m_sortedLinks[j+1] = k;
+    }
+    std::fill(m_overlap.begin(), m_overlap.end(), 0);
+    for (int i=0; i<n; i++){
+        int a = m_sortedLinks[i];
+        for (int j=i+1; j<n; j++){
+            int b = m_sortedLinks[j];
+            if (m_min[b][0] > m_max[a][0]) break;
+            if (m_min[b][1] > m_max[a][1] || m_min[a][1] > m_max[b][1]
+                || m_min[b][2] > m_max[a][2] || m_min[a][2] > m_max[b][2]) continue;
+            int lo = std::min(a, b), hi = std::max(a, b);
+            std::vector<std::pair<int, int> >& lp = m_linkPairs[lo];
+            std::vector<std::pair<int, int> >::iterator it
+                = std::lower_bound(lp.begin(), lp.end(), std::make_pair(hi, -1));
+            for (; it != lp.end() && it->first == hi; it++){
+                m_overlap[it->second] = 1;
+            }
+        }
+    }
+}
+
+void Simulator::setCollisionThreads(int n)
+{
+    if (n <= 1){
+        m_executor.stop();
+    }else{
+        m_executor.start(n - 1, 0, std::vector<int>());
+    }
+}
+
+void Simulator::printCollisionScaling(int nframes)
+{
+    int threads = collisionThreads();
+    bool broadPhase = m_useBroadPhase;
+    double base = 0;
+    printf("collision scaling(%d frames, %d pairs):\n", nframes, (int)pairs.size());
+    const int nthreads[] = {1, 2, 4, 8};
+    for (int i=0; i<4; i++){
+        setCollisionThreads(nthreads[i]);
+        double t[2];
+        for (int j=0; j<2; j++){
+            useBroadPhase(j == 1);
+            TimeMeasure tm;
+            for (int k=0; k<nframes; k++){
+                tm.begin();
+                checkCollision(collisions);
+                tm.end();
+            }
+            t[j] = tm.averageTime();
         }
+        if (i == 0) base = t[0];
+        printf("  %d threads :%8.3f[ms/frame](x%5.2f), %8.3f[ms/frame](x%5.2f) with broad phase, %d/%d pairs\n",
+               nthreads[i], t[0]*1000, base/t[0], t[1]*1000, base/t[1],
+               (int)m_jobs.size(), (int)pairs.size());
     }
+    setCollisionThreads(threads);
+    useBroadPhase(broadPhase);
 }
 
 bool Simulator::oneStep(){
@@ -159,6 +313,7 @@ bool Simulator::oneStep(){
         gettimeofday(&endTime, NULL);
         double realT = (endTime.tv_sec - beginTime.tv_sec)
             + (endTime.tv_usec - beginTime.tv_usec)/1e6;
+        m_realTime = realT;
         printf("total     :%8.3f[s], %8.3f[sim/real]\n",
                realT, m_totalTime/realT);
         printf("controller:%8.3f[s], %8.3f[ms/frame]\n",
@@ -178,6 +333,9 @@ bool Simulator::oneStep(){
             }
             printf("num of triangles : %s : %d\n", body->name().c_str(), ntri);
         }
+        if (m_collisionScalingFrames > 0 && !pairs.empty()){
+            printCollisionScaling(m_collisionScalingFrames);
+        }
         fflush(stdout);
         return false;
     }else{
@@ -185,6 +343,90 @@ bool Simulator::oneStep(){
     }
 }
 
+std::string jsonString(const std::string &str)
+{
+    std::string ret("\"");
+    for (size_t i=0; i<str.size(); i++){
+        if (str[i] == '"' || str[i] == '\\'){
+            ret += '\\';
+            ret += str[i];
+        }else if ((unsigned char)str[i] < 0x20){
+            char buf[8];
+            sprintf(buf, "\\u%04x", str[i]);
+            ret += buf;
+        }else{
+            ret += str[i];
+        }
+    }
+    return ret + "\"";
+}
+
+// JSON has no representation of nan and inf
+static void writeNumber(std::ostream &os, double v)
+{
+    if (v != v || fabs(v) > DBL_MAX){
+        os << "null";
+    }else{
+        os << v;
+    }
+}
+
+static void writeTime(std::ostream &os, const char *name, TimeMeasure &tm)
+{
+    os << "\"" << name << "\":{\"total\":";
+    writeNumber(os, tm.totalTime());
+    os << ",\"per_frame\":";
+    writeNumber(os, tm.averageTime());
+    os << "}";
+}
+
+void Simulator::writeSummary(std::ostream &os)
+{
+    std::streamsize prec = os.precision(9);
+    os << "{\"time\":";
+    writeNumber(os, currentTime());
+    os << ",\"total_time\":";
+    writeNumber(os, m_totalTime);
+    os << ",\"time_step\":";
+    writeNumber(os, timeStep());
+    os << ",\"real_time\":";
+    writeNumber(os, m_realTime);
+    os << ",\"sim_real_ratio\":";
+    writeNumber(os, m_realTime > 0 ? currentTime()/m_realTime : 0);
+    os << ",\"collision_pairs\":" << pairs.size() << ",";
+    writeTime(os, "controller", tm_control);
+    os << ",";
+    writeTime(os, "collision", tm_collision);
+    os << ",";
+    writeTime(os, "dynamics", tm_dynamics);
+    os << ",\"bodies\":[";
+    for (int i=0; i<numBodies(); i++){
+        hrp::BodyPtr body = this->body(i);
+        hrp::Link *root = body->rootLink();
+        hrp::Vector3 rpy(hrp::rpyFromRot(root->R));
+        if (i) os << ",";
+        os << "{\"name\":" << jsonString(body->name()) << ",\"p\":[";
+        for (int j=0; j<3; j++){
+            if (j) os << ",";
+            writeNumber(os, root->p[j]);
+        }
+        os << "],\"rpy\":[";
+        for (int j=0; j<3; j++){
+            if (j) os << ",";
+            writeNumber(os, rpy[j]);
+        }
+        os << "],\"q\":[";
+        for (int j=0; j<body->numJoints(); j++){
+            hrp::Link *l = body->joint(j);
+            if (j) os << ",";
+            writeNumber(os, l ? l->q : 0);
+        }
+        os << "]}";
+    }
+    os << "]}";
+    os.precision(prec);
+}
+
 void Simulator::clear()
 {
     RTC::Manager* manager = &RTC::Manager::instance();
@@ -197,6 +439,7 @@ void Simulator::clear()
     constraintForceSolver.clearCollisionCheckLinkPairs();
     setCurrentTime(0.0);
     pairs.clear();
+    setupBroadPhase();
     receivers.clear();
 }
 
@@ -240,6 +483,7 @@ void Simulator::addCollisionCheckPair(BodyRTC *bodyPtr1, BodyRTC *bodyPtr2)
         pair.linkName1 = CORBA::string_dup(link0->name.c_str());
         pair.linkName2 = CORBA::string_dup(link1->name.c_str());
     }
+    setupBroadPhase();
 }
 
 void Simulator::kinematicsOnly(bool flag)
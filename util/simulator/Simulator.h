@@ -1,3 +1,4 @@
+#include <iosfwd>
 #include <hrpCorba/OpenHRPCommon.hh>
 #include <hrpModel/World.h>
 #include <hrpModel/ConstraintForceSolver.h>
@@ -6,11 +7,17 @@
 #include "util/ThreadedObject.h"
 #include "util/LogManager.h"
 #include "util/ProjectUtil.h"
+#include "util/StageExecutor.h"
 #include "SceneState.h"
 
 class BodyRTC;
 class SDL_Thread;
 
+/**
+   \brief quote a string for JSON
+ */
+std::string jsonString(const std::string &str);
+
 class Simulator : virtual public hrp::World<hrp::ConstraintForceSolver>,
     public ThreadedObject
 {
@@ -28,15 +35,60 @@ public:
     void appendLog();
     void addCollisionCheckPair(BodyRTC *b1, BodyRTC *b2);
     void kinematicsOnly(bool flag);
+    /**
+       \brief set the number of threads which check collision pairs
+       \param n the number of threads including the simulation thread, 1 to check all pairs in the simulation thread
+     */
+    void setCollisionThreads(int n);
+    int collisionThreads() { return m_executor.workers() + 1; }
+    /**
+       \brief enable/disable the broad phase which skips pairs whose AABBs do not overlap(disabled by default)
+     */
+    void useBroadPhase(bool flag) { m_useBroadPhase = flag; }
+    /**
+       \brief print time of checkCollision() with 1/2/4/8 threads in the current state
+       \param nframes the number of checkCollision() calls for each number of threads
+     */
+    void printCollisionScaling(int nframes);
+    /**
+       \brief call printCollisionScaling() when the simulation finishes
+       \param nframes the number of checkCollision() calls for each number of threads, 0 not to print(default)
+     */
+    void setCollisionScalingFrames(int nframes) { m_collisionScalingFrames = nframes; }
+    /**
+       \brief write the result of the simulation as a JSON object
+       \param os stream to write
+       sim/real ratio, time of each stage and the final states of bodies
+     */
+    void writeSummary(std::ostream &os);
 private:
+    static void checkCollisionPair(void *arg, int colIndex);
+    void setupBroadPhase();
+    void updateBroadPhase();
     LogManager<SceneState> *log;
     std::vector<ClockReceiver> receivers;
     std::vector<hrp::ColdetLinkPairPtr> pairs;
     OpenHRP::CollisionSequence collisions;
     SceneState state;
-    double m_totalTime, m_logTimeStep, m_nextLogTime;
+    double m_totalTime, m_logTimeStep, m_nextLogTime, m_realTime;
     TimeMeasure tm_dynamics, tm_control, tm_collision;
     bool adjustTime, m_kinematicsOnly;
     std::deque<struct timeval> startTimes;
     struct timeval beginTime;
+    // collision pairs are checked on a pool of threads
+    StageExecutor m_executor;
+    std::vector<int> m_jobs;
+    OpenHRP::CollisionSequence *m_checkedCollisions;
+    int m_collisionScalingFrames;
+    // broad phase(sweep and prune along x axis) with AABBs of links in
+    // attitude() frames and in the world frame
+    bool m_useBroadPhase;
+    std::vector<hrp::Link *> m_links;
+    std::vector<hrp::Vector3> m_localCenter, m_localHalfSize, m_min, m_max;
+    std::vector<bool> m_hasShape;
+    std::vector<int> m_sortedLinks;
+    // pairs of links, (index of the other link, index of the pair) for each
+    // link whose index is smaller than the other link
+    std::vector<std::vector<std::pair<int, int> > > m_linkPairs;
+    std::vector<char> m_overlap;
 };
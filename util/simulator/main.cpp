@@ -1,4 +1,14 @@
+#include <iostream>
 #include <fstream>
+#include <sstream>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/time.h>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <rtm/Manager.h>
@@ -24,9 +34,12 @@ using namespace std;
 using namespace hrp;
 using namespace OpenHRP;
 
+// BodyInfo of each URL, which is reused by bodies of the same model
+typedef std::map<std::string, BodyInfo_var> BodyInfoCache;
+
 hrp::BodyPtr createBody(const std::string& name, const ModelItem& mitem,
                         ModelLoader_ptr modelloader, GLscene *scene,
-                        bool usebbox)
+                        bool usebbox, BodyInfoCache *cache)
 {
     std::cout << "createBody(" << name << "," << mitem.url << ")" << std::endl;
     RTC::Manager& manager = RTC::Manager::instance();
@@ -34,15 +47,21 @@ hrp::BodyPtr createBody(const std::string& name, const ModelItem& mitem,
     GLbodyRTC *glbodyrtc = (GLbodyRTC *)manager.createComponent(args.c_str());
     hrp::BodyPtr body = hrp::BodyPtr(glbodyrtc);
     BodyInfo_var binfo;
-    try{
-        OpenHRP::ModelLoader::ModelLoadOption opt;
-        opt.readImage = true;
-        opt.AABBdata.length(0);
-        opt.AABBtype = OpenHRP::ModelLoader::AABB_NUM;
-        binfo = modelloader->getBodyInfoEx(mitem.url.c_str(), opt);
-    }catch(OpenHRP::ModelLoader::ModelLoaderException ex){
-        std::cerr << ex.description << std::endl;
-        return hrp::BodyPtr();
+    BodyInfoCache::iterator it = cache->find(mitem.url);
+    if (it != cache->end()){
+        binfo = it->second;
+    }else{
+        try{
+            OpenHRP::ModelLoader::ModelLoadOption opt;
+            opt.readImage = true;
+            opt.AABBdata.length(0);
+            opt.AABBtype = OpenHRP::ModelLoader::AABB_NUM;
+            binfo = modelloader->getBodyInfoEx(mitem.url.c_str(), opt);
+        }catch(OpenHRP::ModelLoader::ModelLoaderException ex){
+            std::cerr << ex.description << std::endl;
+            return hrp::BodyPtr();
+        }
+        (*cache)[mitem.url] = binfo;
     }
     if (!loadBodyFromBodyInfo(body, binfo, true, GLlinkFactory)){
         std::cerr << "failed to load model[" << mitem.url << "]" << std::endl;
@@ -80,118 +99,109 @@ hrp::BodyPtr createBody(const std::string& name, const ModelItem& mitem,
     }
 }
 
-void print_usage(char* progname)
+static double wallTime()
 {
-    std::cerr << "Usage:" << progname << " [project file] [options]" << std::endl;
-    std::cerr << "Options:" << std::endl;
-    std::cerr << " -nodisplay         : headless mode" << std::endl;
-    std::cerr << " -realtime          : syncronize to real world time" << std::endl;
-    std::cerr << " -usebbox           : use bounding box for collision detection" << std::endl;
-    std::cerr << " -endless           : endless mode" << std::endl;
-    std::cerr << " -showsensors       : visualize sensors" << std::endl;
-    std::cerr << " -size [pixels]     : specify window size in pixels" << std::endl;
-    std::cerr << " -no-default-lights : disable ambient light (simulation environment will be dark)" << std::endl;
-    std::cerr << " -max-edge-length [value] : specify maximum length of polygon edge (if exceed, polygon will be divided to improve rendering quality)" << std::endl;
-    std::cerr << " -max-log-length [value] : specify maximum size of the log" << std::endl;
-    std::cerr << " -exit-on-finish    : exit the program when the simulation finish" << std::endl;
-    std::cerr << " -record            : record the simulation as movie" << std::endl;
-    std::cerr << " -bg [r] [g] [b]    : specify background color" << std::endl;
-    std::cerr << " -h --help          : show this help message" << std::endl;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec/1e6;
 }
 
-int main(int argc, char* argv[]) 
+struct Options
 {
-    bool display = true, usebbox=false;
-    bool showsensors = false;
-    int wsize = 0;
-    bool useDefaultLights = true;
-    double maxEdgeLen = 0;
-    bool exitOnFinish = false;
-    bool record = false;
-    double maxLogLen = 60;
-    bool realtime = false;
-    bool endless = false;
-
-    if (argc <= 1){
-        print_usage(argv[0]);
-        return 1;
+    Options() : display(true), usebbox(false), showsensors(false), wsize(0),
+                useDefaultLights(true), maxEdgeLen(0), exitOnFinish(false),
+                record(false), maxLogLen(60), realtime(false), endless(false),
+                collisionThreads(1), broadPhase(false), collisionScaling(0),
+                batchList(NULL), jobs(sysconf(_SC_NPROCESSORS_ONLN)),
+                batchNaming(false), help(false) {
+        bgColor[0] = bgColor[1] = bgColor[2] = 0;
     }
+    bool display, usebbox, showsensors;
+    int wsize;
+    bool useDefaultLights;
+    double maxEdgeLen;
+    bool exitOnFinish, record;
+    double maxLogLen;
+    bool realtime, endless;
+    int collisionThreads;
+    bool broadPhase;
+    int collisionScaling;
+    const char *batchList;
+    int jobs;
+    bool batchNaming, help;
+    std::string summary;
+    float bgColor[3];
+    // arguments which are passed to the RTC manager, starting with the
+    // project file
+    std::vector<char *> rtmargv;
+};
 
-    float bgColor[]={0,0,0};
+static void parseOptions(int argc, char* argv[], Options& opts)
+{
     for (int i=1; i<argc; i++){
         if (strcmp("-nodisplay",argv[i])==0){
-            display = false;
+            opts.display = false;
         }else if(strcmp("-realtime", argv[i])==0){
-            realtime = true;
+            opts.realtime = true;
         }else if(strcmp("-usebbox", argv[i])==0){
-            usebbox = true;
+            opts.usebbox = true;
         }else if(strcmp("-endless", argv[i])==0){
-            endless = true;
+            opts.endless = true;
         }else if(strcmp("-showsensors", argv[i])==0){
-            showsensors = true;
+            opts.showsensors = true;
         }else if(strcmp("-size", argv[i])==0){
-            wsize = atoi(argv[++i]);
+            opts.wsize = atoi(argv[++i]);
         }else if(strcmp("-no-default-lights", argv[i])==0){
-            useDefaultLights = false;
+            opts.useDefaultLights = false;
         }else if(strcmp("-max-edge-length", argv[i])==0){
-            maxEdgeLen = atof(argv[++i]);
+            opts.maxEdgeLen = atof(argv[++i]);
         }else if(strcmp("-max-log-length", argv[i])==0){
-            maxLogLen = atof(argv[++i]);
+            opts.maxLogLen = atof(argv[++i]);
         }else if(strcmp("-exit-on-finish", argv[i])==0){
-            exitOnFinish = true;
+            opts.exitOnFinish = true;
         }else if(strcmp("-record", argv[i])==0){
-            record = true;
-            exitOnFinish = true;
+            opts.record = true;
+            opts.exitOnFinish = true;
         }else if(strcmp("-bg", argv[i])==0){
-            bgColor[0] = atof(argv[++i]);
-            bgColor[1] = atof(argv[++i]);
-            bgColor[2] = atof(argv[++i]);
+            opts.bgColor[0] = atof(argv[++i]);
+            opts.bgColor[1] = atof(argv[++i]);
+            opts.bgColor[2] = atof(argv[++i]);
+        }else if(strcmp("-collision-threads", argv[i])==0){
+            opts.collisionThreads = atoi(argv[++i]);
+        }else if(strcmp("-broad-phase", argv[i])==0){
+            opts.broadPhase = true;
+        }else if(strcmp("-collision-scaling", argv[i])==0){
+            opts.collisionScaling = atoi(argv[++i]);
+        }else if(strcmp("-summary", argv[i])==0){
+            opts.summary = argv[++i];
+        }else if(strcmp("-batch", argv[i])==0){
+            opts.batchList = argv[++i];
+        }else if(strcmp("-jobs", argv[i])==0){
+            opts.jobs = atoi(argv[++i]);
+        }else if(strcmp("-batch-naming", argv[i])==0){
+            opts.batchNaming = true;
         }else if(strcmp("-h", argv[i])==0 || strcmp("--help", argv[i])==0){
-            print_usage(argv[0]);
-            return 1;
+            opts.help = true;
+        }else{
+            opts.rtmargv.push_back(argv[i]);
         }
     }
+}
 
-    Project prj;
-    if (!prj.parse(argv[1])){
-        std::cerr << "failed to parse " << argv[1] << std::endl;
-        return 1;
-    }
-    if (realtime){
-        prj.realTime(true);
-    }
-    if (endless){
-        prj.totalTime(0);
-    }
-
-    //================= OpenRTM =========================
+static RTC::Manager *initManager(std::vector<char *>& rtmargv)
+{
     RTC::Manager* manager;
-    int rtmargc=0;
-    std::vector<char *> rtmargv;
-    for (int i=1; i<argc; i++){
-        if (strcmp(argv[i], "-nodisplay") 
-            && strcmp(argv[i], "-realtime")
-            && strcmp(argv[i], "-usebbox")
-            && strcmp(argv[i], "-endless")
-            && strcmp(argv[i], "-showsensors")
-            && strcmp(argv[i], "-size")
-            && strcmp(argv[i], "-no-default-lights")
-            && strcmp(argv[i], "-max-edge-length")
-            && strcmp(argv[i], "-max-log-length")
-            && strcmp(argv[i], "-exit-on-finish")
-            && strcmp(argv[i], "-record")
-            && strcmp(argv[i], "-bg")
-            ){
-            rtmargv.push_back(argv[i]);
-            rtmargc++;
-        }
-    }
+    int rtmargc = rtmargv.size();
     manager = RTC::Manager::init(rtmargc, rtmargv.data());
     manager->init(rtmargc, rtmargv.data());
     GLbodyRTC::moduleInit(manager);
     manager->activateManager();
     manager->runManager(true);
+    return manager;
+}
 
+static ModelLoader_var findModelLoader(RTC::Manager *manager)
+{
     std::string nameServer = manager->getConfig()["corba.nameservers"];
     int comPos = nameServer.find(",");
     if (comPos < 0){
@@ -200,7 +210,425 @@ int main(int argc, char* argv[])
     nameServer = nameServer.substr(0, comPos);
     RTC::CorbaNaming naming(manager->getORB(), nameServer.c_str());
 
-    ModelLoader_var modelloader = getModelLoader(CosNaming::NamingContext::_duplicate(naming.getRootContext()));
+    return getModelLoader(CosNaming::NamingContext::_duplicate(naming.getRootContext()));
+}
+
+static void setupSimulator(Simulator& simulator, Project& prj,
+                           BodyFactory& factory, LogManager<SceneState>& log,
+                           const Options& opts)
+{
+    if (opts.realtime){
+        prj.realTime(true);
+    }
+    if (opts.endless){
+        prj.totalTime(0);
+    }
+    simulator.init(prj, factory);
+    simulator.setCollisionThreads(opts.collisionThreads);
+    simulator.useBroadPhase(opts.broadPhase);
+    simulator.setCollisionScalingFrames(opts.collisionScaling);
+    if (!prj.totalTime()){
+        log.enableRingBuffer(opts.maxLogLen/prj.timeStep());
+    }
+
+    std::cout << "timestep = " << prj.timeStep() << ", total time = "
+              << prj.totalTime() << std::endl;
+}
+
+static void writeSummary(Simulator& simulator, const std::string& summary)
+{
+    std::ofstream ofs(summary.c_str());
+    simulator.writeSummary(ofs);
+    ofs << std::endl;
+}
+
+struct BatchRun
+{
+    std::vector<std::string> args; // project file and its options
+    std::string summary, logfile;
+    int status;
+    double startTime, elapsed;
+};
+
+// sent by a worker when a run finishes
+struct BatchResult
+{
+    int index, status;
+    double elapsed;
+};
+
+struct BatchWorker
+{
+    pid_t pid;
+    int fd;  // socket to the worker, -1 if it has exited
+    int run; // index of the run, -1 if it is idle
+};
+
+static bool readAll(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    while (len > 0){
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+  Runs indices of runs received from fd one after another in this process
+  and sends a BatchResult for each of them. ORB, the RTC manager, modules
+  of components and models of the model loader are shared among runs, and
+  bodies and components of a run are exited after it finishes. Outputs of
+  a run go to its log file.
+*/
+static int runBatchWorker(char *progname, const std::vector<BatchRun>& runs,
+                          bool naming, const std::vector<std::string>& commonArgs,
+                          int fd)
+{
+    std::vector<char *> argv;
+    argv.push_back(progname);
+    for (size_t i=0; i<commonArgs.size(); i++){
+        argv.push_back(const_cast<char *>(commonArgs[i].c_str()));
+    }
+    Options common;
+    parseOptions(argv.size(), argv.data(), common);
+    std::vector<char *> rtmargv(1, progname);
+    rtmargv.insert(rtmargv.end(), common.rtmargv.begin(), common.rtmargv.end());
+    if (!naming){
+        rtmargv.push_back((char *)"-o");
+        rtmargv.push_back((char *)"naming.enable:NO");
+    }
+
+    RTC::Manager *manager = NULL;
+    ModelLoader_var modelloader;
+    BodyInfoCache cache;
+    BatchResult result;
+    while (readAll(fd, &result.index, sizeof(result.index))){
+        const BatchRun& run = runs[result.index];
+        double startTime = wallTime();
+        std::cout.flush();
+        std::cerr.flush();
+        int logfd = open(run.logfile.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (logfd >= 0){
+            dup2(logfd, 1);
+            dup2(logfd, 2);
+            close(logfd);
+        }
+        unlink(run.summary.c_str());
+
+        // options of the line override the common ones
+        std::vector<std::string> args(1, run.args[0]);
+        args.insert(args.end(), commonArgs.begin(), commonArgs.end());
+        args.insert(args.end(), run.args.begin() + 1, run.args.end());
+        std::vector<char *> runArgv;
+        runArgv.push_back(progname);
+        for (size_t i=0; i<args.size(); i++){
+            runArgv.push_back(const_cast<char *>(args[i].c_str()));
+        }
+        Options opts;
+        parseOptions(runArgv.size(), runArgv.data(), opts);
+        result.status = 1;
+        Project prj;
+        // rtmargv of the line is the project file and the common options
+        // for the RTC manager, which are shared by runs of this worker
+        if (opts.rtmargv.size() != common.rtmargv.size() + 1){
+            std::cerr << "options for the RTC manager can't be given in a line of the list, give them on the command line" << std::endl;
+        }else if (opts.endless){
+            std::cerr << "-endless can't be used with -batch" << std::endl;
+        }else if (!prj.parse(run.args[0])){
+            std::cerr << "failed to parse " << run.args[0] << std::endl;
+        }else{
+            if (!manager){
+                manager = initManager(rtmargv);
+                modelloader = findModelLoader(manager);
+            }
+            if (CORBA::is_nil(modelloader)){
+                std::cerr << "openhrp-model-loader is not running" << std::endl;
+            }else{
+                LogManager<SceneState> log;
+                GLscene scene(&log);
+                Simulator simulator(&log);
+                BodyFactory factory = boost::bind(createBody, _1, _2, modelloader, &scene, opts.usebbox, &cache);
+                setupSimulator(simulator, prj, factory, log, opts);
+                while (simulator.oneStep());
+                writeSummary(simulator, run.summary);
+                clearRTS(prj);
+                simulator.clear();
+                result.status = 0;
+            }
+        }
+        result.elapsed = wallTime() - startTime;
+        std::cout.flush();
+        std::cerr.flush();
+        if (write(fd, &result, sizeof(result)) != sizeof(result)) break;
+    }
+    if (manager) manager->shutdown();
+    return 0;
+}
+
+static bool startBatchWorker(std::vector<BatchWorker>& workers, int i,
+                             char *progname, const std::vector<BatchRun>& runs,
+                             bool naming, const std::vector<std::string>& commonArgs)
+{
+    BatchWorker& worker = workers[i];
+    int sv[2];
+    worker.fd = -1;
+    worker.run = -1;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+        perror("socketpair");
+        return false;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    worker.pid = fork();
+    if (worker.pid == 0){
+        close(sv[0]);
+        // the other workers see EOF only when all sockets to them are closed
+        for (size_t j=0; j<workers.size(); j++){
+            if (workers[j].fd >= 0) close(workers[j].fd);
+        }
+        int ret = runBatchWorker(progname, runs, naming, commonArgs, sv[1]);
+        _exit(ret);
+    }
+    close(sv[1]);
+    if (worker.pid < 0){
+        perror("fork");
+        close(sv[0]);
+        return false;
+    }
+    worker.fd = sv[0];
+    return true;
+}
+
+/*
+  Runs each line of the list file, a project file followed by its options,
+  headless in njobs worker processes. A worker runs lines one after
+  another, so that the startup of ORB, the RTC manager and loading models
+  is paid once for each worker rather than for each run. Unless naming is
+  true, workers do not register components to the name server, so that
+  the same project can run in parallel. Outputs of a run go to
+  [summary].[index].log. When a worker dies, its run fails and a new
+  worker takes the remaining lines.
+*/
+int runBatch(char *progname, const char *listfile, int njobs,
+             const std::string& summary, bool naming,
+             const std::vector<std::string>& commonArgs)
+{
+    std::ifstream ifs(listfile);
+    if (!ifs){
+        std::cerr << "failed to open " << listfile << std::endl;
+        return 1;
+    }
+    std::vector<BatchRun> runs;
+    std::string line;
+    while (std::getline(ifs, line)){
+        std::istringstream iss(line);
+        BatchRun run;
+        std::string arg;
+        while (iss >> arg) run.args.push_back(arg);
+        if (run.args.empty() || run.args[0][0] == '#') continue;
+        std::ostringstream oss;
+        oss << summary << "." << runs.size();
+        run.summary = oss.str() + ".json";
+        run.logfile = oss.str() + ".log";
+        run.status = -1;
+        run.startTime = run.elapsed = 0;
+        runs.push_back(run);
+    }
+    if (njobs < 1) njobs = 1;
+    if (njobs > (int)runs.size()) njobs = runs.size();
+    // a worker which has died is detected by EOF, not by SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    double startTime = wallTime();
+    std::vector<BatchWorker> workers(njobs);
+    for (int i=0; i<njobs; i++){
+        workers[i].fd = -1;
+    }
+    for (int i=0; i<njobs; i++){
+        startBatchWorker(workers, i, progname, runs, naming, commonArgs);
+    }
+    size_t next = 0;
+    while (true){
+        std::vector<pollfd> fds;
+        std::vector<int> busy;
+        for (int i=0; i<njobs; i++){
+            BatchWorker& worker = workers[i];
+            if (worker.fd >= 0 && worker.run < 0 && next < runs.size()){
+                int index = next;
+                if (write(worker.fd, &index, sizeof(index)) == sizeof(index)){
+                    worker.run = next;
+                    runs[next].startTime = wallTime();
+                    std::cout << "[" << next << "] started " << runs[next].args[0]
+                              << "(pid=" << worker.pid << ")" << std::endl;
+                    next++;
+                }
+            }
+            if (worker.fd >= 0 && (worker.run >= 0 || next < runs.size())){
+                pollfd pfd;
+                pfd.fd = worker.fd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                fds.push_back(pfd);
+                busy.push_back(i);
+            }
+        }
+        if (fds.empty()) break;
+        if (poll(fds.data(), fds.size(), -1) < 0){
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        for (size_t j=0; j<fds.size(); j++){
+            if (!fds[j].revents) continue;
+            BatchWorker& worker = workers[busy[j]];
+            BatchResult result;
+            if (readAll(worker.fd, &result, sizeof(result))){
+                BatchRun& run = runs[result.index];
+                run.status = result.status;
+                run.elapsed = result.elapsed;
+                worker.run = -1;
+            }else{
+                close(worker.fd);
+                worker.fd = -1;
+                int status;
+                waitpid(worker.pid, &status, 0);
+                std::cerr << "worker(pid=" << worker.pid << ") exited" << std::endl;
+                result.index = worker.run;
+                worker.run = -1;
+                if (next < runs.size()){
+                    startBatchWorker(workers, busy[j], progname, runs, naming, commonArgs);
+                }
+                if (result.index < 0) continue;
+                BatchRun& run = runs[result.index];
+                run.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+                run.elapsed = wallTime() - run.startTime;
+            }
+            BatchRun& run = runs[result.index];
+            std::cout << "[" << result.index << "] finished " << run.args[0]
+                      << "(status=" << run.status << ", "
+                      << run.elapsed << "[s])" << std::endl;
+        }
+    }
+    for (int i=0; i<njobs; i++){
+        if (workers[i].fd < 0) continue;
+        close(workers[i].fd);
+        waitpid(workers[i].pid, NULL, 0);
+    }
+
+    std::ofstream ofs(summary.c_str());
+    if (!ofs){
+        std::cerr << "failed to open " << summary << std::endl;
+        return 1;
+    }
+    int nfailed = 0;
+    ofs << "{\"jobs\":" << njobs << ",\"wall_time\":" << wallTime() - startTime
+        << ",\"runs\":[" << std::endl;
+    for (size_t i=0; i<runs.size(); i++){
+        BatchRun& run = runs[i];
+        ofs << (i ? "," : "") << "{\"index\":" << i
+            << ",\"project\":" << jsonString(run.args[0]) << ",\"options\":[";
+        for (size_t j=1; j<run.args.size(); j++){
+            ofs << (j > 1 ? "," : "") << jsonString(run.args[j]);
+        }
+        ofs << "],\"status\":" << run.status
+            << ",\"wall_time\":" << run.elapsed
+            << ",\"log\":" << jsonString(run.logfile) << ",\"result\":";
+        std::ifstream result(run.summary.c_str());
+        std::string json;
+        if (result && std::getline(result, json) && !json.empty()){
+            ofs << json;
+            unlink(run.summary.c_str());
+        }else{
+            ofs << "null";
+        }
+        if (run.status != 0 || json.empty()) nfailed++;
+        ofs << "}" << std::endl;
+    }
+    ofs << "]}" << std::endl;
+    std::cout << runs.size() - nfailed << "/" << runs.size()
+              << " runs succeeded, summary is written to " << summary << std::endl;
+    return nfailed ? 1 : 0;
+}
+
+void print_usage(char* progname)
+{
+    std::cerr << "Usage:" << progname << " [project file] [options]" << std::endl;
+    std::cerr << "      " << progname << " -batch [list file] [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << " -nodisplay         : headless mode" << std::endl;
+    std::cerr << " -realtime          : syncronize to real world time" << std::endl;
+    std::cerr << " -usebbox           : use bounding box for collision detection" << std::endl;
+    std::cerr << " -endless           : endless mode" << std::endl;
+    std::cerr << " -showsensors       : visualize sensors" << std::endl;
+    std::cerr << " -size [pixels]     : specify window size in pixels" << std::endl;
+    std::cerr << " -no-default-lights : disable ambient light (simulation environment will be dark)" << std::endl;
+    std::cerr << " -max-edge-length [value] : specify maximum length of polygon edge (if exceed, polygon will be divided to improve rendering quality)" << std::endl;
+    std::cerr << " -max-log-length [value] : specify maximum size of the log" << std::endl;
+    std::cerr << " -exit-on-finish    : exit the program when the simulation finish" << std::endl;
+    std::cerr << " -record            : record the simulation as movie" << std::endl;
+    std::cerr << " -bg [r] [g] [b]    : specify background color" << std::endl;
+    std::cerr << " -collision-threads [num] : specify the number of threads for collision detection" << std::endl;
+    std::cerr << " -broad-phase       : skip collision pairs whose AABBs do not overlap(sweep and prune)" << std::endl;
+    std::cerr << " -collision-scaling [num] : print time of collision detection with 1/2/4/8 threads, measured num times each in the final state" << std::endl;
+    std::cerr << " -summary [file]    : write the result as JSON" << std::endl;
+    std::cerr << " -batch [list file] : run each line of the file, a project file and its options, headless in worker processes and write results to the summary file(summary.json by default)" << std::endl;
+    std::cerr << " -jobs [num]        : specify the number of worker processes of the batch mode(the number of processors by default)" << std::endl;
+    std::cerr << " -batch-naming      : register components of the batch mode to the name server" << std::endl;
+    std::cerr << " -h --help          : show this help message" << std::endl;
+}
+
+int main(int argc, char* argv[]) 
+{
+    if (argc <= 1){
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Options opts;
+    parseOptions(argc, argv, opts);
+    if (opts.help){
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (opts.batchList){
+        if (opts.endless){
+            std::cerr << "-endless can't be used with -batch" << std::endl;
+            return 1;
+        }
+        if (opts.summary == "") opts.summary = "summary.json";
+        // the other options are passed to all runs
+        std::vector<std::string> batchArgs;
+        for (int i=1; i<argc; i++){
+            if (strcmp(argv[i], "-batch") == 0
+                || strcmp(argv[i], "-jobs") == 0
+                || strcmp(argv[i], "-summary") == 0){
+                i++;
+            }else if (strcmp(argv[i], "-nodisplay")
+                      && strcmp(argv[i], "-exit-on-finish")
+                      && strcmp(argv[i], "-record")
+                      && strcmp(argv[i], "-batch-naming")){
+                batchArgs.push_back(argv[i]);
+            }
+        }
+        return runBatch(argv[0], opts.batchList, opts.jobs, opts.summary,
+                        opts.batchNaming, batchArgs);
+    }
+
+    Project prj;
+    if (!prj.parse(argv[1])){
+        std::cerr << "failed to parse " << argv[1] << std::endl;
+        return 1;
+    }
+
+    //================= OpenRTM =========================
+    RTC::Manager* manager = initManager(opts.rtmargv);
+
+    ModelLoader_var modelloader = findModelLoader(manager);
     if (CORBA::is_nil(modelloader)){
         std::cerr << "openhrp-model-loader is not running" << std::endl;
         return 1;
@@ -208,37 +636,32 @@ int main(int argc, char* argv[])
     //==================== Viewer setup ===============
     LogManager<SceneState> log;
     GLscene scene(&log);
-    scene.setBackGroundColor(bgColor);
-    scene.showSensors(showsensors);
-    scene.maxEdgeLen(maxEdgeLen);
+    scene.setBackGroundColor(opts.bgColor);
+    scene.showSensors(opts.showsensors);
+    scene.maxEdgeLen(opts.maxEdgeLen);
     scene.showCollision(prj.view().showCollision);
     Simulator simulator(&log);
 
     SDLwindow window(&scene, &log, &simulator);
-    if (display){
-        window.init(wsize, wsize);
-        if (!useDefaultLights) scene.defaultLights(false);
+    if (opts.display){
+        window.init(opts.wsize, opts.wsize);
+        if (!opts.useDefaultLights) scene.defaultLights(false);
         window.setView(prj.view().T);
         scene.showFloorGrid(prj.view().showScale);
     }
 
     //================= setup Simulator ======================
-    BodyFactory factory = boost::bind(createBody, _1, _2, modelloader, &scene, usebbox);
-    simulator.init(prj, factory);
-    if (!prj.totalTime()){
-        log.enableRingBuffer(maxLogLen/prj.timeStep());
-    }
+    BodyInfoCache cache;
+    BodyFactory factory = boost::bind(createBody, _1, _2, modelloader, &scene, opts.usebbox, &cache);
+    setupSimulator(simulator, prj, factory, log, opts);
 
-    std::cout << "timestep = " << prj.timeStep() << ", total time = " 
-              << prj.totalTime() << std::endl;
-
-    if (display){
+    if (opts.display){
         simulator.start();
         while(window.oneStep()){
-            if (exitOnFinish && !simulator.isRunning()) break;
+            if (opts.exitOnFinish && !simulator.isRunning()) break;
         };
         simulator.stop();
-        if (record){
+        if (opts.record){
             log.record(10);
             while(window.oneStep()){
                 if (!log.isRecording()) break;
@@ -247,6 +670,9 @@ int main(int argc, char* argv[])
     }else{
         while (simulator.oneStep());
     }
+    if (opts.summary != ""){
+        writeSummary(simulator, opts.summary);
+    }
 
     manager->shutdown();
 